@@ -0,0 +1,475 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/*
+ * Calibrated baseline kernels over the same buffer the engines scan:
+ * what the machine can do without any regex at all. gen-plot.pl takes
+ * the fastest of them as the roofline and reports every engine's
+ * throughput as a fraction of it.
+ *
+ *   read        sums the buffer in 64-bit words (sequential bandwidth)
+ *   memchr      counts the occurrences of the byte the regex must start
+ *               with, or of NUL (absent from text) when there is none
+ *   class scan  counts the bytes in the class of the regex's first
+ *               positions, 16 bytes at a time with SSSE3 when available
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "getcputime.h"
+#include "bench.h"
+#include "glushkov.h"
+
+
+static void usage(int rc);
+static void run_kernels(unsigned kernel_types, const uint8_t *cls,
+    const unsigned char *input, size_t len, int repeat);
+static int first_class(const char *re, int flags, uint8_t *cls);
+static uint64_t bl_read(const unsigned char *p, size_t len);
+static long bl_memchr(const unsigned char *p, size_t len, int c);
+static long bl_class_scan(const uint8_t *cls, const unsigned char *p,
+    size_t len);
+
+
+enum {
+    KERNEL_READ         = (1 << 0),
+    KERNEL_MEMCHR       = (1 << 1),
+    KERNEL_CLASS_SCAN   = (1 << 2)
+};
+
+
+#define TIMER_START                                                          \
+        begin = get_cpu_time();                                              \
+        if (begin == -1) {                                                   \
+            perror("get_cpu_time");                                          \
+            exit(2);                                                         \
+        }
+
+
+#define TIMER_STOP                                                           \
+        end = get_cpu_time();                                                \
+        if (end == -1) {                                                     \
+            perror("get_cpu_time");                                          \
+            exit(2);                                                         \
+        }                                                                    \
+        elapsed = end - begin;
+
+
+int
+main(int argc, char **argv)
+{
+    int                  flags = 0;
+    int                  repeat = 5;
+    unsigned             kernel_types = 0;
+    unsigned             i;
+    uint8_t              cls[32];
+    unsigned char       *input;
+    FILE                *f;
+    size_t               len;
+    long                 rc;
+
+    if (argc < 3) {
+        usage(1);
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            break;
+        }
+
+        if (strcmp(argv[i], "--read") == 0) {
+            kernel_types |= KERNEL_READ;
+
+        } else if (strcmp(argv[i], "--memchr") == 0) {
+            kernel_types |= KERNEL_MEMCHR;
+
+        } else if (strcmp(argv[i], "--class-scan") == 0) {
+            kernel_types |= KERNEL_CLASS_SCAN;
+
+        } else if (strncmp(argv[i], "--repeat=", sizeof("--repeat=") - 1)
+                   == 0)
+        {
+            repeat = atoi(argv[i] + sizeof("--repeat=") - 1);
+            if (repeat <= 0) {
+                repeat = 5;
+            }
+
+        } else if (strncmp(argv[i], "-i", 2) == 0) {
+            flags |= GK_CASELESS;
+
+        } else if (strncmp(argv[i], "-g", 2) == 0) {
+            /* accepted for the bench scripts; the kernels always scan
+             * the whole buffer */
+
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (kernel_types == 0) {
+        kernel_types = KERNEL_READ | KERNEL_MEMCHR | KERNEL_CLASS_SCAN;
+    }
+
+    if (argc - i != 2) {
+        usage(1);
+    }
+
+    /* none of the modes */
+    bench_setup(0);
+
+    if (first_class(argv[i++], flags, cls) != 0) {
+        return 2;
+    }
+
+    errno = 0;
+
+    f = fopen(argv[i], "rb");
+    if (f == NULL) {
+        perror("open file");
+        return 1;
+    }
+
+    if (fseek(f, 0L, SEEK_END) != 0) {
+        perror("seek to file end");
+        return 1;
+    }
+
+    rc = ftell(f);
+    if (rc == -1) {
+        perror("get file offset by ftell");
+        return 1;
+    }
+
+    len = bench_input_size((size_t) rc);
+
+    if (fseek(f, 0L, SEEK_SET) != 0) {
+        perror("seek to file beginning");
+        return 1;
+    }
+
+    input = malloc(len);
+    if (input == NULL) {
+        fprintf(stderr, "failed to allocate %ld bytes.\n", len);
+        return BENCH_EXIT_NOMEM;
+    }
+
+    if (fread(input, 1, len, f) < len) {
+        if (feof(f)) {
+            fprintf(stderr, "file truncated.\n");
+            return 1;
+
+        } else {
+            perror("read file");
+        }
+    }
+
+    if (fclose(f) != 0) {
+        perror("close file");
+        return 1;
+    }
+
+    bench_cache_add(input, len);
+
+    run_kernels(kernel_types, cls, input, len, repeat);
+
+    free(input);
+
+    return 0;
+}
+
+
+static void
+run_kernels(unsigned kernel_types, const uint8_t *cls,
+    const unsigned char *input, size_t len, int repeat)
+{
+    int                  c, n, members;
+    long                 found = 0;
+    uint64_t             sum = 0;
+    double               begin, end;
+    bench_stats_t        st;
+
+    if (kernel_types & KERNEL_READ) {
+        printf("Baseline read ");
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            TIMER_START
+
+            sum = bl_read(input, len);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        printf("done: %.05lf ms elapsed (checksum %016llx, "
+               "%d repeated times).\n",
+               bench_stats_median(&st) * 1e3, (unsigned long long) sum, st.n);
+        bench_stats_print(&st);
+    }
+
+    if (kernel_types & KERNEL_MEMCHR) {
+        /* a literal first byte is what a prefilter would look for */
+        for (c = 0, n = 0, members = 0; n < 256; n++) {
+            if (gk_cls_test(cls, n)) {
+                c = n;
+                members++;
+            }
+        }
+
+        if (members != 1) {
+            c = 0;
+        }
+
+        printf("Baseline memchr ");
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            TIMER_START
+
+            found = bl_memchr(input, len, c);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        printf("done: %.05lf ms elapsed (%ld bytes 0x%02x found, "
+               "%d repeated times).\n",
+               bench_stats_median(&st) * 1e3, found, c, st.n);
+        bench_stats_print(&st);
+    }
+
+    if (kernel_types & KERNEL_CLASS_SCAN) {
+        printf("Baseline class scan ");
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            TIMER_START
+
+            found = bl_class_scan(cls, input, len);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        printf("done: %.05lf ms elapsed (%ld bytes in class, "
+               "%d repeated times).\n",
+               bench_stats_median(&st) * 1e3, found, st.n);
+        bench_stats_print(&st);
+    }
+}
+
+
+/*
+ * The union of the classes of the positions a match can start with. A
+ * regex the Glushkov compiler does not take falls back to its first
+ * byte; the kernels scan the whole buffer either way.
+ */
+static int
+first_class(const char *re, int flags, uint8_t *cls)
+{
+    int          err_offset = -1;
+    unsigned     i, j;
+    gk_nfa_t    *nfa;
+    const char  *errstr;
+
+    memset(cls, 0, 32);
+
+    nfa = malloc(sizeof(gk_nfa_t));
+    if (nfa == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        return -1;
+    }
+
+    if (gk_compile(re, flags, nfa, &errstr, &err_offset) != 0) {
+        fprintf(stderr, "[warn] pos %d: %s; scanning for the first byte "
+                "of the regex instead\n", err_offset, errstr);
+        gk_cls_set(cls, (unsigned char) re[0]);
+        free(nfa);
+        return 0;
+    }
+
+    for (i = 0; i < nfa->npos; i++) {
+        if (nfa->first & ((uint64_t) 1 << i)) {
+            for (j = 0; j < 32; j++) {
+                cls[j] |= nfa->cls[i][j];
+            }
+        }
+    }
+
+    free(nfa);
+    return 0;
+}
+
+
+static uint64_t
+bl_read(const unsigned char *p, size_t len)
+{
+    size_t      i;
+    uint64_t    w, sum = 0;
+
+    for (i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        memcpy(&w, p + i, sizeof(uint64_t));
+        sum += w;
+    }
+
+    for ( /* void */ ; i < len; i++) {
+        sum += p[i];
+    }
+
+    return sum;
+}
+
+
+static long
+bl_memchr(const unsigned char *p, size_t len, int c)
+{
+    long                 n = 0;
+    const unsigned char *last = p + len, *q;
+
+    while ((q = memchr(p, c, last - p)) != NULL) {
+        n++;
+        p = q + 1;
+    }
+
+    return n;
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*
+ * The "truffle" technique: two PSHUFB lookups by the low nibble give the
+ * set of high nibbles (one bit each) the class admits for it, the first
+ * table for bytes below 0x80 and the second for the rest; a third lookup
+ * turns the high nibble into its bit.
+ */
+__attribute__((target("ssse3")))
+static long
+bl_class_scan_ssse3(const uint8_t *cls, const unsigned char *p, size_t len)
+{
+    int         c, mask;
+    long        n = 0;
+    size_t      i;
+    uint8_t     lo[16], hi[16];
+    __m128i     tlo, thi, tbit, m0f, m80, v, a, b, bit, hit;
+
+    memset(lo, 0, sizeof(lo));
+    memset(hi, 0, sizeof(hi));
+
+    for (c = 0; c < 256; c++) {
+        if (gk_cls_test(cls, c)) {
+            if (c < 0x80) {
+                lo[c & 0x0f] |= 1 << (c >> 4);
+
+            } else {
+                hi[c & 0x0f] |= 1 << ((c >> 4) & 7);
+            }
+        }
+    }
+
+    tlo = _mm_loadu_si128((const __m128i *) lo);
+    thi = _mm_loadu_si128((const __m128i *) hi);
+    tbit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128,
+                         1, 2, 4, 8, 16, 32, 64, (char) 128);
+    m0f = _mm_set1_epi8(0x0f);
+    m80 = _mm_set1_epi8((char) 0x80);
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i *) (p + i));
+
+        /* PSHUFB yields 0 for indexes with the top bit set */
+        a = _mm_shuffle_epi8(tlo, v);
+        b = _mm_shuffle_epi8(thi, _mm_xor_si128(v, m80));
+        bit = _mm_shuffle_epi8(tbit,
+                               _mm_and_si128(_mm_srli_epi16(v, 4), m0f));
+
+        hit = _mm_cmpeq_epi8(_mm_and_si128(_mm_or_si128(a, b), bit),
+                             _mm_setzero_si128());
+
+        /* the common case in a scan: nothing in the class */
+        mask = _mm_movemask_epi8(hit);
+        if (mask != 0xffff) {
+            n += 16 - __builtin_popcount(mask);
+        }
+    }
+
+    for ( /* void */ ; i < len; i++) {
+        n += gk_cls_test(cls, p[i]) != 0;
+    }
+
+    return n;
+}
+
+#endif
+
+
+static long
+bl_class_scan(const uint8_t *cls, const unsigned char *p, size_t len)
+{
+    long        n = 0;
+    size_t      i;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3")) {
+        return bl_class_scan_ssse3(cls, p, len);
+    }
+#endif
+
+    for (i = 0; i < len; i++) {
+        n += gk_cls_test(cls, p[i]) != 0;
+    }
+
+    return n;
+}
+
+
+static void
+usage(int rc)
+{
+    fprintf(stderr, "usage: baseline [options] <regexp> <file>\n"
+            "options:\n"
+            "   -i                  use case insensitive matching for the\n"
+            "                       class of the first positions\n"
+            "   --read              sum the buffer in 64-bit words\n"
+            "   --memchr            count the regex's literal first byte\n"
+            "                       (or NUL) with memchr\n"
+            "   --class-scan        count the bytes in the class of the\n"
+            "                       regex's first positions\n"
+            "   --repeat=N          repeat each kernel at least N times;\n"
+            "                       report the median. default to 5.\n"
+            BENCH_USAGE
+            "all kernels are run when none is specified.\n");
+    exit(rc);
+}
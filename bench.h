@@ -0,0 +1,4433 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/*
+ * Run-time settings shared by all the drivers: CPU pinning, discarded
+ * warm-up iterations and a check of the machine for known sources of
+ * noise (frequency scaling, turbo, a busy SMT sibling). The settings
+ * come from the options below or from the SREGEX_BENCH_* environment
+ * variables so that plot-all.pl can set them for a whole run.
+ *
+ * The bench_stats_* functions drive the timing loops: every engine is
+ * run until the 95% confidence interval of the median time is within
+ * --ci percent of the median, or the --budget of measured CPU time is
+ * spent. The median is what the drivers print. With --energy, the RAPL
+ * energy counters of get_energy() are read around every run too.
+ *
+ * The bench_pool_* functions run a driver's scan callback in N threads
+ * at once (see --threads) for the drivers whose compiled objects can be
+ * shared between threads.
+ *
+ * The bench_streams_* functions split the input into the bodies of K
+ * concurrent streams fed to the engines in interleaved chunks (see
+ * --streams), and bench_perf_* count cache misses where perf events are
+ * available.
+ *
+ * The bench_reader_* functions stream a file of any size through a ring
+ * of aligned buffers with io_uring, or pread() in a reader thread, for
+ * the end-to-end --pipeline mode. A .gz or .zst file is decompressed by
+ * the reader thread instead when built with BENCH_HAVE_ZLIB or
+ * BENCH_HAVE_ZSTD.
+ *
+ * The bench_tree_* functions walk a directory tree and scan its files,
+ * and the chunks of the large ones, in a pool of threads stealing jobs
+ * from one another (see --tree).
+ *
+ * The bench_fields_* functions drive the field extraction mode (see
+ * --fields): every line of the input matched on its own, its groups
+ * stored as views into the input.
+ *
+ * The bench_column_* functions cut the input into a string column, one
+ * data buffer and an offsets array, for the batch filter mode (see
+ * --batch), and keep its selection bitmap.
+ *
+ * The bench_grep_* functions write the lines of the matches of the grep
+ * mode (see --grep) with their line and column numbers, counting the
+ * newlines between the matches only, and in batches of writev() calls.
+ *
+ * The bench_out_* functions build the output of the replace mode (see
+ * --replace) for the drivers rewriting the input themselves. A driver
+ * defining BENCH_COUNT_ALLOCS before including this file counts the
+ * malloc(), calloc() and realloc() calls of the whole process in
+ * bench_allocs, with glibc.
+ *
+ * The C drivers define _GNU_SOURCE before their first include for
+ * sched_setaffinity() and sched_getcpu(), and include getcputime.h
+ * before this file.
+ */
+
+#ifndef _BENCH_H_INCLUDED_
+#define _BENCH_H_INCLUDED_
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef BENCH_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BENCH_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define BENCH_HAVE_IO_URING    1
+#endif
+#endif
+#endif
+
+
+#define BENCH_UNSET            (-1)
+#define BENCH_DEFAULT_WARMUP   1
+#define BENCH_DEFAULT_CI       2       /* percent */
+#define BENCH_DEFAULT_BUDGET   5       /* seconds */
+#define BENCH_DEFAULT_MAX_RUNS 1000
+
+/* the exit status of a driver whose allocation failed; runcase reports
+ * it as running out of memory */
+#define BENCH_EXIT_NOMEM       125
+
+/* quantiles are taken over the first this many samples of a run */
+#define BENCH_MAX_SAMPLES      10000
+
+/* the eviction sweep covers this much when the LLC size is unknown */
+#define BENCH_DEFAULT_LLC      (64 * 1024 * 1024)
+
+/* input regions flushed between runs in the cold cache mode */
+#define BENCH_MAX_REGIONS      8
+
+
+enum {
+    BENCH_CACHE_WARM     = 0,   /* runs back to back */
+    BENCH_CACHE_COLD     = 1,   /* flush the input before every run */
+    BENCH_CACHE_COLD_ALL = 2    /* evict all caches before every run */
+};
+
+
+/* the modes of bench_conf, each driver passing those it implements to
+ * bench_setup(); in the order of bench_mode_options[] */
+enum {
+    BENCH_MODE_LATENCY   = 0x001,
+    BENCH_MODE_THREADS   = 0x002,
+    BENCH_MODE_STREAMS   = 0x004,
+    BENCH_MODE_PIPELINE  = 0x008,
+    BENCH_MODE_TREE      = 0x010,
+    BENCH_MODE_REPLACE   = 0x020,
+    BENCH_MODE_FIELDS    = 0x040,
+    BENCH_MODE_BATCH     = 0x080,
+    BENCH_MODE_HEATMAP   = 0x100,
+    BENCH_MODE_GREP      = 0x200
+};
+
+
+/* the latency mode: see bench_subjects_init() */
+#define BENCH_DEFAULT_OFFSETS  "0,64,4k,1m,none"
+#define BENCH_DEFAULT_CALLS    1000
+#define BENCH_MAX_OFFSETS      16
+#define BENCH_NO_OFFSET        ((size_t) -1)
+#define BENCH_SUBJECT_TAIL     64
+#define BENCH_SUBJECT_ARENA    (16 * 1024 * 1024)
+
+
+/* the threads mode: see bench_pool_run() */
+#define BENCH_MAX_THREADS      256
+
+
+enum {
+    BENCH_OBJECTS_BOTH   = 0,
+    BENCH_OBJECTS_SHARED = 1,   /* one compiled object for all threads */
+    BENCH_OBJECTS_COPY   = 2    /* a compiled object per thread */
+};
+
+
+/* the streams mode: see bench_streams_init() */
+#define BENCH_DEFAULT_CHUNK    64
+
+
+/* the pipeline mode: see bench_reader_open() */
+#define BENCH_DEFAULT_BUFFERS  4
+#define BENCH_MAX_BUFFERS      64
+#define BENCH_DEFAULT_BUFSIZE  (1024 * 1024)
+
+
+enum {
+    BENCH_IO_URING = 0,
+    BENCH_IO_PREAD = 1
+};
+
+
+/* what the reader thread decompresses the file with */
+enum {
+    BENCH_SOURCE_RAW  = 0,
+    BENCH_SOURCE_GZIP = 1,
+    BENCH_SOURCE_ZSTD = 2
+};
+
+
+/* compressed bytes read at a time */
+#define BENCH_SOURCE_INBUF     (256 * 1024)
+
+
+enum {
+    BENCH_SLOT_EMPTY   = 0,
+    BENCH_SLOT_READING = 1,
+    BENCH_SLOT_FULL    = 2
+};
+
+
+/* the tree mode: see bench_tree_run() */
+#define BENCH_DEFAULT_SPLIT    (4 * 1024 * 1024)
+#define BENCH_TREE_OVERLAP     (64 * 1024)
+
+
+/* the batch mode: see bench_column_init() */
+#define BENCH_DEFAULT_ROWS     "8,64,512,4k"
+#define BENCH_MAX_ROW_SIZES    16
+
+
+/* the heatmap mode: see bench_heatmap_run() */
+#define BENCH_DEFAULT_SLICE    (256 * 1024)
+
+
+/* the grep mode: see bench_grep_flush() */
+#define BENCH_GREP_IOVS        1024
+#define BENCH_GREP_PREFIXES    (16 * 1024)  /* "line:column:" of a batch */
+
+
+/* a sibling hyper-thread busier than this skews the timings */
+#define BENCH_MAX_SIBLING_LOAD 10
+
+
+typedef struct {
+    int                  pin;        /* CPU to run on */
+    int                  warmup;     /* discarded iterations per engine */
+    int                  strict_env; /* refuse to run when noisy */
+    int                  max_runs;
+    double               ci;         /* target in percent; 0: fixed runs */
+    double               budget;     /* seconds of measured time */
+    long                 size;       /* bytes of the input used; 0: all */
+    int                  cache;      /* BENCH_CACHE_* */
+    const char          *plant;      /* the latency mode when set */
+    const char          *offsets;
+    int                  calls;      /* per offset */
+    int                  setup;      /* time engine setup with each call */
+    int                  threads;    /* the threads mode when set */
+    int                  objects;    /* BENCH_OBJECTS_* */
+    int                  streams;    /* the streams mode when set */
+    int                  chunk;      /* bytes fed to a stream at a time */
+    int                  pipeline;   /* read the file while matching */
+    int                  buffers;
+    long                 bufsize;
+    int                  io;         /* BENCH_IO_* */
+    int                  tree;       /* scan a directory tree */
+    long                 split;      /* bytes per job of a large file */
+    const char          *replace;    /* the replace mode when set */
+    int                  fields;     /* the field extraction mode */
+    int                  batch;      /* the batch filter mode */
+    const char          *rows;       /* the row sizes of the batch mode */
+    int                  energy;     /* read the RAPL counters per run */
+    long                 slice;      /* the heatmap mode when set */
+    const char          *grep;       /* the grep mode when set */
+} bench_conf_t;
+
+
+static bench_conf_t      bench_conf = {
+    BENCH_UNSET, BENCH_UNSET, BENCH_UNSET, BENCH_UNSET, BENCH_UNSET,
+    BENCH_UNSET, 0, BENCH_UNSET, NULL, BENCH_DEFAULT_OFFSETS,
+    BENCH_DEFAULT_CALLS, 0, 0, BENCH_OBJECTS_BOTH, 0, BENCH_DEFAULT_CHUNK,
+    0, BENCH_DEFAULT_BUFFERS, BENCH_DEFAULT_BUFSIZE, BENCH_IO_URING,
+    0, BENCH_DEFAULT_SPLIT, NULL, 0, 0, BENCH_DEFAULT_ROWS, BENCH_UNSET,
+    0, NULL
+};
+
+
+#if defined(BENCH_COUNT_ALLOCS) && defined(__GLIBC__)
+
+/* the exception specification of the glibc declarations in C++ */
+#ifdef __cplusplus
+#define BENCH_THROW  __THROW
+extern "C" {
+#else
+#define BENCH_THROW
+#endif
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+static unsigned long     bench_allocs;
+
+
+void *
+malloc(size_t size) BENCH_THROW
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+
+void *
+calloc(size_t n, size_t size) BENCH_THROW
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+
+void *
+realloc(void *p, size_t size) BENCH_THROW
+{
+    __atomic_add_fetch(&bench_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(p, size);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#define BENCH_ALLOCS()  __atomic_load_n(&bench_allocs, __ATOMIC_RELAXED)
+
+#else
+
+#define BENCH_ALLOCS()  0UL
+
+#endif
+
+
+/* short subjects with a match planted at the same offset in each */
+typedef struct {
+    size_t               offset;     /* BENCH_NO_OFFSET: no match */
+    size_t               len;        /* of every subject */
+    int                  n;
+    unsigned char       *data;       /* n subjects of len bytes */
+} bench_subjects_t;
+
+
+typedef struct {
+    const void          *data;
+    size_t               len;
+} bench_region_t;
+
+
+static bench_region_t    bench_regions[BENCH_MAX_REGIONS];
+static int               bench_nregions;
+static unsigned char    *bench_sweep_buf;
+static size_t            bench_sweep_len;
+static const char       *bench_cache_names[] = { "warm", "cold", "cold-all" };
+
+
+typedef struct {
+    int                  n;          /* samples taken */
+    int                  warmup;     /* warm-up runs left */
+    int                  min_runs;
+    double               spent;
+    double               sum;
+    double               sumsq;
+    double              *samples;
+    double               energy[2];  /* joules of the runs counted */
+    double               energy_begin[2];
+} bench_stats_t;
+
+
+static double            bench_samples[BENCH_MAX_SAMPLES];
+
+/* where the package and DRAM energy counters wrap around */
+static double            bench_energy_range[2];
+
+
+/* stream s gets the bytes [s * len / n, (s + 1) * len / n) of the input */
+typedef struct {
+    int                  n;
+    size_t               len;
+    size_t               chunk;
+    size_t               rounds;     /* chunks of the longest body */
+} bench_streams_t;
+
+
+/* a buffer of the reader's ring */
+typedef struct {
+    unsigned char       *data;
+    size_t               len;        /* bytes read so far */
+    size_t               want;
+    off_t                off;
+    int                  state;      /* BENCH_SLOT_* */
+} bench_slot_t;
+
+
+typedef struct {
+    int                  fd;
+    int                  io;         /* BENCH_IO_* */
+    int                  source;     /* BENCH_SOURCE_* */
+    int                  nslots;
+    int                  head;       /* the slot to consume next */
+    int                  pending;    /* SQEs not submitted yet */
+    size_t               size;       /* of every buffer */
+    off_t                file_size;  /* decompressed after a pass */
+    off_t                csize;      /* of a compressed file */
+    off_t                next_off;   /* of the next read to issue */
+    double               begin;      /* of the pass */
+    double               wait;       /* in bench_reader_next(), all passes */
+    double               elapsed;    /* all passes */
+    int                  passes;
+    bench_slot_t         slots[BENCH_MAX_BUFFERS];
+
+    /* the pread() reader thread */
+    pthread_t            tid;
+    pthread_mutex_t      mutex;
+    pthread_cond_t       cond;
+
+    /* the decompressor, in the reader thread */
+    unsigned char       *in;
+    size_t               in_len;
+    size_t               in_pos;
+    int                  in_eof;
+    int                  in_frame;   /* inside a gzip member/zstd frame */
+    void                *zs;         /* z_stream */
+    void                *zdctx;      /* ZSTD_DCtx */
+
+    /* the io_uring rings */
+    int                  ring_fd;
+    void                *sq_ptr;
+    void                *cq_ptr;
+    void                *sqes;
+    size_t               sq_len;
+    size_t               cq_len;
+    size_t               sqes_len;
+    unsigned            *sq_head;
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    void                *cqes;
+} bench_reader_t;
+
+
+/* a field of the field extraction mode: a view into the input */
+typedef struct {
+    const unsigned char *data;
+    size_t               len;
+} bench_field_t;
+
+
+typedef struct {
+    size_t               off;
+    size_t               len;        /* without the line feed */
+} bench_line_t;
+
+
+typedef struct {
+    const unsigned char *input;
+    bench_line_t        *lines;
+    size_t               nlines;
+    int                  ngroups;    /* of the regexp */
+    bench_field_t       *arena;      /* ngroups + 1 fields per line */
+    double               n, sx, sy, sxx, sxy;  /* the fit of the costs */
+} bench_fields_t;
+
+
+/* a string column: row i is data[offsets[i]] up to data[offsets[i + 1]] */
+typedef struct {
+    const char          *data;
+    size_t              *offsets;    /* nrows + 1 */
+    size_t               nrows;
+    size_t               row_size;
+    size_t               words;      /* of the bitmaps */
+    unsigned long long  *selected;   /* bit i set when row i matches */
+    unsigned long long  *reference;  /* the bitmap of the first engine */
+    int                  checked;    /* reference is set */
+} bench_column_t;
+
+
+/* the output of the replace mode, reused from run to run */
+typedef struct {
+    unsigned char       *data;
+    size_t               len;
+    size_t               size;
+} bench_out_t;
+
+
+/* the output of the grep mode: see bench_grep_match() */
+typedef struct {
+    const unsigned char *input;
+    size_t               len;
+    int                  fd;
+    int                  regular;    /* fd is a regular file */
+    size_t               pos;        /* newlines counted up to here */
+    size_t               line;       /* the line of pos, from 1 */
+    size_t               bol;        /* the offset of that line */
+    size_t               next;       /* the end of the last line queued */
+    struct iovec         iov[BENCH_GREP_IOVS];
+    int                  niov;
+    char                 prefixes[BENCH_GREP_PREFIXES];
+    size_t               used;       /* of prefixes */
+    size_t               matches;
+    size_t               lines;
+    size_t               bytes;
+    size_t               writes;
+} bench_grep_t;
+
+
+/* cache miss counters; fd -1 where unavailable */
+typedef struct {
+    int                  fd[2];      /* LLC misses, L1D read misses */
+    unsigned long long   count[2];
+} bench_perf_t;
+
+
+/* scans a buffer once with a thread's compiled object; returns the
+ * number of matches */
+typedef int (*bench_scan_pt)(void *ctx, const unsigned char *data,
+    size_t len);
+
+
+typedef struct bench_pool_s  bench_pool_t;
+
+
+typedef struct {
+    bench_pool_t        *pool;
+    void                *ctx;        /* passed to the scan callback */
+    unsigned char       *data;       /* the thread's copy of the input */
+    int                  matches;    /* in the last round */
+    double               wall;       /* spent scanning */
+    double               cpu;        /* of the thread while scanning */
+    long                 switches;   /* voluntary context switches */
+    pthread_t            tid;
+} bench_worker_t;
+
+
+typedef struct {
+    pthread_mutex_t      mutex;
+    pthread_cond_t       cond;
+    int                  count;
+    int                  waiting;
+    unsigned             gen;
+} bench_barrier_t;
+
+
+struct bench_pool_s {
+    bench_scan_pt        scan;
+    size_t               len;
+    int                  max;        /* workers with a copy of the input */
+    int                  stop;
+    double               base;       /* bytes per second of one thread */
+    bench_barrier_t      start;
+    bench_barrier_t      done;
+    bench_worker_t       workers[BENCH_MAX_THREADS];
+};
+
+
+/* a file, or a chunk of a large one */
+typedef struct {
+    int                  file;
+    off_t                off;
+    size_t               len;
+    double               elapsed;    /* in the last pass */
+} bench_job_t;
+
+
+typedef struct bench_tree_s  bench_tree_t;
+
+
+typedef struct {
+    bench_tree_t        *tree;
+    void                *ctx;        /* passed to the scan callback */
+    unsigned char       *buf;
+    size_t               size;
+    int                 *jobs;       /* the worker's deque */
+    int                  head;       /* stolen from */
+    int                  tail;       /* pushed and popped by the owner */
+    pthread_mutex_t      mutex;
+    int                  matches;    /* in the last pass */
+    long                 steals;     /* all passes */
+    pthread_t            tid;
+} bench_tree_worker_t;
+
+
+struct bench_tree_s {
+    bench_scan_pt        scan;
+    char               **paths;
+    off_t               *sizes;
+    int                  nfiles;
+    bench_job_t         *jobs;
+    int                  njobs;
+    unsigned long long   bytes;
+    int                  n;          /* workers in the current run */
+    int                  stop;
+    bench_barrier_t      start;
+    bench_barrier_t      done;
+    bench_tree_worker_t  workers[BENCH_MAX_THREADS];
+};
+
+
+#define BENCH_USAGE                                                          \
+    "   --pin=N             run on CPU N only\n"                             \
+    "   --warmup=N          run each engine N more times first and\n"        \
+    "                       discard the results. default to 1.\n"            \
+    "   --strict-env        refuse to run when the machine looks noisy\n"    \
+    "   --energy            read the RAPL package and DRAM energy counters\n"\
+    "                       around every run and report joules per run\n"  \
+    "                       and per GB of the file, where readable\n"       \
+    "   --ci=P              repeat until the 95 percent confidence\n"        \
+    "                       interval of the median is within P percent;\n"   \
+    "                       --repeat is then the minimum number of runs.\n"  \
+    "                       0 runs exactly --repeat times. default to 2.\n"  \
+    "   --budget=S          stop repeating after S seconds of measured\n"    \
+    "                       time. default to 5.\n"                           \
+    "   --max-runs=N        stop repeating after N runs. default to 1000.\n" \
+    "   --size=N            only use the first N bytes of the file (see\n"   \
+    "                       bench-sweep)\n"                                  \
+    "   --cache=MODE        warm (run back to back, the default), cold\n"    \
+    "                       (flush the input from the caches before every\n" \
+    "                       run) or cold-all (also evict the compiled\n"     \
+    "                       regex with a sweep over a buffer twice the\n"    \
+    "                       size of the last level cache)\n"                 \
+    "   --latency=TEXT      time the first match of many short subjects\n"   \
+    "                       made of the file's bytes with TEXT planted at\n" \
+    "                       each of the --offsets and report percentiles\n"  \
+    "   --offsets=LIST      where to plant TEXT, with k and m suffixes,\n"   \
+    "                       and none for no match. default to\n"             \
+    "                       0,64,4k,1m,none\n"                               \
+    "   --calls=N           calls per offset. default to 1000.\n"            \
+    "   --setup=MODE        exclude (the default) or include the engine's\n" \
+    "                       per-call setup (scratch, match data, JIT\n"      \
+    "                       stack) in the latency\n"                        \
+    "   --threads=N         scan a copy of the file in each of 1, 2, 4 ...\n" \
+    "                       N threads at once and report the scaling\n"     \
+    "   --objects=MODE      shared (one compiled object for all threads),\n"\
+    "                       copy (one per thread) or both (the default)\n"  \
+    "   --streams=K         split the file among 1, 10, 100 ... K streams\n" \
+    "                       fed in interleaved chunks, each with its own\n" \
+    "                       resumable match state\n"                         \
+    "   --chunk=N           feed the streams N bytes at a time. default\n"  \
+    "                       to 64.\n"                                      \
+    "   --pipeline          stream the file from disk while matching, with\n"\
+    "                       the read time included\n"                       \
+    "   --buffers=N         read ahead into a ring of N buffers. default\n" \
+    "                       to 4.\n"                                        \
+    "   --buffer-size=N     of each buffer in bytes. default to 1048576.\n" \
+    "   --io=MODE           uring (the default, where available) or pread\n"\
+    "                       (in a reader thread)\n"                         \
+    "   --tree              scan every file under the directory given as\n" \
+    "                       the file in 1, 2, 4 ... --threads workers\n"    \
+    "                       stealing jobs from one another; --setup=include\n"\
+    "                       redoes the engine's setup for every job\n"     \
+    "   --split=N           scan files over N bytes in N-byte jobs cut at\n"\
+    "                       line ends. default to 4194304; 0 never splits.\n"\
+    "   --replace=TEMPLATE  replace every match with TEMPLATE, where $N\n"  \
+    "                       or ${N} is group N and $$ is a $, and report\n" \
+    "                       the output rate and allocations\n"              \
+    "   --fields            match each line on its own and store its\n"     \
+    "                       groups, with 0, 1, 2 ... of the capture\n"      \
+    "                       groups of the regexp left capturing, and\n"     \
+    "                       report the lines per second and the cost of\n"  \
+    "                       a group\n"                                      \
+    "   --batch             cut the file into a column of rows and write\n" \
+    "                       a bitmap of the rows matching, for each of\n"   \
+    "                       the --rows sizes\n"                             \
+    "   --rows=LIST         the row sizes in bytes of --batch, with k\n"    \
+    "                       suffixes. default to 8,64,512,4k.\n"            \
+    "   --heatmap[=N]       time every slice of N bytes of the file on\n"   \
+    "                       its own and print its throughput, for the\n"    \
+    "                       heatmap of gen-plot.pl. N defaults to\n"        \
+    "                       262144.\n"                                      \
+    "   --grep[=FILE]       write every line with a match to FILE, as\n"    \
+    "                       LINE:COLUMN:TEXT, and report what the\n"        \
+    "                       output costs over the matching alone.\n"        \
+    "                       FILE defaults to /dev/null.\n"                  \
+    "the modes from --latency on are exclusive, but for --threads giving\n" \
+    "the workers of --tree. a driver rejects the modes it does not\n"       \
+    "implement.\n"
+
+
+static inline int
+bench_cache_mode(const char *name)
+{
+    int  i;
+
+    for (i = 0; i < (int) (sizeof(bench_cache_names) / sizeof(char *)); i++) {
+        if (strcmp(name, bench_cache_names[i]) == 0) {
+            return i;
+        }
+    }
+
+    fprintf(stderr, "unknown cache mode: %s\n", name);
+    exit(1);
+}
+
+
+/* returns 1 when arg is one of the shared options above */
+static inline int
+bench_parse_option(const char *arg)
+{
+    if (strncmp(arg, "--pin=", sizeof("--pin=") - 1) == 0) {
+        bench_conf.pin = atoi(arg + sizeof("--pin=") - 1);
+        return 1;
+    }
+
+    if (strncmp(arg, "--warmup=", sizeof("--warmup=") - 1) == 0) {
+        bench_conf.warmup = atoi(arg + sizeof("--warmup=") - 1);
+        if (bench_conf.warmup < 0) {
+            bench_conf.warmup = 0;
+        }
+
+        return 1;
+    }
+
+    if (strcmp(arg, "--strict-env") == 0) {
+        bench_conf.strict_env = 1;
+        return 1;
+    }
+
+    if (strcmp(arg, "--energy") == 0) {
+        bench_conf.energy = 1;
+        return 1;
+    }
+
+    if (strncmp(arg, "--ci=", sizeof("--ci=") - 1) == 0) {
+        bench_conf.ci = atof(arg + sizeof("--ci=") - 1);
+        if (bench_conf.ci < 0) {
+            bench_conf.ci = 0;
+        }
+
+        return 1;
+    }
+
+    if (strncmp(arg, "--budget=", sizeof("--budget=") - 1) == 0) {
+        bench_conf.budget = atof(arg + sizeof("--budget=") - 1);
+        return 1;
+    }
+
+    if (strncmp(arg, "--max-runs=", sizeof("--max-runs=") - 1) == 0) {
+        bench_conf.max_runs = atoi(arg + sizeof("--max-runs=") - 1);
+        return 1;
+    }
+
+    if (strncmp(arg, "--size=", sizeof("--size=") - 1) == 0) {
+        bench_conf.size = atol(arg + sizeof("--size=") - 1);
+        return 1;
+    }
+
+    if (strncmp(arg, "--cache=", sizeof("--cache=") - 1) == 0) {
+        bench_conf.cache = bench_cache_mode(arg + sizeof("--cache=") - 1);
+        return 1;
+    }
+
+    if (strncmp(arg, "--latency=", sizeof("--latency=") - 1) == 0) {
+        bench_conf.plant = arg + sizeof("--latency=") - 1;
+        return 1;
+    }
+
+    if (strncmp(arg, "--offsets=", sizeof("--offsets=") - 1) == 0) {
+        bench_conf.offsets = arg + sizeof("--offsets=") - 1;
+        return 1;
+    }
+
+    if (strncmp(arg, "--calls=", sizeof("--calls=") - 1) == 0) {
+        bench_conf.calls = atoi(arg + sizeof("--calls=") - 1);
+        if (bench_conf.calls <= 0) {
+            bench_conf.calls = BENCH_DEFAULT_CALLS;
+        }
+
+        return 1;
+    }
+
+    if (strcmp(arg, "--setup=include") == 0) {
+        bench_conf.setup = 1;
+        return 1;
+    }
+
+    if (strcmp(arg, "--setup=exclude") == 0) {
+        bench_conf.setup = 0;
+        return 1;
+    }
+
+    if (strncmp(arg, "--threads=", sizeof("--threads=") - 1) == 0) {
+        bench_conf.threads = atoi(arg + sizeof("--threads=") - 1);
+        if (bench_conf.threads < 0) {
+            bench_conf.threads = 0;
+        }
+
+        if (bench_conf.threads > BENCH_MAX_THREADS) {
+            bench_conf.threads = BENCH_MAX_THREADS;
+        }
+
+        return 1;
+    }
+
+    if (strncmp(arg, "--streams=", sizeof("--streams=") - 1) == 0) {
+        bench_conf.streams = atoi(arg + sizeof("--streams=") - 1);
+        if (bench_conf.streams < 0) {
+            bench_conf.streams = 0;
+        }
+
+        return 1;
+    }
+
+    if (strncmp(arg, "--chunk=", sizeof("--chunk=") - 1) == 0) {
+        bench_conf.chunk = atoi(arg + sizeof("--chunk=") - 1);
+        if (bench_conf.chunk <= 0) {
+            bench_conf.chunk = BENCH_DEFAULT_CHUNK;
+        }
+
+        return 1;
+    }
+
+    if (strcmp(arg, "--pipeline") == 0) {
+        bench_conf.pipeline = 1;
+        return 1;
+    }
+
+    if (strncmp(arg, "--buffers=", sizeof("--buffers=") - 1) == 0) {
+        bench_conf.buffers = atoi(arg + sizeof("--buffers=") - 1);
+        if (bench_conf.buffers < 2) {
+            bench_conf.buffers = 2;
+        }
+
+        if (bench_conf.buffers > BENCH_MAX_BUFFERS) {
+            bench_conf.buffers = BENCH_MAX_BUFFERS;
+        }
+
+        return 1;
+    }
+
+    if (strncmp(arg, "--buffer-size=", sizeof("--buffer-size=") - 1) == 0) {
+        bench_conf.bufsize = atol(arg + sizeof("--buffer-size=") - 1);
+        if (bench_conf.bufsize < 4096) {
+            bench_conf.bufsize = 4096;
+        }
+
+        /* whole pages, for the alignment */
+        bench_conf.bufsize &= ~4095L;
+
+        return 1;
+    }
+
+    if (strncmp(arg, "--replace=", sizeof("--replace=") - 1) == 0) {
+        bench_conf.replace = arg + sizeof("--replace=") - 1;
+        return 1;
+    }
+
+    if (strcmp(arg, "--fields") == 0) {
+        bench_conf.fields = 1;
+        return 1;
+    }
+
+    if (strcmp(arg, "--batch") == 0) {
+        bench_conf.batch = 1;
+        return 1;
+    }
+
+    if (strncmp(arg, "--rows=", sizeof("--rows=") - 1) == 0) {
+        bench_conf.rows = arg + sizeof("--rows=") - 1;
+        return 1;
+    }
+
+    if (strcmp(arg, "--heatmap") == 0) {
+        bench_conf.slice = BENCH_DEFAULT_SLICE;
+        return 1;
+    }
+
+    if (strncmp(arg, "--heatmap=", sizeof("--heatmap=") - 1) == 0) {
+        bench_conf.slice = atol(arg + sizeof("--heatmap=") - 1);
+        if (bench_conf.slice <= 0) {
+            fprintf(stderr, "bad slice size: %s\n", arg);
+            exit(1);
+        }
+
+        return 1;
+    }
+
+    if (strcmp(arg, "--grep") == 0) {
+        bench_conf.grep = "/dev/null";
+        return 1;
+    }
+
+    if (strncmp(arg, "--grep=", sizeof("--grep=") - 1) == 0) {
+        bench_conf.grep = arg + sizeof("--grep=") - 1;
+        return 1;
+    }
+
+    if (strcmp(arg, "--tree") == 0) {
+        bench_conf.tree = 1;
+        return 1;
+    }
+
+    if (strncmp(arg, "--split=", sizeof("--split=") - 1) == 0) {
+        bench_conf.split = atol(arg + sizeof("--split=") - 1);
+        if (bench_conf.split < 0) {
+            bench_conf.split = 0;
+        }
+
+        return 1;
+    }
+
+    if (strcmp(arg, "--io=uring") == 0) {
+        bench_conf.io = BENCH_IO_URING;
+        return 1;
+    }
+
+    if (strcmp(arg, "--io=pread") == 0) {
+        bench_conf.io = BENCH_IO_PREAD;
+        return 1;
+    }
+
+    if (strcmp(arg, "--objects=both") == 0) {
+        bench_conf.objects = BENCH_OBJECTS_BOTH;
+        return 1;
+    }
+
+    if (strcmp(arg, "--objects=shared") == 0) {
+        bench_conf.objects = BENCH_OBJECTS_SHARED;
+        return 1;
+    }
+
+    if (strcmp(arg, "--objects=copy") == 0) {
+        bench_conf.objects = BENCH_OBJECTS_COPY;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static inline int
+bench_env_int(const char *name, int dflt)
+{
+    const char  *v = getenv(name);
+
+    return v && *v ? atoi(v) : dflt;
+}
+
+
+static inline double
+bench_env_double(const char *name, double dflt)
+{
+    const char  *v = getenv(name);
+
+    return v && *v ? atof(v) : dflt;
+}
+
+
+#ifdef __linux__
+
+/* reads the first line of a /sys or /proc file; returns 0 on success */
+static inline int
+bench_read_line(const char *path, char *buf, size_t size)
+{
+    FILE    *f;
+    size_t   n;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    if (fgets(buf, (int) size, f) == NULL) {
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+
+    n = strlen(buf);
+    if (n && buf[n - 1] == '\n') {
+        buf[n - 1] = '\0';
+    }
+
+    return 0;
+}
+
+
+/* the busy and total jiffies of a CPU from /proc/stat */
+static inline int
+bench_cpu_jiffies(int cpu, unsigned long long *busy,
+    unsigned long long *total)
+{
+    FILE                *f;
+    char                 line[256], tag[16];
+    unsigned long long   v[8];
+    int                  i, n;
+
+    snprintf(tag, sizeof(tag), "cpu%d ", cpu);
+
+    f = fopen("/proc/stat", "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, tag, strlen(tag)) != 0) {
+            continue;
+        }
+
+        memset(v, 0, sizeof(v));
+        n = sscanf(line + strlen(tag), "%llu %llu %llu %llu %llu %llu %llu "
+                   "%llu", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+                   &v[7]);
+        fclose(f);
+
+        if (n < 4) {
+            return -1;
+        }
+
+        *total = 0;
+        for (i = 0; i < 8; i++) {
+            *total += v[i];
+        }
+
+        /* idle and iowait */
+        *busy = *total - v[3] - v[4];
+        return 0;
+    }
+
+    fclose(f);
+    return -1;
+}
+
+
+/* the load of the other hyper-threads of cpu in percent over 100ms, or
+ * -1 when it has none */
+static inline int
+bench_sibling_load(int cpu, char *siblings, size_t size)
+{
+    char                 path[128], list[64], *p, *end;
+    unsigned long long   busy0[8], total0[8], busy1, total1;
+    int                  ids[8], n = 0, i, load = -1, lo, hi;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/"
+             "thread_siblings_list", cpu);
+
+    if (bench_read_line(path, list, sizeof(list)) != 0) {
+        return -1;
+    }
+
+    /* a list like "3,7" or "2-3" */
+    for (p = list; *p && n < 8; p = *end ? end + 1 : end) {
+        lo = hi = (int) strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+
+        if (*end == '-') {
+            hi = (int) strtol(end + 1, &end, 10);
+        }
+
+        for (i = lo; i <= hi && n < 8; i++) {
+            if (i != cpu
+                && bench_cpu_jiffies(i, &busy0[n], &total0[n]) == 0)
+            {
+                ids[n++] = i;
+            }
+        }
+    }
+
+    if (n == 0) {
+        return -1;
+    }
+
+    usleep(100000);
+
+    siblings[0] = '\0';
+
+    for (i = 0; i < n; i++) {
+        if (bench_cpu_jiffies(ids[i], &busy1, &total1) != 0) {
+            continue;
+        }
+
+        if (total1 > total0[i]) {
+            int l = (int) (100 * (busy1 - busy0[i]) / (total1 - total0[i]));
+
+            if (l > load) {
+                load = l;
+            }
+        }
+
+        snprintf(siblings + strlen(siblings), size - strlen(siblings),
+                 "%s%d", i ? "," : "", ids[i]);
+    }
+
+    return load;
+}
+
+#endif /* __linux__ */
+
+
+static const char *bench_mode_options[] = {
+    "--latency", "--threads", "--streams", "--pipeline", "--tree",
+    "--replace", "--fields", "--batch", "--heatmap", "--grep"
+};
+
+
+/* the BENCH_MODE_* asked for on the command line */
+static inline unsigned
+bench_modes(void)
+{
+    unsigned  modes = 0;
+
+    modes |= bench_conf.plant ? BENCH_MODE_LATENCY : 0;
+    modes |= bench_conf.threads && !bench_conf.tree ? BENCH_MODE_THREADS : 0;
+    modes |= bench_conf.streams ? BENCH_MODE_STREAMS : 0;
+    modes |= bench_conf.pipeline ? BENCH_MODE_PIPELINE : 0;
+    modes |= bench_conf.tree ? BENCH_MODE_TREE : 0;
+    modes |= bench_conf.replace ? BENCH_MODE_REPLACE : 0;
+    modes |= bench_conf.fields ? BENCH_MODE_FIELDS : 0;
+    modes |= bench_conf.batch ? BENCH_MODE_BATCH : 0;
+    modes |= bench_conf.slice ? BENCH_MODE_HEATMAP : 0;
+    modes |= bench_conf.grep ? BENCH_MODE_GREP : 0;
+
+    return modes;
+}
+
+
+/*
+ * Exits when a mode the driver does not implement is asked for, or two
+ * modes at once, rather than run the plain benchmark in their place.
+ */
+static inline void
+bench_check_modes(unsigned implemented)
+{
+    int       i, first = -1;
+    unsigned  modes = bench_modes();
+
+    for (i = 0; i < (int) (sizeof(bench_mode_options) / sizeof(char *));
+         i++)
+    {
+        if (!(modes & (1u << i))) {
+            continue;
+        }
+
+        if (!(implemented & (1u << i))) {
+            fprintf(stderr, "unsupported option: %s\n",
+                    bench_mode_options[i]);
+            exit(1);
+        }
+
+        if (first >= 0) {
+            fprintf(stderr, "unsupported option: %s with %s\n",
+                    bench_mode_options[i], bench_mode_options[first]);
+            exit(1);
+        }
+
+        first = i;
+    }
+}
+
+
+/*
+ * Applies the settings: checks the modes asked for against those the
+ * driver implements, pins the process and reports the environment as a
+ * "# env:" line on stdout (ignored by gen-plot.pl). Exits when the
+ * environment is noisy and --strict-env is in effect.
+ */
+static inline void
+bench_setup(unsigned modes)
+{
+    bench_check_modes(modes);
+
+    if (bench_conf.pin == BENCH_UNSET) {
+        bench_conf.pin = bench_env_int("SREGEX_BENCH_PIN", BENCH_UNSET);
+    }
+
+    if (bench_conf.warmup == BENCH_UNSET) {
+        bench_conf.warmup = bench_env_int("SREGEX_BENCH_WARMUP",
+                                          BENCH_DEFAULT_WARMUP);
+    }
+
+    if (bench_conf.strict_env == BENCH_UNSET) {
+        bench_conf.strict_env = bench_env_int("SREGEX_BENCH_STRICT_ENV", 0);
+    }
+
+    if (bench_conf.energy == BENCH_UNSET) {
+        bench_conf.energy = bench_env_int("SREGEX_BENCH_ENERGY", 0);
+    }
+
+    if (bench_conf.ci == BENCH_UNSET) {
+        bench_conf.ci = bench_env_double("SREGEX_BENCH_CI", BENCH_DEFAULT_CI);
+    }
+
+    if (bench_conf.budget == BENCH_UNSET) {
+        bench_conf.budget = bench_env_double("SREGEX_BENCH_BUDGET",
+                                             BENCH_DEFAULT_BUDGET);
+    }
+
+    if (bench_conf.max_runs == BENCH_UNSET) {
+        bench_conf.max_runs = bench_env_int("SREGEX_BENCH_MAX_RUNS",
+                                            BENCH_DEFAULT_MAX_RUNS);
+    }
+
+    if (bench_conf.cache == BENCH_UNSET) {
+        const char  *v = getenv("SREGEX_BENCH_CACHE");
+
+        bench_conf.cache = v && *v ? bench_cache_mode(v) : BENCH_CACHE_WARM;
+    }
+
+#ifdef __linux__
+    {
+        int          cpu, load;
+        char         path[128], buf[128], noise[256], siblings[64];
+        const char  *turbo = "n/a";
+        cpu_set_t    set;
+
+        noise[0] = '\0';
+
+        if (bench_conf.pin >= 0) {
+            CPU_ZERO(&set);
+            CPU_SET(bench_conf.pin, &set);
+
+            if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                perror("sched_setaffinity");
+                exit(1);
+            }
+        }
+
+        cpu = sched_getcpu();
+
+        printf("# env: cpu %d%s", cpu,
+               bench_conf.pin >= 0 ? " (pinned)" : " (not pinned)");
+
+        if (bench_conf.pin < 0) {
+            strcat(noise, ", not pinned");
+        }
+
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",
+                 cpu);
+
+        if (bench_read_line(path, buf, sizeof(buf)) == 0) {
+            printf(", governor %s", buf);
+
+            if (strcmp(buf, "performance") != 0) {
+                strcat(noise, ", governor not performance");
+            }
+
+        } else {
+            printf(", governor n/a");
+        }
+
+        if (bench_read_line("/sys/devices/system/cpu/intel_pstate/no_turbo",
+                            buf, sizeof(buf)) == 0)
+        {
+            turbo = strcmp(buf, "0") == 0 ? "on" : "off";
+
+        } else if (bench_read_line("/sys/devices/system/cpu/cpufreq/boost",
+                                   buf, sizeof(buf)) == 0)
+        {
+            turbo = strcmp(buf, "0") == 0 ? "off" : "on";
+        }
+
+        printf(", turbo %s", turbo);
+
+        if (strcmp(turbo, "on") == 0) {
+            strcat(noise, ", turbo on");
+        }
+
+        load = bench_sibling_load(cpu, siblings, sizeof(siblings));
+        if (load >= 0) {
+            printf(", smt sibling %s load %d%%", siblings, load);
+
+            if (load > BENCH_MAX_SIBLING_LOAD) {
+                strcat(noise, ", busy smt sibling");
+            }
+
+        } else {
+            printf(", no smt sibling");
+        }
+
+        if (bench_read_line("/sys/kernel/mm/transparent_hugepage/enabled",
+                            buf, sizeof(buf)) == 0)
+        {
+            char  *b = strchr(buf, '['), *e = strchr(buf, ']');
+
+            if (b && e && e > b) {
+                *e = '\0';
+                printf(", thp %s", b + 1);
+            }
+        }
+
+        printf(", warmup %d, cache %s\n", bench_conf.warmup,
+               bench_cache_names[bench_conf.cache]);
+
+        if (noise[0]) {
+            printf("# env: noisy:%s\n", noise + 1);
+
+            if (bench_conf.strict_env) {
+                fflush(stdout);
+                fprintf(stderr, "refusing to run in a noisy environment:%s\n",
+                        noise + 1);
+                exit(3);
+            }
+        }
+
+        fflush(stdout);
+    }
+#endif
+
+    if (bench_conf.energy) {
+        bench_energy_range[ENERGY_PACKAGE] = get_energy(ENERGY_PACKAGE, 1);
+        bench_energy_range[ENERGY_DRAM] = get_energy(ENERGY_DRAM, 1);
+
+        if (get_energy(ENERGY_PACKAGE, 0) < 0) {
+            printf("# env: energy n/a, no readable RAPL counters under "
+                   POWERCAP_DIR "\n");
+            bench_conf.energy = 0;
+        }
+    }
+}
+
+
+/* the number of bytes to read from an input file of the given size */
+static inline size_t
+bench_input_size(size_t file_size)
+{
+    if (bench_conf.size > 0 && (size_t) bench_conf.size < file_size) {
+        return (size_t) bench_conf.size;
+    }
+
+    return file_size;
+}
+
+
+/* registers a buffer the engines read, to be flushed in the cold mode */
+static inline void
+bench_cache_add(const void *data, size_t len)
+{
+    if (len && bench_nregions < BENCH_MAX_REGIONS) {
+        bench_regions[bench_nregions].data = data;
+        bench_regions[bench_nregions].len = len;
+        bench_nregions++;
+    }
+}
+
+
+/* writes to every line of a buffer twice the size of the largest cache */
+static inline void
+bench_cache_sweep(void)
+{
+    size_t  i;
+
+    if (bench_sweep_buf == NULL) {
+        long  llc = -1;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (llc <= 0) {
+            llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        }
+#endif
+
+        bench_sweep_len = 2 * (llc > 0 ? (size_t) llc : BENCH_DEFAULT_LLC);
+
+        bench_sweep_buf = (unsigned char *) malloc(bench_sweep_len);
+        if (bench_sweep_buf == NULL) {
+            fprintf(stderr, "failed to allocate %lu bytes.\n",
+                    (unsigned long) bench_sweep_len);
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        memset(bench_sweep_buf, 0, bench_sweep_len);
+    }
+
+    for (i = 0; i < bench_sweep_len; i += 64) {
+        bench_sweep_buf[i]++;
+    }
+}
+
+
+/* called before every run: empties the caches for the cold modes */
+static inline void
+bench_cache_evict(void)
+{
+    if (bench_conf.cache == BENCH_CACHE_COLD_ALL) {
+        bench_cache_sweep();
+        return;
+    }
+
+    if (bench_conf.cache != BENCH_CACHE_COLD) {
+        return;
+    }
+
+#ifdef __SSE2__
+    {
+        int                  i;
+        size_t               off;
+        const char          *p;
+
+        for (i = 0; i < bench_nregions; i++) {
+            p = (const char *) bench_regions[i].data;
+
+            /* a 64 byte stride is safe: lines are no larger on x86 */
+            for (off = 0; off < bench_regions[i].len; off += 64) {
+                _mm_clflush(p + off);
+            }
+
+            _mm_clflush(p + bench_regions[i].len - 1);
+        }
+
+        _mm_mfence();
+    }
+#else
+    bench_cache_sweep();
+#endif
+}
+
+
+/* starts the timing of an engine; repeat is the minimum number of runs */
+static inline void
+bench_stats_init(bench_stats_t *st, int repeat)
+{
+    st->n = 0;
+    st->warmup = bench_conf.warmup > 0 ? bench_conf.warmup : 0;
+    st->min_runs = repeat > 0 ? repeat : 1;
+    st->spent = 0;
+    st->sum = 0;
+    st->sumsq = 0;
+    st->samples = bench_samples;
+    st->energy[0] = 0;
+    st->energy[1] = 0;
+}
+
+
+static inline int
+bench_cmp_double(const void *a, const void *b)
+{
+    double  x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+static inline int
+bench_stats_stored(bench_stats_t *st)
+{
+    return st->n < BENCH_MAX_SAMPLES ? st->n : BENCH_MAX_SAMPLES;
+}
+
+
+/* sorts the stored samples and returns the median */
+static inline double
+bench_stats_median(bench_stats_t *st)
+{
+    int  n = bench_stats_stored(st);
+
+    if (n == 0) {
+        return 0;
+    }
+
+    qsort(st->samples, n, sizeof(double), bench_cmp_double);
+
+    return n % 2 ? st->samples[n / 2]
+                 : (st->samples[n / 2 - 1] + st->samples[n / 2]) / 2;
+}
+
+
+/* the nearest-rank quantile; the samples must be sorted */
+static inline double
+bench_stats_quantile(bench_stats_t *st, double q)
+{
+    int  n = bench_stats_stored(st), k;
+
+    k = (int) ceil(q * n);
+
+    return st->samples[k > 0 ? k - 1 : 0];
+}
+
+
+/*
+ * The distribution-free 95% confidence interval of the median: the
+ * order statistics n/2 -+ 0.98 sqrt(n) (1-based). Needs 6 samples; the
+ * samples must be sorted.
+ */
+static inline int
+bench_stats_ci(bench_stats_t *st, double *lo, double *hi)
+{
+    int     n = bench_stats_stored(st), j, k;
+    double  d;
+
+    if (n < 6) {
+        return -1;
+    }
+
+    d = 0.98 * sqrt((double) n);
+    j = (int) floor(n / 2.0 - d);
+    k = (int) ceil(n / 2.0 + 1 + d);
+
+    if (j < 1) {
+        j = 1;
+    }
+
+    if (k > n) {
+        k = n;
+    }
+
+    *lo = st->samples[j - 1];
+    *hi = st->samples[k - 1];
+
+    return 0;
+}
+
+
+/* the half width of the confidence interval relative to the median, or
+ * a negative value when there are too few samples */
+static inline double
+bench_stats_rel_ci(bench_stats_t *st)
+{
+    double  median, lo, hi;
+
+    median = bench_stats_median(st);
+
+    if (bench_stats_ci(st, &lo, &hi) != 0) {
+        return -1;
+    }
+
+    return median > 0 ? (hi - lo) / 2 / median : 0;
+}
+
+
+/* readies the next run: the caches, and the energy counters */
+static inline void
+bench_stats_start(bench_stats_t *st)
+{
+    bench_cache_evict();
+
+    if (bench_conf.energy) {
+        st->energy_begin[ENERGY_PACKAGE] = get_energy(ENERGY_PACKAGE, 0);
+        st->energy_begin[ENERGY_DRAM] = get_energy(ENERGY_DRAM, 0);
+    }
+}
+
+
+/* returns 1 while the engine should be run (and timed) once more */
+static inline int
+bench_stats_next(bench_stats_t *st)
+{
+    double  rel;
+
+    if (st->warmup > 0 || st->n < st->min_runs) {
+        bench_stats_start(st);
+        return 1;
+    }
+
+    if (bench_conf.ci <= 0 || st->n >= bench_conf.max_runs
+        || st->spent >= bench_conf.budget)
+    {
+        return 0;
+    }
+
+    rel = bench_stats_rel_ci(st);
+    if (rel >= 0 && rel * 100 <= bench_conf.ci) {
+        return 0;
+    }
+
+    bench_stats_start(st);
+    return 1;
+}
+
+
+/* records the time of a run in seconds; warm-up runs are dropped */
+static inline void
+bench_stats_add(bench_stats_t *st, double elapsed)
+{
+    int     d;
+    double  now, joules;
+
+    for (d = ENERGY_PACKAGE; bench_conf.energy && d <= ENERGY_DRAM; d++) {
+        now = get_energy(d, 0);
+        if (now < 0 || st->energy_begin[d] < 0) {
+            continue;
+        }
+
+        joules = now - st->energy_begin[d];
+
+        /* a counter wrapped around during the run */
+        if (joules < 0) {
+            joules += bench_energy_range[d];
+        }
+
+        if (st->warmup == 0) {
+            st->energy[d] += joules;
+        }
+    }
+
+    if (st->warmup > 0) {
+        st->warmup--;
+        return;
+    }
+
+    if (st->n < BENCH_MAX_SAMPLES) {
+        st->samples[st->n] = elapsed;
+    }
+
+    st->n++;
+    st->spent += elapsed;
+    st->sum += elapsed;
+    st->sumsq += elapsed * elapsed;
+}
+
+
+/*
+ * Prints a "# energy:" line with the mean joules of a run read from the
+ * package and DRAM counters, the whole machine's, and the joules per GB
+ * of the input file, the first buffer the drivers register with
+ * bench_cache_add().
+ */
+static inline void
+bench_energy_print(bench_stats_t *st)
+{
+    double  pkg, dram, bytes;
+
+    if (!bench_conf.energy || st->n == 0) {
+        return;
+    }
+
+    pkg = st->energy[ENERGY_PACKAGE] / st->n;
+    dram = bench_energy_range[ENERGY_DRAM] > 0
+           ? st->energy[ENERGY_DRAM] / st->n : 0;
+    bytes = bench_nregions ? (double) bench_regions[0].len : 0;
+
+    printf("# energy: %.4lf J package, ", pkg);
+
+    if (bench_energy_range[ENERGY_DRAM] > 0) {
+        printf("%.4lf J dram", dram);
+
+    } else {
+        printf("dram n/a");
+    }
+
+    printf(" per run");
+
+    if (bytes > 0) {
+        printf(", %.3lf J/GB", (pkg + dram) / bytes * 1e9);
+    }
+
+    printf("\n");
+}
+
+
+/*
+ * Prints the summary as a "# stats:" line (ignored by gen-plot.pl):
+ * min, median with its confidence interval, mean, standard deviation,
+ * 95th percentile and the number of outliers beyond Tukey's fences
+ * (1.5 IQR outside the quartiles).
+ */
+static inline void
+bench_stats_print(bench_stats_t *st)
+{
+    int      n = bench_stats_stored(st), i, outliers = 0;
+    double   median, mean, var, sd, p95, q1, q3, iqr, lo, hi, rel = -1;
+
+    if (st->n == 0) {
+        return;
+    }
+
+    median = bench_stats_median(st);
+    mean = st->sum / st->n;
+    var = st->n > 1 ? (st->sumsq - st->n * mean * mean) / (st->n - 1) : 0;
+    sd = var > 0 ? sqrt(var) : 0;
+
+    p95 = bench_stats_quantile(st, 0.95);
+    q1 = bench_stats_quantile(st, 0.25);
+    q3 = bench_stats_quantile(st, 0.75);
+    iqr = q3 - q1;
+
+    for (i = 0; i < n; i++) {
+        if (st->samples[i] < q1 - 1.5 * iqr
+            || st->samples[i] > q3 + 1.5 * iqr)
+        {
+            outliers++;
+        }
+    }
+
+    printf("# stats: %d runs, min %.05lf, median %.05lf", st->n,
+           st->samples[0] * 1e3, median * 1e3);
+
+    if (bench_stats_ci(st, &lo, &hi) == 0) {
+        rel = median > 0 ? (hi - lo) / 2 / median : 0;
+        printf(" (95%% ci %.05lf..%.05lf, +-%.2lf%%)", lo * 1e3, hi * 1e3,
+               rel * 100);
+    }
+
+    printf(", mean %.05lf, sd %.05lf, p95 %.05lf ms, %d outliers", mean * 1e3,
+           sd * 1e3, p95 * 1e3, outliers);
+
+    if (bench_conf.ci > 0 && (rel < 0 || rel * 100 > bench_conf.ci)) {
+        printf(", ci target %.2lf%% missed", bench_conf.ci);
+    }
+
+    printf("\n");
+
+    bench_energy_print(st);
+}
+
+
+/* parses --offsets into offsets[]; returns their number */
+static inline int
+bench_latency_offsets(size_t *offsets)
+{
+    int          n = 0;
+    char        *end;
+    const char  *p = bench_conf.offsets;
+
+    while (*p && n < BENCH_MAX_OFFSETS) {
+        if (strncmp(p, "none", sizeof("none") - 1) == 0) {
+            offsets[n] = BENCH_NO_OFFSET;
+            end = (char *) p + sizeof("none") - 1;
+
+        } else {
+            offsets[n] = strtoul(p, &end, 10);
+            if (end == p) {
+                fprintf(stderr, "bad offset list: %s\n", bench_conf.offsets);
+                exit(1);
+            }
+
+            if (*end == 'k' || *end == 'K') {
+                offsets[n] *= 1024;
+                end++;
+
+            } else if (*end == 'm' || *end == 'M') {
+                offsets[n] *= 1024 * 1024;
+                end++;
+            }
+        }
+
+        n++;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return n;
+}
+
+
+/*
+ * Builds the subjects for one offset: windows of the input at different
+ * places, each with the planted text at the offset and a short tail
+ * after it. Subjects without a match are as long as the ones for the
+ * largest offset. The input should not match by itself; the drivers
+ * count the calls that match early. The subjects take at most
+ * BENCH_SUBJECT_ARENA bytes and are reused round robin.
+ */
+static inline void
+bench_subjects_init(bench_subjects_t *s, const unsigned char *input,
+    size_t len, size_t offset, size_t max_offset)
+{
+    int      i;
+    size_t   plen = strlen(bench_conf.plant), j, from;
+
+    s->offset = offset;
+    s->len = (offset == BENCH_NO_OFFSET ? max_offset : offset) + plen
+             + BENCH_SUBJECT_TAIL;
+
+    s->n = BENCH_SUBJECT_ARENA / s->len;
+    if (s->n > bench_conf.calls) {
+        s->n = bench_conf.calls;
+    }
+
+    if (s->n == 0) {
+        s->n = 1;
+    }
+
+    s->data = (unsigned char *) malloc(s->n * s->len);
+    if (s->data == NULL) {
+        fprintf(stderr, "failed to allocate %lu bytes.\n",
+                (unsigned long) (s->n * s->len));
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    for (i = 0; i < s->n; i++) {
+        unsigned char  *d = s->data + i * s->len;
+
+        from = len ? (size_t) i * 4099 % len : 0;
+
+        for (j = 0; j < s->len; j++) {
+            d[j] = len ? input[(from + j) % len] : ' ';
+        }
+
+        if (offset != BENCH_NO_OFFSET) {
+            memcpy(d + offset, bench_conf.plant, plen);
+        }
+    }
+}
+
+
+static inline const unsigned char *
+bench_subject(bench_subjects_t *s, int i)
+{
+    return s->data + (size_t) (i % s->n) * s->len;
+}
+
+
+static inline void
+bench_subjects_free(bench_subjects_t *s)
+{
+    free(s->data);
+    s->data = NULL;
+}
+
+
+/* returns 1 while another call should be timed: --calls of them, but
+ * no more than the --budget allows after the first 100 */
+static inline int
+bench_latency_next(bench_stats_t *st)
+{
+    if (st->warmup > 0) {
+        return 1;
+    }
+
+    if (st->n >= bench_conf.calls) {
+        return 0;
+    }
+
+    return st->n < 100 || st->spent < bench_conf.budget;
+}
+
+
+/*
+ * Ends the line of an engine in the latency mode with the percentiles of
+ * the calls, in microseconds, and prints their histogram in power of 2
+ * nanosecond buckets as a "# hist:" line. missed counts the calls that
+ * found no match at the planted offset and early the calls that matched
+ * before it.
+ */
+static inline void
+bench_latency_print(bench_stats_t *st, bench_subjects_t *s, int missed,
+    int early)
+{
+    int          i, n = bench_stats_stored(st), b, nb = 0, count[64];
+    const char  *sep = "";
+
+    if (st->n == 0) {
+        printf("no calls\n");
+        return;
+    }
+
+    bench_stats_median(st);
+
+    if (s->offset == BENCH_NO_OFFSET) {
+        printf("%s in %lu bytes", missed == st->n ? "no match" : "match",
+               (unsigned long) s->len);
+
+    } else {
+        printf("%s at %lu", missed == st->n ? "no match" : "match",
+               (unsigned long) s->offset);
+    }
+
+    printf(": p50 %.03lf us, p99 %.03lf us, p999 %.03lf us, max %.03lf us "
+           "(%d calls over %d subjects, setup %s",
+           bench_stats_quantile(st, 0.5) * 1e6,
+           bench_stats_quantile(st, 0.99) * 1e6,
+           bench_stats_quantile(st, 0.999) * 1e6,
+           st->samples[n - 1] * 1e6, st->n, s->n,
+           bench_conf.setup ? "included" : "excluded");
+
+    if (s->offset != BENCH_NO_OFFSET && missed) {
+        printf(", %d missed", missed);
+    }
+
+    if (early) {
+        printf(", %d matched early", early);
+    }
+
+    printf(").\n");
+
+    memset(count, 0, sizeof(count));
+
+    for (i = 0; i < n; i++) {
+        double  ns = st->samples[i] * 1e9;
+
+        for (b = 0; b < 63 && ns >= 2; b++) {
+            ns /= 2;
+        }
+
+        count[b]++;
+
+        if (b + 1 > nb) {
+            nb = b + 1;
+        }
+    }
+
+    printf("# hist:");
+
+    for (b = 0; b < nb; b++) {
+        if (count[b]) {
+            printf("%s %.0lf-%.0lf ns %d", sep, b ? ldexp(1, b) : 0,
+                   ldexp(1, b + 1), count[b]);
+            sep = ",";
+        }
+    }
+
+    printf("\n");
+}
+
+
+static inline void
+bench_barrier_init(bench_barrier_t *b, int count)
+{
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_cond_init(&b->cond, NULL);
+    b->count = count;
+    b->waiting = 0;
+    b->gen = 0;
+}
+
+
+static inline void
+bench_barrier_destroy(bench_barrier_t *b)
+{
+    pthread_cond_destroy(&b->cond);
+    pthread_mutex_destroy(&b->mutex);
+}
+
+
+/* pthread_barrier_t is missing on Darwin */
+static inline void
+bench_barrier_wait(bench_barrier_t *b)
+{
+    unsigned  gen;
+
+    pthread_mutex_lock(&b->mutex);
+
+    gen = b->gen;
+
+    if (++b->waiting == b->count) {
+        b->waiting = 0;
+        b->gen++;
+        pthread_cond_broadcast(&b->cond);
+
+    } else {
+        while (gen == b->gen) {
+            pthread_cond_wait(&b->cond, &b->mutex);
+        }
+    }
+
+    pthread_mutex_unlock(&b->mutex);
+}
+
+
+/* the CPU time and the voluntary context switches of the calling thread */
+static inline void
+bench_thread_usage(double *cpu, long *switches)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec  ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        *cpu = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    } else {
+        *cpu = -1;
+    }
+#else
+    *cpu = -1;
+#endif
+
+#ifdef RUSAGE_THREAD
+    {
+        struct rusage  ru;
+
+        *switches = getrusage(RUSAGE_THREAD, &ru) == 0 ? ru.ru_nvcsw : -1;
+    }
+#else
+    *switches = -1;
+#endif
+}
+
+
+/* the resident set size in bytes, or 0 when unknown */
+static inline size_t
+bench_rss(void)
+{
+#ifdef __linux__
+    char           buf[128];
+    unsigned long  size, resident;
+
+    if (bench_read_line("/proc/self/statm", buf, sizeof(buf)) == 0
+        && sscanf(buf, "%lu %lu", &size, &resident) == 2)
+    {
+        return (size_t) resident * (size_t) sysconf(_SC_PAGESIZE);
+    }
+#endif
+
+    return 0;
+}
+
+
+/*
+ * Gives each of max workers a private copy of the input; the driver then
+ * sets the workers' ctx before every bench_pool_run().
+ */
+static inline void
+bench_pool_init(bench_pool_t *pool, bench_scan_pt scan,
+    const unsigned char *input, size_t len, int max)
+{
+    int  i;
+
+    memset(pool, 0, sizeof(bench_pool_t));
+
+    pool->scan = scan;
+    pool->len = len;
+    pool->max = max < BENCH_MAX_THREADS ? max : BENCH_MAX_THREADS;
+
+    for (i = 0; i < pool->max; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].data = (unsigned char *) malloc(len ? len : 1);
+        if (pool->workers[i].data == NULL) {
+            fprintf(stderr, "failed to allocate %lu bytes.\n",
+                    (unsigned long) len);
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        memcpy(pool->workers[i].data, input, len);
+    }
+}
+
+
+static inline void
+bench_pool_free(bench_pool_t *pool)
+{
+    int  i;
+
+    for (i = 0; i < pool->max; i++) {
+        free(pool->workers[i].data);
+    }
+}
+
+
+static inline void *
+bench_pool_worker(void *arg)
+{
+    bench_worker_t  *w = (bench_worker_t *) arg;
+    bench_pool_t    *pool = w->pool;
+    double           begin, cpu0, cpu1;
+    long             sw0, sw1;
+
+#ifdef __linux__
+    /* the threads inherit the pinning of the process: spread them out
+     * over the CPUs from --pin on instead */
+    if (bench_conf.pin >= 0) {
+        cpu_set_t  set;
+        long       ncpus = sysconf(_SC_NPROCESSORS_CONF);
+
+        CPU_ZERO(&set);
+        CPU_SET((bench_conf.pin + (int) (w - pool->workers))
+                % (ncpus > 0 ? ncpus : 1), &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+
+    for ( ;; ) {
+        bench_barrier_wait(&pool->start);
+
+        if (pool->stop) {
+            break;
+        }
+
+        bench_thread_usage(&cpu0, &sw0);
+        begin = get_wall_time();
+
+        w->matches = pool->scan(w->ctx, w->data, pool->len);
+
+        w->wall += get_wall_time() - begin;
+        bench_thread_usage(&cpu1, &sw1);
+
+        w->cpu = cpu0 < 0 || w->cpu < 0 ? -1 : w->cpu + cpu1 - cpu0;
+        w->switches = sw0 < 0 || w->switches < 0
+                      ? -1 : w->switches + sw1 - sw0;
+
+        bench_barrier_wait(&pool->done);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Times rounds in which n threads each scan their own copy of the input
+ * once, with the usual stopping rules, and prints the median round after
+ * the engine name as well as a "# threads:" line with the aggregate
+ * throughput, the speedup over the last run with 1 thread, and the share
+ * of the scanning time the threads spent off the CPU along with their
+ * voluntary context switches: blocking on a lock shows up in both, while
+ * spinning does not.
+ */
+static inline void
+bench_pool_run(bench_pool_t *pool, int n, int repeat)
+{
+    int              i, matches = 0, rounds = 0;
+    long             switches = 0;
+    double           begin, wall = 0, cpu = 0, rate, median;
+    bench_stats_t    st;
+    bench_worker_t  *w;
+
+    if (n > pool->max) {
+        n = pool->max;
+    }
+
+    bench_barrier_init(&pool->start, n + 1);
+    bench_barrier_init(&pool->done, n + 1);
+    pool->stop = 0;
+
+    for (i = 0; i < n; i++) {
+        w = &pool->workers[i];
+        w->matches = 0;
+        w->wall = 0;
+        w->cpu = 0;
+        w->switches = 0;
+
+        if (pthread_create(&w->tid, NULL, bench_pool_worker, w) != 0) {
+            fprintf(stderr, "failed to create thread %d\n", i);
+            exit(2);
+        }
+    }
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        begin = get_wall_time();
+
+        bench_barrier_wait(&pool->start);
+        bench_barrier_wait(&pool->done);
+
+        bench_stats_add(&st, get_wall_time() - begin);
+        rounds++;
+    }
+
+    pool->stop = 1;
+    bench_barrier_wait(&pool->start);
+
+    for (i = 0; i < n; i++) {
+        w = &pool->workers[i];
+
+        pthread_join(w->tid, NULL);
+
+        matches += w->matches;
+        wall += w->wall;
+
+        cpu = cpu < 0 || w->cpu < 0 ? -1 : cpu + w->cpu;
+        switches = switches < 0 || w->switches < 0
+                   ? -1 : switches + w->switches;
+    }
+
+    bench_barrier_destroy(&pool->start);
+    bench_barrier_destroy(&pool->done);
+
+    median = bench_stats_median(&st);
+    rate = median > 0 ? n * pool->len / median : 0;
+
+    if (n == 1) {
+        pool->base = rate;
+    }
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           matches ? "match" : "no match", median * 1e3, matches, st.n);
+
+    printf("# threads: %d x %lu bytes, %.1lf MB/s", n,
+           (unsigned long) pool->len, rate / 1e6);
+
+    if (pool->base > 0) {
+        printf(", %.2lfx of 1 thread (%.0lf%% efficiency)",
+               rate / pool->base, rate / pool->base / n * 100);
+    }
+
+    if (cpu >= 0 && wall > 0) {
+        printf(", %.1lf%% off cpu", cpu < wall ? (1 - cpu / wall) * 100 : 0);
+    }
+
+    if (switches >= 0 && rounds) {
+        printf(", %.1lf voluntary switches per round",
+               (double) switches / rounds);
+    }
+
+    printf("\n");
+
+    bench_stats_print(&st);
+}
+
+
+/* the thread count after n in 1, 2, 4 ... --threads, or 0 after the last */
+static inline int
+bench_pool_next_threads(int n)
+{
+    if (n >= bench_conf.threads) {
+        return 0;
+    }
+
+    return n * 2 < bench_conf.threads ? n * 2 : bench_conf.threads;
+}
+
+
+/*
+ * Prints a "# memory:" line: the bytes the driver knows its compiled
+ * objects and per-thread state to take (0 when it cannot tell) and the
+ * growth of the resident set since rss was taken, which also covers
+ * caches built lazily during the scans (the RE2 DFA).
+ */
+static inline void
+bench_pool_print_memory(const char *objects, int n, size_t compiled,
+    size_t rss)
+{
+    size_t  now = bench_rss();
+
+    printf("# memory: %s objects, %d threads: ", objects, n);
+
+    if (compiled) {
+        printf("compiled %.1lf KB, ", compiled / 1024.0);
+
+    } else {
+        printf("compiled n/a, ");
+    }
+
+    if (now && rss) {
+        printf("rss %+.1lf KB\n", ((double) now - (double) rss) / 1024);
+
+    } else {
+        printf("rss n/a\n");
+    }
+}
+
+
+/* the stream count after n in 1, 10, 100 ... --streams, or 0 after the
+ * last */
+static inline int
+bench_streams_next_count(int n)
+{
+    if (n >= bench_conf.streams) {
+        return 0;
+    }
+
+    return n * 10 < bench_conf.streams ? n * 10 : bench_conf.streams;
+}
+
+
+/*
+ * Splits the input among n streams. The drivers feed round 0 of every
+ * stream, then round 1 and so on, so that consecutive calls touch the
+ * state of different streams like a proxy serving many slow connections.
+ */
+static inline void
+bench_streams_init(bench_streams_t *ss, size_t len, int n)
+{
+    size_t  longest;
+
+    ss->n = n;
+    ss->len = len;
+    ss->chunk = (size_t) bench_conf.chunk;
+
+    longest = (len + n - 1) / n;
+    ss->rounds = (longest + ss->chunk - 1) / ss->chunk;
+
+    if (ss->rounds == 0) {
+        ss->rounds = 1;
+    }
+}
+
+
+/*
+ * The chunk of stream s in round r: sets *off to its offset in the input
+ * and *eof on the last chunk of the stream, and returns its length. A
+ * stream whose body is already done returns 0 with *eof unset, while an
+ * empty body returns 0 with *eof set in round 0.
+ */
+static inline size_t
+bench_stream_chunk(bench_streams_t *ss, int s, size_t r, size_t *off,
+    int *eof)
+{
+    size_t  begin, end, pos;
+
+    begin = (size_t) s * ss->len / ss->n;
+    end = (size_t) (s + 1) * ss->len / ss->n;
+    pos = begin + r * ss->chunk;
+
+    *eof = 0;
+
+    if (pos >= end) {
+        *off = end;
+        *eof = r == 0;
+        return 0;
+    }
+
+    *off = pos;
+
+    if (end - pos <= ss->chunk) {
+        *eof = 1;
+        return end - pos;
+    }
+
+    return ss->chunk;
+}
+
+
+#ifdef __linux__
+
+static inline int
+bench_perf_event(unsigned type, unsigned long long config)
+{
+    struct perf_event_attr  attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#endif
+
+
+/* opens the counters; they stay at -1 when perf events are unavailable,
+ * e.g. under a perf_event_paranoid setting above 2 or in a container */
+static inline void
+bench_perf_open(bench_perf_t *perf)
+{
+    perf->fd[0] = -1;
+    perf->fd[1] = -1;
+    perf->count[0] = 0;
+    perf->count[1] = 0;
+
+#ifdef __linux__
+    perf->fd[0] = bench_perf_event(PERF_TYPE_HARDWARE,
+                                   PERF_COUNT_HW_CACHE_MISSES);
+    perf->fd[1] = bench_perf_event(PERF_TYPE_HW_CACHE,
+                                   PERF_COUNT_HW_CACHE_L1D
+                                   | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                   | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#endif
+}
+
+
+static inline void
+bench_perf_close(bench_perf_t *perf)
+{
+#ifdef __linux__
+    int  i;
+
+    for (i = 0; i < 2; i++) {
+        if (perf->fd[i] >= 0) {
+            close(perf->fd[i]);
+        }
+    }
+#endif
+}
+
+
+static inline void
+bench_perf_start(bench_perf_t *perf)
+{
+#ifdef __linux__
+    int  i;
+
+    for (i = 0; i < 2; i++) {
+        if (perf->fd[i] >= 0) {
+            ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+
+/* adds the events since bench_perf_start() to the counts */
+static inline void
+bench_perf_stop(bench_perf_t *perf)
+{
+#ifdef __linux__
+    int                  i;
+    unsigned long long   v;
+
+    for (i = 0; i < 2; i++) {
+        if (perf->fd[i] >= 0) {
+            ioctl(perf->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            if (read(perf->fd[i], &v, sizeof(v)) == sizeof(v)) {
+                perf->count[i] += v;
+            }
+        }
+    }
+#endif
+}
+
+
+/*
+ * Prints a "# streams:" line after the engine's result line: the
+ * throughput of the bytes fed in a pass (streams stop at their first
+ * match without -g) at the median time, the bytes of match state per
+ * stream (as the engine reports them where it can, else the growth of
+ * the resident set while the streams were opened), and the cache misses
+ * per KB fed over the given number of passes.
+ */
+static inline void
+bench_streams_print(bench_streams_t *ss, double median, size_t fed,
+    double state, bench_perf_t *perf, int passes)
+{
+    int          i;
+    double       kb = (double) fed * passes / 1024;
+    const char  *names[] = { "llc", "l1d" };
+
+    printf("# streams: %d x %lu bytes in %lu byte chunks, %lu bytes fed, "
+           "%.1lf MB/s, %.0lf bytes of state per stream", ss->n,
+           (unsigned long) (ss->len / ss->n), (unsigned long) ss->chunk,
+           (unsigned long) fed, median > 0 ? fed / median / 1e6 : 0,
+           state);
+
+    for (i = 0; i < 2; i++) {
+        if (perf->fd[i] >= 0 && kb > 0) {
+            printf(", %.2lf %s misses per KB", perf->count[i] / kb,
+                   names[i]);
+
+        } else {
+            printf(", %s misses n/a", names[i]);
+        }
+    }
+
+    printf("\n");
+}
+
+
+#ifdef BENCH_HAVE_IO_URING
+
+/* maps the rings; returns -1 when io_uring is unavailable */
+static inline int
+bench_uring_init(bench_reader_t *rd)
+{
+    unsigned char           *sq, *cq;
+    struct io_uring_params   params;
+
+    memset(&params, 0, sizeof(params));
+
+    rd->ring_fd = (int) syscall(__NR_io_uring_setup, BENCH_MAX_BUFFERS,
+                                &params);
+    if (rd->ring_fd < 0) {
+        return -1;
+    }
+
+    rd->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    rd->cq_len = params.cq_off.cqes
+                 + params.cq_entries * sizeof(struct io_uring_cqe);
+    rd->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    rd->sq_ptr = mmap(NULL, rd->sq_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, rd->ring_fd,
+                      IORING_OFF_SQ_RING);
+    rd->cq_ptr = mmap(NULL, rd->cq_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, rd->ring_fd,
+                      IORING_OFF_CQ_RING);
+    rd->sqes = mmap(NULL, rd->sqes_len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, rd->ring_fd,
+                    IORING_OFF_SQES);
+
+    if (rd->sq_ptr == MAP_FAILED || rd->cq_ptr == MAP_FAILED
+        || rd->sqes == MAP_FAILED)
+    {
+        close(rd->ring_fd);
+        return -1;
+    }
+
+    sq = (unsigned char *) rd->sq_ptr;
+    cq = (unsigned char *) rd->cq_ptr;
+
+    rd->sq_head = (unsigned *) (sq + params.sq_off.head);
+    rd->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    rd->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    rd->sq_array = (unsigned *) (sq + params.sq_off.array);
+    rd->cq_head = (unsigned *) (cq + params.cq_off.head);
+    rd->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    rd->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    rd->cqes = cq + params.cq_off.cqes;
+
+    return 0;
+}
+
+
+/* queues a read of the rest of a slot; bench_uring_enter() submits it */
+static inline void
+bench_uring_read(bench_reader_t *rd, int i)
+{
+    unsigned              tail, idx;
+    bench_slot_t         *slot = &rd->slots[i];
+    struct io_uring_sqe  *sqe;
+
+    tail = *rd->sq_tail;
+    idx = tail & *rd->sq_mask;
+    sqe = &((struct io_uring_sqe *) rd->sqes)[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = rd->fd;
+    sqe->addr = (unsigned long) (slot->data + slot->len);
+    sqe->len = (unsigned) (slot->want - slot->len);
+    sqe->off = (unsigned long long) (slot->off + slot->len);
+    sqe->user_data = (unsigned long long) i;
+
+    rd->sq_array[idx] = idx;
+    __atomic_store_n(rd->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    slot->state = BENCH_SLOT_READING;
+    rd->pending++;
+}
+
+
+/* submits the queued reads and, with wait set, reaps at least one
+ * completion */
+static inline void
+bench_uring_enter(bench_reader_t *rd, int wait)
+{
+    int                   i;
+    long                  rc;
+    unsigned              head;
+    bench_slot_t         *slot;
+    struct io_uring_cqe  *cqe;
+
+    if (rd->pending || wait) {
+        rc = syscall(__NR_io_uring_enter, rd->ring_fd, rd->pending,
+                     wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0,
+                     NULL, 0);
+        if (rc < 0) {
+            perror("io_uring_enter");
+            exit(2);
+        }
+
+        rd->pending -= (int) rc < rd->pending ? (int) rc : rd->pending;
+    }
+
+    head = *rd->cq_head;
+
+    while (head != __atomic_load_n(rd->cq_tail, __ATOMIC_ACQUIRE)) {
+        cqe = &((struct io_uring_cqe *) rd->cqes)[head & *rd->cq_mask];
+        i = (int) cqe->user_data;
+        slot = &rd->slots[i];
+
+        if (cqe->res < 0) {
+            fprintf(stderr, "read failed: %s\n", strerror(-cqe->res));
+            exit(2);
+        }
+
+        slot->len += cqe->res;
+        head++;
+
+        if (cqe->res == 0 || slot->len == slot->want) {
+            slot->want = slot->len;
+            slot->state = BENCH_SLOT_FULL;
+
+        } else {
+            /* a short read: ask for the rest */
+            __atomic_store_n(rd->cq_head, head, __ATOMIC_RELEASE);
+            bench_uring_read(rd, i);
+            head = *rd->cq_head;
+            continue;
+        }
+    }
+
+    __atomic_store_n(rd->cq_head, head, __ATOMIC_RELEASE);
+}
+
+#endif /* BENCH_HAVE_IO_URING */
+
+
+/* assigns the next part of the file to a slot, or marks it as the end */
+static inline int
+bench_reader_assign(bench_reader_t *rd, int i)
+{
+    bench_slot_t  *slot = &rd->slots[i];
+
+    slot->len = 0;
+    slot->off = rd->next_off;
+
+    if (rd->next_off >= rd->file_size) {
+        slot->want = 0;
+        slot->state = BENCH_SLOT_FULL;
+        return 0;
+    }
+
+    slot->want = rd->file_size - rd->next_off < (off_t) rd->size
+                 ? (size_t) (rd->file_size - rd->next_off) : rd->size;
+    rd->next_off += slot->want;
+
+    return 1;
+}
+
+
+/* the pread() backend: fills the slots in order, one pass of the file */
+static inline void *
+bench_reader_thread(void *arg)
+{
+    int              i = 0, more;
+    ssize_t          n;
+    bench_reader_t  *rd = (bench_reader_t *) arg;
+    bench_slot_t    *slot;
+
+    do {
+        slot = &rd->slots[i];
+
+        pthread_mutex_lock(&rd->mutex);
+
+        while (slot->state != BENCH_SLOT_EMPTY) {
+            pthread_cond_wait(&rd->cond, &rd->mutex);
+        }
+
+        more = bench_reader_assign(rd, i);
+        if (more) {
+            slot->state = BENCH_SLOT_READING;
+        }
+
+        pthread_mutex_unlock(&rd->mutex);
+
+        while (more && slot->len < slot->want) {
+            n = pread(rd->fd, slot->data + slot->len, slot->want - slot->len,
+                      slot->off + slot->len);
+            if (n < 0) {
+                perror("pread");
+                exit(2);
+            }
+
+            if (n == 0) {
+                slot->want = slot->len;
+                break;
+            }
+
+            slot->len += n;
+        }
+
+        pthread_mutex_lock(&rd->mutex);
+        slot->state = BENCH_SLOT_FULL;
+        pthread_cond_broadcast(&rd->cond);
+        pthread_mutex_unlock(&rd->mutex);
+
+        i = (i + 1) % rd->nslots;
+
+    } while (more);
+
+    return NULL;
+}
+
+
+/* tells a compressed file by its suffix */
+static inline int
+bench_source_type(const char *path)
+{
+    size_t  len = strlen(path);
+
+    if (len > 3 && strcmp(path + len - 3, ".gz") == 0) {
+        return BENCH_SOURCE_GZIP;
+    }
+
+    if (len > 4 && strcmp(path + len - 4, ".zst") == 0) {
+        return BENCH_SOURCE_ZSTD;
+    }
+
+    return BENCH_SOURCE_RAW;
+}
+
+
+/* sets up the decompressor; always in the reader thread */
+static inline void
+bench_source_open(bench_reader_t *rd)
+{
+    rd->csize = rd->file_size;
+    rd->file_size = 0;
+    rd->io = BENCH_IO_PREAD;
+
+    rd->in = (unsigned char *) malloc(BENCH_SOURCE_INBUF);
+    if (rd->in == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    if (rd->source == BENCH_SOURCE_GZIP) {
+#ifdef BENCH_HAVE_ZLIB
+        rd->zs = calloc(1, sizeof(z_stream));
+
+        /* 32: a gzip or a zlib header */
+        if (rd->zs == NULL
+            || inflateInit2((z_stream *) rd->zs, 15 + 32) != Z_OK)
+        {
+            fprintf(stderr, "zlib cannot allocate a stream\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        return;
+#endif
+
+    } else {
+#ifdef BENCH_HAVE_ZSTD
+        rd->zdctx = ZSTD_createDCtx();
+        if (rd->zdctx == NULL) {
+            fprintf(stderr, "zstd cannot allocate a context\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        return;
+#endif
+    }
+
+    fprintf(stderr, "built without %s support: see BENCH_HAVE_%s in the "
+            "Makefile\n", rd->source == BENCH_SOURCE_GZIP ? "gzip" : "zstd",
+            rd->source == BENCH_SOURCE_GZIP ? "ZLIB" : "ZSTD");
+    exit(1);
+}
+
+
+/*
+ * Decompresses up to size more bytes; returns 0 at the end of the file.
+ * A file ending inside a gzip member or zstd frame is an error.
+ */
+static inline size_t
+bench_source_decode(bench_reader_t *rd, unsigned char *out, size_t size)
+{
+    ssize_t  n;
+
+    for ( ;; ) {
+        if (rd->in_pos == rd->in_len && !rd->in_eof) {
+            n = read(rd->fd, rd->in, BENCH_SOURCE_INBUF);
+            if (n < 0) {
+                perror("read file");
+                exit(2);
+            }
+
+            rd->in_eof = n == 0;
+            rd->in_len = n;
+            rd->in_pos = 0;
+        }
+
+#ifdef BENCH_HAVE_ZLIB
+        if (rd->source == BENCH_SOURCE_GZIP) {
+            int        rc;
+            z_stream  *zs = (z_stream *) rd->zs;
+
+            zs->next_in = rd->in + rd->in_pos;
+            zs->avail_in = (uInt) (rd->in_len - rd->in_pos);
+            zs->next_out = out;
+            zs->avail_out = (uInt) size;
+
+            rc = inflate(zs, Z_NO_FLUSH);
+
+            if (rc == Z_STREAM_END) {
+                rd->in_frame = 0;
+
+            } else if (rd->in_pos < rd->in_len) {
+                rd->in_frame = 1;
+            }
+
+            rd->in_pos = rd->in_len - zs->avail_in;
+
+            if (rc == Z_STREAM_END
+                && (rd->in_pos < rd->in_len || !rd->in_eof))
+            {
+                /* concatenated gzip members */
+                inflateReset(zs);
+
+            } else if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR)
+            {
+                fprintf(stderr, "zlib error: %s\n", zs->msg ? zs->msg : "?");
+                exit(2);
+            }
+
+            if (size - zs->avail_out) {
+                return size - zs->avail_out;
+            }
+        }
+#endif
+
+#ifdef BENCH_HAVE_ZSTD
+        if (rd->source == BENCH_SOURCE_ZSTD) {
+            size_t          rc;
+            ZSTD_inBuffer   in = { rd->in, rd->in_len, rd->in_pos };
+            ZSTD_outBuffer  ob = { out, size, 0 };
+
+            rc = ZSTD_decompressStream((ZSTD_DCtx *) rd->zdctx, &ob, &in);
+            if (ZSTD_isError(rc)) {
+                fprintf(stderr, "zstd error: %s\n", ZSTD_getErrorName(rc));
+                exit(2);
+            }
+
+            /* 0 once a frame is decoded and flushed */
+            if (rc == 0) {
+                rd->in_frame = 0;
+
+            } else if (in.pos > rd->in_pos || ob.pos) {
+                rd->in_frame = 1;
+            }
+
+            rd->in_pos = in.pos;
+
+            if (ob.pos) {
+                return ob.pos;
+            }
+        }
+#endif
+
+        if (rd->in_eof && rd->in_pos == rd->in_len) {
+            if (rd->in_frame) {
+                fprintf(stderr, "%s file truncated\n",
+                        rd->source == BENCH_SOURCE_GZIP ? "gzip" : "zstd");
+                exit(2);
+            }
+
+            return 0;
+        }
+    }
+}
+
+
+/* the decompressing reader thread: fills the slots in order, one pass */
+static inline void *
+bench_source_thread(void *arg)
+{
+    int              i = 0;
+    size_t           n, k;
+    off_t            total = 0;
+    bench_reader_t  *rd = (bench_reader_t *) arg;
+    bench_slot_t    *slot;
+
+    if (lseek(rd->fd, 0, SEEK_SET) != 0) {
+        perror("seek to file beginning");
+        exit(2);
+    }
+
+    rd->in_len = 0;
+    rd->in_pos = 0;
+    rd->in_eof = 0;
+    rd->in_frame = 0;
+
+#ifdef BENCH_HAVE_ZLIB
+    if (rd->zs) {
+        inflateReset((z_stream *) rd->zs);
+    }
+#endif
+
+#ifdef BENCH_HAVE_ZSTD
+    if (rd->zdctx) {
+        ZSTD_DCtx_reset((ZSTD_DCtx *) rd->zdctx, ZSTD_reset_session_only);
+    }
+#endif
+
+    do {
+        slot = &rd->slots[i];
+
+        pthread_mutex_lock(&rd->mutex);
+
+        while (slot->state != BENCH_SLOT_EMPTY) {
+            pthread_cond_wait(&rd->cond, &rd->mutex);
+        }
+
+        slot->state = BENCH_SLOT_READING;
+
+        pthread_mutex_unlock(&rd->mutex);
+
+        n = 0;
+
+        while (n < rd->size
+               && (k = bench_source_decode(rd, slot->data + n, rd->size - n)))
+        {
+            n += k;
+        }
+
+        slot->len = n;
+        slot->want = n;
+        slot->off = total;
+        total += n;
+
+        if (n == 0) {
+            rd->file_size = total;
+        }
+
+        pthread_mutex_lock(&rd->mutex);
+        slot->state = BENCH_SLOT_FULL;
+        pthread_cond_broadcast(&rd->cond);
+        pthread_mutex_unlock(&rd->mutex);
+
+        i = (i + 1) % rd->nslots;
+
+    } while (n);
+
+    return NULL;
+}
+
+
+/*
+ * Opens a file for the pipeline mode: a ring of --buffers page-aligned
+ * buffers of --buffer-size bytes each, filled by io_uring reads or, with
+ * --io=pread or where io_uring is unavailable, by a reader thread. The
+ * ring never holds more than that, whatever the size of the file.
+ */
+static inline void
+bench_reader_open(bench_reader_t *rd, const char *path)
+{
+    int          i;
+    struct stat  sb;
+
+    memset(rd, 0, sizeof(bench_reader_t));
+
+    rd->fd = open(path, O_RDONLY);
+    if (rd->fd < 0 || fstat(rd->fd, &sb) != 0) {
+        perror("open file");
+        exit(1);
+    }
+
+    rd->file_size = sb.st_size;
+    rd->nslots = bench_conf.buffers;
+    rd->size = (size_t) bench_conf.bufsize;
+    rd->io = bench_conf.io;
+    rd->source = bench_source_type(path);
+
+    for (i = 0; i < rd->nslots; i++) {
+        if (posix_memalign((void **) &rd->slots[i].data, 4096, rd->size)
+            != 0)
+        {
+            fprintf(stderr, "failed to allocate %lu bytes.\n",
+                    (unsigned long) rd->size);
+            exit(BENCH_EXIT_NOMEM);
+        }
+    }
+
+    if (rd->source != BENCH_SOURCE_RAW) {
+        bench_source_open(rd);
+    }
+
+#ifdef BENCH_HAVE_IO_URING
+    if (rd->io == BENCH_IO_URING && bench_uring_init(rd) != 0) {
+        rd->io = BENCH_IO_PREAD;
+    }
+#else
+    rd->io = BENCH_IO_PREAD;
+#endif
+
+    pthread_mutex_init(&rd->mutex, NULL);
+    pthread_cond_init(&rd->cond, NULL);
+}
+
+
+/* starts a pass over the file with reads into every buffer */
+static inline void
+bench_reader_start(bench_reader_t *rd)
+{
+    int  i;
+
+    rd->next_off = 0;
+    rd->head = 0;
+
+    for (i = 0; i < rd->nslots; i++) {
+        rd->slots[i].state = BENCH_SLOT_EMPTY;
+    }
+
+    rd->begin = get_wall_time();
+
+#ifdef BENCH_HAVE_IO_URING
+    if (rd->io == BENCH_IO_URING) {
+        for (i = 0; i < rd->nslots; i++) {
+            if (bench_reader_assign(rd, i)) {
+                bench_uring_read(rd, i);
+            }
+        }
+
+        bench_uring_enter(rd, 0);
+        return;
+    }
+#endif
+
+    if (pthread_create(&rd->tid, NULL, rd->source == BENCH_SOURCE_RAW
+                       ? bench_reader_thread : bench_source_thread, rd)
+        != 0)
+    {
+        fprintf(stderr, "failed to create the reader thread\n");
+        exit(2);
+    }
+}
+
+
+/* waits for the next buffer; returns its length, or 0 at the end */
+static inline size_t
+bench_reader_next(bench_reader_t *rd, const unsigned char **data)
+{
+    double         begin;
+    bench_slot_t  *slot = &rd->slots[rd->head];
+
+    begin = get_wall_time();
+
+#ifdef BENCH_HAVE_IO_URING
+    if (rd->io == BENCH_IO_URING) {
+        while (slot->state != BENCH_SLOT_FULL) {
+            bench_uring_enter(rd, 1);
+        }
+
+    } else
+#endif
+    {
+        pthread_mutex_lock(&rd->mutex);
+
+        while (slot->state != BENCH_SLOT_FULL) {
+            pthread_cond_wait(&rd->cond, &rd->mutex);
+        }
+
+        pthread_mutex_unlock(&rd->mutex);
+    }
+
+    rd->wait += get_wall_time() - begin;
+
+    *data = slot->data;
+    return slot->len;
+}
+
+
+/* hands the buffer from bench_reader_next() back for the next read */
+static inline void
+bench_reader_release(bench_reader_t *rd)
+{
+    int  i = rd->head;
+
+    rd->head = (rd->head + 1) % rd->nslots;
+
+#ifdef BENCH_HAVE_IO_URING
+    if (rd->io == BENCH_IO_URING) {
+        if (bench_reader_assign(rd, i)) {
+            bench_uring_read(rd, i);
+            bench_uring_enter(rd, 0);
+        }
+
+        return;
+    }
+#endif
+
+    pthread_mutex_lock(&rd->mutex);
+    rd->slots[i].state = BENCH_SLOT_EMPTY;
+    pthread_cond_broadcast(&rd->cond);
+    pthread_mutex_unlock(&rd->mutex);
+}
+
+
+/*
+ * Ends a pass, which must have read up to the end of the file, and
+ * returns its wall time.
+ */
+static inline double
+bench_reader_end(bench_reader_t *rd)
+{
+    double  elapsed;
+
+    if (rd->io == BENCH_IO_PREAD) {
+        pthread_join(rd->tid, NULL);
+    }
+
+    elapsed = get_wall_time() - rd->begin;
+
+    rd->elapsed += elapsed;
+    rd->passes++;
+
+    return elapsed;
+}
+
+
+static inline void
+bench_reader_close(bench_reader_t *rd)
+{
+    int  i;
+
+#ifdef BENCH_HAVE_IO_URING
+    if (rd->io == BENCH_IO_URING) {
+        munmap(rd->sqes, rd->sqes_len);
+        munmap(rd->cq_ptr, rd->cq_len);
+        munmap(rd->sq_ptr, rd->sq_len);
+        close(rd->ring_fd);
+    }
+#endif
+
+    for (i = 0; i < rd->nslots; i++) {
+        free(rd->slots[i].data);
+    }
+
+#ifdef BENCH_HAVE_ZLIB
+    if (rd->zs) {
+        inflateEnd((z_stream *) rd->zs);
+        free(rd->zs);
+    }
+#endif
+
+#ifdef BENCH_HAVE_ZSTD
+    if (rd->zdctx) {
+        ZSTD_freeDCtx((ZSTD_DCtx *) rd->zdctx);
+    }
+#endif
+
+    free(rd->in);
+
+    pthread_cond_destroy(&rd->cond);
+    pthread_mutex_destroy(&rd->mutex);
+    close(rd->fd);
+}
+
+
+static inline const char *
+bench_reader_backend(bench_reader_t *rd)
+{
+    return rd->source == BENCH_SOURCE_GZIP ? "gzip"
+           : rd->source == BENCH_SOURCE_ZSTD ? "zstd"
+           : rd->io == BENCH_IO_URING ? "io_uring" : "pread";
+}
+
+
+/*
+ * Prints a "# pipeline:" line: the end-to-end throughput at the median
+ * time of a pass and the shares of the time of all the passes spent
+ * waiting for reads and elsewhere (matching, mostly), along with the
+ * throughput of the matching alone.
+ */
+static inline void
+bench_reader_print(bench_reader_t *rd, double median)
+{
+    double  wait = rd->elapsed > 0 ? rd->wait / rd->elapsed : 0;
+    double  busy = rd->passes ? (rd->elapsed - rd->wait) / rd->passes : 0;
+
+    printf("# pipeline: %s, %d x %lu byte buffers, %lu bytes, %.3lf GB/s, "
+           "waiting on reads %.1lf%%, matching %.1lf%% (%.3lf and %.3lf ms "
+           "per pass, match only %.3lf GB/s)\n", bench_reader_backend(rd),
+           rd->nslots, (unsigned long) rd->size,
+           (unsigned long) rd->file_size,
+           median > 0 ? rd->file_size / median / 1e9 : 0, wait * 100,
+           (1 - wait) * 100,
+           rd->passes ? rd->wait / rd->passes * 1e3 : 0, busy * 1e3,
+           busy > 0 ? rd->file_size / busy / 1e9 : 0);
+}
+
+
+/*
+ * Times passes that only drain the ring, for the throughput of the
+ * reads or the decompression alone, and prints it in a "# source:" line.
+ * Also learns the decompressed size.
+ */
+static inline void
+bench_reader_drain(bench_reader_t *rd, int repeat)
+{
+    size_t                size;
+    double                median;
+    bench_stats_t         st;
+    const unsigned char  *p;
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        bench_reader_start(rd);
+
+        do {
+            size = bench_reader_next(rd, &p);
+            bench_reader_release(rd);
+
+        } while (size);
+
+        bench_stats_add(&st, bench_reader_end(rd));
+    }
+
+    median = bench_stats_median(&st);
+
+    printf("# source: %s, ", bench_reader_backend(rd));
+
+    if (rd->source != BENCH_SOURCE_RAW) {
+        printf("%lu compressed bytes (ratio %.2lf), ",
+               (unsigned long) rd->csize,
+               rd->csize ? (double) rd->file_size / rd->csize : 0);
+    }
+
+    printf("%lu bytes, %s only %.3lf GB/s (%.3lf ms)\n",
+           (unsigned long) rd->file_size,
+           rd->source == BENCH_SOURCE_RAW ? "read" : "decompress",
+           median > 0 ? rd->file_size / median / 1e9 : 0, median * 1e3);
+
+    rd->wait = 0;
+    rd->elapsed = 0;
+    rd->passes = 0;
+}
+
+
+/* collects the regular files under path, without following symlinks */
+static inline void
+bench_tree_walk(bench_tree_t *tree, const char *path)
+{
+    DIR            *dir;
+    char           *sub;
+    size_t          len;
+    struct stat     sb;
+    struct dirent  *de;
+
+    if (lstat(path, &sb) != 0) {
+        perror(path);
+        return;
+    }
+
+    if (S_ISREG(sb.st_mode)) {
+        if ((tree->nfiles & (tree->nfiles - 1)) == 0) {
+            tree->paths = (char **) realloc(tree->paths, (tree->nfiles
+                                            ? tree->nfiles * 2 : 1)
+                                            * sizeof(char *));
+            tree->sizes = (off_t *) realloc(tree->sizes, (tree->nfiles
+                                            ? tree->nfiles * 2 : 1)
+                                            * sizeof(off_t));
+            if (tree->paths == NULL || tree->sizes == NULL) {
+                fprintf(stderr, "failed to allocate memory\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+        }
+
+        tree->paths[tree->nfiles] = strdup(path);
+        tree->sizes[tree->nfiles] = sb.st_size;
+        tree->nfiles++;
+        tree->bytes += sb.st_size;
+        return;
+    }
+
+    if (!S_ISDIR(sb.st_mode)) {
+        return;
+    }
+
+    dir = opendir(path);
+    if (dir == NULL) {
+        perror(path);
+        return;
+    }
+
+    while ((de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+
+        len = strlen(path) + strlen(de->d_name) + 2;
+        sub = (char *) malloc(len);
+        if (sub == NULL) {
+            fprintf(stderr, "failed to allocate memory\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        snprintf(sub, len, "%s/%s", path, de->d_name);
+        bench_tree_walk(tree, sub);
+        free(sub);
+    }
+
+    closedir(dir);
+}
+
+
+/*
+ * Walks the directory tree at path and cuts its files into jobs: one per
+ * file, or one per --split bytes of the larger files. The driver then
+ * sets the workers' ctx before every bench_tree_run().
+ */
+static inline void
+bench_tree_init(bench_tree_t *tree, bench_scan_pt scan, const char *path)
+{
+    int     i, k, max;
+    off_t   off;
+
+    memset(tree, 0, sizeof(bench_tree_t));
+
+    tree->scan = scan;
+
+    bench_tree_walk(tree, path);
+
+    if (tree->nfiles == 0) {
+        fprintf(stderr, "no files found under %s\n", path);
+        exit(1);
+    }
+
+    for (i = 0; i < tree->nfiles; i++) {
+        tree->njobs += bench_conf.split && tree->sizes[i] > bench_conf.split
+                       ? (int) ((tree->sizes[i] + bench_conf.split - 1)
+                                / bench_conf.split)
+                       : 1;
+    }
+
+    tree->jobs = (bench_job_t *) calloc(tree->njobs, sizeof(bench_job_t));
+    if (tree->jobs == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    k = 0;
+
+    for (i = 0; i < tree->nfiles; i++) {
+        off = 0;
+
+        do {
+            tree->jobs[k].file = i;
+            tree->jobs[k].off = off;
+            tree->jobs[k].len = bench_conf.split
+                                && tree->sizes[i] - off > bench_conf.split
+                                ? (size_t) bench_conf.split
+                                : (size_t) (tree->sizes[i] - off);
+            off += tree->jobs[k].len;
+            k++;
+
+        } while (off < tree->sizes[i]);
+    }
+
+    max = bench_conf.threads > 1 ? bench_conf.threads : 1;
+    if (max > BENCH_MAX_THREADS) {
+        max = BENCH_MAX_THREADS;
+    }
+
+    for (i = 0; i < max; i++) {
+        tree->workers[i].tree = tree;
+        tree->workers[i].jobs = (int *) malloc(tree->njobs * sizeof(int));
+        if (tree->workers[i].jobs == NULL) {
+            fprintf(stderr, "failed to allocate memory\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        pthread_mutex_init(&tree->workers[i].mutex, NULL);
+    }
+}
+
+
+static inline void
+bench_tree_free(bench_tree_t *tree)
+{
+    int  i;
+
+    for (i = 0; i < BENCH_MAX_THREADS && tree->workers[i].jobs; i++) {
+        pthread_mutex_destroy(&tree->workers[i].mutex);
+        free(tree->workers[i].jobs);
+        free(tree->workers[i].buf);
+    }
+
+    for (i = 0; i < tree->nfiles; i++) {
+        free(tree->paths[i]);
+    }
+
+    free(tree->paths);
+    free(tree->sizes);
+    free(tree->jobs);
+}
+
+
+/* the next job of a worker from the back of its own deque, else from
+ * the front of another worker's; -1 when all are empty */
+static inline int
+bench_tree_take(bench_tree_worker_t *w)
+{
+    int                   i, k, job = -1;
+    bench_tree_t         *tree = w->tree;
+    bench_tree_worker_t  *v;
+
+    pthread_mutex_lock(&w->mutex);
+
+    if (w->tail > w->head) {
+        job = w->jobs[--w->tail];
+    }
+
+    pthread_mutex_unlock(&w->mutex);
+
+    if (job >= 0) {
+        return job;
+    }
+
+    i = (int) (w - tree->workers);
+
+    for (k = 1; k < tree->n && job < 0; k++) {
+        v = &tree->workers[(i + k) % tree->n];
+
+        pthread_mutex_lock(&v->mutex);
+
+        if (v->tail > v->head) {
+            job = v->jobs[v->head++];
+            w->steals++;
+        }
+
+        pthread_mutex_unlock(&v->mutex);
+    }
+
+    return job;
+}
+
+
+/*
+ * Reads a job into the worker's buffer and scans it. A chunk of a split
+ * file starts after the first line end at or past its offset and runs
+ * on to the first line end at or past its length, looking up to
+ * BENCH_TREE_OVERLAP bytes ahead, so that every line is scanned once.
+ */
+static inline int
+bench_tree_job(bench_tree_worker_t *w, bench_job_t *job)
+{
+    int             fd;
+    size_t          want, n = 0;
+    ssize_t         rc;
+    bench_tree_t   *tree = w->tree;
+    unsigned char  *p, *last, *nl;
+
+    want = job->len;
+    if (job->off + (off_t) job->len < tree->sizes[job->file]) {
+        want += BENCH_TREE_OVERLAP;
+    }
+
+    if (want > w->size) {
+        free(w->buf);
+
+        w->buf = (unsigned char *) malloc(want);
+        if (w->buf == NULL) {
+            fprintf(stderr, "failed to allocate %lu bytes.\n",
+                    (unsigned long) want);
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        w->size = want;
+    }
+
+    fd = open(tree->paths[job->file], O_RDONLY);
+    if (fd < 0) {
+        perror(tree->paths[job->file]);
+        return 0;
+    }
+
+    while (n < want) {
+        rc = pread(fd, w->buf + n, want - n, job->off + n);
+        if (rc <= 0) {
+            break;
+        }
+
+        n += rc;
+    }
+
+    close(fd);
+
+    p = w->buf;
+    last = w->buf + n;
+
+    if (n > job->len) {
+        nl = (unsigned char *) memchr(w->buf + job->len, '\n',
+                                      n - job->len);
+        if (nl) {
+            last = nl + 1;
+        }
+    }
+
+    if (job->off > 0) {
+        nl = (unsigned char *) memchr(p, '\n', last - p);
+        p = nl ? nl + 1 : last;
+    }
+
+    return tree->scan(w->ctx, p, last - p);
+}
+
+
+static inline void *
+bench_tree_worker(void *arg)
+{
+    int                   j;
+    double                begin;
+    bench_tree_worker_t  *w = (bench_tree_worker_t *) arg;
+    bench_tree_t         *tree = w->tree;
+
+    for ( ;; ) {
+        bench_barrier_wait(&tree->start);
+
+        if (tree->stop) {
+            break;
+        }
+
+        w->matches = 0;
+
+        while ((j = bench_tree_take(w)) >= 0) {
+            begin = get_wall_time();
+
+            w->matches += bench_tree_job(w, &tree->jobs[j]);
+
+            tree->jobs[j].elapsed = get_wall_time() - begin;
+        }
+
+        bench_barrier_wait(&tree->done);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Times passes over all the jobs in n workers, each job dealt to the
+ * workers in turn and stolen by the ones running out, and prints the
+ * median pass after the engine name as well as a "# tree:" line with the
+ * files and bytes per second and the latency of the files in the last
+ * pass: the time of their jobs, from opening the file to the end of the
+ * scan, summed over the chunks of the split ones.
+ */
+static inline void
+bench_tree_run(bench_tree_t *tree, int n, int repeat)
+{
+    int                   i, j, matches = 0, slowest = 0, passes = 0;
+    long                  steals = 0;
+    double                begin, median, *lat;
+    bench_stats_t         st;
+    bench_tree_worker_t  *w;
+
+    if (n > BENCH_MAX_THREADS || tree->workers[n - 1].jobs == NULL) {
+        n = 1;
+    }
+
+    tree->n = n;
+    tree->stop = 0;
+
+    bench_barrier_init(&tree->start, n + 1);
+    bench_barrier_init(&tree->done, n + 1);
+
+    for (i = 0; i < n; i++) {
+        w = &tree->workers[i];
+        w->steals = 0;
+
+        if (pthread_create(&w->tid, NULL, bench_tree_worker, w) != 0) {
+            fprintf(stderr, "failed to create thread %d\n", i);
+            exit(2);
+        }
+    }
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        for (i = 0; i < n; i++) {
+            tree->workers[i].head = 0;
+            tree->workers[i].tail = 0;
+        }
+
+        for (j = 0; j < tree->njobs; j++) {
+            w = &tree->workers[j % n];
+            w->jobs[w->tail++] = j;
+        }
+
+        begin = get_wall_time();
+
+        bench_barrier_wait(&tree->start);
+        bench_barrier_wait(&tree->done);
+
+        bench_stats_add(&st, get_wall_time() - begin);
+        passes++;
+    }
+
+    tree->stop = 1;
+    bench_barrier_wait(&tree->start);
+
+    for (i = 0; i < n; i++) {
+        pthread_join(tree->workers[i].tid, NULL);
+        matches += tree->workers[i].matches;
+        steals += tree->workers[i].steals;
+    }
+
+    bench_barrier_destroy(&tree->start);
+    bench_barrier_destroy(&tree->done);
+
+    lat = (double *) calloc(tree->nfiles, sizeof(double));
+    if (lat == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    for (j = 0; j < tree->njobs; j++) {
+        lat[tree->jobs[j].file] += tree->jobs[j].elapsed;
+    }
+
+    for (i = 1; i < tree->nfiles; i++) {
+        if (lat[i] > lat[slowest]) {
+            slowest = i;
+        }
+    }
+
+    median = bench_stats_median(&st);
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           matches ? "match" : "no match", median * 1e3, matches, st.n);
+
+    printf("# tree: %d files, %d jobs, %llu bytes, %d worker%s, %.0lf "
+           "files/s, %.1lf MB/s, %.1lf steals per pass, slowest file %s "
+           "%.3lf ms", tree->nfiles, tree->njobs, tree->bytes, n,
+           n == 1 ? "" : "s", median > 0 ? tree->nfiles / median : 0,
+           median > 0 ? tree->bytes / median / 1e6 : 0,
+           passes ? (double) steals / passes : 0, tree->paths[slowest],
+           lat[slowest] * 1e3);
+
+    qsort(lat, tree->nfiles, sizeof(double), bench_cmp_double);
+
+    printf(", file p50 %.3lf p99 %.3lf ms\n",
+           lat[(int) ceil(0.5 * tree->nfiles) - 1] * 1e3,
+           lat[(int) ceil(0.99 * tree->nfiles) - 1] * 1e3);
+
+    bench_stats_print(&st);
+
+    free(lat);
+}
+
+
+static inline void
+bench_out_append(bench_out_t *out, const void *p, size_t n)
+{
+    size_t  size;
+
+    if (out->len + n > out->size) {
+        size = out->size ? out->size : 4096;
+
+        while (size < out->len + n) {
+            size *= 2;
+        }
+
+        out->data = (unsigned char *) realloc(out->data, size);
+        if (out->data == NULL) {
+            fprintf(stderr, "failed to allocate %lu bytes.\n",
+                    (unsigned long) size);
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        out->size = size;
+    }
+
+    memcpy(out->data + out->len, p, n);
+    out->len += n;
+}
+
+
+/*
+ * Appends the --replace template for a match of subj: caps holds the
+ * start and end offsets of ncaps groups, group 0 being the whole match,
+ * with BENCH_NO_OFFSET for the unset ones. Groups beyond ncaps are
+ * empty.
+ */
+static inline void
+bench_out_expand(bench_out_t *out, const unsigned char *subj,
+    const size_t *caps, int ncaps)
+{
+    int          n;
+    const char  *p = bench_conf.replace, *lit;
+
+    while (*p) {
+        lit = p;
+
+        while (*p && *p != '$') {
+            p++;
+        }
+
+        if (p > lit) {
+            bench_out_append(out, lit, p - lit);
+        }
+
+        if (*p == '\0') {
+            break;
+        }
+
+        p++;
+
+        if (*p == '$') {
+            bench_out_append(out, p++, 1);
+            continue;
+        }
+
+        if (*p == '{') {
+            n = (int) strtol(p + 1, (char **) &p, 10);
+            if (*p == '}') {
+                p++;
+            }
+
+        } else if (*p >= '0' && *p <= '9') {
+            n = (int) strtol(p, (char **) &p, 10);
+
+        } else {
+            bench_out_append(out, "$", 1);
+            continue;
+        }
+
+        if (n < ncaps && caps[2 * n] != BENCH_NO_OFFSET) {
+            bench_out_append(out, subj + caps[2 * n],
+                             caps[2 * n + 1] - caps[2 * n]);
+        }
+    }
+}
+
+
+/*
+ * Prints a "# replace:" line: the rate of the output at the median time
+ * of a run and the allocations of the process per run and per MB of
+ * input, from allocs counted over runs (0 without BENCH_COUNT_ALLOCS).
+ */
+static inline void
+bench_replace_print(size_t len, size_t out_len, double median,
+    unsigned long allocs, int runs)
+{
+    printf("# replace: %lu bytes in, %lu bytes out, %.1lf MB/s out, ",
+           (unsigned long) len, (unsigned long) out_len,
+           median > 0 ? out_len / median / 1e6 : 0);
+
+#if defined(BENCH_COUNT_ALLOCS) && defined(__GLIBC__)
+    printf("%.1lf allocations per run, %.2lf per MB\n",
+           runs ? (double) allocs / runs : 0,
+           runs && len ? (double) allocs / runs / (len / 1e6) : 0);
+#else
+    (void) allocs;
+    (void) runs;
+    printf("allocations n/a\n");
+#endif
+}
+
+
+/* parses --rows into sizes[]; returns their number */
+static inline int
+bench_column_sizes(size_t *sizes)
+{
+    int          n = 0;
+    char        *end;
+    const char  *p = bench_conf.rows;
+
+    while (*p && n < BENCH_MAX_ROW_SIZES) {
+        sizes[n] = strtoul(p, &end, 10);
+        if (end == p || sizes[n] == 0) {
+            fprintf(stderr, "bad row size list: %s\n", bench_conf.rows);
+            exit(1);
+        }
+
+        if (*end == 'k' || *end == 'K') {
+            sizes[n] *= 1024;
+            end++;
+        }
+
+        n++;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return n;
+}
+
+
+/*
+ * Cuts the input into a column of rows of row_size bytes, the last one
+ * shorter, with an offsets array as a column store keeps it, and
+ * allocates its selection bitmap.
+ */
+static inline void
+bench_column_init(bench_column_t *col, const char *input, size_t len,
+    size_t row_size)
+{
+    size_t      i;
+
+    memset(col, 0, sizeof(bench_column_t));
+
+    col->data = input;
+    col->row_size = row_size;
+    col->nrows = (len + row_size - 1) / row_size;
+    col->words = (col->nrows + 63) / 64;
+
+    col->offsets = (size_t *) malloc((col->nrows + 1) * sizeof(size_t));
+    col->selected = (unsigned long long *)
+                        calloc(col->words ? col->words : 1,
+                               sizeof(unsigned long long));
+    col->reference = (unsigned long long *)
+                        calloc(col->words ? col->words : 1,
+                               sizeof(unsigned long long));
+    if (col->offsets == NULL || col->selected == NULL
+        || col->reference == NULL)
+    {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    for (i = 0; i < col->nrows; i++) {
+        col->offsets[i] = i * row_size;
+    }
+
+    col->offsets[col->nrows] = len;
+}
+
+
+static inline void
+bench_column_free(bench_column_t *col)
+{
+    free(col->offsets);
+    free(col->selected);
+    free(col->reference);
+}
+
+
+/* clears the selection bitmap before a run */
+static inline void
+bench_column_clear(bench_column_t *col)
+{
+    memset(col->selected, 0, col->words * sizeof(unsigned long long));
+}
+
+
+static inline void
+bench_column_select(bench_column_t *col, size_t row)
+{
+    col->selected[row >> 6] |= 1ULL << (row & 63);
+}
+
+
+/* the rows selected */
+static inline size_t
+bench_column_count(bench_column_t *col)
+{
+    size_t      i, n = 0;
+
+    for (i = 0; i < col->words; i++) {
+        n += __builtin_popcountll(col->selected[i]);
+    }
+
+    return n;
+}
+
+
+/*
+ * Prints a "# batch:" line for the median time of a run over the column.
+ * The bitmap of the first engine is kept and those of the next ones
+ * compared to it.
+ */
+static inline void
+bench_column_print(bench_column_t *col, double median)
+{
+    size_t      i, differ = 0;
+
+    for (i = 0; i < col->words; i++) {
+        differ += __builtin_popcountll(col->selected[i]
+                                       ^ col->reference[i]);
+    }
+
+    printf("# batch: %lu rows of %lu bytes, %lu selected, %.0lf rows/s, "
+           "%.3lf GB/s", (unsigned long) col->nrows,
+           (unsigned long) col->row_size,
+           (unsigned long) bench_column_count(col),
+           median > 0 ? col->nrows / median : 0,
+           median > 0 ? col->offsets[col->nrows] / median / 1e9 : 0);
+
+    if (col->checked) {
+        printf(", %lu rows differ from the first engine", (unsigned long)
+               differ);
+
+    } else {
+        memcpy(col->reference, col->selected,
+               col->words * sizeof(unsigned long long));
+        col->checked = 1;
+    }
+
+    printf("\n");
+}
+
+
+/*
+ * Copies a regexp with only its first keep capture groups left capturing,
+ * all of them when keep is negative, and the others made non-capturing,
+ * (?:...), and with the names of the named groups, (?<name>, (?P<name>
+ * and (?'name', taken out when strip is set. Sets *ngroups to the number
+ * of capture groups of the regexp. The caller frees the copy.
+ */
+static inline char *
+bench_groups_keep(const char *re, int keep, int strip, int *ngroups)
+{
+    int          n = 0, named, capturing, in_class = 0;
+    char        *out, *q;
+    const char  *p, *name;
+
+    /* a "(" becomes "(?:" at worst */
+    out = (char *) malloc(strlen(re) * 3 + 1);
+    if (out == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    q = out;
+
+    for (p = re; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            *q++ = *p++;
+            *q++ = *p;
+            continue;
+        }
+
+        if (in_class) {
+            if (*p == ']') {
+                in_class = 0;
+            }
+
+            *q++ = *p;
+            continue;
+        }
+
+        if (*p == '[') {
+            in_class = 1;
+            *q++ = *p;
+
+            /* a leading ] is a literal */
+            if (p[1] == '^') {
+                *q++ = *++p;
+            }
+
+            if (p[1] == ']') {
+                *q++ = *++p;
+            }
+
+            continue;
+        }
+
+        if (*p != '(') {
+            *q++ = *p;
+            continue;
+        }
+
+        named = 0;
+        name = NULL;
+
+        if (p[1] == '?') {
+            if ((p[2] == '<' && p[3] != '=' && p[3] != '!')
+                || p[2] == '\'')
+            {
+                named = 1;
+                name = p + 3;
+
+            } else if (p[2] == 'P' && p[3] == '<') {
+                named = 1;
+                name = p + 4;
+
+            } else {
+                /* (?:, lookarounds, options */
+                *q++ = *p;
+                continue;
+            }
+
+        } else if (p[1] == '*') {
+            /* a verb */
+            *q++ = *p;
+            continue;
+        }
+
+        n++;
+        capturing = keep < 0 || n <= keep;
+
+        if (!capturing) {
+            memcpy(q, "(?:", 3);
+            q += 3;
+
+        } else if (!named || strip) {
+            *q++ = '(';
+        }
+
+        if (named) {
+            while (*name && *name != '>' && *name != '\'') {
+                name++;
+            }
+
+            if (capturing && !strip) {
+                memcpy(q, p, name + 1 - p);
+                q += name + 1 - p;
+            }
+
+            p = name;
+        }
+    }
+
+    *q = '\0';
+    *ngroups = n;
+
+    return out;
+}
+
+
+/* splits the input into lines and sets up the arena of fields */
+static inline void
+bench_fields_init(bench_fields_t *fl, const unsigned char *input,
+    size_t len, int ngroups)
+{
+    size_t                n = 0, max = 1024;
+    const unsigned char  *p = input, *last = input + len, *nl;
+
+    memset(fl, 0, sizeof(bench_fields_t));
+
+    fl->input = input;
+    fl->ngroups = ngroups;
+
+    fl->lines = (bench_line_t *) malloc(max * sizeof(bench_line_t));
+    if (fl->lines == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    while (p < last) {
+        nl = (const unsigned char *) memchr(p, '\n', last - p);
+
+        if (n == max) {
+            max *= 2;
+            fl->lines = (bench_line_t *) realloc(fl->lines,
+                                                 max * sizeof(bench_line_t));
+            if (fl->lines == NULL) {
+                fprintf(stderr, "failed to allocate memory\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+        }
+
+        fl->lines[n].off = p - input;
+        fl->lines[n].len = (nl ? nl : last) - p;
+        n++;
+
+        p = nl ? nl + 1 : last;
+    }
+
+    fl->nlines = n;
+
+    fl->arena = (bench_field_t *) calloc(n ? n * (ngroups + 1) : 1,
+                                         sizeof(bench_field_t));
+    if (fl->arena == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+}
+
+
+static inline void
+bench_fields_free(bench_fields_t *fl)
+{
+    free(fl->lines);
+    free(fl->arena);
+}
+
+
+/* the fields of a line: group 0, the whole match, first */
+static inline bench_field_t *
+bench_fields_line(bench_fields_t *fl, size_t line)
+{
+    return fl->arena + line * (fl->ngroups + 1);
+}
+
+
+/*
+ * Prints a "# fields:" line for a run with groups capture groups at the
+ * median time of a run, and adds it to the fit of
+ * bench_fields_print_cost() unless groups is negative (no groups at
+ * all, for the engines that cannot capture).
+ */
+static inline void
+bench_fields_print(bench_fields_t *fl, int groups, size_t matched,
+    double median)
+{
+    double  per_line = fl->nlines ? median / fl->nlines : 0;
+
+    printf("# fields: %lu lines, %lu matched, %d group%s, %.0lf lines/s, "
+           "%.1lf ns per line\n", (unsigned long) fl->nlines,
+           (unsigned long) matched, groups < 0 ? 0 : groups,
+           groups == 1 ? "" : "s", median > 0 ? fl->nlines / median : 0,
+           per_line * 1e9);
+
+    if (groups < 0) {
+        return;
+    }
+
+    fl->n++;
+    fl->sx += groups;
+    fl->sy += per_line;
+    fl->sxx += (double) groups * groups;
+    fl->sxy += groups * per_line;
+}
+
+
+/*
+ * Prints a "# capture cost:" line with the least-squares fit of the
+ * time per line against the capture groups of the runs since the last
+ * call: the cost of one more group and of a line without any.
+ */
+static inline void
+bench_fields_print_cost(bench_fields_t *fl)
+{
+    double  d, slope, base;
+
+    d = fl->n * fl->sxx - fl->sx * fl->sx;
+
+    if (fl->n >= 2 && d > 0) {
+        slope = (fl->n * fl->sxy - fl->sx * fl->sy) / d;
+        base = (fl->sy - slope * fl->sx) / fl->n;
+
+        printf("# capture cost: %.2lf ns per group per line, %.1lf ns per "
+               "line without groups (fit over %.0lf runs)\n", slope * 1e9,
+               base * 1e9, fl->n);
+    }
+
+    fl->n = 0;
+    fl->sx = 0;
+    fl->sy = 0;
+    fl->sxx = 0;
+    fl->sxy = 0;
+}
+
+
+/*
+ * The heatmap mode (see --heatmap): every slice of bench_conf.slice
+ * bytes of the input timed on its own with scan, each with its share
+ * of the --budget. Prints the engine line, its time being the sum of
+ * the slice medians, then a "# slice:" line per slice with its offset,
+ * throughput and matches, for the heatmap of gen-plot.pl, and a
+ * "# heatmap:" summary. Matches across two slices are not found.
+ */
+static inline void
+bench_heatmap_run(bench_scan_pt scan, void *ctx, const unsigned char *input,
+    size_t len, int repeat)
+{
+    int             *counts, matches = 0, runs = 0;
+    size_t           i, n, off, size, slowest = 0, fastest = 0;
+    double           begin, end, median, total = 0, budget;
+    double          *rates, *sorted;
+    bench_stats_t    st;
+
+    n = len ? (len + bench_conf.slice - 1) / bench_conf.slice : 0;
+
+    rates = (double *) malloc(2 * (n + 1) * sizeof(double));
+    counts = (int *) malloc((n + 1) * sizeof(int));
+    if (rates == NULL || counts == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    sorted = rates + n + 1;
+
+    budget = bench_conf.budget;
+    bench_conf.budget = n ? budget / n : budget;
+
+    for (i = 0; i < n; i++) {
+        off = i * bench_conf.slice;
+        size = len - off < (size_t) bench_conf.slice
+               ? len - off : (size_t) bench_conf.slice;
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            begin = get_cpu_time();
+            if (begin == -1) {
+                perror("get_cpu_time");
+                exit(2);
+            }
+
+            counts[i] = scan(ctx, input + off, size);
+
+            end = get_cpu_time();
+            if (end == -1) {
+                perror("get_cpu_time");
+                exit(2);
+            }
+
+            bench_stats_add(&st, end - begin);
+        }
+
+        median = bench_stats_median(&st);
+
+        rates[i] = median > 0 ? size / median : 0;
+        sorted[i] = rates[i];
+
+        if (rates[i] < rates[slowest]) {
+            slowest = i;
+        }
+
+        if (rates[i] > rates[fastest]) {
+            fastest = i;
+        }
+
+        total += median;
+        matches += counts[i];
+
+        if (runs == 0 || st.n < runs) {
+            runs = st.n;
+        }
+    }
+
+    bench_conf.budget = budget;
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           matches ? "match" : "no match", total * 1e3, matches, runs);
+
+    for (i = 0; i < n; i++) {
+        printf("# slice: %lu %.1lf MB/s %d matches\n",
+               (unsigned long) (i * bench_conf.slice), rates[i] / 1e6,
+               counts[i]);
+    }
+
+    if (n) {
+        qsort(sorted, n, sizeof(double), bench_cmp_double);
+
+        printf("# heatmap: %lu slices of %ld bytes, median %.1lf MB/s, "
+               "slowest %.1lf MB/s at %lu, fastest %.1lf MB/s at %lu\n",
+               (unsigned long) n, bench_conf.slice, sorted[n / 2] / 1e6,
+               rates[slowest] / 1e6,
+               (unsigned long) (slowest * bench_conf.slice),
+               rates[fastest] / 1e6,
+               (unsigned long) (fastest * bench_conf.slice));
+    }
+
+    free(rates);
+    free(counts);
+}
+
+
+/* opens the --grep file for the output of the grep mode */
+static inline void
+bench_grep_init(bench_grep_t *g, const unsigned char *input, size_t len)
+{
+    struct stat  st;
+
+    g->input = input;
+    g->len = len;
+
+    g->fd = open(bench_conf.grep, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (g->fd == -1) {
+        perror(bench_conf.grep);
+        exit(1);
+    }
+
+    g->regular = fstat(g->fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+
+static inline void
+bench_grep_free(bench_grep_t *g)
+{
+    close(g->fd);
+}
+
+
+/* starts a run over the input; a regular file keeps the last run only */
+static inline void
+bench_grep_reset(bench_grep_t *g)
+{
+    if (g->regular && ftruncate(g->fd, 0) == 0) {
+        lseek(g->fd, 0, SEEK_SET);
+    }
+
+    g->pos = 0;
+    g->line = 1;
+    g->bol = 0;
+    g->next = 0;
+    g->niov = 0;
+    g->used = 0;
+    g->matches = 0;
+    g->lines = 0;
+    g->bytes = 0;
+    g->writes = 0;
+}
+
+
+/*
+ * Counts the line feeds of p[0 .. n) and sets *last to the offset of the
+ * last one when there is any. With SSE2, 16 byte counters add up the
+ * compares for up to 255 rounds at a time, without a branch per block.
+ */
+static inline size_t
+bench_grep_newlines(const unsigned char *p, size_t n, size_t *last)
+{
+    size_t                i = 0, count = 0;
+#ifdef __SSE2__
+    int                   k;
+    unsigned long long    halves[2];
+    __m128i               nl, zero, acc, sum;
+
+    nl = _mm_set1_epi8('\n');
+    zero = _mm_setzero_si128();
+    sum = zero;
+
+    while (i + 16 <= n) {
+        acc = zero;
+
+        for (k = 0; k < 255 && i + 16 <= n; k++, i += 16) {
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(
+                      _mm_loadu_si128((const __m128i *) (p + i)), nl));
+        }
+
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(acc, zero));
+    }
+
+    _mm_storeu_si128((__m128i *) halves, sum);
+    count = halves[0] + halves[1];
+#endif
+
+    for (; i < n; i++) {
+        count += p[i] == '\n';
+    }
+
+    /* the last one is near the end but for very long lines */
+    for (i = n; count && i > 0; i--) {
+        if (p[i - 1] == '\n') {
+            *last = i - 1;
+            break;
+        }
+    }
+
+    return count;
+}
+
+
+/* writes the lines queued, again after a short write */
+static inline void
+bench_grep_flush(bench_grep_t *g)
+{
+    int      i = 0;
+    ssize_t  n;
+
+    while (i < g->niov) {
+        n = writev(g->fd, g->iov + i, g->niov - i);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("writev");
+            exit(2);
+        }
+
+        g->writes++;
+        g->bytes += n;
+
+        while (i < g->niov && (size_t) n >= g->iov[i].iov_len) {
+            n -= g->iov[i].iov_len;
+            i++;
+        }
+
+        if (i < g->niov) {
+            g->iov[i].iov_base = (char *) g->iov[i].iov_base + n;
+            g->iov[i].iov_len -= n;
+        }
+    }
+
+    g->niov = 0;
+    g->used = 0;
+}
+
+
+/*
+ * Queues the line of a match at input[start .. end), up to the line of
+ * its end, with its line and column numbers, unless an earlier match
+ * queued it already. The matches must come in the order of their
+ * starts: only the newlines between the last one and this one are
+ * counted, and a match starting within the lines last queued only adds
+ * the lines past them up to its end. The lines point into the input, so
+ * that a writev() call writes up to BENCH_GREP_IOVS / 3 of them without
+ * a copy.
+ */
+static inline void
+bench_grep_match(bench_grep_t *g, size_t start, size_t end)
+{
+    int                   n;
+    size_t                nl, last = 0, eol;
+    const unsigned char  *p;
+
+    g->matches++;
+
+    if (start < g->next) {
+        if (end <= g->next) {
+            return;
+        }
+
+        /* the rest of a match running past the lines queued, which end
+         * with a line feed */
+        p = (const unsigned char *) memchr(g->input + end - 1, '\n',
+                                           g->len - (end - 1));
+        eol = p ? (size_t) (p - g->input) + 1 : g->len;
+
+        if (g->niov + 2 > BENCH_GREP_IOVS) {
+            bench_grep_flush(g);
+        }
+
+        g->iov[g->niov].iov_base = (void *) (g->input + g->next);
+        g->iov[g->niov].iov_len = eol - g->next;
+        g->niov++;
+
+        if (g->input[eol - 1] != '\n') {
+            g->iov[g->niov].iov_base = (void *) "\n";
+            g->iov[g->niov].iov_len = 1;
+            g->niov++;
+        }
+
+        g->next = eol;
+        return;
+    }
+
+    /* an empty match at the end of the input has no line of its own
+     * after a final line feed, and shares the last line otherwise */
+    if (start == g->len
+        && (g->next == g->len || g->input[g->len - 1] == '\n'))
+    {
+        return;
+    }
+
+    nl = bench_grep_newlines(g->input + g->pos, start - g->pos, &last);
+    if (nl) {
+        g->line += nl;
+        g->bol = g->pos + last + 1;
+    }
+
+    g->pos = start;
+
+    /* from the last byte of the match: it may be a line feed */
+    eol = end > start ? end - 1 : start;
+    p = (const unsigned char *) memchr(g->input + eol, '\n', g->len - eol);
+    eol = p ? (size_t) (p - g->input) + 1 : g->len;
+
+    if (g->niov + 3 > BENCH_GREP_IOVS
+        || g->used + 2 * sizeof("18446744073709551615") > BENCH_GREP_PREFIXES)
+    {
+        bench_grep_flush(g);
+    }
+
+    n = sprintf(g->prefixes + g->used, "%lu:%lu:", (unsigned long) g->line,
+                (unsigned long) (start - g->bol + 1));
+
+    g->iov[g->niov].iov_base = g->prefixes + g->used;
+    g->iov[g->niov].iov_len = n;
+    g->iov[g->niov + 1].iov_base = (void *) (g->input + g->bol);
+    g->iov[g->niov + 1].iov_len = eol - g->bol;
+    g->niov += 2;
+    g->used += n;
+
+    /* the last line of a file without a line feed at its end */
+    if (eol == g->len && (eol == g->bol || g->input[eol - 1] != '\n')) {
+        g->iov[g->niov].iov_base = (void *) "\n";
+        g->iov[g->niov].iov_len = 1;
+        g->niov++;
+    }
+
+    g->next = eol;
+    g->lines++;
+}
+
+
+/*
+ * Prints a "# grep:" line for the median times of a run matching only
+ * and of a run writing the lines too: the throughputs of both and what
+ * the output adds per line written.
+ */
+static inline void
+bench_grep_print(bench_grep_t *g, double match_only, double median)
+{
+    printf("# grep: %lu matches on %lu lines, %lu bytes in %lu writev "
+           "calls, %.1lf MB/s matching only, %.1lf MB/s with the output",
+           (unsigned long) g->matches, (unsigned long) g->lines,
+           (unsigned long) g->bytes, (unsigned long) g->writes,
+           match_only > 0 ? g->len / match_only / 1e6 : 0,
+           median > 0 ? g->len / median / 1e6 : 0);
+
+    if (match_only > 0 && g->lines) {
+        printf(" (+%.1lf%%, %.1lf ns per line)",
+               (median - match_only) / match_only * 100,
+               (median - match_only) / g->lines * 1e9);
+    }
+
+    printf("\n");
+}
+
+
+#endif /* _BENCH_H_INCLUDED_ */
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+
+#include "ctmatch.hh"
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <cstdlib>
+#include "getcputime.h"
+#include "bench.h"
+
+
+static void usage(int rc);
+static void run_engine(ct::search_pt search, const ct::uchar *input,
+    size_t len, int global, int repeat);
+
+
+int
+main(int argc, char **argv)
+{
+    int                  i, global = 0, repeat = 5;
+    const ct::entry     *e;
+    char                *re_str;
+    ct::uchar           *input;
+    FILE                *f;
+    size_t               len;
+    long                 rc;
+
+    if (argc < 3) {
+        usage(1);
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            break;
+        }
+
+        if (strncmp(argv[i], "-g", 2) == 0) {
+            global = 1;
+            continue;
+        }
+
+        if (strncmp(argv[i], "--repeat=", sizeof("--repeat=") - 1) == 0) {
+            repeat = atoi(argv[i] + sizeof("--repeat=") - 1);
+            if (repeat <= 0) {
+                repeat = 5;
+            }
+
+            continue;
+        }
+
+        if (bench_parse_option(argv[i])) {
+            continue;
+        }
+
+        fprintf(stderr, "unknown option: %s\n", argv[i]);
+        exit(1);
+    }
+
+    if (argc - i != 2) {
+        usage(1);
+    }
+
+    /* none of the modes */
+    bench_setup(0);
+
+    re_str = argv[i++];
+
+    for (e = ct_cases; e->pattern; e++) {
+        if (strcmp(e->pattern, re_str) == 0) {
+            break;
+        }
+    }
+
+    if (e->pattern == NULL) {
+        fprintf(stderr, "[error] regex not compiled in: %s\n", re_str);
+        return 2;
+    }
+
+    errno = 0;
+
+    f = fopen(argv[i], "rb");
+    if (f == NULL) {
+        perror("open file");
+        return 1;
+    }
+
+    if (fseek(f, 0L, SEEK_END) != 0) {
+        perror("seek to file end");
+        return 1;
+    }
+
+    rc = ftell(f);
+    if (rc == -1) {
+        perror("get file offset by ftell");
+        return 1;
+    }
+
+    len = bench_input_size((size_t) rc);
+
+    if (fseek(f, 0L, SEEK_SET) != 0) {
+        perror("seek to file beginning");
+        return 1;
+    }
+
+    input = (ct::uchar *) malloc(len);
+    if (input == NULL) {
+        fprintf(stderr, "failed to allocate %ld bytes.\n", len);
+        return BENCH_EXIT_NOMEM;
+    }
+
+    if (fread(input, 1, len, f) < len) {
+        if (feof(f)) {
+            fprintf(stderr, "file truncated.\n");
+            return 1;
+
+        } else {
+            perror("read file");
+        }
+    }
+
+    if (fclose(f) != 0) {
+        perror("close file");
+        return 1;
+    }
+
+    bench_cache_add(input, len);
+
+    run_engine(e->search, input, len, global, repeat);
+
+    free(input);
+    return 0;
+}
+
+
+static void
+run_engine(ct::search_pt search, const ct::uchar *input, size_t len,
+    int global, int repeat)
+{
+    int                  matches = 0;
+    bool                 rc = 0;
+    double               begin, end;
+    bench_stats_t        st;
+    const ct::uchar     *p, *from = NULL, *to = NULL;
+
+    printf("CT template ");
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        matches = 0;
+        p = input;
+
+        begin = get_cpu_time();
+        if (begin == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        do {
+            rc = search(input, input + len, p, &from, &to);
+
+            if (rc) {
+                matches++;
+
+                /* an empty match moves on by one byte */
+                p = to > from ? to : to + 1;
+            }
+
+        } while (global && rc && p <= input + len);
+
+        end = get_cpu_time();
+        if (end == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        elapsed = end - begin;
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    if (rc) {
+        printf("match (%ld, %ld)", (long) (from - input), (long) (to - input));
+
+    } else {
+        printf("no match");
+    }
+
+    printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           bench_stats_median(&st) * 1e3, matches, st.n);
+    bench_stats_print(&st);
+}
+
+
+static void
+usage(int rc)
+{
+    fprintf(stderr, "usage: ct [options] <regexp> <file>\n"
+            "   -g                  enable the global search mode\n"
+            "   --repeat=N          repeat the test at least N times; report\n"
+            "                       the median. default to 5.\n"
+            BENCH_USAGE
+            "only the regexes of the bench target in the Makefile are\n"
+            "available; see gen/ct.pl.\n");
+    exit(rc);
+}
@@ -0,0 +1,428 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/*
+ * Compile-time regex matchers in the spirit of CTRE: every pattern is a
+ * type built from the nodes below, and matching is a backtracking
+ * search in which the continuation of every node is a template
+ * argument, so the compiler sees (and can inline) the whole automaton.
+ * The types are produced by gen/ct.pl; see ct-cases.cc.
+ *
+ * Only the whole-match span is tracked; groups do not capture.
+ */
+
+#ifndef _CTMATCH_HH_INCLUDED_
+#define _CTMATCH_HH_INCLUDED_
+
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace ct {
+
+
+typedef unsigned char  uchar;
+
+
+struct ctx {
+    const uchar         *begin;
+    const uchar         *end;
+    const uchar         *out;
+};
+
+
+struct bits {
+    uint64_t             w[4];
+
+    constexpr bool test(unsigned c) const {
+        return (w[c >> 6] >> (c & 63)) & 1;
+    }
+
+    constexpr void set(unsigned c) {
+        w[c >> 6] |= (uint64_t) 1 << (c & 63);
+    }
+};
+
+
+/* the final continuation records where the match ended */
+struct accept {
+    static inline bool run(const uchar *p, ctx &c) {
+        c.out = p;
+        return true;
+    }
+};
+
+
+template <typename Node, typename K>
+struct cont {
+    static inline bool run(const uchar *p, ctx &c) {
+        return Node::template match<K>(p, c);
+    }
+};
+
+
+template <typename Node, typename = void>
+struct is_single : std::false_type {};
+
+template <typename Node>
+struct is_single<Node, std::void_t<decltype(Node::one(0))>>
+    : std::true_type {};
+
+
+/* single-byte nodes */
+
+template <uchar C>
+struct chr {
+    static constexpr bool nullable = false;
+
+    static constexpr void first(bits &b) {
+        b.set(C);
+    }
+
+    static inline bool one(uchar ch) {
+        return ch == C;
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        return p < c.end && *p == C && K::run(p + 1, c);
+    }
+};
+
+
+template <uchar Lo, uchar Hi>
+struct range {};
+
+
+template <typename... R>
+struct set;
+
+template <uchar... Lo, uchar... Hi>
+struct set<range<Lo, Hi>...> {
+    static constexpr bool nullable = false;
+
+    static constexpr bits make() {
+        constexpr uchar  lo[] = { Lo... };
+        constexpr uchar  hi[] = { Hi... };
+        bits             b = {};
+
+        for (unsigned i = 0; i < sizeof(lo); i++) {
+            for (unsigned c = lo[i]; c <= hi[i]; c++) {
+                b.set(c);
+            }
+        }
+
+        return b;
+    }
+
+    static constexpr bits table = make();
+
+    static constexpr void first(bits &b) {
+        for (unsigned i = 0; i < 4; i++) {
+            b.w[i] |= table.w[i];
+        }
+    }
+
+    static inline bool one(uchar ch) {
+        return table.test(ch);
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        return p < c.end && table.test(*p) && K::run(p + 1, c);
+    }
+};
+
+
+struct any {
+    static constexpr bool nullable = false;
+
+    static constexpr void first(bits &b) {
+        for (unsigned i = 0; i < 4; i++) {
+            b.w[i] = ~(uint64_t) 0;
+        }
+    }
+
+    static inline bool one(uchar) {
+        return true;
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        return p < c.end && K::run(p + 1, c);
+    }
+};
+
+
+/* a literal string */
+
+template <uchar... Cs>
+struct str {
+    static constexpr bool nullable = sizeof...(Cs) == 0;
+    static constexpr uchar chars[] = { Cs... };
+
+    static constexpr void first(bits &b) {
+        b.set(chars[0]);
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        std::size_t  i = 0;
+
+        if ((std::size_t) (c.end - p) < sizeof...(Cs)) {
+            return false;
+        }
+
+        if (!((p[i++] == Cs) && ...)) {
+            return false;
+        }
+
+        return K::run(p + sizeof...(Cs), c);
+    }
+};
+
+
+/* \b and \B */
+
+template <bool Negate>
+struct wordb {
+    static constexpr bool nullable = true;
+
+    static constexpr void first(bits &) {
+    }
+
+    static inline bool word(uchar ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')
+               || (ch >= '0' && ch <= '9') || ch == '_';
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        bool  before = p > c.begin && word(p[-1]);
+        bool  after = p < c.end && word(p[0]);
+
+        return ((before != after) != Negate) && K::run(p, c);
+    }
+};
+
+
+/* composition */
+
+template <typename... Nodes>
+struct seq;
+
+template <>
+struct seq<> {
+    static constexpr bool nullable = true;
+
+    static constexpr void first(bits &) {
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        return K::run(p, c);
+    }
+};
+
+template <typename Head, typename... Tail>
+struct seq<Head, Tail...> {
+    static constexpr bool nullable = Head::nullable
+                                     && seq<Tail...>::nullable;
+
+    static constexpr void first(bits &b) {
+        Head::first(b);
+
+        if (Head::nullable) {
+            seq<Tail...>::first(b);
+        }
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        return Head::template match<cont<seq<Tail...>, K>>(p, c);
+    }
+};
+
+
+template <typename... Nodes>
+struct alt {
+    static constexpr bool nullable = (Nodes::nullable || ...);
+
+    static constexpr void first(bits &b) {
+        (Nodes::first(b), ...);
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        return (Nodes::template match<K>(p, c) || ...);
+    }
+};
+
+
+/*
+ * Counted repetition of a general node; I is the number of iterations
+ * done so far, which stops growing at Min for unbounded repeats.
+ * gen/ct.pl never repeats a nullable node without a bound.
+ */
+
+template <int I, int Min, int Max, bool Greedy, typename Node>
+struct rep_n {
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        if constexpr (I < Min) {
+            return Node::template match<
+                       cont<rep_n<I + 1, Min, Max, Greedy, Node>, K>>(p, c);
+
+        } else if constexpr (Max != -1 && I >= Max) {
+            return K::run(p, c);
+
+        } else {
+            typedef rep_n<Max == -1 ? I : I + 1, Min, Max, Greedy, Node>
+                    more;
+
+            if constexpr (Greedy) {
+                return Node::template match<cont<more, K>>(p, c)
+                       || K::run(p, c);
+
+            } else {
+                return K::run(p, c)
+                       || Node::template match<cont<more, K>>(p, c);
+            }
+        }
+    }
+};
+
+
+/* Max is -1 for unbounded repeats */
+
+template <int Min, int Max, bool Greedy, typename Node>
+struct rep {
+    static constexpr bool nullable = Min == 0 || Node::nullable;
+
+    static constexpr void first(bits &b) {
+        Node::first(b);
+    }
+
+    template <typename K>
+    static inline bool match(const uchar *p, ctx &c) {
+        if constexpr (is_single<Node>::value) {
+            /* single bytes need no recursion: scan, then backtrack */
+            const uchar  *s = p, *limit = c.end;
+
+            if (Max != -1 && (std::size_t) (c.end - p) > (std::size_t) Max) {
+                limit = p + Max;
+            }
+
+            if constexpr (Greedy) {
+                while (s < limit && Node::one(*s)) {
+                    s++;
+                }
+
+                if (s - p < Min) {
+                    return false;
+                }
+
+                for ( ;; s--) {
+                    if (K::run(s, c)) {
+                        return true;
+                    }
+
+                    if (s == p + Min) {
+                        return false;
+                    }
+                }
+
+            } else {
+                for ( ; s < p + Min; s++) {
+                    if (s == c.end || !Node::one(*s)) {
+                        return false;
+                    }
+                }
+
+                for ( ;; s++) {
+                    if (K::run(s, c)) {
+                        return true;
+                    }
+
+                    if (s == limit || !Node::one(*s)) {
+                        return false;
+                    }
+                }
+            }
+
+        } else {
+            return rep_n<0, Min, Max, Greedy, Node>::template match<K>(p, c);
+        }
+    }
+};
+
+
+template <typename Re>
+constexpr bits
+first_bits()
+{
+    bits  b = {};
+
+    Re::first(b);
+    return b;
+}
+
+
+/*
+ * Leftmost search starting at from; the whole buffer is kept in the
+ * context so that \b can look behind the starting point.
+ */
+template <typename Re>
+inline bool
+search(const uchar *begin, const uchar *end, const uchar *from,
+    const uchar **mstart, const uchar **mend)
+{
+    static constexpr bits  fb = first_bits<Re>();
+
+    ctx            c = { begin, end, NULL };
+    const uchar   *p;
+
+    for (p = from; p <= end; p++) {
+        if constexpr (!Re::nullable) {
+            while (p < end && !fb.test(*p)) {
+                p++;
+            }
+
+            if (p == end) {
+                return false;
+            }
+        }
+
+        if (Re::template match<accept>(p, c)) {
+            *mstart = p;
+            *mend = c.out;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+typedef bool (*search_pt)(const uchar *begin, const uchar *end,
+    const uchar *from, const uchar **mstart, const uchar **mend);
+
+
+struct entry {
+    const char          *pattern;
+    search_pt            search;
+};
+
+
+} /* namespace ct */
+
+
+extern const ct::entry  ct_cases[];
+
+
+#endif /* _CTMATCH_HH_INCLUDED_ */
@@ -0,0 +1,627 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include "getcputime.h"
+#include "bench.h"
+#include "glushkov.h"
+
+
+/* the exit status for a pattern beyond the Glushkov parser or the
+ * --max-states limit, so that bench2 can fall back to re.pl; 3 is taken
+ * by bench_setup() under --strict-env */
+#define DFA_AOT_UNSUPPORTED    4
+
+
+typedef long (*dfa_exec_pt)(const unsigned char *p, size_t len);
+
+
+typedef struct {
+    unsigned             nstates;
+    unsigned             naccepts;  /* accepting states are numbered last */
+    unsigned             nclasses;
+    unsigned char        cls[256];
+    unsigned            *trans;     /* nstates * nclasses */
+} dfa_t;
+
+
+static void usage(int rc);
+static int dfa_build(gk_nfa_t *nfa, unsigned max_states, dfa_t *dfa);
+static int dfa_emit(dfa_t *dfa, const char *re, const char *path);
+static void dfa_cleanup(const char *dir, const char *src, const char *obj,
+    int keep);
+static void run_engine(dfa_exec_pt exec, const unsigned char *input,
+    size_t len, int global, int repeat);
+
+
+#define TIMER_START                                                          \
+        begin = get_cpu_time();                                              \
+        if (begin == -1) {                                                   \
+            perror("get_cpu_time");                                          \
+            exit(2);                                                         \
+        }
+
+
+#define TIMER_STOP                                                           \
+        end = get_cpu_time();                                                \
+        if (end == -1) {                                                     \
+            perror("get_cpu_time");                                          \
+            exit(2);                                                         \
+        }                                                                    \
+        elapsed = end - begin;
+
+
+int
+main(int argc, char **argv)
+{
+    int                  flags = 0;
+    int                  global = 0, repeat = 5, keep = 0;
+    int                  err_offset = -1;
+    unsigned             i, max_states = 10000;
+    gk_nfa_t            *nfa;
+    dfa_t                dfa;
+    void                *so;
+    dfa_exec_pt          exec;
+    const char          *errstr, *re_str;
+    const char          *cc;
+    char                 dir[] = "/tmp/dfa-aot-XXXXXX";
+    char                 src[sizeof(dir) + 16], obj[sizeof(dir) + 16];
+    char                *cmd;
+    unsigned char       *input;
+    FILE                *f;
+    size_t               len;
+    long                 rc;
+    double               begin, end, elapsed;
+    struct stat          st;
+
+    if (argc < 3) {
+        usage(1);
+    }
+
+    cc = getenv("CC");
+    if (cc == NULL) {
+        cc = "cc -O3";
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            break;
+        }
+
+        if (strncmp(argv[i], "--cc=", sizeof("--cc=") - 1) == 0) {
+            cc = argv[i] + sizeof("--cc=") - 1;
+
+        } else if (strncmp(argv[i], "--max-states=",
+                           sizeof("--max-states=") - 1) == 0)
+        {
+            max_states = atoi(argv[i] + sizeof("--max-states=") - 1);
+            if (max_states == 0) {
+                max_states = 10000;
+            }
+
+        } else if (strncmp(argv[i], "--keep", sizeof("--keep") - 1) == 0) {
+            keep = 1;
+
+        } else if (strncmp(argv[i], "--repeat=", sizeof("--repeat=") - 1)
+                   == 0)
+        {
+            repeat = atoi(argv[i] + sizeof("--repeat=") - 1);
+            if (repeat <= 0) {
+                repeat = 5;
+            }
+
+        } else if (strncmp(argv[i], "-i", 2) == 0) {
+            flags |= GK_CASELESS;
+
+        } else if (strncmp(argv[i], "-g", 2) == 0) {
+            global = 1;
+
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (argc - i != 2) {
+        usage(1);
+    }
+
+    /* none of the modes */
+    bench_setup(0);
+
+    re_str = argv[i++];
+
+    /* code generation: parsing, subset construction and writing C */
+
+    TIMER_START
+
+    nfa = malloc(sizeof(gk_nfa_t));
+    if (nfa == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        return BENCH_EXIT_NOMEM;
+    }
+
+    if (gk_compile(re_str, flags, nfa, &errstr, &err_offset) != 0) {
+        fprintf(stderr, "[error] pos %d: %s\n", err_offset, errstr);
+        return DFA_AOT_UNSUPPORTED;
+    }
+
+    if (dfa_build(nfa, max_states, &dfa) != 0) {
+        return DFA_AOT_UNSUPPORTED;
+    }
+
+    free(nfa);
+
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    snprintf(src, sizeof(src), "%s/dfa.c", dir);
+    snprintf(obj, sizeof(obj), "%s/dfa.so", dir);
+
+    if (dfa_emit(&dfa, re_str, src) != 0) {
+        dfa_cleanup(dir, src, obj, keep);
+        return 1;
+    }
+
+    TIMER_STOP
+
+    printf("DFA AOT codegen: %.05lf ms (%u states, %u byte classes).\n",
+           elapsed * 1e3, dfa.nstates, dfa.nclasses);
+
+    free(dfa.trans);
+
+    /* the compiler runs in a child process, so use the wall clock */
+
+    cmd = malloc(strlen(cc) + strlen(src) + strlen(obj) + 64);
+    if (cmd == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        dfa_cleanup(dir, src, obj, keep);
+        return BENCH_EXIT_NOMEM;
+    }
+
+    sprintf(cmd, "%s -shared -fPIC -o %s %s", cc, obj, src);
+
+    begin = get_wall_time();
+
+    if (system(cmd) != 0) {
+        fprintf(stderr, "[error] failed to run: %s\n", cmd);
+        dfa_cleanup(dir, src, obj, keep);
+        return 2;
+    }
+
+    end = get_wall_time();
+
+    free(cmd);
+
+    if (stat(obj, &st) != 0) {
+        perror("stat shared object");
+        dfa_cleanup(dir, src, obj, keep);
+        return 1;
+    }
+
+    printf("DFA AOT compile: %.05lf ms (%s, %ld bytes of shared object).\n",
+           (end - begin) * 1e3, cc, (long) st.st_size);
+
+    so = dlopen(obj, RTLD_NOW | RTLD_LOCAL);
+    if (so == NULL) {
+        fprintf(stderr, "[error] dlopen: %s\n", dlerror());
+        dfa_cleanup(dir, src, obj, keep);
+        return 2;
+    }
+
+    exec = (dfa_exec_pt) dlsym(so, "dfa_exec");
+    if (exec == NULL) {
+        fprintf(stderr, "[error] dlsym: %s\n", dlerror());
+        dfa_cleanup(dir, src, obj, keep);
+        return 2;
+    }
+
+    /* the shared object stays mapped */
+    dfa_cleanup(dir, src, obj, keep);
+
+    errno = 0;
+
+    f = fopen(argv[i], "rb");
+    if (f == NULL) {
+        perror("open file");
+        return 1;
+    }
+
+    if (fseek(f, 0L, SEEK_END) != 0) {
+        perror("seek to file end");
+        return 1;
+    }
+
+    rc = ftell(f);
+    if (rc == -1) {
+        perror("get file offset by ftell");
+        return 1;
+    }
+
+    len = bench_input_size((size_t) rc);
+
+    if (fseek(f, 0L, SEEK_SET) != 0) {
+        perror("seek to file beginning");
+        return 1;
+    }
+
+    input = malloc(len);
+    if (input == NULL) {
+        fprintf(stderr, "failed to allocate %ld bytes.\n", len);
+        return BENCH_EXIT_NOMEM;
+    }
+
+    if (fread(input, 1, len, f) < len) {
+        if (feof(f)) {
+            fprintf(stderr, "file truncated.\n");
+            return 1;
+
+        } else {
+            perror("read file");
+        }
+    }
+
+    if (fclose(f) != 0) {
+        perror("close file");
+        return 1;
+    }
+
+    bench_cache_add(input, len);
+
+    run_engine(exec, input, len, global, repeat);
+
+    free(input);
+    dlclose(so);
+
+    return 0;
+}
+
+
+static void
+run_engine(dfa_exec_pt exec, const unsigned char *input, size_t len,
+    int global, int repeat)
+{
+    int                  matches = 0;
+    long                 rc = -1;
+    size_t               rest;
+    double               begin, end;
+    bench_stats_t        st;
+    const unsigned char *p;
+
+    printf("DFA AOT ");
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        matches = 0;
+        p = input;
+        rest = len;
+
+        TIMER_START
+
+        do {
+            rc = exec(p, rest);
+
+            if (rc >= 0) {
+                matches++;
+                p += rc;
+                rest -= rc;
+            }
+
+        } while (global && rc >= 0);
+
+        TIMER_STOP
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    if (rc < 0) {
+        printf("no match");
+
+    } else {
+        printf("match (end %ld)", (long) (p - input));
+    }
+
+    printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           bench_stats_median(&st) * 1e3, matches, st.n);
+    bench_stats_print(&st);
+}
+
+
+/*
+ * Subset construction over the Glushkov automaton for an unanchored
+ * search: a DFA state is the set of live positions, and the start
+ * positions are re-added on every byte.
+ */
+static int
+dfa_build(gk_nfa_t *nfa, unsigned max_states, dfa_t *dfa)
+{
+    unsigned    i, j, k, c, nsets, hsize, h, rep[256];
+    unsigned   *map, *trans, *perm, *slots, nacc;
+    uint64_t    b[256], d, next, *sets;
+
+    memset(b, 0, sizeof(b));
+
+    for (i = 0; i < nfa->npos; i++) {
+        for (c = 0; c < 256; c++) {
+            if (gk_cls_test(nfa->cls[i], c)) {
+                b[c] |= (uint64_t) 1 << i;
+            }
+        }
+    }
+
+    /* bytes with the same position mask are interchangeable */
+
+    dfa->nclasses = 0;
+
+    for (c = 0; c < 256; c++) {
+        for (k = 0; k < c; k++) {
+            if (b[k] == b[c]) {
+                break;
+            }
+        }
+
+        if (k == c) {
+            rep[dfa->nclasses] = c;
+            dfa->cls[c] = dfa->nclasses++;
+
+        } else {
+            dfa->cls[c] = dfa->cls[k];
+        }
+    }
+
+    for (hsize = 16; hsize < max_states * 2; hsize <<= 1) {
+        /* void */
+    }
+
+    sets = malloc(max_states * sizeof(uint64_t));
+    slots = malloc(hsize * sizeof(unsigned));
+    trans = malloc((size_t) max_states * dfa->nclasses * sizeof(unsigned));
+
+    if (sets == NULL || slots == NULL || trans == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    memset(slots, 0xff, hsize * sizeof(unsigned));
+
+    sets[0] = 0;
+    slots[0] = 0;
+    nsets = 1;
+
+    for (i = 0; i < nsets; i++) {
+        d = sets[i];
+
+        next = nfa->first;
+        for (j = 0; d; j++, d >>= 1) {
+            if (d & 1) {
+                next |= nfa->follow[j];
+            }
+        }
+
+        for (k = 0; k < dfa->nclasses; k++) {
+            c = rep[k];
+            d = next & b[c];
+
+            h = (unsigned) ((d * 0x9e3779b97f4a7c15ULL) >> 40) & (hsize - 1);
+
+            while (slots[h] != (unsigned) -1 && sets[slots[h]] != d) {
+                h = (h + 1) & (hsize - 1);
+            }
+
+            if (slots[h] == (unsigned) -1) {
+                if (nsets == max_states) {
+                    fprintf(stderr, "[error] more than %u DFA states\n",
+                            max_states);
+                    return -1;
+                }
+
+                sets[nsets] = d;
+                slots[h] = nsets++;
+            }
+
+            trans[i * dfa->nclasses + k] = slots[h];
+        }
+    }
+
+    /* renumber so that the accepting states come last and a single
+     * comparison detects a match */
+
+    map = malloc(nsets * sizeof(unsigned));
+    perm = malloc(nsets * sizeof(unsigned));
+    dfa->trans = malloc((size_t) nsets * dfa->nclasses * sizeof(unsigned));
+
+    if (map == NULL || perm == NULL || dfa->trans == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    for (i = 0, k = 0; i < nsets; i++) {
+        if (!(sets[i] & nfa->last)) {
+            map[i] = k;
+            perm[k++] = i;
+        }
+    }
+
+    nacc = nsets - k;
+
+    for (i = 0; i < nsets; i++) {
+        if (sets[i] & nfa->last) {
+            map[i] = k;
+            perm[k++] = i;
+        }
+    }
+
+    for (i = 0; i < nsets; i++) {
+        for (k = 0; k < dfa->nclasses; k++) {
+            dfa->trans[i * dfa->nclasses + k]
+                = map[trans[perm[i] * dfa->nclasses + k]];
+        }
+    }
+
+    dfa->nstates = nsets;
+    dfa->naccepts = nacc;
+
+    free(map);
+    free(perm);
+    free(sets);
+    free(slots);
+    free(trans);
+
+    return 0;
+}
+
+
+static int
+dfa_emit(dfa_t *dfa, const char *re, const char *path)
+{
+    unsigned     i, k, c;
+    char        *title, *t;
+    const char  *type;
+    FILE        *out;
+
+    out = fopen(path, "w");
+    if (out == NULL) {
+        perror("open generated source");
+        return -1;
+    }
+
+    type = dfa->nstates <= 256 ? "unsigned char"
+           : dfa->nstates <= 65536 ? "unsigned short" : "unsigned int";
+
+    title = malloc(strlen(re) + sizeof("//"));
+    if (title == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        fclose(out);
+        return -1;
+    }
+
+    sprintf(title, "/%s/", re);
+
+    fprintf(out, "/* generated by dfa-aot for ");
+
+    for (t = title; *t; t++) {
+        fputc(*t, out);
+
+        /* keep the pattern, slashes included, from ending or nesting
+         * the comment, as gen/ct.pl does */
+        if ((t[0] == '*' && t[1] == '/') || (t[0] == '/' && t[1] == '*')) {
+            fputc('\\', out);
+        }
+    }
+
+    free(title);
+
+    fprintf(out, " */\n\n#include <stddef.h>\n\n");
+
+    fprintf(out, "static const unsigned char cls[256] = {");
+    for (c = 0; c < 256; c++) {
+        fprintf(out, "%s%u,", c % 16 ? " " : "\n    ", dfa->cls[c]);
+    }
+
+    fprintf(out, "\n};\n\nstatic const %s trans[%u][%u] = {\n",
+            type, dfa->nstates, dfa->nclasses);
+
+    for (i = 0; i < dfa->nstates; i++) {
+        fprintf(out, "    {");
+        for (k = 0; k < dfa->nclasses; k++) {
+            fprintf(out, "%s%u", k ? ", " : "",
+                    dfa->trans[i * dfa->nclasses + k]);
+        }
+
+        fprintf(out, "},\n");
+    }
+
+    /* the start state is 0; bytes leaving it are the only ones that can
+     * begin a match, so the inner loop skips the others */
+
+    fprintf(out, "};\n\n"
+            "long\n"
+            "dfa_exec(const unsigned char *p, size_t len)\n"
+            "{\n"
+            "    size_t    i;\n"
+            "    unsigned  s = 0;\n"
+            "\n"
+            "    for (i = 0; i < len; i++) {\n"
+            "        if (s == 0) {\n"
+            "            while (trans[0][cls[p[i]]] == 0) {\n"
+            "                if (++i == len) {\n"
+            "                    return -1;\n"
+            "                }\n"
+            "            }\n"
+            "        }\n"
+            "\n"
+            "        s = trans[s][cls[p[i]]];\n"
+            "\n"
+            "        if (s >= %uU) {\n"
+            "            return (long) i + 1;\n"
+            "        }\n"
+            "    }\n"
+            "\n"
+            "    return -1;\n"
+            "}\n", dfa->nstates - dfa->naccepts);
+
+    if (fclose(out) != 0) {
+        perror("close generated source");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+dfa_cleanup(const char *dir, const char *src, const char *obj, int keep)
+{
+    if (keep) {
+        fprintf(stderr, "generated files kept in %s\n", dir);
+        return;
+    }
+
+    unlink(src);
+    unlink(obj);
+    rmdir(dir);
+}
+
+
+static void
+usage(int rc)
+{
+    fprintf(stderr, "usage: dfa-aot [options] <regexp> <file>\n"
+            "options:\n"
+            "   -i                  use case insensitive matching\n"
+            "   -g                  enable the global search mode\n"
+            "   --cc=CMD            C compiler command for the generated\n"
+            "                       matcher. default to $CC or \"cc -O3\".\n"
+            "   --max-states=N      give up when the DFA grows beyond N\n"
+            "                       states. default to 10000.\n"
+            "   --keep              keep the generated C source and shared\n"
+            "                       object.\n"
+            "   --repeat=N          repeat the test at least N times; report\n"
+            "                       the median. default to 5.\n"
+            BENCH_USAGE
+            "exits with 4 for a pattern it cannot compile to a DFA.\n");
+    exit(rc);
+}
@@ -5,6 +5,10 @@ use warnings;
 
 use Getopt::Std;
 
+sub plot_sweep ($$$);
+sub plot_heatmap ($$$);
+sub cache_sizes ();
+
 my %opts;
 getopts("o:", \%opts) or die;
 
@@ -23,18 +27,79 @@ my $total_size;
 my $title;
 my @data;
 my $max_y = 0;
+my $sweep;
+my $heatmap;
+my $engine;     # the engine of the "# slice:" lines that follow
+my $mode = "";
+my $roofline;
+my $last;       # the row of the last engine, for its "# energy:" line
+my $max_e = 0;
 while (<$in>) {
-    if (m{^\./bench\d*\s+(.*?)\s+(\S+)$}) {
+    if (m{^\./\w+\s.*?--heatmap\S*\s+(.*?)\s+(\S+)$}) {
+        # drivers run with --heatmap: one row of slices per engine, the
+        # drivers of the first regex and file only
+        if ($found && (!$heatmap || $heatmap->{re} ne $1
+                       || $heatmap->{file} ne $2))
+        {
+            last;
+        }
+        $heatmap ||= { re => $1, file => $2, engines => [], slices => {} };
+        $found = 1;
+
+    } elsif ($heatmap) {
+        if (/^(\w+ .*?)\s*(?:match|no match)\b.*? ms elapsed/) {
+            ($engine = $1) =~ s/\s*\(heatmap\)//;
+            $engine =~ s/^\s+|\s+$//sg;
+            push @{ $heatmap->{engines} }, $engine;
+            $heatmap->{slices}{$engine} = [];
+
+        } elsif ($engine && /^# slice: (\d+) ((?:\d+)(?:\.\d+)?) MB\/s/) {
+            push @{ $heatmap->{slices}{$engine} }, [$1, $2 * 1e6 / 1024 / 1024];
+
+        } elsif (/^# heatmap: \d+ slices of (\d+) bytes/) {
+            $heatmap->{slice} = $1;
+        }
+
+    } elsif (m{^\./bench-sweep\s+(.*?)\s+(\S+)$}) {
+        # the output of bench-sweep: one section per input size
+        if ($found) {
+            last;
+        }
+        $sweep = { re => $1, file => $2, sizes => [], engines => [],
+                   ms => {} };
+        $found = 1;
+
+    } elsif ($sweep && /^-+ \S+ (\d+)$/) {
+        $total_size = $1;
+        push @{ $sweep->{sizes} }, $total_size;
+
+    } elsif ($sweep) {
+        if (defined $total_size
+            && /^(\w+ .*?)\s*(?:match|no match)\b.*?((?:\d+)(?:\.\d+)?) ms elapsed/)
+        {
+            my ($name, $ms) = ($1, $2);
+            $name =~ s/^\s+|\s+$//sg;
+            if (!exists $sweep->{ms}{$name}) {
+                push @{ $sweep->{engines} }, $name;
+            }
+            $sweep->{ms}{$name}{$total_size} = $ms;
+        }
+
+    } elsif (m{^\./bench(?:\d*|-cache)\s+(.*?)\s+(\S+)(?:\s+(\d+))?\s*$}) {
         if ($found) {
             last;
         }
-        my ($re, $file) = ($1, $2);
+        my ($re, $file, $size) = ($1, $2, $3);
         #warn $re;
         my @info = stat $file;
         $total_size = $info[7];
         if (!defined $total_size) {
             die "failed to stat $file.\n";
         }
+        if (defined $size && $size < $total_size) {
+            # bench-cache over a prefix of the file
+            $total_size = $size;
+        }
         my $msize = sprintf("%.01f MB", $total_size / 1024 / 1024);
         #warn "RE: $re";
         my $n = ($re =~ s/(.{60,70}?.*?(?![\.\w*?[:^ascii:]]))/$1\n/g);
@@ -46,9 +111,25 @@ while (<$in>) {
         $title = "Benchmarking regex /$re/" . ($n ? "\\n" : " ") . "matching file $file of size $msize";
         #print $out "$title\n";
         $found = 1;
-    } elsif ($found && /^(\w+ .*?)\s*(?:match|error|no match)/) {
-        my $name = $1;
+    } elsif ($found && /^-+ (warm|cold|cold-all)$/) {
+        # bench-cache runs every engine once in each cache mode
+        $mode = " ($1)";
+    } elsif ($found && /^(Baseline .*?)\s*(done|timeout|oom|crash)\b/) {
+        # the fastest kernel of ./baseline is the roofline
+        my ($name, $status) = ($1, $2);
+        undef $last;
+        if ($status eq 'done' && /((?:\d+)(?:\.\d+)?) ms elapsed/) {
+            my $speed = $total_size / $1 * 1000 / 1024 / 1024;
+            if (!$roofline || $speed > $roofline->[1]) {
+                $roofline = [$name, $speed];
+            }
+        }
+    } elsif ($found
+             && /^(\w+ .*?)\s*(match|error|no match|timeout|oom|crash)\b/)
+    {
+        my ($name, $status) = ($1, $2);
         $name =~ s/^\s+|\s+$//sg;
+        $name .= $mode;
         if (/((?:\d+)(?:\.\d+)?) ms elapsed/) {
             my $time = $1;
             my $speed = sprintf "%.01lf", $total_size/$time*1000/1024/1024;
@@ -58,17 +139,47 @@ while (<$in>) {
                 $max_y = $speed;
             }
             my $label;
-            if (/\berror:/) {
-                $label = "error";
+            if ($status !~ /match/) {
+                # errors and the results of runcase: timeout, oom, crash
+                $label = $status;
             } else {
                 $label = $speed;
             }
-            push @data, "$name,$speed,$label";
+            push @data, [$name, $speed, $label, $status =~ /match/];
+            $last = $data[-1];
+        }
+    } elsif ($found && $last
+             && /^# energy: .*?((?:\d+)(?:\.\d+)?) J\/GB/ && $1 > 0)
+    {
+        # the drivers run with --energy: megabytes matched per joule
+        my $mbj = sprintf "%.01lf", 1e9 / $1 / 1024 / 1024;
+        $last->[4] = $mbj;
+        if ($mbj > $max_e) {
+            $max_e = $mbj;
         }
+        undef $last;
     }
 }
 close $in;
 
+if ($sweep) {
+    plot_sweep($sweep, "a.gnu", "a.csv");
+    my $cmd = "gnuplot a.gnu";
+    print "$cmd\n";
+    system($cmd) == 0 or die;
+    print "$outfile generated.\n";
+    exit;
+}
+
+if ($heatmap) {
+    plot_heatmap($heatmap, "a.gnu", "a.csv");
+    my $cmd = "gnuplot a.gnu";
+    print "$cmd\n";
+    system($cmd) == 0 or die;
+    print "$outfile generated.\n";
+    exit;
+}
+
 if (!@data) {
     die "No benchmark data found!";
 }
@@ -77,17 +188,40 @@ if (!$title) {
     die "No ./bench command found!";
 }
 
+if ($roofline) {
+    # every engine as a fraction of the roofline, which becomes the first
+    # bar for reference
+    my ($kernel, $speed) = @$roofline;
+    $kernel =~ s/^Baseline\s+//;
+    printf "roofline: %.01f MB/s (%s)\n", $speed, $kernel;
+    for my $row (@data) {
+        next if !$row->[3];
+        my $pct = $row->[1] / $speed * 100;
+        printf "%s: %.01f MB/s, %.01f%% of the roofline\n", $row->[0],
+               $row->[1], $pct;
+        $row->[2] = sprintf "%s (%.0f%%)", $row->[1], $pct;
+    }
+    $speed = sprintf "%.01lf", $speed;
+    unshift @data, ["roofline ($kernel)", $speed, $speed];
+    if ($speed > $max_y) {
+        $max_y = $speed;
+    }
+}
+
 $max_y *= 1.1;
 
 my $label_delta = $max_y / 25;
 #warn $label_delta;
 
+# the energy efficiency goes in a second chart next to the speed
+my $size = $max_e ? "1600, 500" : "800, 500";
+
 my $gnufile = "a.gnu";
 open my $out, ">$gnufile"
     or die "Cannot open $gnufile for writing: $!\n";
 
 print $out <<_EOC_;
-set terminal pngcairo noenhanced background "#ffffff" fontscale 1.0 size 800, 500 enhanced font 'andale mono,10'
+set terminal pngcairo noenhanced background "#ffffff" fontscale 1.0 size $size enhanced font 'andale mono,10'
 
 set encoding utf8
 set boxwidth 1
@@ -99,17 +233,38 @@ set style fill solid 1.0 border -1
 set xtics border in scale 0,10  nomirror rotate by -45
 set ylabel "Matching Speed (Mega Bytes/Sec)" font "bold"
 set title "$title" noenhanced
+_EOC_
+
+if ($max_e) {
+    print $out "set multiplot layout 1, 2\n";
+}
+
+print $out <<_EOC_;
 plot "a.csv" using (\$0):2:(\$0):xticlabels(1) with boxes lc variable notitle, \\
      "" using (\$0):(\$2+$label_delta):3 with labels notitle
 _EOC_
 
+if ($max_e) {
+    $max_e *= 1.1;
+    my $e_delta = $max_e / 25;
+    print $out <<_EOC_;
+set yrange [0:$max_e]
+set ylabel "Energy Efficiency (Mega Bytes/Joule)" font "bold"
+set title "Package and DRAM energy (RAPL) per megabyte matched" noenhanced
+plot "a.csv" using (\$0):4:(\$0):xticlabels(1) with boxes lc variable notitle, \\
+     "" using (\$0):(\$4+$e_delta):4 with labels notitle
+unset multiplot
+_EOC_
+}
+
 close $out;
 
 my $csvfile = "a.csv";
 open $out, ">$csvfile"
     or die "Cannot open $csvfile for writing: $!\n";
 for my $row (@data) {
-    print $out "$row\n";
+    # NaN leaves out the energy bar of the engines without one
+    print $out join(",", @{$row}[0 .. 2], $row->[4] // "NaN"), "\n";
 }
 close $out;
 
@@ -117,3 +272,195 @@ my $cmd = "gnuplot $gnufile";
 print "$cmd\n";
 system($cmd) == 0 or die;
 print "$outfile generated.\n";
+
+# Draws one throughput curve per engine over the input sizes of a
+# bench-sweep run. Each engine's times are fitted with
+#
+#   time = overhead + size / throughput
+#
+# by least squares weighted by 1/time^2, so that the small inputs, where
+# the overhead shows, count as much as the large ones.
+sub plot_sweep ($$$) {
+    my ($sweep, $gnufile, $csvfile) = @_;
+
+    my @engines = @{ $sweep->{engines} };
+    if (!@engines) {
+        die "No benchmark data found!";
+    }
+
+    open my $out, ">$csvfile"
+        or die "Cannot open $csvfile for writing: $!\n";
+    my @plots;
+    my $idx = 0;
+    for my $name (@engines) {
+        my $runs = $sweep->{ms}{$name};
+        my ($s, $sx, $sy, $sxx, $sxy) = (0) x 5;
+        for my $size (@{ $sweep->{sizes} }) {
+            my $ms = $runs->{$size};
+            next if !defined $ms || $ms <= 0;
+            my $w = 1 / ($ms * $ms);
+            $s += $w;
+            $sx += $w * $size;
+            $sy += $w * $ms;
+            $sxx += $w * $size * $size;
+            $sxy += $w * $size * $ms;
+            printf $out "%d,%.01f\n", $size, $size / $ms * 1000 / 1024 / 1024;
+        }
+        print $out "\n\n";
+
+        my $fit = "";
+        my $det = $s * $sxx - $sx * $sx;
+        if ($det > 0) {
+            my $per_byte = ($s * $sxy - $sx * $sy) / $det;
+            my $overhead = ($sy - $per_byte * $sx) / $s;
+            if ($per_byte > 0) {
+                my $speed = 1000 / $per_byte / 1024 / 1024;
+                printf "%s: %.01f MB/s, %.03f us per call\n", $name, $speed,
+                       $overhead * 1000;
+                $fit = sprintf " (%.01f MB/s, %.02f us/call)", $speed,
+                               $overhead * 1000;
+            }
+        }
+
+        (my $title = "$name$fit") =~ s/"/\\"/g;
+        push @plots, qq{"$csvfile" index $idx using 1:2 with linespoints }
+                     . qq{title "$title"};
+        $idx++;
+    }
+    close $out;
+
+    my $re = $sweep->{re};
+    $re =~ s/^'(.*)'$/$1/;
+    $re =~ s{\\}{\\\\}g;
+    $re =~ s{"}{\\"}g;
+    $re =~ s{`}{\\\\x60}g;
+    my $title = "Throughput of regex /$re/ versus the size of the input\\n"
+                . "(prefixes of $sweep->{file})";
+
+    # mark where the input outgrows each cache level
+    my $arrows = "";
+    my $max_size = $sweep->{sizes}[-1];
+    for my $cache (cache_sizes()) {
+        my ($level, $size) = @$cache;
+        next if $size > $max_size;
+        $arrows .= "set arrow from $size, graph 0 to $size, graph 1 nohead "
+                   . "dt 2 lc rgb \"#808080\"\n"
+                   . "set label \"L$level\" at $size, graph 0.97 offset 0.5\n";
+    }
+
+    open $out, ">$gnufile"
+        or die "Cannot open $gnufile for writing: $!\n";
+    print $out <<_EOC_;
+set terminal pngcairo noenhanced background "#ffffff" fontscale 1.0 size 800, 500 enhanced font 'andale mono,10'
+
+set encoding utf8
+set grid
+set datafile separator ","
+set output "$outfile"
+set logscale x 2
+set format x "%.0b%B"
+set yrange [0:*]
+set key outside bottom center horizontal
+set xlabel "Input Size (Bytes)" font "bold"
+set ylabel "Matching Speed (Mega Bytes/Sec)" font "bold"
+set title "$title" noenhanced
+$arrows
+_EOC_
+    print $out "plot ", join(", \\\n     ", @plots), "\n";
+    close $out;
+}
+
+# Draws the throughput of every slice of the input of a --heatmap run as
+# a heatmap with one row per engine and the offset into the file along
+# the x axis, on a log color scale, so that the regions where an engine
+# crawls stand out against the rest of its row.
+sub plot_heatmap ($$$) {
+    my ($heatmap, $gnufile, $csvfile) = @_;
+
+    my @engines = @{ $heatmap->{engines} };
+    if (!@engines) {
+        die "No benchmark data found!";
+    }
+
+    open my $out, ">$csvfile"
+        or die "Cannot open $csvfile for writing: $!\n";
+    my @ytics;
+    my $idx = 0;
+    for my $name (@engines) {
+        my $slices = $heatmap->{slices}{$name};
+        my ($min, $max);
+        for my $slice (@$slices) {
+            my ($offset, $speed) = @$slice;
+            if (!defined $min || $speed < $min) {
+                $min = $speed;
+            }
+            if (!defined $max || $speed > $max) {
+                $max = $speed;
+            }
+            # NaN leaves out the slices too short to time
+            printf $out "%.03f,%d,%s\n", $offset / 1024 / 1024, $idx,
+                   $speed > 0 ? sprintf("%.01f", $speed) : "NaN";
+        }
+        print $out "\n";
+
+        if (defined $min) {
+            printf "%s: %.01f .. %.01f MB/s over %d slices\n", $name, $min,
+                   $max, scalar @$slices;
+        }
+
+        (my $label = $name) =~ s/"/\\"/g;
+        push @ytics, qq{"$label" $idx};
+        $idx++;
+    }
+    close $out;
+
+    my $re = $heatmap->{re};
+    $re =~ s/^'(.*)'$/$1/;
+    $re =~ s{\\}{\\\\}g;
+    $re =~ s{"}{\\"}g;
+    $re =~ s{`}{\\\\x60}g;
+    my $size = sprintf "%.0f KB", ($heatmap->{slice} // 0) / 1024;
+    my $title = "Throughput of regex /$re/ along $heatmap->{file}\\n"
+                . "(slices of $size)";
+    my $height = 150 + 40 * @engines;
+    my $ytics = join ", ", @ytics;
+    my $max_y = @engines - 0.5;
+
+    open $out, ">$gnufile"
+        or die "Cannot open $gnufile for writing: $!\n";
+    print $out <<_EOC_;
+set terminal pngcairo noenhanced background "#ffffff" fontscale 1.0 size 1000, $height enhanced font 'andale mono,10'
+
+set encoding utf8
+set datafile separator ","
+set output "$outfile"
+set xrange [*:*] noextend
+set yrange [-0.5:$max_y] reverse
+set ytics ($ytics) nomirror
+set logscale cb
+set palette defined (0 "#b2182b", 0.5 "#fddbc7", 1 "#2166ac")
+set xlabel "Offset (Mega Bytes)" font "bold"
+set cblabel "Matching Speed (Mega Bytes/Sec)" font "bold"
+set title "$title" noenhanced
+plot "$csvfile" using 1:2:3 with image notitle
+_EOC_
+    close $out;
+}
+
+# returns [level, bytes] for the data caches of CPU 0 (Linux only)
+sub cache_sizes () {
+    my @caches;
+    for my $dir (glob "/sys/devices/system/cpu/cpu0/cache/index*") {
+        my %info;
+        for my $key (qw(level type size)) {
+            open my $in, "$dir/$key" or next;
+            chomp($info{$key} = <$in> // "");
+            close $in;
+        }
+        next if !$info{type} || $info{type} eq 'Instruction';
+        next if !$info{size} || $info{size} !~ /^(\d+)([KM]?)$/;
+        my $size = $1 * ($2 eq 'K' ? 1024 : $2 eq 'M' ? 1024 * 1024 : 1);
+        push @caches, [$info{level}, $size];
+    }
+    return sort { $a->[0] <=> $b->[0] } @caches;
+}
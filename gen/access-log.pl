@@ -0,0 +1,62 @@
+#!/usr/bin/env perl
+
+# an access log in the combined log format of Apache and nginx, one
+# request per line, for the field extraction mode (--fields)
+
+use strict;
+use warnings;
+
+my $lines = shift || 200_000;
+
+srand 42;
+
+my $outfile = "access.log";
+open my $out, ">$outfile" or
+    die "Cannot open $outfile for writing: $!\n";
+
+my @users = qw( - - - - alice bob carol );
+my @months = qw( Jan Feb Mar Apr May Jun Jul Aug Sep Oct Nov Dec );
+my @methods = qw( GET GET GET GET POST POST HEAD PUT DELETE );
+my @dirs = qw( api static images css js blog user search cart );
+my @exts = qw( html php json png jpg css js );
+my @protos = ("HTTP/1.0", "HTTP/1.1", "HTTP/1.1", "HTTP/2.0");
+my @statuses = qw( 200 200 200 200 200 304 301 302 404 403 500 );
+my @agents = (
+    "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36",
+    "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:121.0) Gecko/20100101 Firefox/121.0",
+    "Mozilla/5.0 (iPhone; CPU iPhone OS 17_1 like Mac OS X) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.1 Mobile/15E148 Safari/604.1",
+    "curl/8.4.0",
+    "Googlebot/2.1 (+http://www.google.com/bot.html)",
+);
+
+sub pick {
+    my $list = shift;
+    return $list->[int rand @$list];
+}
+
+for (my $i = 0; $i < $lines; $i++) {
+    my $ip = join ".", map { 1 + int rand 254 } 1 .. 4;
+
+    my $path = "";
+    for (my $d = 1 + int rand 3; $d > 0; $d--) {
+        $path .= "/" . pick(\@dirs);
+    }
+    $path .= "/" . int(rand 10000) . "." . pick(\@exts);
+
+    if (rand() < 0.3) {
+        $path .= "?id=" . int(rand 100000) . "&page=" . int(rand 50);
+    }
+
+    my $status = pick(\@statuses);
+    my $bytes = $status eq "304" ? "-" : int rand 200000;
+    my $referer = rand() < 0.4 ? "-" : "https://example.com" . $path;
+
+    printf $out "%s - %s [%02d/%s/%d:%02d:%02d:%02d +0000] \"%s %s %s\" "
+                . "%s %s \"%s\" \"%s\"\n",
+        $ip, pick(\@users), 1 + int rand 28, pick(\@months),
+        2020 + int rand 5, int rand 24, int rand 60, int rand 60,
+        pick(\@methods), $path, pick(\@protos), $status, $bytes,
+        $referer, pick(\@agents);
+}
+
+close $out;
@@ -0,0 +1,370 @@
+#!/usr/bin/env perl
+
+# Turns the regexes of the "bench" target in the Makefile into
+# compile-time matchers (see ctmatch.hh) and writes the C++ translation
+# unit to stdout.
+
+use strict;
+use warnings;
+
+sub unquote ($);
+sub parse_re ($);
+sub parse_alt ($);
+sub parse_seq ($);
+sub parse_atom ($);
+sub parse_class ($);
+sub escape_class ($);
+sub emit ($);
+sub set_type ($);
+
+my $infile = shift || "Makefile";
+open my $in, $infile
+    or die "Cannot open $infile for reading: $!\n";
+my @patterns;
+my %seen;
+my $found;
+while (<$in>) {
+    if (!$found && /^bench:/) {
+        $found = 1;
+        next;
+    }
+    if ($found) {
+        if (/^\S/) {
+            last;
+        }
+        if (m{^\t\@?(?:export \w+=[^;]*;\s+)?\./bench\d*\s+(.+)}) {
+            (my $args = $1) =~ s/\$\$/\$/g;
+            my $re = unquote($args);
+            if (defined $re && !$seen{$re}++) {
+                push @patterns, $re;
+            }
+        }
+    }
+}
+close $in;
+
+if (!@patterns) {
+    die "No ./bench command found in $infile!\n";
+}
+
+print <<_EOC_;
+/* generated by gen/ct.pl from $infile; do not edit */
+
+#include "ctmatch.hh"
+
+
+using namespace ct;
+
+_EOC_
+
+my @cases;
+my $i = 0;
+for my $re (@patterns) {
+    # the slashes around it may close or open a comment too: /x*/
+    (my $comment = "/$re/") =~ s{\*/}{*\\/}g;
+    $comment =~ s{/\*}{/\\*}g;
+    my $type = eval { emit(parse_re($re)) };
+    if (!defined $type) {
+        (my $err = $@) =~ s/\s+$//;
+        print "/* skipped $comment: $err */\n\n";
+        warn "skipped /$re/: $err\n";
+        next;
+    }
+
+    print <<_EOC_;
+/* $comment */
+typedef $type re_$i;
+
+bool
+ct_case_$i(const uchar *begin, const uchar *end, const uchar *from,
+    const uchar **mstart, const uchar **mend)
+{
+    return search<re_$i>(begin, end, from, mstart, mend);
+}
+
+
+_EOC_
+
+    (my $lit = $re) =~ s/([\\"])/\\$1/g;
+    $lit =~ s/([^\x20-\x7e])/sprintf("\\%03o", ord $1)/ge;
+    push @cases, qq{    { "$lit", ct_case_$i },\n};
+    $i++;
+}
+
+print "const ct::entry  ct_cases[] = {\n", @cases, "    { NULL, NULL }\n};\n";
+
+# returns the first shell word of the string, honoring '', "" and $''
+sub unquote ($) {
+    my $s = shift;
+    my $word = "";
+    while (length $s) {
+        if ($s =~ s/^\s.*//s) {
+            last;
+        } elsif ($s =~ s/^'([^']*)'//) {
+            $word .= $1;
+        } elsif ($s =~ s/^\$'((?:[^'\\]|\\.)*)'//) {
+            my $w = $1;
+            my %ctrl = (n => "\n", t => "\t", r => "\r", a => "\a",
+                        f => "\f", v => "\cK", e => "\e", b => "\b",
+                        "\\" => "\\", "'" => "'", '"' => '"');
+            $w =~ s/\\(x[0-9a-fA-F]{1,2}|.)/
+                my $e = $1;
+                $e =~ m{^x} ? chr(hex substr $e, 1)
+                : exists $ctrl{$e} ? $ctrl{$e} : "\\$e"/ge;
+            $word .= $w;
+        } elsif ($s =~ s/^"((?:[^"\\]|\\.)*)"//) {
+            (my $w = $1) =~ s/\\([\\"\$`])/$1/g;
+            $word .= $w;
+        } elsif ($s =~ s/^\\(.)//) {
+            $word .= $1;
+        } elsif ($s =~ s/^([^\s'"\\\$]+|\$)//) {
+            $word .= $1;
+        } else {
+            return undef;
+        }
+    }
+    return $word;
+}
+
+# The parser works on a state hash { s => remaining pattern, i => (?i) }
+# and returns nodes like { t => 'set', set => [256 flags] }.
+
+sub parse_re ($) {
+    my %st = (s => shift, i => 0);
+    my $node = parse_alt(\%st);
+    if (length $st{s}) {
+        die "unmatched ) before \"$st{s}\"\n";
+    }
+    return $node;
+}
+
+sub parse_alt ($) {
+    my $st = shift;
+    my @alts = (parse_seq($st));
+    while ($st->{s} =~ s/^\|//) {
+        push @alts, parse_seq($st);
+    }
+    return @alts == 1 ? $alts[0] : { t => 'alt', kids => \@alts };
+}
+
+sub parse_seq ($) {
+    my $st = shift;
+    my @kids;
+    while (length $st->{s} && $st->{s} !~ /^[|)]/) {
+        my $atom = parse_atom($st);
+        next if !defined $atom;
+        while ($st->{s} =~ s/^(?:([*+?])|\{(\d+)(?:(,)(\d*))?\})(\?|\+)?//) {
+            my ($min, $max);
+            if (defined $1) {
+                ($min, $max) = $1 eq '*' ? (0, -1) : $1 eq '+' ? (1, -1)
+                             : (0, 1);
+            } else {
+                $min = $2;
+                $max = !defined $3 ? $2 : length $4 ? $4 : -1;
+                die "numbers out of order in {} quantifier\n"
+                    if $max != -1 && $max < $min;
+            }
+            my $greedy = 1;
+            if (defined $5) {
+                die "possessive quantifiers are not supported\n"
+                    if $5 eq '+';
+                $greedy = 0;
+            }
+            if ($max == -1 && nullable($atom)) {
+                die "unbounded repeat of a nullable expression\n";
+            }
+            $atom = { t => 'rep', min => $min, max => $max,
+                      greedy => $greedy, kid => $atom };
+        }
+        push @kids, $atom;
+    }
+    return @kids == 1 ? $kids[0] : { t => 'seq', kids => \@kids };
+}
+
+sub nullable {
+    my $n = shift;
+    my $t = $n->{t};
+    return 0 if $t eq 'set';
+    return 1 if $t eq 'wordb';
+    return $n->{min} == 0 || nullable($n->{kid}) if $t eq 'rep';
+    if ($t eq 'alt') {
+        for my $kid (@{ $n->{kids} }) {
+            return 1 if nullable($kid);
+        }
+        return 0;
+    }
+    for my $kid (@{ $n->{kids} }) {
+        return 0 if !nullable($kid);
+    }
+    return 1;
+}
+
+sub new_set {
+    my ($st, @chars) = @_;
+    my @set = (0) x 256;
+    for my $c (@chars) {
+        $set[$c] = 1;
+        if ($st->{i} && chr($c) =~ /[a-zA-Z]/) {
+            $set[ord lc chr $c] = $set[ord uc chr $c] = 1;
+        }
+    }
+    return { t => 'set', set => \@set };
+}
+
+sub parse_atom ($) {
+    my $st = shift;
+    if ($st->{s} =~ s/^\(\?i\)//) {
+        $st->{i} = 1;
+        return undef;
+    }
+    if ($st->{s} =~ s/^\((\?:)?//) {
+        my $node = parse_alt($st);
+        $st->{s} =~ s/^\)// or die "missing )\n";
+        return $node;
+    }
+    if ($st->{s} =~ s/^\[//) {
+        return parse_class($st);
+    }
+    if ($st->{s} =~ s/^\.//) {
+        return new_set($st, 0 .. 255);
+    }
+    if ($st->{s} =~ s/^\\([bB])//) {
+        return { t => 'wordb', negate => $1 eq 'B' };
+    }
+    if ($st->{s} =~ s/^\\([dDwWsS])//) {
+        my @chars = escape_class($1);
+        return new_set($st, @chars);
+    }
+    if ($st->{s} =~ /^[\^\$]/) {
+        die "anchors are not supported\n";
+    }
+    if ($st->{s} =~ /^[*+?]/) {
+        die "nothing to repeat\n";
+    }
+    if ($st->{s} =~ s/^\\(x[0-9a-fA-F]{1,2}|[ntrfv]|[^a-zA-Z0-9])//) {
+        my $e = $1;
+        my %ctrl = (n => 10, t => 9, r => 13, f => 12, v => 11);
+        my $c = $e =~ /^x/ ? hex(substr $e, 1)
+              : exists $ctrl{$e} ? $ctrl{$e} : ord $e;
+        return new_set($st, $c);
+    }
+    if ($st->{s} =~ /^\\/) {
+        die "unsupported escape sequence\n";
+    }
+    $st->{s} =~ s/^(.)//s;
+    return new_set($st, ord $1);
+}
+
+sub escape_class ($) {
+    my $e = shift;
+    my @chars;
+    if (lc $e eq 'd') {
+        @chars = (ord('0') .. ord('9'));
+    } elsif (lc $e eq 'w') {
+        @chars = (ord('0') .. ord('9'), ord('a') .. ord('z'),
+                  ord('A') .. ord('Z'), ord('_'));
+    } else {
+        @chars = (9 .. 13, 32);
+    }
+    if ($e =~ /[A-Z]/) {
+        my %in = map { $_ => 1 } @chars;
+        @chars = grep { !$in{$_} } 0 .. 255;
+    }
+    return @chars;
+}
+
+sub parse_class ($) {
+    my $st = shift;
+    my $negate = $st->{s} =~ s/^\^//;
+    my @chars;
+    my $first = 1;
+    while (1) {
+        die "missing terminating ]\n" if !length $st->{s};
+        last if !$first && $st->{s} =~ s/^\]//;
+        $first = 0;
+        my $c;
+        if ($st->{s} =~ s/^\\([dDwWsS])//) {
+            push @chars, escape_class($1);
+            next;
+        }
+        if ($st->{s} =~ s/^\\(.)//s) {
+            my %ctrl = (n => 10, t => 9, r => 13, f => 12, v => 11, b => 8);
+            $c = exists $ctrl{$1} ? $ctrl{$1} : ord $1;
+        } else {
+            $st->{s} =~ s/^(.)//s;
+            $c = ord $1;
+        }
+        if ($st->{s} =~ s/^-(?=[^\]])//) {
+            $st->{s} =~ s/^\\?(.)//s;
+            my $to = ord $1;
+            die "range out of order in character class\n" if $to < $c;
+            push @chars, $c .. $to;
+            next;
+        }
+        push @chars, $c;
+    }
+    my $node = new_set($st, @chars);
+    if ($negate) {
+        $_ = !$_ || 0 for @{ $node->{set} };
+    }
+    return $node;
+}
+
+sub set_type ($) {
+    my $set = shift;
+    my @members = grep { $set->[$_] } 0 .. 255;
+    if (@members == 256) {
+        return "any";
+    }
+    if (@members == 1) {
+        return "chr<$members[0]>";
+    }
+    my @ranges;
+    for my $c (@members) {
+        if (@ranges && $ranges[-1][1] == $c - 1) {
+            $ranges[-1][1] = $c;
+        } else {
+            push @ranges, [$c, $c];
+        }
+    }
+    return "set<" . join(", ", map { "range<$_->[0], $_->[1]>" } @ranges)
+           . ">";
+}
+
+sub emit ($) {
+    my $n = shift;
+    my $t = $n->{t};
+    if ($t eq 'set') {
+        return set_type($n->{set});
+    }
+    if ($t eq 'wordb') {
+        return "wordb<" . ($n->{negate} ? "true" : "false") . ">";
+    }
+    if ($t eq 'rep') {
+        return "rep<$n->{min}, $n->{max}, "
+               . ($n->{greedy} ? "true" : "false") . ", "
+               . emit($n->{kid}) . ">";
+    }
+    if ($t eq 'alt') {
+        return "alt<" . join(", ", map { emit($_) } @{ $n->{kids} }) . ">";
+    }
+
+    # runs of single characters in a sequence become literal strings
+    my @types;
+    my @run;
+    for my $kid (@{ $n->{kids} }, undef) {
+        my $type = defined $kid ? emit($kid) : undef;
+        if (defined $type && $type =~ /^chr<(\d+)>$/) {
+            push @run, $1;
+            next;
+        }
+        if (@run > 1) {
+            push @types, "str<" . join(", ", @run) . ">";
+        } elsif (@run) {
+            push @types, "chr<$run[0]>";
+        }
+        @run = ();
+        push @types, $type if defined $type;
+    }
+    return @types == 1 ? $types[0] : "seq<" . join(", ", @types) . ">";
+}
@@ -0,0 +1,21 @@
+#!/usr/bin/env perl
+
+# Writes the inputs of the bench-redos target: redos-N.txt holds N "a"
+# characters followed by a "!", so that none of the pathological
+# patterns there can match and backtracking engines have to try every
+# way of splitting the run of "a"s.
+
+use strict;
+use warnings;
+
+my @sizes = @ARGV ? @ARGV : (16, 24, 32, 1024, 65536, 1048576);
+for my $n (@sizes) {
+    if ($n !~ /^\d+$/) {
+        die "Bad input size: $n\n";
+    }
+    my $outfile = "redos-$n.txt";
+    open my $out, ">$outfile" or
+        die "Cannot open $outfile for writing: $!\n";
+    print $out "a" x $n . "!";
+    close $out;
+}
@@ -18,6 +18,23 @@
 #error "Unable to define get_cpu_time( ) for an unknown OS."
 #endif
 
+#if defined(__linux__)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#endif
+
+
+/* where Linux exposes the RAPL energy counters; see get_energy( ) */
+#ifndef POWERCAP_DIR
+#define POWERCAP_DIR  "/sys/class/powercap"
+#endif
+
+enum {
+    ENERGY_PACKAGE = 0,
+    ENERGY_DRAM    = 1
+};
+
 
 /**
  * Returns the amount of CPU time in seconds used by the current process,
@@ -100,3 +117,114 @@ get_cpu_time(void)
 
     return -1.0;                /* Failed. */
 }
+
+
+/**
+ * Returns the elapsed real time in seconds from an arbitrary fixed
+ * point, or -1.0 if an error occurred. Used for work done outside
+ * of the current process, like running the C compiler.
+ */
+static inline double
+get_wall_time(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, now;
+    if ( QueryPerformanceFrequency( &freq ) && QueryPerformanceCounter( &now ) )
+        return (double)now.QuadPart / (double)freq.QuadPart;
+
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    if ( clock_gettime( CLOCK_MONOTONIC, &ts ) != -1 )
+        return (double)ts.tv_sec +
+            (double)ts.tv_nsec / 1000000000.0;
+#endif
+
+    return -1.0;                /* Failed. */
+}
+
+
+/**
+ * Reads the first line of a file of a RAPL powercap zone into buf.
+ * Returns 0, or -1 if the file is missing or not readable.
+ */
+static inline int
+read_powercap(const char *zone, const char *file, char *buf, size_t size)
+{
+#if defined(__linux__)
+    char  path[256];
+    FILE *f;
+
+    snprintf( path, sizeof(path), POWERCAP_DIR "/%s/%s", zone, file );
+
+    f = fopen( path, "r" );
+    if ( f == NULL )
+        return -1;
+
+    if ( fgets( buf, (int)size, f ) == NULL ) {
+        fclose( f );
+        return -1;
+    }
+
+    fclose( f );
+    buf[strcspn( buf, "\n" )] = '\0';
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+
+/**
+ * Returns the energy in joules used by the CPU packages (ENERGY_PACKAGE)
+ * or by their DRAM (ENERGY_DRAM) from an arbitrary fixed point, summed
+ * over the packages, or -1.0 where the intel-rapl powercap zones are
+ * not exposed or their counters not readable (only root can read them
+ * on recent kernels). The energy is that of the whole machine, not of
+ * the current process. With range set, returns the largest
+ * max_energy_range_uj of the counters instead, where they wrap around.
+ */
+static inline double
+get_energy(int domain, int range)
+{
+    double  total = -1.0;
+
+#if defined(__linux__)
+    int     pkg, sub;
+    char    zone[64], buf[64];
+    double  v;
+    const char *file = range ? "max_energy_range_uj" : "energy_uj";
+
+    for ( pkg = 0; pkg < 64; pkg++ ) {
+        snprintf( zone, sizeof(zone), "intel-rapl:%d", pkg );
+        if ( read_powercap( zone, "name", buf, sizeof(buf) ) != 0 )
+            break;
+
+        for ( sub = -1; sub < 16; sub++ ) {
+            if ( sub >= 0 ) {
+                /* the DRAM is a subzone of its package */
+                if ( domain != ENERGY_DRAM )
+                    break;
+                snprintf( zone, sizeof(zone), "intel-rapl:%d:%d", pkg, sub );
+                if ( read_powercap( zone, "name", buf, sizeof(buf) ) != 0 )
+                    break;
+                if ( strcmp( buf, "dram" ) != 0 )
+                    continue;
+
+            } else if ( domain != ENERGY_PACKAGE ) {
+                continue;
+            }
+
+            if ( read_powercap( zone, file, buf, sizeof(buf) ) != 0 )
+                continue;
+
+            v = strtod( buf, NULL ) / 1000000.0;
+            if ( range )
+                total = v > total ? v : total;
+            else
+                total = (total < 0 ? 0 : total) + v;
+        }
+    }
+#endif
+
+    return total;
+}
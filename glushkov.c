@@ -0,0 +1,419 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include "getcputime.h"
+#include "bench.h"
+#include "glushkov.h"
+
+
+typedef struct {
+    uint64_t             first;
+    uint64_t             last;
+    unsigned             nchunks;
+    uint64_t             b[256];
+    uint64_t             t[GK_MAX_POS / 8][256];
+} bp_matcher_t;
+
+
+static void usage(int rc);
+static void run_engines(gk_nfa_t *nfa, unsigned engine_types,
+    const unsigned char *input, size_t len, int global, int repeat);
+static void bp_init(bp_matcher_t *m, gk_nfa_t *nfa);
+static int bp_is_linear(gk_nfa_t *nfa);
+static long bp_glushkov_exec(bp_matcher_t *m, const unsigned char *p,
+    size_t len);
+static long bp_shift_and_exec(bp_matcher_t *m, const unsigned char *p,
+    size_t len);
+
+
+enum {
+    ENGINE_GLUSHKOV     = (1 << 0),
+    ENGINE_SHIFT_AND    = (1 << 1)
+};
+
+
+#define TIMER_START                                                          \
+        begin = get_cpu_time();                                              \
+        if (begin == -1) {                                                   \
+            perror("get_cpu_time");                                          \
+            exit(2);                                                         \
+        }
+
+
+#define TIMER_STOP                                                           \
+        end = get_cpu_time();                                                \
+        if (end == -1) {                                                     \
+            perror("get_cpu_time");                                          \
+            exit(2);                                                         \
+        }                                                                    \
+        elapsed = end - begin;
+
+
+int
+main(int argc, char **argv)
+{
+    int                  flags = 0;
+    int                  global = 0, repeat = 5;
+    int                  err_offset = -1;
+    unsigned             engine_types = 0;
+    unsigned             i;
+    gk_nfa_t            *nfa;
+    const char          *errstr;
+    unsigned char       *input;
+    FILE                *f;
+    size_t               len;
+    long                 rc;
+
+    if (argc < 3) {
+        usage(1);
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            break;
+        }
+
+        if (strncmp(argv[i], "--glushkov", sizeof("--glushkov") - 1) == 0) {
+            engine_types |= ENGINE_GLUSHKOV;
+
+        } else if (strncmp(argv[i], "--shift-and",
+                           sizeof("--shift-and") - 1) == 0)
+        {
+            engine_types |= ENGINE_SHIFT_AND;
+
+        } else if (strncmp(argv[i], "--repeat=", sizeof("--repeat=") - 1)
+                   == 0)
+        {
+            repeat = atoi(argv[i] + sizeof("--repeat=") - 1);
+            if (repeat <= 0) {
+                repeat = 5;
+            }
+
+        } else if (strncmp(argv[i], "-i", 2) == 0) {
+            flags |= GK_CASELESS;
+
+        } else if (strncmp(argv[i], "-g", 2) == 0) {
+            global = 1;
+
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (engine_types == 0) {
+        fprintf(stderr, "No engine specified.\n");
+        exit(1);
+    }
+
+    if (argc - i != 2) {
+        usage(1);
+    }
+
+    /* none of the modes */
+    bench_setup(0);
+
+    nfa = malloc(sizeof(gk_nfa_t));
+    if (nfa == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        return BENCH_EXIT_NOMEM;
+    }
+
+    if (gk_compile(argv[i++], flags, nfa, &errstr, &err_offset) != 0) {
+        fprintf(stderr, "[error] pos %d: %s\n", err_offset, errstr);
+        return 2;
+    }
+
+    errno = 0;
+
+    f = fopen(argv[i], "rb");
+    if (f == NULL) {
+        perror("open file");
+        return 1;
+    }
+
+    if (fseek(f, 0L, SEEK_END) != 0) {
+        perror("seek to file end");
+        return 1;
+    }
+
+    rc = ftell(f);
+    if (rc == -1) {
+        perror("get file offset by ftell");
+        return 1;
+    }
+
+    len = bench_input_size((size_t) rc);
+
+    if (fseek(f, 0L, SEEK_SET) != 0) {
+        perror("seek to file beginning");
+        return 1;
+    }
+
+    input = malloc(len);
+    if (input == NULL) {
+        fprintf(stderr, "failed to allocate %ld bytes.\n", len);
+        return BENCH_EXIT_NOMEM;
+    }
+
+    if (fread(input, 1, len, f) < len) {
+        if (feof(f)) {
+            fprintf(stderr, "file truncated.\n");
+            return 1;
+
+        } else {
+            perror("read file");
+        }
+    }
+
+    if (fclose(f) != 0) {
+        perror("close file");
+        return 1;
+    }
+
+    bench_cache_add(input, len);
+
+    run_engines(nfa, engine_types, input, len, global, repeat);
+
+    free(input);
+    free(nfa);
+
+    return 0;
+}
+
+
+static void
+run_engines(gk_nfa_t *nfa, unsigned engine_types,
+    const unsigned char *input, size_t len, int global, int repeat)
+{
+    int                  matches = 0;
+    long                 rc = -1;
+    size_t               rest;
+    double               begin, end;
+    bench_stats_t        st;
+    const unsigned char *p = NULL;
+    bp_matcher_t        *m;
+
+    long (*exec)(bp_matcher_t *m, const unsigned char *p, size_t len);
+
+    m = malloc(sizeof(bp_matcher_t));
+    if (m == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    bp_init(m, nfa);
+
+    if ((engine_types & ENGINE_SHIFT_AND) && !bp_is_linear(nfa)) {
+        fprintf(stderr, "Shift-And requires a fixed-length sequence of "
+                "classes; use --glushkov instead.\n");
+        exit(2);
+    }
+
+    for (engine_types &= ENGINE_GLUSHKOV | ENGINE_SHIFT_AND;
+         engine_types;
+         engine_types &= engine_types - 1)
+    {
+        if (engine_types & ENGINE_GLUSHKOV) {
+            printf("Glushkov bit-parallel ");
+            fflush(stdout);
+            exec = bp_glushkov_exec;
+
+        } else {
+            printf("Shift-And ");
+            fflush(stdout);
+            exec = bp_shift_and_exec;
+        }
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            matches = 0;
+            p = input;
+            rest = len;
+
+            TIMER_START
+
+            do {
+                rc = exec(m, p, rest);
+
+                if (rc >= 0) {
+                    matches++;
+                    p += rc;
+                    rest -= rc;
+                }
+
+            } while (global && rc >= 0);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        if (rc < 0) {
+            printf("no match");
+
+        } else {
+            /* only the end of the match is known in a forward scan */
+            printf("match (end %ld)", (long) (p - input));
+        }
+
+        printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
+    }
+
+    free(m);
+}
+
+
+static void
+bp_init(bp_matcher_t *m, gk_nfa_t *nfa)
+{
+    unsigned   i, j, c, chunk;
+    uint64_t   follow;
+
+    memset(m, 0, sizeof(bp_matcher_t));
+
+    m->first = nfa->first;
+    m->last = nfa->last;
+    m->nchunks = (nfa->npos + 7) / 8;
+
+    for (i = 0; i < nfa->npos; i++) {
+        for (c = 0; c < 256; c++) {
+            if (gk_cls_test(nfa->cls[i], c)) {
+                m->b[c] |= (uint64_t) 1 << i;
+            }
+        }
+    }
+
+    /* t[k][byte] is the union of the follow sets of the positions
+     * 8k..8k+7 present in byte */
+
+    for (chunk = 0; chunk < m->nchunks; chunk++) {
+        for (c = 1; c < 256; c++) {
+            follow = 0;
+
+            for (j = 0; j < 8; j++) {
+                if ((c & (1 << j)) && chunk * 8 + j < nfa->npos) {
+                    follow |= nfa->follow[chunk * 8 + j];
+                }
+            }
+
+            m->t[chunk][c] = follow;
+        }
+    }
+}
+
+
+/* the plain Shift-And recurrence only holds when every position is
+ * followed by exactly the next one */
+static int
+bp_is_linear(gk_nfa_t *nfa)
+{
+    unsigned  i;
+
+    if (nfa->first != 1 || nfa->last != (uint64_t) 1 << (nfa->npos - 1)) {
+        return 0;
+    }
+
+    for (i = 0; i + 1 < nfa->npos; i++) {
+        if (nfa->follow[i] != (uint64_t) 1 << (i + 1)) {
+            return 0;
+        }
+    }
+
+    return nfa->follow[nfa->npos - 1] == 0;
+}
+
+
+/* returns the offset just past the earliest-ending match, or -1 */
+static long
+bp_glushkov_exec(bp_matcher_t *m, const unsigned char *p, size_t len)
+{
+    size_t     i, k;
+    uint64_t   d = 0, next, first = m->first, last = m->last;
+    unsigned   nchunks = m->nchunks;
+
+    for (i = 0; i < len; i++) {
+        if (d == 0) {
+            /* nothing in flight: skip bytes that cannot start a match */
+            while ((first & m->b[p[i]]) == 0) {
+                if (++i == len) {
+                    return -1;
+                }
+            }
+
+            d = first & m->b[p[i]];
+
+        } else {
+            next = first;
+
+            for (k = 0; k < nchunks; k++) {
+                next |= m->t[k][(d >> (k * 8)) & 0xff];
+            }
+
+            d = next & m->b[p[i]];
+        }
+
+        if (d & last) {
+            return (long) i + 1;
+        }
+    }
+
+    return -1;
+}
+
+
+static long
+bp_shift_and_exec(bp_matcher_t *m, const unsigned char *p, size_t len)
+{
+    size_t     i;
+    uint64_t   d = 0, last = m->last;
+
+    for (i = 0; i < len; i++) {
+        d = ((d << 1) | 1) & m->b[p[i]];
+
+        if (d & last) {
+            return (long) i + 1;
+        }
+    }
+
+    return -1;
+}
+
+
+static void
+usage(int rc)
+{
+    fprintf(stderr, "usage: glushkov [options] <regexp> <file>\n"
+            "options:\n"
+            "   -i                  use case insensitive matching\n"
+            "   --glushkov          use the bit-parallel Glushkov automaton\n"
+            "   --shift-and         use the Shift-And algorithm (fixed-length\n"
+            "                       sequences of classes only)\n"
+            "   -g                  enable the global search mode\n"
+            "   --repeat=N          repeat the test at least N times; report\n"
+            "                       the median. default to 5.\n"
+            BENCH_USAGE
+            "patterns are limited to %d positions; matches are reported at\n"
+            "their earliest end.\n", GK_MAX_POS);
+    exit(rc);
+}
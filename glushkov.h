@@ -0,0 +1,745 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/*
+ * A tiny regex front end building the Glushkov (position) automaton of
+ * a pattern. Only the subset of the syntax used by the benchmark cases
+ * is supported: literals, ".", character classes, the \d \w \s escapes
+ * (and their negations), (?:...) and (...) groups (captures are not
+ * tracked), "|", the *, +, ? and {m,n} quantifiers (lazy forms are
+ * accepted but match the same language) and a leading (?i).
+ * Assertions and back-references are rejected.
+ */
+
+#ifndef _GLUSHKOV_H_INCLUDED_
+#define _GLUSHKOV_H_INCLUDED_
+
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+
+#define GK_MAX_POS      64
+#define GK_MAX_NODES    4096
+#define GK_CASELESS     (1 << 0)
+
+
+enum {
+    GK_NODE_CLASS,
+    GK_NODE_EMPTY,
+    GK_NODE_CAT,
+    GK_NODE_ALT,
+    GK_NODE_REPEAT
+};
+
+
+typedef struct gk_node_s  gk_node_t;
+
+struct gk_node_s {
+    int                  type;
+    int                  min;
+    int                  max;       /* -1 means unbounded */
+    uint8_t              cls[32];
+    gk_node_t           *left;
+    gk_node_t           *right;
+};
+
+
+typedef struct {
+    unsigned             npos;
+    uint64_t             first;
+    uint64_t             last;
+    int                  nullable;
+    uint64_t             follow[GK_MAX_POS];
+    uint8_t              cls[GK_MAX_POS][32];
+} gk_nfa_t;
+
+
+typedef struct {
+    const unsigned char *pos;
+    const unsigned char *start;
+    int                  caseless;
+    const char          *err;
+    unsigned             nnodes;
+    gk_node_t            nodes[GK_MAX_NODES];
+} gk_parser_t;
+
+
+typedef struct {
+    uint64_t             first;
+    uint64_t             last;
+    int                  nullable;
+} gk_set_t;
+
+
+static gk_node_t *gk_parse_alt(gk_parser_t *ps);
+
+
+static inline void
+gk_cls_set(uint8_t *cls, unsigned c)
+{
+    cls[c >> 3] |= (uint8_t) (1 << (c & 7));
+}
+
+
+static inline int
+gk_cls_test(const uint8_t *cls, unsigned c)
+{
+    return cls[c >> 3] & (1 << (c & 7));
+}
+
+
+static inline void
+gk_cls_range(uint8_t *cls, unsigned from, unsigned to)
+{
+    unsigned  c;
+
+    for (c = from; c <= to; c++) {
+        gk_cls_set(cls, c);
+    }
+}
+
+
+static inline gk_node_t *
+gk_new_node(gk_parser_t *ps, int type)
+{
+    gk_node_t  *node;
+
+    if (ps->nnodes == GK_MAX_NODES) {
+        ps->err = "pattern too large";
+        return NULL;
+    }
+
+    node = &ps->nodes[ps->nnodes++];
+    memset(node, 0, sizeof(gk_node_t));
+    node->type = type;
+
+    return node;
+}
+
+
+/* adds the class denoted by the escape letter c; returns 0 if unknown */
+static inline int
+gk_escape_class(uint8_t *cls, int c)
+{
+    uint8_t   tmp[32];
+    unsigned  i;
+    int       negate = isupper(c);
+
+    memset(tmp, 0, sizeof(tmp));
+
+    switch (tolower(c)) {
+    case 'd':
+        gk_cls_range(tmp, '0', '9');
+        break;
+
+    case 'w':
+        gk_cls_range(tmp, '0', '9');
+        gk_cls_range(tmp, 'a', 'z');
+        gk_cls_range(tmp, 'A', 'Z');
+        gk_cls_set(tmp, '_');
+        break;
+
+    case 's':
+        gk_cls_range(tmp, '\t', '\r');
+        gk_cls_set(tmp, ' ');
+        break;
+
+    default:
+        return 0;
+    }
+
+    for (i = 0; i < 32; i++) {
+        cls[i] |= negate ? (uint8_t) ~tmp[i] : tmp[i];
+    }
+
+    return 1;
+}
+
+
+/* parses a single-character escape after the backslash; -1 on error */
+static inline int
+gk_escape_char(gk_parser_t *ps, int in_class)
+{
+    int  c = *ps->pos++;
+    int  i, v;
+
+    switch (c) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case 'a': return '\a';
+    case 'e': return 0x1b;
+
+    case 'b':
+        if (in_class) {
+            return '\b';
+        }
+
+        break;
+
+    case 'x':
+        v = 0;
+        for (i = 0; i < 2 && isxdigit(*ps->pos); i++) {
+            c = *ps->pos++;
+            v = v * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+        }
+
+        return v;
+
+    case '\0':
+        ps->pos--;
+        ps->err = "trailing backslash";
+        return -1;
+
+    default:
+        if (!isalnum(c)) {
+            return c;
+        }
+
+        break;
+    }
+
+    ps->err = "unsupported escape sequence";
+    return -1;
+}
+
+
+static inline gk_node_t *
+gk_parse_class(gk_parser_t *ps)
+{
+    int         c, from, negate = 0;
+    unsigned    i;
+    gk_node_t  *node;
+
+    node = gk_new_node(ps, GK_NODE_CLASS);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (*ps->pos == '^') {
+        negate = 1;
+        ps->pos++;
+    }
+
+    for (i = 0; ; i++) {
+        c = *ps->pos;
+
+        if (c == '\0') {
+            ps->err = "missing terminating ]";
+            return NULL;
+        }
+
+        if (c == ']' && i > 0) {
+            ps->pos++;
+            break;
+        }
+
+        ps->pos++;
+
+        if (c == '\\') {
+            if (gk_escape_class(node->cls, *ps->pos)) {
+                ps->pos++;
+                continue;
+            }
+
+            c = gk_escape_char(ps, 1);
+            if (c < 0) {
+                return NULL;
+            }
+        }
+
+        if (ps->pos[0] == '-' && ps->pos[1] != ']' && ps->pos[1] != '\0') {
+            from = c;
+            ps->pos++;
+            c = *ps->pos++;
+
+            if (c == '\\') {
+                c = gk_escape_char(ps, 1);
+                if (c < 0) {
+                    return NULL;
+                }
+            }
+
+            if (c < from) {
+                ps->err = "range out of order in character class";
+                return NULL;
+            }
+
+            gk_cls_range(node->cls, from, c);
+            continue;
+        }
+
+        gk_cls_set(node->cls, c);
+    }
+
+    if (negate) {
+        for (i = 0; i < 32; i++) {
+            node->cls[i] = ~node->cls[i];
+        }
+    }
+
+    return node;
+}
+
+
+static inline gk_node_t *
+gk_parse_atom(gk_parser_t *ps)
+{
+    int         c;
+    gk_node_t  *node;
+
+    c = *ps->pos++;
+
+    switch (c) {
+    case '(':
+        if (ps->pos[0] == '?') {
+            if (ps->pos[1] == 'i' && ps->pos[2] == ')') {
+                /* it would widen the literals before it too */
+                if (ps->pos - 1 != ps->start) {
+                    ps->err = "(?i) only supported at the start";
+                    return NULL;
+                }
+
+                ps->pos += 3;
+                ps->caseless = 1;
+                return gk_new_node(ps, GK_NODE_EMPTY);
+            }
+
+            if (ps->pos[1] != ':') {
+                ps->err = "unsupported group syntax";
+                return NULL;
+            }
+
+            ps->pos += 2;
+        }
+
+        node = gk_parse_alt(ps);
+        if (node == NULL) {
+            return NULL;
+        }
+
+        if (*ps->pos != ')') {
+            ps->err = "missing )";
+            return NULL;
+        }
+
+        ps->pos++;
+        return node;
+
+    case '[':
+        return gk_parse_class(ps);
+
+    case '.':
+        node = gk_new_node(ps, GK_NODE_CLASS);
+        if (node != NULL) {
+            memset(node->cls, 0xff, sizeof(node->cls));
+        }
+
+        return node;
+
+    case '^':
+    case '$':
+        ps->err = "assertions are not supported";
+        return NULL;
+
+    case '*':
+    case '+':
+    case '?':
+        ps->err = "nothing to repeat";
+        return NULL;
+
+    default:
+        break;
+    }
+
+    node = gk_new_node(ps, GK_NODE_CLASS);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    if (c == '\\') {
+        if (gk_escape_class(node->cls, *ps->pos)) {
+            ps->pos++;
+            return node;
+        }
+
+        c = gk_escape_char(ps, 0);
+        if (c < 0) {
+            return NULL;
+        }
+    }
+
+    gk_cls_set(node->cls, c);
+
+    return node;
+}
+
+
+/* parses "{m}", "{m,}" or "{m,n}"; returns 0 if it is not a quantifier */
+static inline int
+gk_parse_counted(gk_parser_t *ps, int *min, int *max)
+{
+    const unsigned char  *p = ps->pos + 1;
+
+    if (!isdigit(*p)) {
+        return 0;
+    }
+
+    *min = 0;
+    while (isdigit(*p)) {
+        *min = *min * 10 + *p++ - '0';
+    }
+
+    if (*p == '}') {
+        *max = *min;
+
+    } else if (*p == ',') {
+        p++;
+
+        if (*p == '}') {
+            *max = -1;
+
+        } else {
+            if (!isdigit(*p)) {
+                return 0;
+            }
+
+            *max = 0;
+            while (isdigit(*p)) {
+                *max = *max * 10 + *p++ - '0';
+            }
+
+            if (*p != '}') {
+                return 0;
+            }
+        }
+
+    } else {
+        return 0;
+    }
+
+    ps->pos = p + 1;
+    return 1;
+}
+
+
+static inline gk_node_t *
+gk_parse_seq(gk_parser_t *ps)
+{
+    int         c, min, max;
+    gk_node_t  *seq = NULL, *atom, *node;
+
+    for ( ;; ) {
+        c = *ps->pos;
+        if (c == '\0' || c == '|' || c == ')') {
+            break;
+        }
+
+        atom = gk_parse_atom(ps);
+        if (atom == NULL) {
+            return NULL;
+        }
+
+        for ( ;; ) {
+            c = *ps->pos;
+
+            if (c == '*') {
+                min = 0; max = -1;
+                ps->pos++;
+
+            } else if (c == '+') {
+                min = 1; max = -1;
+                ps->pos++;
+
+            } else if (c == '?') {
+                min = 0; max = 1;
+                ps->pos++;
+
+            } else if (c == '{' && gk_parse_counted(ps, &min, &max)) {
+                if (max != -1 && max < min) {
+                    ps->err = "numbers out of order in {} quantifier";
+                    return NULL;
+                }
+
+            } else {
+                break;
+            }
+
+            if (*ps->pos == '?') {
+                /* lazy: same language, and we only report match ends */
+                ps->pos++;
+
+            } else if (*ps->pos == '+') {
+                ps->err = "possessive quantifiers are not supported";
+                return NULL;
+            }
+
+            node = gk_new_node(ps, GK_NODE_REPEAT);
+            if (node == NULL) {
+                return NULL;
+            }
+
+            node->min = min;
+            node->max = max;
+            node->left = atom;
+            atom = node;
+        }
+
+        if (seq == NULL) {
+            seq = atom;
+            continue;
+        }
+
+        node = gk_new_node(ps, GK_NODE_CAT);
+        if (node == NULL) {
+            return NULL;
+        }
+
+        node->left = seq;
+        node->right = atom;
+        seq = node;
+    }
+
+    if (seq == NULL) {
+        return gk_new_node(ps, GK_NODE_EMPTY);
+    }
+
+    return seq;
+}
+
+
+static gk_node_t *
+gk_parse_alt(gk_parser_t *ps)
+{
+    gk_node_t  *alt, *seq, *node;
+
+    alt = gk_parse_seq(ps);
+    if (alt == NULL) {
+        return NULL;
+    }
+
+    while (*ps->pos == '|') {
+        ps->pos++;
+
+        seq = gk_parse_seq(ps);
+        if (seq == NULL) {
+            return NULL;
+        }
+
+        node = gk_new_node(ps, GK_NODE_ALT);
+        if (node == NULL) {
+            return NULL;
+        }
+
+        node->left = alt;
+        node->right = seq;
+        alt = node;
+    }
+
+    return alt;
+}
+
+
+static inline void
+gk_link(gk_nfa_t *nfa, uint64_t from, uint64_t to)
+{
+    unsigned  i;
+
+    for (i = 0; from; i++, from >>= 1) {
+        if (from & 1) {
+            nfa->follow[i] |= to;
+        }
+    }
+}
+
+
+static inline gk_set_t
+gk_cat(gk_nfa_t *nfa, gk_set_t a, gk_set_t b)
+{
+    gk_set_t  r;
+
+    gk_link(nfa, a.last, b.first);
+
+    r.first = a.first | (a.nullable ? b.first : 0);
+    r.last = b.last | (b.nullable ? a.last : 0);
+    r.nullable = a.nullable && b.nullable;
+
+    return r;
+}
+
+
+/* every visit of a leaf creates a fresh position, which is what makes
+ * the expansion of counted repetitions work */
+static int
+gk_build(gk_parser_t *ps, gk_nfa_t *nfa, gk_node_t *node, gk_set_t *out)
+{
+    int       i;
+    unsigned  c;
+    gk_set_t  a, b;
+
+    switch (node->type) {
+    case GK_NODE_EMPTY:
+        out->first = out->last = 0;
+        out->nullable = 1;
+        return 0;
+
+    case GK_NODE_CLASS:
+        if (nfa->npos == GK_MAX_POS) {
+            ps->err = "too many positions in the pattern";
+            return -1;
+        }
+
+        memcpy(nfa->cls[nfa->npos], node->cls, 32);
+
+        if (ps->caseless) {
+            for (c = 'a'; c <= 'z'; c++) {
+                if (gk_cls_test(node->cls, c)
+                    || gk_cls_test(node->cls, toupper(c)))
+                {
+                    gk_cls_set(nfa->cls[nfa->npos], c);
+                    gk_cls_set(nfa->cls[nfa->npos], toupper(c));
+                }
+            }
+        }
+
+        out->first = out->last = (uint64_t) 1 << nfa->npos;
+        out->nullable = 0;
+        nfa->npos++;
+        return 0;
+
+    case GK_NODE_CAT:
+        if (gk_build(ps, nfa, node->left, &a) != 0
+            || gk_build(ps, nfa, node->right, &b) != 0)
+        {
+            return -1;
+        }
+
+        *out = gk_cat(nfa, a, b);
+        return 0;
+
+    case GK_NODE_ALT:
+        if (gk_build(ps, nfa, node->left, &a) != 0
+            || gk_build(ps, nfa, node->right, &b) != 0)
+        {
+            return -1;
+        }
+
+        out->first = a.first | b.first;
+        out->last = a.last | b.last;
+        out->nullable = a.nullable || b.nullable;
+        return 0;
+
+    default: /* GK_NODE_REPEAT */
+        break;
+    }
+
+    out->first = out->last = 0;
+    out->nullable = 1;
+
+    for (i = 0; i < node->min; i++) {
+        if (gk_build(ps, nfa, node->left, &a) != 0) {
+            return -1;
+        }
+
+        if (node->max == -1 && i == node->min - 1) {
+            /* x{m,} is x{m-1}x+ */
+            gk_link(nfa, a.last, a.first);
+        }
+
+        *out = gk_cat(nfa, *out, a);
+    }
+
+    if (node->max == -1) {
+        if (node->min == 0) {
+            if (gk_build(ps, nfa, node->left, &a) != 0) {
+                return -1;
+            }
+
+            gk_link(nfa, a.last, a.first);
+            a.nullable = 1;
+            *out = gk_cat(nfa, *out, a);
+        }
+
+        return 0;
+    }
+
+    /* x{m,n} is x{m} followed by n - m copies of x? */
+
+    for (i = node->min; i < node->max; i++) {
+        if (gk_build(ps, nfa, node->left, &a) != 0) {
+            return -1;
+        }
+
+        a.nullable = 1;
+        *out = gk_cat(nfa, *out, a);
+    }
+
+    return 0;
+}
+
+
+/*
+ * Compiles the pattern into nfa. Returns 0 on success; on failure
+ * returns -1 and sets *errstr and *erroff.
+ */
+static inline int
+gk_compile(const char *re, int flags, gk_nfa_t *nfa, const char **errstr,
+    int *erroff)
+{
+    int           rc = -1;
+    gk_set_t      top;
+    gk_node_t    *root;
+    gk_parser_t  *ps;
+
+    ps = malloc(sizeof(gk_parser_t));
+    if (ps == NULL) {
+        *errstr = "failed to allocate memory";
+        *erroff = 0;
+        return -1;
+    }
+
+    ps->start = ps->pos = (const unsigned char *) re;
+    ps->caseless = flags & GK_CASELESS;
+    ps->err = NULL;
+    ps->nnodes = 0;
+
+    memset(nfa, 0, sizeof(gk_nfa_t));
+
+    root = gk_parse_alt(ps);
+
+    if (root != NULL && *ps->pos != '\0') {
+        ps->err = "unmatched )";
+        root = NULL;
+    }
+
+    if (root != NULL && gk_build(ps, nfa, root, &top) == 0) {
+        if (top.nullable) {
+            ps->err = "pattern matches the empty string";
+
+        } else {
+            nfa->first = top.first;
+            nfa->last = top.last;
+            nfa->nullable = top.nullable;
+            rc = 0;
+        }
+    }
+
+    if (rc != 0) {
+        *errstr = ps->err;
+        *erroff = (int) (ps->pos - ps->start);
+    }
+
+    free(ps);
+    return rc;
+}
+
+
+#endif /* _GLUSHKOV_H_INCLUDED_ */
@@ -1,17 +1,162 @@
 
+#define _GNU_SOURCE
+#define BENCH_COUNT_ALLOCS
 #include <hs/hs.h>
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 #include <time.h>
 #include "getcputime.h"
+#include "bench.h"
 
 
 static void usage(int rc);
-static void run_engines(hs_database_t *re, hs_scratch_t *scratch,
+static double run_engines(hs_database_t *re, hs_scratch_t *scratch,
     const char *input, size_t len, int global, int repeat);
+static void run_latency(hs_database_t *re, hs_scratch_t *scratch,
+    const char *input, size_t len);
+static void run_threads(hs_database_t *re, const char *input, size_t len,
+    int global, int repeat);
+static int thread_scan(void *data, const unsigned char *p, size_t len);
+
+
+struct match_cbdata {
+    int matches;
+    int global;
+    unsigned long long end;
+};
+
+
+/* the output of the replace mode */
+typedef struct {
+    bench_out_t          out;
+    const char          *input;
+    size_t               copied;     /* input up to here is in out */
+    int                  matches;
+} replace_t;
+
+
+/* a match of the grep mode */
+typedef struct {
+    unsigned long long   from;
+    unsigned long long   to;
+} grep_match_t;
+
+
+/* the scan of the grep mode */
+typedef struct {
+    bench_grep_t        *g;          /* NULL: matching only */
+    int                  matches;
+    grep_match_t        *m;          /* the matches of a scan for g */
+    size_t               n;
+    size_t               size;
+    int                  sorted;     /* m is in the order of the starts */
+} grep_t;
+
+
+/* the vectored scan of the batch mode */
+typedef struct {
+    bench_column_t      *col;
+    size_t               row;        /* of the last match */
+} batch_t;
+
+
+/* the per-thread state of the threads mode */
+typedef struct {
+    hs_database_t       *db;
+    hs_scratch_t        *scratch;
+    int                  global;
+} thread_ctx_t;
+
+
+/* the streams of the streams mode */
+typedef struct {
+    hs_database_t       *db;
+    hs_scratch_t        *scratch;
+    hs_stream_t        **streams;
+    char                *done;
+    char               **idle;       /* compressed state of idle streams */
+    size_t              *idle_len;
+    char                *buf;        /* hs_stream_size() bytes */
+    size_t               state;
+    size_t               fed;
+    const char          *input;
+    bench_streams_t      ss;
+    struct match_cbdata  cbdata;
+} streams_t;
+
+
+static void run_streams(hs_database_t *re, hs_scratch_t *scratch,
+    const char *input, size_t len, int global, int repeat);
+static void streams_feed(streams_t *sts, size_t from, size_t to);
+static int streams_is_idle(int s, size_t r);
+static void streams_compress(streams_t *sts, int s);
+static void streams_expand(streams_t *sts, int s);
+static void streams_checkpoint(streams_t *sts);
+static int streams_restore(streams_t *sts);
+static size_t streams_write(streams_t *sts, size_t round);
+static int streams_read(streams_t *sts, const char *path, size_t *round);
+static void run_pipeline(hs_database_t *re, hs_scratch_t *scratch,
+    const char *path, int global, int repeat);
+static void run_tree(hs_database_t *re, const char *path, int global,
+    int repeat);
+static int tree_scan(void *data, const unsigned char *p, size_t len);
+static void run_replace(hs_database_t *re, hs_scratch_t *scratch,
+    const char *input, size_t len, int repeat);
+static int replace_cb(unsigned int id, unsigned long long from,
+    unsigned long long to, unsigned int flags, void *context);
+static void run_batch(hs_database_t *re, hs_scratch_t *scratch,
+    const char *pattern, int flags, hs_platform_info_t *plt,
+    const char *input, size_t len, int repeat);
+static int batch_cb(unsigned int id, unsigned long long from,
+    unsigned long long to, unsigned int flags, void *context);
+static int batch_vector_cb(unsigned int id, unsigned long long from,
+    unsigned long long to, unsigned int flags, void *context);
+static void run_platforms(const char *pattern, int flags,
+    const char *input, size_t len, int global, int repeat);
+static void run_heatmap(hs_database_t *re, hs_scratch_t *scratch,
+    const char *input, size_t len, int global, int repeat);
+static void run_grep(const char *pattern, int flags, hs_platform_info_t *plt,
+    const char *input, size_t len, int repeat);
+static int grep_cb(unsigned int id, unsigned long long from,
+    unsigned long long to, unsigned int flags, void *context);
+static void grep_queue(grep_t *gr);
+static int grep_cmp(const void *a, const void *b);
+static int platform_listed(const char *name);
+
+
+/* a target of the platform sweep */
+typedef struct {
+    const char          *name;
+    unsigned long long   features;   /* HS_CPU_FEATURES_* */
+} platform_t;
+
+
+/* each with the features of the ones before it; 0 is SSSE3 */
+static platform_t        platforms[] = {
+    { "ssse3", 0 },
+    { "avx2", HS_CPU_FEATURES_AVX2 },
+    { "avx512", HS_CPU_FEATURES_AVX2 | HS_CPU_FEATURES_AVX512 },
+#ifdef HS_CPU_FEATURES_AVX512VBMI
+    { "avx512vbmi", HS_CPU_FEATURES_AVX2 | HS_CPU_FEATURES_AVX512
+                    | HS_CPU_FEATURES_AVX512VBMI },
+#endif
+    { NULL, 0 }
+};
+
+
+/* the streams mode: percent of the streams compressed between chunks */
+static int               idle = 0;
+static const char       *checkpoint = NULL;
+static const char       *restore = NULL;
+
+/* the platform sweep: the targets, and the one being timed */
+static const char       *platforms_list = NULL;
+static int               tune_generic = 0;
+static const char       *platform = NULL;
 
 
 #define TIMER_START                                                          \
@@ -40,6 +185,7 @@ main(int argc, char **argv)
     unsigned             i;
     hs_database_t       *re;
     char                *input;
+    const char          *pattern;
     FILE                *f;
     size_t               len;
     long                 rc;
@@ -74,6 +220,40 @@ main(int argc, char **argv)
         } else if (strncmp(argv[i], "-g", 2) == 0) {
             global = 1;
 
+        } else if (strncmp(argv[i], "--idle=", sizeof("--idle=") - 1) == 0) {
+            idle = atoi(argv[i] + sizeof("--idle=") - 1);
+            if (idle < 0 || idle > 100) {
+                fprintf(stderr, "bad idle percentage: %s\n", argv[i]);
+                exit(1);
+            }
+
+        } else if (strncmp(argv[i], "--checkpoint=",
+                           sizeof("--checkpoint=") - 1) == 0)
+        {
+            checkpoint = argv[i] + sizeof("--checkpoint=") - 1;
+
+        } else if (strncmp(argv[i], "--restore=",
+                           sizeof("--restore=") - 1) == 0)
+        {
+            restore = argv[i] + sizeof("--restore=") - 1;
+
+        } else if (strncmp(argv[i], "--platforms=",
+                           sizeof("--platforms=") - 1) == 0)
+        {
+            platforms_list = argv[i] + sizeof("--platforms=") - 1;
+
+        } else if (strcmp(argv[i], "--platforms") == 0) {
+            platforms_list = "all";
+
+        } else if (strcmp(argv[i], "--tune=generic") == 0) {
+            tune_generic = 1;
+
+        } else if (strcmp(argv[i], "--tune=host") == 0) {
+            tune_generic = 0;
+
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
         } else {
             fprintf(stderr, "unknown option: %s\n", argv[i]);
             exit(1);
@@ -84,16 +264,43 @@ main(int argc, char **argv)
         usage(1);
     }
 
-    ret = hs_compile(argv[i], flags, HS_MODE_BLOCK, &plt, &re, &err);
+    if (platforms_list && bench_modes()) {
+        fprintf(stderr, "unsupported option: --platforms with another "
+                "mode\n");
+        exit(1);
+    }
+
+    bench_setup(BENCH_MODE_LATENCY | BENCH_MODE_THREADS | BENCH_MODE_STREAMS
+                | BENCH_MODE_PIPELINE | BENCH_MODE_TREE | BENCH_MODE_REPLACE
+                | BENCH_MODE_BATCH | BENCH_MODE_HEATMAP | BENCH_MODE_GREP);
+
+    if (bench_conf.replace) {
+        flags |= HS_FLAG_SOM_LEFTMOST;
+    }
+
+    pattern = argv[i++];
+
+    ret = hs_compile(pattern, flags,
+                     bench_conf.streams || bench_conf.pipeline
+                     ? HS_MODE_STREAM : HS_MODE_BLOCK,
+                     &plt, &re, &err);
     if (ret != HS_SUCCESS) {
-        fprintf(stderr, "[error] compile: %s\n", argv[i]);
+        fprintf(stderr, "[error] compile: %s\n", pattern);
         return 2;
     }
 
-    i ++;
-
     hs_alloc_scratch(re, &scratch);
 
+    if (bench_conf.pipeline) {
+        run_pipeline(re, scratch, argv[i], global, repeat);
+        return 0;
+    }
+
+    if (bench_conf.tree) {
+        run_tree(re, argv[i], global, repeat);
+        return 0;
+    }
+
     errno = 0;
 
     f = fopen(argv[i], "rb");
@@ -113,7 +320,7 @@ main(int argc, char **argv)
         return 1;
     }
 
-    len = (size_t) rc;
+    len = bench_input_size((size_t) rc);
 
     if (fseek(f, 0L, SEEK_SET) != 0) {
         perror("seek to file beginning");
@@ -123,7 +330,7 @@ main(int argc, char **argv)
     input = malloc(len);
     if (input == NULL) {
         fprintf(stderr, "failed to allocate %ld bytes.\n", len);
-        return 1;
+        return BENCH_EXIT_NOMEM;
     }
 
     if (fread(input, 1, len, f) < len) {
@@ -141,18 +348,41 @@ main(int argc, char **argv)
         return 1;
     }
 
-    run_engines(re, scratch, input, len, global, repeat);
+    bench_cache_add(input, len);
+
+    if (platforms_list) {
+        run_platforms(pattern, flags, input, len, global, repeat);
+
+    } else if (bench_conf.batch) {
+        run_batch(re, scratch, pattern, flags, &plt, input, len, repeat);
+
+    } else if (bench_conf.slice) {
+        run_heatmap(re, scratch, input, len, global, repeat);
+
+    } else if (bench_conf.grep) {
+        run_grep(pattern, flags, &plt, input, len, repeat);
+
+    } else if (bench_conf.replace) {
+        run_replace(re, scratch, input, len, repeat);
+
+    } else if (bench_conf.plant) {
+        run_latency(re, scratch, input, len);
+
+    } else if (bench_conf.threads) {
+        run_threads(re, input, len, global, repeat);
+
+    } else if (bench_conf.streams) {
+        run_streams(re, scratch, input, len, global, repeat);
+
+    } else {
+        run_engines(re, scratch, input, len, global, repeat);
+    }
 
     free(input);
 
     return 0;
 }
 
-struct match_cbdata {
-    int matches;
-    int global;
-};
-
 static int
 match_cb (unsigned int id, unsigned long long from, unsigned long long to, 
     unsigned int flags, void *context)
@@ -160,6 +390,7 @@ match_cb (unsigned int id, unsigned long long from, unsigned long long to,
     struct match_cbdata *cbdata = context;
 
     cbdata->matches ++;
+    cbdata->end = to;
 
     if (cbdata->global) {
         return 0;
@@ -168,20 +399,29 @@ match_cb (unsigned int id, unsigned long long from, unsigned long long to,
     return 1;
 }
 
-static void
+static double
 run_engines(hs_database_t *re, hs_scratch_t *scratch,
     const char *input, size_t len, int global, int repeat)
 {
-    int                  i, matches = 0;
+    int                  matches = 0;
     size_t               rest;
-    double               begin, end, best = -1;
+    double               begin, end;
+    bench_stats_t        st;
     const char          *p;
     struct match_cbdata  cbdata;
 
 
     printf("Hyperscan ");
 
-    for (i = 0; i < repeat; i++) {
+    if (platform) {
+        printf("(%s) ", platform);
+    }
+
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
         double elapsed;
 
         matches = 0;
@@ -198,9 +438,7 @@ run_engines(hs_database_t *re, hs_scratch_t *scratch,
 
         TIMER_STOP
 
-        if (i == 0 || elapsed < best) {
-            best = elapsed;
-        }
+        bench_stats_add(&st, elapsed);
     }
 
     if (matches == 0) {
@@ -212,7 +450,1481 @@ run_engines(hs_database_t *re, hs_scratch_t *scratch,
     }
 
     printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-           best * 1e3, matches, repeat);
+           bench_stats_median(&st) * 1e3, matches, st.n);
+    bench_stats_print(&st);
+
+    return bench_stats_median(&st);
+}
+
+
+/*
+ * The time to the first match of short subjects (see --latency).
+ * Allocating the scratch space counts as the setup. Without
+ * HS_FLAG_SOM_LEFTMOST only the end of a match is known, so a match is
+ * early when it ends before the planted text does.
+ */
+static void
+run_latency(hs_database_t *re, hs_scratch_t *scratch, const char *input,
+    size_t len)
+{
+    int                  k, noffsets, call, missed, early;
+    size_t               offsets[BENCH_MAX_OFFSETS], max_offset = 0;
+    size_t               plen;
+    double               begin, elapsed;
+    bench_stats_t        st;
+    bench_subjects_t     subj;
+    const char          *s;
+    hs_scratch_t        *sc;
+    struct match_cbdata  cbdata;
+
+    noffsets = bench_latency_offsets(offsets);
+    plen = strlen(bench_conf.plant);
+
+    for (k = 0; k < noffsets; k++) {
+        if (offsets[k] != BENCH_NO_OFFSET && offsets[k] > max_offset) {
+            max_offset = offsets[k];
+        }
+    }
+
+    for (k = 0; k < noffsets; k++) {
+        bench_subjects_init(&subj, (const unsigned char *) input, len,
+                            offsets[k], max_offset);
+
+        printf("Hyperscan ");
+        fflush(stdout);
+
+        bench_stats_init(&st, bench_conf.calls);
+        missed = 0;
+        early = 0;
+
+        for (call = 0; bench_latency_next(&st); call++) {
+            s = (const char *) bench_subject(&subj, call);
+            sc = scratch;
+            cbdata.matches = 0;
+            cbdata.global = 0;
+
+            begin = get_wall_time();
+
+            if (bench_conf.setup) {
+                sc = NULL;
+                if (hs_alloc_scratch(re, &sc) != HS_SUCCESS) {
+                    fprintf(stderr, "Hyperscan cannot allocate scratch\n");
+                    exit(BENCH_EXIT_NOMEM);
+                }
+            }
+
+            hs_scan(re, s, subj.len, 0, sc, match_cb, &cbdata);
+
+            if (bench_conf.setup) {
+                hs_free_scratch(sc);
+            }
+
+            elapsed = get_wall_time() - begin;
+
+            if (st.warmup == 0) {
+                if (cbdata.matches == 0) {
+                    missed++;
+
+                } else if (subj.offset == BENCH_NO_OFFSET
+                           || cbdata.end < subj.offset + plen)
+                {
+                    early++;
+                }
+            }
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        bench_latency_print(&st, &subj, missed, early);
+        bench_subjects_free(&subj);
+    }
+}
+
+
+/*
+ * Scans a copy of the input in each of 1, 2, 4 ... --threads threads
+ * (see bench_pool_run()), with either the one database shared by all the
+ * threads or a copy per thread made with hs_serialize_database() and
+ * hs_deserialize_database(). Scratch space is per thread either way.
+ */
+static void
+run_threads(hs_database_t *re, const char *input, size_t len, int global,
+    int repeat)
+{
+    int                  t, n, objects;
+    char                *bytes;
+    size_t               rss, compiled, size, nbytes;
+    thread_ctx_t        *ctxs, *ctx;
+    static bench_pool_t  pool;
+
+    static const char   *names[] = { NULL, "shared", "copy" };
+
+    ctxs = malloc(bench_conf.threads * sizeof(thread_ctx_t));
+    if (ctxs == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    if (hs_serialize_database(re, &bytes, &nbytes) != HS_SUCCESS) {
+        fprintf(stderr, "Hyperscan cannot serialize the database\n");
+        exit(2);
+    }
+
+    bench_pool_init(&pool, thread_scan, (const unsigned char *) input, len,
+                    bench_conf.threads);
+
+    for (objects = BENCH_OBJECTS_SHARED; objects <= BENCH_OBJECTS_COPY;
+         objects++)
+    {
+        if (bench_conf.objects != BENCH_OBJECTS_BOTH
+            && bench_conf.objects != objects)
+        {
+            continue;
+        }
+
+        rss = bench_rss();
+        compiled = 0;
+
+        for (t = 0; t < pool.max; t++) {
+            ctx = &ctxs[t];
+            ctx->global = global;
+            ctx->scratch = NULL;
+            ctx->db = re;
+
+            if (objects == BENCH_OBJECTS_COPY) {
+                ctx->db = NULL;
+                if (hs_deserialize_database(bytes, nbytes, &ctx->db)
+                    != HS_SUCCESS)
+                {
+                    fprintf(stderr, "Hyperscan cannot copy the database\n");
+                    exit(2);
+                }
+            }
+
+            if (objects == BENCH_OBJECTS_COPY || t == 0) {
+                if (hs_database_size(ctx->db, &size) == HS_SUCCESS) {
+                    compiled += size;
+                }
+            }
+
+            if (hs_alloc_scratch(ctx->db, &ctx->scratch) != HS_SUCCESS) {
+                fprintf(stderr, "Hyperscan cannot allocate scratch\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+
+            pool.workers[t].ctx = ctx;
+        }
+
+        for (n = 1; n; n = bench_pool_next_threads(n)) {
+            printf("Hyperscan (%s, %d thread%s) ", names[objects], n,
+                   n == 1 ? "" : "s");
+            fflush(stdout);
+
+            bench_pool_run(&pool, n, repeat);
+        }
+
+        bench_pool_print_memory(names[objects], pool.max, compiled, rss);
+
+        for (t = 0; t < pool.max; t++) {
+            ctx = &ctxs[t];
+
+            hs_free_scratch(ctx->scratch);
+
+            if (ctx->db != re) {
+                hs_free_database(ctx->db);
+            }
+        }
+    }
+
+    bench_pool_free(&pool);
+    free(bytes);
+    free(ctxs);
+}
+
+
+/*
+ * Splits the input among 1, 10, 100 ... --streams streams fed in
+ * interleaved chunks (see bench_streams_init()), each an hs_stream_t of
+ * its own. A stream's last chunk is followed by hs_reset_stream(), which
+ * reports the matches at the end of the data like hs_close_stream() but
+ * keeps the stream for the next pass. Without -g a stream stops at its
+ * first match.
+ *
+ * With --idle=P, about P percent of the streams go idle after each
+ * chunk: their state is compressed and the stream freed until their next
+ * chunk expands it again, which the timings include. An untimed pass
+ * then measures the compression and, with --checkpoint=FILE, writes
+ * the compressed state of every stream to FILE halfway through the
+ * input and reads it back before scanning the rest, the round trip a
+ * checkpoint costs.
+ *
+ * With --restore=FILE, that pass instead starts from the checkpoint an
+ * earlier run of the same pattern and file left in FILE, for the stream
+ * count it was taken with, and scans the rest of the input only.
+ */
+static void
+run_streams(hs_database_t *re, hs_scratch_t *scratch, const char *input,
+    size_t len, int global, int repeat)
+{
+    int                  n, s, matches = 0, passes;
+    double               begin, end;
+    bench_stats_t        st;
+    bench_perf_t         perf;
+    streams_t            sts;
+
+    memset(&sts, 0, sizeof(streams_t));
+
+    sts.db = re;
+    sts.scratch = scratch;
+    sts.input = input;
+    sts.cbdata.global = global;
+
+    if (hs_stream_size(re, &sts.state) != HS_SUCCESS) {
+        fprintf(stderr, "Hyperscan cannot get the stream size\n");
+        exit(2);
+    }
+
+    sts.buf = malloc(sts.state);
+    if (sts.buf == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    bench_perf_open(&perf);
+
+    for (n = 1; n; n = bench_streams_next_count(n)) {
+        bench_streams_init(&sts.ss, len, n);
+
+        sts.streams = malloc(n * sizeof(hs_stream_t *));
+        sts.done = malloc(n);
+        sts.idle = calloc(n, sizeof(char *));
+        sts.idle_len = calloc(n, sizeof(size_t));
+        if (sts.streams == NULL || sts.done == NULL || sts.idle == NULL
+            || sts.idle_len == NULL)
+        {
+            fprintf(stderr, "failed to allocate memory\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        for (s = 0; s < n; s++) {
+            if (hs_open_stream(re, 0, &sts.streams[s]) != HS_SUCCESS) {
+                fprintf(stderr, "Hyperscan cannot open stream %d\n", s);
+                exit(2);
+            }
+        }
+
+        printf("Hyperscan (%d stream%s", n, n == 1 ? "" : "s");
+
+        if (idle) {
+            printf(", %d%% idle", idle);
+        }
+
+        printf(") ");
+        fflush(stdout);
+
+        perf.count[0] = 0;
+        perf.count[1] = 0;
+        passes = 0;
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            memset(sts.done, 0, n);
+            sts.cbdata.matches = 0;
+            sts.fed = 0;
+
+            bench_perf_start(&perf);
+
+            TIMER_START
+
+            streams_feed(&sts, 0, sts.ss.rounds);
+
+            TIMER_STOP
+
+            bench_perf_stop(&perf);
+            passes++;
+
+            matches = sts.cbdata.matches;
+
+            /* the streams stopped early are still to be reset */
+            for (s = 0; s < n; s++) {
+                hs_reset_stream(sts.streams[s], 0, NULL, NULL, NULL);
+            }
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+               "times).\n", matches ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_streams_print(&sts.ss, bench_stats_median(&st), sts.fed,
+                            (double) sts.state, &perf, passes);
+        bench_stats_print(&st);
+
+        if (restore && streams_restore(&sts)) {
+            /* only the matches after the checkpoint were counted */
+
+        } else if (idle || checkpoint) {
+            streams_checkpoint(&sts);
+
+            if (sts.cbdata.matches != matches) {
+                printf("# checkpoint: %d matches instead of %d\n",
+                       sts.cbdata.matches, matches);
+            }
+        }
+
+        for (s = 0; s < n; s++) {
+            hs_close_stream(sts.streams[s], NULL, NULL, NULL);
+        }
+
+        free(sts.idle_len);
+        free(sts.idle);
+        free(sts.done);
+        free(sts.streams);
+    }
+
+    bench_perf_close(&perf);
+    free(sts.buf);
+}
+
+
+/* feeds the rounds [from, to) to the streams not done yet */
+static void
+streams_feed(streams_t *sts, size_t from, size_t to)
+{
+    int                  s, eof, found;
+    size_t               r, off, size;
+
+    for (r = from; r < to; r++) {
+        for (s = 0; s < sts->ss.n; s++) {
+            if (sts->done[s]) {
+                continue;
+            }
+
+            size = bench_stream_chunk(&sts->ss, s, r, &off, &eof);
+            if (size == 0 && !eof) {
+                continue;
+            }
+
+            if (sts->idle[s]) {
+                streams_expand(sts, s);
+            }
+
+            sts->fed += size;
+            found = sts->cbdata.matches;
+
+            if (size) {
+                hs_scan_stream(sts->streams[s], sts->input + off, size, 0,
+                               sts->scratch, match_cb, &sts->cbdata);
+            }
+
+            if (!sts->cbdata.global && sts->cbdata.matches > found) {
+                sts->done[s] = 1;
+                continue;
+            }
+
+            if (eof) {
+                hs_reset_stream(sts->streams[s], 0, sts->scratch, match_cb,
+                                &sts->cbdata);
+                sts->done[s] = 1;
+                continue;
+            }
+
+            if (streams_is_idle(s, r)) {
+                streams_compress(sts, s);
+            }
+        }
+    }
+}
+
+
+/* about idle percent of the streams, a different set in every round */
+static int
+streams_is_idle(int s, size_t r)
+{
+    return idle && ((unsigned) s * 2654435761u + (unsigned) r * 40503u)
+                   % 100 < (unsigned) idle;
+}
+
+
+/* replaces a stream by a copy of its compressed state */
+static void
+streams_compress(streams_t *sts, int s)
+{
+    size_t  used;
+
+    if (hs_compress_stream(sts->streams[s], sts->buf, sts->state, &used)
+        != HS_SUCCESS)
+    {
+        fprintf(stderr, "Hyperscan cannot compress stream %d\n", s);
+        exit(2);
+    }
+
+    sts->idle[s] = malloc(used);
+    if (sts->idle[s] == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    memcpy(sts->idle[s], sts->buf, used);
+    sts->idle_len[s] = used;
+
+    hs_close_stream(sts->streams[s], NULL, NULL, NULL);
+    sts->streams[s] = NULL;
+}
+
+
+static void
+streams_expand(streams_t *sts, int s)
+{
+    if (hs_expand_stream(sts->db, &sts->streams[s], sts->idle[s],
+                         sts->idle_len[s])
+        != HS_SUCCESS)
+    {
+        fprintf(stderr, "Hyperscan cannot expand stream %d\n", s);
+        exit(2);
+    }
+
+    free(sts->idle[s]);
+    sts->idle[s] = NULL;
+}
+
+
+/*
+ * An untimed pass: feeds the first half of the rounds, then compresses
+ * and expands every stream in one go to time the calls, and with
+ * --checkpoint also writes the compressed state to the file and reads it
+ * back into fresh streams before feeding the rest, all in this process.
+ * Prints a "# compress:" line and a "# checkpoint:" line.
+ */
+static void
+streams_checkpoint(streams_t *sts)
+{
+    int          s, n = sts->ss.n, live = 0;
+    size_t       mid = sts->ss.rounds / 2, total = 0, round;
+    size_t       bytes = 0;
+    double       begin, compress, expand, write = 0, read = 0;
+
+    memset(sts->done, 0, n);
+    sts->cbdata.matches = 0;
+    sts->fed = 0;
+
+    streams_feed(sts, 0, mid);
+
+    for (s = 0; s < n; s++) {
+        if (sts->idle[s]) {
+            streams_expand(sts, s);
+        }
+
+        if (!sts->done[s]) {
+            live++;
+        }
+    }
+
+    begin = get_wall_time();
+
+    for (s = 0; s < n; s++) {
+        if (!sts->done[s]) {
+            streams_compress(sts, s);
+            total += sts->idle_len[s];
+        }
+    }
+
+    compress = get_wall_time() - begin;
+
+    if (checkpoint) {
+        begin = get_wall_time();
+        bytes = streams_write(sts, mid);
+        write = get_wall_time() - begin;
+
+        for (s = 0; s < n; s++) {
+            free(sts->idle[s]);
+            sts->idle[s] = NULL;
+        }
+
+        begin = get_wall_time();
+        streams_read(sts, checkpoint, &round);
+        read = get_wall_time() - begin;
+
+        if (round != mid) {
+            fprintf(stderr, "bad checkpoint round: %lu\n",
+                    (unsigned long) round);
+            exit(2);
+        }
+    }
+
+    begin = get_wall_time();
+
+    for (s = 0; s < n; s++) {
+        if (sts->idle[s]) {
+            streams_expand(sts, s);
+        }
+    }
+
+    expand = get_wall_time() - begin;
+
+    streams_feed(sts, mid, sts->ss.rounds);
+
+    for (s = 0; s < n; s++) {
+        if (sts->idle[s]) {
+            streams_expand(sts, s);
+        }
+
+        hs_reset_stream(sts->streams[s], 0, NULL, NULL, NULL);
+    }
+
+    if (live == 0) {
+        printf("# compress: no stream left at round %lu\n",
+               (unsigned long) mid);
+        return;
+    }
+
+    printf("# compress: %d stream%s at round %lu, %.0lf of %lu bytes "
+           "(%.1lf%%), compress %.3lf us, expand %.3lf us, %.0lf bytes "
+           "per stream at %d%% idle\n", live, live == 1 ? "" : "s",
+           (unsigned long) mid,
+           (double) total / live, (unsigned long) sts->state,
+           100.0 * total / live / sts->state, compress / live * 1e6,
+           expand / live * 1e6,
+           (100 - idle) / 100.0 * sts->state
+           + idle / 100.0 * total / live, idle);
+
+    if (checkpoint) {
+        printf("# checkpoint: %s, %lu bytes, write %.3lf ms, read %.3lf "
+               "ms, %d matches after the restore\n", checkpoint,
+               (unsigned long) bytes, write * 1e3, read * 1e3, sts->cbdata.matches);
+    }
+}
+
+
+/*
+ * An untimed pass resuming from the checkpoint in the --restore file:
+ * the streams that were live get their state back, the others stay done,
+ * and the rounds after the checkpoint are fed. Prints a "# restore:"
+ * line. Returns 0 when the file holds another number of streams.
+ */
+static int
+streams_restore(streams_t *sts)
+{
+    int          s, n = sts->ss.n, live = 0;
+    size_t       mid = sts->ss.rounds / 2, round;
+    double       begin, read, expand;
+
+    memset(sts->done, 0, n);
+    sts->cbdata.matches = 0;
+    sts->fed = 0;
+
+    begin = get_wall_time();
+
+    if (streams_read(sts, restore, &round) != 0) {
+        printf("# restore: %s holds another number of streams than %d\n",
+               restore, n);
+        return 0;
+    }
+
+    read = get_wall_time() - begin;
+
+    if (round != mid) {
+        fprintf(stderr, "checkpoint of round %lu instead of %lu in %s: "
+                "another file?\n", (unsigned long) round,
+                (unsigned long) mid, restore);
+        exit(1);
+    }
+
+    for (s = 0; s < n; s++) {
+        if (sts->idle[s] == NULL) {
+            sts->done[s] = 1;
+            continue;
+        }
+
+        /* the fresh stream gives way to the restored one */
+        hs_close_stream(sts->streams[s], NULL, NULL, NULL);
+        sts->streams[s] = NULL;
+        live++;
+    }
+
+    begin = get_wall_time();
+
+    for (s = 0; s < n; s++) {
+        if (sts->idle[s]) {
+            streams_expand(sts, s);
+        }
+    }
+
+    expand = get_wall_time() - begin;
+
+    streams_feed(sts, mid, sts->ss.rounds);
+
+    for (s = 0; s < n; s++) {
+        if (sts->idle[s]) {
+            streams_expand(sts, s);
+        }
+
+        hs_reset_stream(sts->streams[s], 0, NULL, NULL, NULL);
+    }
+
+    printf("# restore: %s, %d stream%s live at round %lu, read %.3lf ms, "
+           "expand %.3lf us per stream, %d matches after the restore\n",
+           restore, live, live == 1 ? "" : "s", (unsigned long) mid,
+           read * 1e3, live ? expand / live * 1e6 : 0.0,
+           sts->cbdata.matches);
+
+    return 1;
+}
+
+
+/*
+ * The checkpoint file: "HSCK", the round, the number of streams and the
+ * stream size as 32-bit words, then each stream's compressed size (0 for
+ * a stream that is done) and state.
+ */
+static size_t
+streams_write(streams_t *sts, size_t round)
+{
+    int        s;
+    FILE      *f;
+    size_t     bytes;
+    uint32_t   hdr[4], size;
+
+    f = fopen(checkpoint, "wb");
+    if (f == NULL) {
+        perror("open checkpoint");
+        exit(1);
+    }
+
+    memcpy(&hdr[0], "HSCK", 4);
+    hdr[1] = (uint32_t) round;
+    hdr[2] = (uint32_t) sts->ss.n;
+    hdr[3] = (uint32_t) sts->state;
+
+    if (fwrite(hdr, sizeof(hdr), 1, f) != 1) {
+        perror("write checkpoint");
+        exit(1);
+    }
+
+    bytes = sizeof(hdr);
+
+    for (s = 0; s < sts->ss.n; s++) {
+        size = sts->idle[s] ? (uint32_t) sts->idle_len[s] : 0;
+
+        if (fwrite(&size, sizeof(size), 1, f) != 1
+            || (size && fwrite(sts->idle[s], size, 1, f) != 1))
+        {
+            perror("write checkpoint");
+            exit(1);
+        }
+
+        bytes += sizeof(size) + size;
+    }
+
+    if (fclose(f) != 0) {
+        perror("close checkpoint");
+        exit(1);
+    }
+
+    return bytes;
+}
+
+
+/*
+ * Reads the checkpoint in path into the idle states of the streams.
+ * Returns -1, reading nothing, when it holds another number of streams.
+ */
+static int
+streams_read(streams_t *sts, const char *path, size_t *round)
+{
+    int        s;
+    FILE      *f;
+    uint32_t   hdr[4], size;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        perror("open checkpoint");
+        exit(1);
+    }
+
+    if (fread(hdr, sizeof(hdr), 1, f) != 1
+        || memcmp(&hdr[0], "HSCK", 4) != 0
+        || hdr[3] != (uint32_t) sts->state)
+    {
+        fprintf(stderr, "bad checkpoint file: %s\n", path);
+        exit(1);
+    }
+
+    if (hdr[2] != (uint32_t) sts->ss.n) {
+        fclose(f);
+        return -1;
+    }
+
+    *round = hdr[1];
+
+    for (s = 0; s < sts->ss.n; s++) {
+        if (fread(&size, sizeof(size), 1, f) != 1 || size > sts->state) {
+            fprintf(stderr, "bad checkpoint file: %s\n", path);
+            exit(1);
+        }
+
+        if (size == 0) {
+            continue;
+        }
+
+        sts->idle[s] = malloc(size);
+        if (sts->idle[s] == NULL) {
+            fprintf(stderr, "failed to allocate memory\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        if (fread(sts->idle[s], size, 1, f) != 1) {
+            fprintf(stderr, "checkpoint truncated: %s\n", path);
+            exit(1);
+        }
+
+        sts->idle_len[s] = size;
+    }
+
+    fclose(f);
+
+    return 0;
+}
+
+
+/*
+ * Scans the file as one stream while it is being read into the buffers
+ * of a bench_reader_t. The times include the reads.
+ */
+static void
+run_pipeline(hs_database_t *re, hs_scratch_t *scratch, const char *path,
+    int global, int repeat)
+{
+    int                  done;
+    size_t               size;
+    bench_stats_t        st;
+    bench_reader_t       rd;
+    hs_stream_t         *stream;
+    const unsigned char *p;
+    struct match_cbdata  cbdata;
+
+    bench_reader_open(&rd, path);
+    bench_reader_drain(&rd, repeat);
+
+    printf("Hyperscan (pipeline) ");
+    fflush(stdout);
+
+    cbdata.matches = 0;
+    cbdata.global = global;
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        cbdata.matches = 0;
+        done = 0;
+
+        bench_reader_start(&rd);
+
+        if (hs_open_stream(re, 0, &stream) != HS_SUCCESS) {
+            fprintf(stderr, "Hyperscan cannot open a stream\n");
+            exit(2);
+        }
+
+        do {
+            size = bench_reader_next(&rd, &p);
+
+            /* keeps draining the ring after the first match */
+            if (size && !done
+                && hs_scan_stream(stream, (const char *) p, size, 0, scratch,
+                                  match_cb, &cbdata)
+                   == HS_SCAN_TERMINATED)
+            {
+                done = 1;
+            }
+
+            bench_reader_release(&rd);
+
+        } while (size);
+
+        hs_close_stream(stream, scratch, done ? NULL : match_cb, &cbdata);
+
+        bench_stats_add(&st, bench_reader_end(&rd));
+    }
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+           "times).\n", cbdata.matches ? "match" : "no match",
+           bench_stats_median(&st) * 1e3, cbdata.matches, st.n);
+    bench_reader_print(&rd, bench_stats_median(&st));
+    bench_stats_print(&st);
+
+    bench_reader_close(&rd);
+}
+
+
+/*
+ * Scans the files under a directory in a pool of workers sharing the
+ * database (see bench_tree_run()), each with its own scratch space, or
+ * a new one for every job with --setup=include.
+ */
+static void
+run_tree(hs_database_t *re, const char *path, int global, int repeat)
+{
+    int                  t, n;
+    thread_ctx_t        *ctxs, *ctx;
+    static bench_tree_t  tree;
+
+    bench_tree_init(&tree, tree_scan, path);
+
+    n = bench_conf.threads > 1 ? bench_conf.threads : 1;
+
+    ctxs = malloc(n * sizeof(thread_ctx_t));
+    if (ctxs == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    for (t = 0; t < n; t++) {
+        ctx = &ctxs[t];
+        ctx->db = re;
+        ctx->global = global;
+        ctx->scratch = NULL;
+
+        if (!bench_conf.setup
+            && hs_alloc_scratch(re, &ctx->scratch) != HS_SUCCESS)
+        {
+            fprintf(stderr, "Hyperscan cannot allocate scratch\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        tree.workers[t].ctx = ctx;
+    }
+
+    for (t = 1; t; t = bench_pool_next_threads(t)) {
+        printf("Hyperscan (tree, %d worker%s) ", t, t == 1 ? "" : "s");
+        fflush(stdout);
+
+        bench_tree_run(&tree, t, repeat);
+    }
+
+    for (t = 0; t < n; t++) {
+        hs_free_scratch(ctxs[t].scratch);
+    }
+
+    bench_tree_free(&tree);
+    free(ctxs);
+}
+
+
+static int
+tree_scan(void *data, const unsigned char *p, size_t len)
+{
+    int            matches;
+    thread_ctx_t  *ctx = data;
+
+    if (!bench_conf.setup) {
+        return thread_scan(data, p, len);
+    }
+
+    ctx->scratch = NULL;
+
+    if (hs_alloc_scratch(ctx->db, &ctx->scratch) != HS_SUCCESS) {
+        fprintf(stderr, "Hyperscan cannot allocate scratch\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    matches = thread_scan(data, p, len);
+
+    hs_free_scratch(ctx->scratch);
+    ctx->scratch = NULL;
+
+    return matches;
+}
+
+
+/*
+ * Replaces the matches by copying the input between them to an output
+ * buffer kept from run to run, with the match offsets of
+ * HS_FLAG_SOM_LEFTMOST. Hyperscan has no capture groups, so only $0 is
+ * set. It reports every match in the order of their ends, so a match
+ * starting inside the last one replaced is dropped: for a+ on aaa only
+ * the first a is replaced, where a backtracking engine would take all
+ * three.
+ */
+static void
+run_replace(hs_database_t *re, hs_scratch_t *scratch, const char *input,
+    size_t len, int repeat)
+{
+    int                  runs = 0;
+    unsigned long        allocs = 0, a;
+    double               begin, end;
+    bench_stats_t        st;
+    replace_t            rp;
+
+    memset(&rp, 0, sizeof(replace_t));
+    rp.input = input;
+
+    printf("Hyperscan (replace) ");
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        rp.out.len = 0;
+        rp.copied = 0;
+        rp.matches = 0;
+
+        a = BENCH_ALLOCS();
+
+        TIMER_START
+
+        hs_scan(re, input, len, 0, scratch, replace_cb, &rp);
+
+        bench_out_append(&rp.out, input + rp.copied, len - rp.copied);
+
+        TIMER_STOP
+
+        allocs += BENCH_ALLOCS() - a;
+        runs++;
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           rp.matches ? "match" : "no match", bench_stats_median(&st) * 1e3,
+           rp.matches, st.n);
+    bench_replace_print(len, rp.out.len, bench_stats_median(&st), allocs,
+                        runs);
+    bench_stats_print(&st);
+
+    free(rp.out.data);
+}
+
+
+static int
+replace_cb(unsigned int id, unsigned long long from, unsigned long long to,
+    unsigned int flags, void *context)
+{
+    size_t      caps[2];
+    replace_t  *rp = context;
+
+    if (from < rp->copied) {
+        return 0;
+    }
+
+    bench_out_append(&rp->out, rp->input + rp->copied, from - rp->copied);
+
+    caps[0] = from;
+    caps[1] = to;
+
+    bench_out_expand(&rp->out, (const unsigned char *) rp->input, caps, 1);
+
+    rp->copied = to;
+    rp->matches++;
+
+    return 0;
+}
+
+
+/*
+ * The batch filter mode (see --batch): the file cut into a column of
+ * rows of each of the --rows sizes and a bitmap of the rows matching,
+ * with an hs_scan() of every row that stops at its first match, and with
+ * one hs_scan_vector() of the whole column. Hyperscan scans the blocks
+ * of a vector as one stream, so there the rows are told from the match
+ * offsets and a match across rows is dropped; it can miss a row whose
+ * own match starts after the leftmost start of one across rows, and ^
+ * and $ only see line ends, as the "rows differ" count shows.
+ */
+static void
+run_batch(hs_database_t *re, hs_scratch_t *scratch, const char *pattern,
+    int flags, hs_platform_info_t *plt, const char *input, size_t len,
+    int repeat)
+{
+    int                  s, nsizes, hit;
+    size_t               row, n, sizes[BENCH_MAX_ROW_SIZES];
+    double               begin, end;
+    unsigned            *lens;
+    const char         **rows;
+    const size_t        *off;
+    bench_stats_t        st;
+    bench_column_t       col;
+    batch_t              b;
+    hs_database_t       *vdb = NULL;
+    hs_scratch_t        *vscratch = NULL;
+    hs_compile_error_t  *err = NULL;
+
+    if (hs_compile(pattern, flags | HS_FLAG_SOM_LEFTMOST, HS_MODE_VECTORED,
+                   plt, &vdb, &err) != HS_SUCCESS)
+    {
+        hs_free_compile_error(err);
+        vdb = NULL;
+
+    } else {
+        hs_alloc_scratch(vdb, &vscratch);
+    }
+
+    nsizes = bench_column_sizes(sizes);
+
+    for (s = 0; s < nsizes; s++) {
+        bench_column_init(&col, input, len, sizes[s]);
+        off = col.offsets;
+
+        printf("Hyperscan (batch, %lu-byte rows) ", (unsigned long) sizes[s]);
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            bench_column_clear(&col);
+
+            TIMER_START
+
+            for (row = 0; row < col.nrows; row++) {
+                hit = 0;
+
+                hs_scan(re, input + off[row], off[row + 1] - off[row], 0,
+                        scratch, batch_cb, &hit);
+
+                if (hit) {
+                    bench_column_select(&col, row);
+                }
+            }
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        n = bench_column_count(&col);
+
+        printf("%s: %.05lf ms elapsed (%lu matches found, %d repeated "
+               "times).\n", n ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, (unsigned long) n, st.n);
+        bench_column_print(&col, bench_stats_median(&st));
+        bench_stats_print(&st);
+
+        if (vdb == NULL) {
+            printf("Hyperscan vectored (batch, %lu-byte rows) cannot "
+                   "report match starts.\n", (unsigned long) sizes[s]);
+            bench_column_free(&col);
+            continue;
+        }
+
+        rows = malloc(col.nrows * sizeof(const char *));
+        lens = malloc(col.nrows * sizeof(unsigned));
+        if (rows == NULL || lens == NULL) {
+            fprintf(stderr, "failed to allocate memory\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        for (row = 0; row < col.nrows; row++) {
+            rows[row] = input + off[row];
+            lens[row] = off[row + 1] - off[row];
+        }
+
+        printf("Hyperscan vectored (batch, %lu-byte rows) ",
+               (unsigned long) sizes[s]);
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            bench_column_clear(&col);
+
+            b.col = &col;
+            b.row = 0;
+
+            TIMER_START
+
+            hs_scan_vector(vdb, rows, lens, col.nrows, 0, vscratch,
+                           batch_vector_cb, &b);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        n = bench_column_count(&col);
+
+        printf("%s: %.05lf ms elapsed (%lu matches found, %d repeated "
+               "times).\n", n ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, (unsigned long) n, st.n);
+        bench_column_print(&col, bench_stats_median(&st));
+        bench_stats_print(&st);
+
+        free(rows);
+        free(lens);
+        bench_column_free(&col);
+    }
+
+    if (vdb) {
+        hs_free_scratch(vscratch);
+        hs_free_database(vdb);
+    }
+}
+
+
+/* a row matches: stop at its first match */
+static int
+batch_cb(unsigned int id, unsigned long long from, unsigned long long to,
+    unsigned int flags, void *context)
+{
+    *(int *) context = 1;
+
+    return 1;
+}
+
+
+static int
+batch_vector_cb(unsigned int id, unsigned long long from,
+    unsigned long long to, unsigned int flags, void *context)
+{
+    batch_t       *b = context;
+    const size_t  *off = b->col->offsets;
+
+    /* the matches come in the order of their ends */
+    while (to > off[b->row + 1]) {
+        b->row++;
+    }
+
+    if (from >= off[b->row]) {
+        bench_column_select(b->col, b->row);
+    }
+
+    return 0;
+}
+
+
+/* the heatmap mode (see --heatmap), with the scan of the threads mode */
+static void
+run_heatmap(hs_database_t *re, hs_scratch_t *scratch, const char *input,
+    size_t len, int global, int repeat)
+{
+    thread_ctx_t         ctx;
+
+    ctx.db = re;
+    ctx.scratch = scratch;
+    ctx.global = global;
+
+    printf("Hyperscan ");
+
+    if (platform) {
+        printf("(%s) ", platform);
+    }
+
+    printf("(heatmap) ");
+    fflush(stdout);
+
+    bench_heatmap_run(thread_scan, &ctx, (const unsigned char *) input, len,
+                      repeat);
+}
+
+
+/*
+ * The grep mode (see --grep): a scan for all the matches of the input
+ * timed, then a scan writing their lines out too, both with a database
+ * reporting the starts of the matches.
+ *
+ * Hyperscan reports the matches in the order of their ends while
+ * bench_grep_match() takes them in the order of their starts, so the
+ * second scan collects them and sorts them by start when they are out of
+ * order before queuing their lines, all of it timed.
+ */
+static void
+run_grep(const char *pattern, int flags, hs_platform_info_t *plt,
+    const char *input, size_t len, int repeat)
+{
+    double               begin, end, match_only;
+    grep_t               gr;
+    bench_stats_t        st;
+    hs_database_t       *db = NULL;
+    hs_scratch_t        *scratch = NULL;
+    hs_compile_error_t  *err = NULL;
+    static bench_grep_t  g;
+
+    printf("Hyperscan ");
+
+    if (platform) {
+        printf("(%s) ", platform);
+    }
+
+    printf("(grep) ");
+    fflush(stdout);
+
+    if (hs_compile(pattern, flags | HS_FLAG_SOM_LEFTMOST, HS_MODE_BLOCK,
+                   plt, &db, &err) != HS_SUCCESS)
+    {
+        printf("cannot report match starts: %s\n", err->message);
+        hs_free_compile_error(err);
+        return;
+    }
+
+    if (hs_alloc_scratch(db, &scratch) != HS_SUCCESS) {
+        fprintf(stderr, "Hyperscan cannot allocate scratch\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    bench_grep_init(&g, (const unsigned char *) input, len);
+
+    gr.m = NULL;
+    gr.size = 0;
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        gr.g = NULL;
+        gr.matches = 0;
+
+        TIMER_START
+
+        hs_scan(db, input, len, 0, scratch, grep_cb, &gr);
+
+        TIMER_STOP
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    match_only = bench_stats_median(&st);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        bench_grep_reset(&g);
+
+        gr.g = &g;
+        gr.matches = 0;
+        gr.n = 0;
+        gr.sorted = 1;
+
+        TIMER_START
+
+        hs_scan(db, input, len, 0, scratch, grep_cb, &gr);
+        grep_queue(&gr);
+        bench_grep_flush(&g);
+
+        TIMER_STOP
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           gr.matches ? "match" : "no match", bench_stats_median(&st) * 1e3,
+           gr.matches, st.n);
+    bench_grep_print(&g, match_only, bench_stats_median(&st));
+    bench_stats_print(&st);
+
+    free(gr.m);
+    bench_grep_free(&g);
+    hs_free_scratch(scratch);
+    hs_free_database(db);
+}
+
+
+/* the matches come in the order of their ends: keep them for
+ * grep_queue() */
+static int
+grep_cb(unsigned int id, unsigned long long from, unsigned long long to,
+    unsigned int flags, void *context)
+{
+    grep_t        *gr = context;
+    grep_match_t  *m;
+
+    gr->matches++;
+
+    if (gr->g == NULL) {
+        return 0;
+    }
+
+    if (gr->n == gr->size) {
+        gr->size = gr->size ? gr->size * 2 : 1024;
+
+        m = realloc(gr->m, gr->size * sizeof(grep_match_t));
+        if (m == NULL) {
+            fprintf(stderr, "failed to allocate memory\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        gr->m = m;
+    }
+
+    if (gr->n && from < gr->m[gr->n - 1].from) {
+        gr->sorted = 0;
+    }
+
+    gr->m[gr->n].from = from;
+    gr->m[gr->n].to = to;
+    gr->n++;
+
+    return 0;
+}
+
+
+/* queues the lines of the matches of a scan in the order of their starts */
+static void
+grep_queue(grep_t *gr)
+{
+    size_t  i;
+
+    if (!gr->sorted) {
+        qsort(gr->m, gr->n, sizeof(grep_match_t), grep_cmp);
+    }
+
+    for (i = 0; i < gr->n; i++) {
+        bench_grep_match(gr->g, gr->m[i].from, gr->m[i].to);
+    }
+}
+
+
+static int
+grep_cmp(const void *a, const void *b)
+{
+    const grep_match_t  *x = a, *y = b;
+
+    if (x->from != y->from) {
+        return x->from < y->from ? -1 : 1;
+    }
+
+    return x->to < y->to ? -1 : x->to > y->to;
+}
+
+
+/*
+ * The platform sweep (see --platforms): the database compiled for each
+ * target the host can run, from the least Hyperscan needs up to the
+ * host's best, and the scan timed with each, to see what older machines
+ * of a fleet lose. The tune is the host's unless --tune=generic.
+ */
+static void
+run_platforms(const char *pattern, int flags, const char *input,
+    size_t len, int global, int repeat)
+{
+    int                  i, listed = 0;
+    size_t               size;
+    double               median, first = 0;
+    hs_database_t       *db;
+    hs_scratch_t        *scratch;
+    hs_platform_info_t   host, plt;
+    hs_compile_error_t  *err = NULL;
+
+    hs_populate_platform(&host);
+
+    for (i = 0; platforms[i].name; i++) {
+        if (!platform_listed(platforms[i].name)) {
+            continue;
+        }
+
+        listed++;
+
+        if ((host.cpu_features & platforms[i].features)
+            != platforms[i].features)
+        {
+            printf("Hyperscan (%s) cannot run on this host.\n",
+                   platforms[i].name);
+            continue;
+        }
+
+        plt = host;
+        plt.cpu_features = platforms[i].features;
+
+        if (tune_generic) {
+            plt.tune = HS_TUNE_FAMILY_GENERIC;
+        }
+
+        if (hs_compile(pattern, flags, HS_MODE_BLOCK, &plt, &db, &err)
+            != HS_SUCCESS)
+        {
+            printf("Hyperscan (%s) cannot compile: %s\n", platforms[i].name,
+                   err->message);
+            hs_free_compile_error(err);
+            continue;
+        }
+
+        scratch = NULL;
+
+        if (hs_database_size(db, &size) != HS_SUCCESS
+            || hs_alloc_scratch(db, &scratch) != HS_SUCCESS)
+        {
+            fprintf(stderr, "Hyperscan (%s) cannot allocate scratch\n",
+                    platforms[i].name);
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        platform = platforms[i].name;
+
+        median = run_engines(db, scratch, input, len, global, repeat);
+
+        if (first == 0) {
+            first = median;
+        }
+
+        printf("# platform: %s, cpu features 0x%llx, tune %u, database %lu "
+               "bytes, %.3lf GB/s, %.2fx the first\n", platforms[i].name,
+               (unsigned long long) plt.cpu_features, plt.tune,
+               (unsigned long) size, median > 0 ? len / median / 1e9 : 0,
+               median > 0 ? first / median : 0);
+
+        hs_free_scratch(scratch);
+        hs_free_database(db);
+    }
+
+    if (listed == 0) {
+        fprintf(stderr, "unknown platforms: %s\n", platforms_list);
+        exit(1);
+    }
+
+    platform = NULL;
+}
+
+
+/* the target is in the --platforms list, or the list is all */
+static int
+platform_listed(const char *name)
+{
+    size_t       n = strlen(name);
+    const char  *p = platforms_list;
+
+    if (strcmp(p, "all") == 0) {
+        return 1;
+    }
+
+    while (*p) {
+        if (strncmp(p, name, n) == 0 && (p[n] == ',' || p[n] == '\0')) {
+            return 1;
+        }
+
+        p = strchr(p, ',');
+        if (p == NULL) {
+            break;
+        }
+
+        p++;
+    }
+
+    return 0;
+}
+
+
+static int
+thread_scan(void *data, const unsigned char *p, size_t len)
+{
+    thread_ctx_t        *ctx = data;
+    struct match_cbdata  cbdata;
+
+    cbdata.matches = 0;
+    cbdata.global = ctx->global;
+
+    hs_scan(ctx->db, (const char *) p, len, 0, ctx->scratch, match_cb,
+            &cbdata);
+
+    return cbdata.matches;
 }
 
 
@@ -223,7 +1935,21 @@ usage(int rc)
             "options:\n"
             "   -i                  use case insensitive matching\n"
             "   -g                  enable the global search mode\n"
-            "   --repeat=N          repeat the test for N times; pick the best\n"
-            "                       result. default to 5.\n");
+            "   --repeat=N          repeat the test at least N times; report\n"
+            "                       the median. default to 5.\n"
+            BENCH_USAGE
+            "   --idle=P            with --streams, compress the state of\n"
+            "                       about P percent of the streams between\n"
+            "                       their chunks. default to 0.\n"
+            "   --checkpoint=FILE   with --streams, write the compressed\n"
+            "                       state of all the streams to FILE halfway\n"
+            "                       through and read it back (a round trip)\n"
+            "   --restore=FILE      with --streams, resume from the\n"
+            "                       checkpoint an earlier run left in FILE\n"
+            "   --platforms[=LIST]  compile for each of ssse3, avx2, avx512\n"
+            "                       and avx512vbmi, or the targets in LIST,\n"
+            "                       that the host can run, and time each\n"
+            "   --tune=MODE         host (the default) or generic, the tune\n"
+            "                       of --platforms\n");
     exit(rc);
 }
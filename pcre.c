@@ -6,6 +6,7 @@
  */
 
 
+#define _GNU_SOURCE
 #include <pcre.h>
 #include <assert.h>
 #include <string.h>
@@ -14,21 +15,29 @@
 #include <errno.h>
 #include <time.h>
 #include "getcputime.h"
+#include "bench.h"
 
 
 static void usage(int rc);
 static void run_engines(pcre *re, unsigned engine_types, int* ovector,
     int ovecsize, const char *input, size_t len, int global, int repeat);
+static void print_limits(void);
+static void set_limits(pcre_extra *extra);
+static const char *exec_error(int rc);
 
 
 enum {
     ENGINE_DEFAULT = (1 << 0),
     ENGINE_JIT     = (1 << 1),
     ENGINE_DFA     = (1 << 2),
-    MATCH_LIMIT    = 0,
 };
 
 
+/* 0 keeps the library defaults */
+static unsigned long     match_limit = 0;
+static unsigned long     recursion_limit = 0;
+
+
 #define TIMER_START                                                          \
         begin = get_cpu_time();                                              \
         if (begin == -1) {                                                   \
@@ -96,12 +105,28 @@ main(int argc, char **argv)
                 repeat = 5;
             }
 
+        } else if (strncmp(argv[i], "--match-limit=",
+                           sizeof("--match-limit=") - 1) == 0)
+        {
+            match_limit = strtoul(argv[i] + sizeof("--match-limit=") - 1,
+                                  NULL, 10);
+
+        } else if (strncmp(argv[i], "--recursion-limit=",
+                           sizeof("--recursion-limit=") - 1) == 0)
+        {
+            recursion_limit = strtoul(argv[i]
+                                      + sizeof("--recursion-limit=") - 1,
+                                      NULL, 10);
+
         } else if (strncmp(argv[i], "-i", 2) == 0) {
             flags |= PCRE_CASELESS;
 
         } else if (strncmp(argv[i], "-g", 2) == 0) {
             global = 1;
 
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
         } else {
             fprintf(stderr, "unknown option: %s\n", argv[i]);
             exit(1);
@@ -117,6 +142,9 @@ main(int argc, char **argv)
         usage(1);
     }
 
+    /* none of the modes */
+    bench_setup(0);
+
     re = pcre_compile(argv[i++], flags, &errstr, &err_offset, NULL);
     if (re == NULL) {
         fprintf(stderr, "[error] pos %d: %s\n", err_offset, errstr);
@@ -147,7 +175,7 @@ main(int argc, char **argv)
         return 1;
     }
 
-    len = (size_t) rc;
+    len = bench_input_size((size_t) rc);
 
     if (fseek(f, 0L, SEEK_SET) != 0) {
         perror("seek to file beginning");
@@ -157,7 +185,7 @@ main(int argc, char **argv)
     input = malloc(len);
     if (input == NULL) {
         fprintf(stderr, "failed to allocate %ld bytes.\n", len);
-        return 1;
+        return BENCH_EXIT_NOMEM;
     }
 
     if (fread(input, 1, len, f) < len) {
@@ -175,6 +203,8 @@ main(int argc, char **argv)
         return 1;
     }
 
+    bench_cache_add(input, len);
+
     ovecsize = (ncaps + 1) * 3;
     ovector = malloc(ovecsize * sizeof(int));
     if (ovector == NULL) {
@@ -200,22 +230,27 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
     int                  rc = -1;
     size_t               rest;
     pcre_extra          *extra;
-    double               begin, end, best = -1;
+    double               begin, end;
+    bench_stats_t        st;
     const char          *errstr = NULL, *p;
 
     if (engine_types & ENGINE_DEFAULT) {
 
         printf("PCRE interp ");
+        print_limits();
+        fflush(stdout);
 
-        extra = pcre_study(re, 0, &errstr);
+        extra = pcre_study(re, PCRE_STUDY_EXTRA_NEEDED, &errstr);
         if (errstr != NULL) {
             fprintf(stderr, "failed to study the regex: %s", errstr);
             exit(2);
         }
 
-        extra->match_limit = MATCH_LIMIT;
+        set_limits(extra);
+
+        bench_stats_init(&st, repeat);
 
-        for (i = 0; i < repeat; i++) {
+        while (bench_stats_next(&st)) {
             double elapsed;
 
             matches = 0;
@@ -241,9 +276,7 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
 
             TIMER_STOP
 
-            if (i == 0 || elapsed < best) {
-                best = elapsed;
-            }
+            bench_stats_add(&st, elapsed);
         }
 
         if (rc == 0) {
@@ -255,7 +288,7 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
             printf("no match");
 
         } else if (rc < 0) {
-            printf("error: %d", rc);
+            printf("error: %d (%s)", rc, exec_error(rc));
 
         } else if (rc > 0) {
             printf("match");
@@ -265,7 +298,8 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
         }
 
         printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-               best * 1e3, matches, repeat);
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
 
         if (extra) {
             pcre_free_study(extra);
@@ -276,15 +310,20 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
     if (engine_types & ENGINE_JIT) {
 
         printf("PCRE JIT ");
+        print_limits();
+        fflush(stdout);
 
-        extra = pcre_study(re, PCRE_STUDY_JIT_COMPILE, &errstr);
+        extra = pcre_study(re, PCRE_STUDY_JIT_COMPILE
+                           | PCRE_STUDY_EXTRA_NEEDED, &errstr);
         if (errstr != NULL) {
             fprintf(stderr, "failed to study the regex: %s", errstr);
             exit(2);
         }
-        extra->match_limit = MATCH_LIMIT;
+        set_limits(extra);
 
-        for (i = 0; i < repeat; i++) {
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
             double elapsed;
 
             matches = 0;
@@ -306,9 +345,7 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
 
             TIMER_STOP
 
-            if (i == 0 || elapsed < best) {
-                best = elapsed;
-            }
+            bench_stats_add(&st, elapsed);
         }
 
         if (rc == 0) {
@@ -320,7 +357,7 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
             printf("no match");
 
         } else if (rc < 0) {
-            printf("error: %d", rc);
+            printf("error: %d (%s)", rc, exec_error(rc));
 
         } else if (rc > 0) {
             printf("match");
@@ -330,7 +367,8 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
         }
 
         printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-               best * 1e3, matches, repeat);
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
 
         if (extra) {
             pcre_free_study(extra);
@@ -344,14 +382,20 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
         ovecsize = 2;
 
         printf("PCRE DFA ");
+        print_limits();
+        fflush(stdout);
 
-        extra = pcre_study(re, 0, &errstr);
+        extra = pcre_study(re, PCRE_STUDY_EXTRA_NEEDED, &errstr);
         if (errstr != NULL) {
             fprintf(stderr, "failed to study the regex: %s", errstr);
             exit(2);
         }
 
-        for (i = 0; i < repeat; i++) {
+        set_limits(extra);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
             double elapsed;
 
             matches = 0;
@@ -374,9 +418,7 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
 
             TIMER_STOP
 
-            if (i == 0 || elapsed < best) {
-                best = elapsed;
-            }
+            bench_stats_add(&st, elapsed);
         }
 
         if (rc == 0) {
@@ -387,7 +429,7 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
             printf("no match");
 
         } else if (rc < 0) {
-            printf("error: %d", rc);
+            printf("error: %d (%s)", rc, exec_error(rc));
 
         } else if (rc > 0) {
             printf("match");
@@ -397,7 +439,8 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
         }
 
         printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-               best * 1e3, matches, repeat);
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
 
         if (extra) {
             pcre_free_study(extra);
@@ -407,6 +450,72 @@ run_engines(pcre *re, unsigned engine_types, int *ovector, int ovecsize,
 }
 
 
+/* tags the engine name so that runs under different limits can be told
+ * apart */
+static void
+print_limits(void)
+{
+    if (match_limit == 0 && recursion_limit == 0) {
+        return;
+    }
+
+    printf("(");
+
+    if (match_limit) {
+        printf("steps %lu%s", match_limit, recursion_limit ? ", " : "");
+    }
+
+    if (recursion_limit) {
+        printf("recursion %lu", recursion_limit);
+    }
+
+    printf(") ");
+}
+
+
+static void
+set_limits(pcre_extra *extra)
+{
+    if (match_limit) {
+        extra->flags |= PCRE_EXTRA_MATCH_LIMIT;
+        extra->match_limit = match_limit;
+    }
+
+    if (recursion_limit) {
+        extra->flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+        extra->match_limit_recursion = recursion_limit;
+    }
+}
+
+
+static const char *
+exec_error(int rc)
+{
+    switch (rc) {
+    case PCRE_ERROR_MATCHLIMIT:
+        return "match limit exceeded";
+
+    case PCRE_ERROR_RECURSIONLIMIT:
+        return "recursion limit exceeded";
+
+    case PCRE_ERROR_JIT_STACKLIMIT:
+        return "JIT stack limit exceeded";
+
+    case PCRE_ERROR_NOMEMORY:
+        return "out of memory";
+
+    case PCRE_ERROR_DFA_WSSIZE:
+        return "DFA workspace too small";
+
+    case PCRE_ERROR_DFA_RECURSE:
+        return "DFA recursion limit exceeded";
+
+    default:
+        return "failed";
+    }
+}
+
+
 static void
 usage(int rc)
 {
@@ -417,7 +526,12 @@ usage(int rc)
             "   --dfa               use the PCRE DFA engine\n"
             "   --jit               use the PCRE JIT engine\n"
             "   -g                  enable the global search mode\n"
-            "   --repeat=N          repeat the test for N times; pick the best\n"
-            "                       result. default to 5.\n");
+            "   --repeat=N          repeat the test at least N times; report\n"
+            "                       the median. default to 5.\n"
+            BENCH_USAGE
+            "   --match-limit=N     fail a match after N internal match()\n"
+            "                       calls. default to the library setting.\n"
+            "   --recursion-limit=N fail a match nested deeper than N calls.\n"
+            "                       default to the library setting.\n");
     exit(rc);
 }
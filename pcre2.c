@@ -6,7 +6,9 @@
  */
 
 
+#define _GNU_SOURCE
 #define PCRE2_CODE_UNIT_WIDTH 8
+#define BENCH_COUNT_ALLOCS
 #include <pcre2.h>
 #include <assert.h>
 #include <string.h>
@@ -15,22 +17,101 @@
 #include <errno.h>
 #include <time.h>
 #include "getcputime.h"
+#include "bench.h"
+
+
+/* the streams mode keeps at most this much of a partial match */
+#define STREAM_MAX_HOLD          1024
+#define STREAM_WORK_SPACE        256
+
+
+/*
+ * The match state of a stream: the DFA engine resumes a partial match
+ * from its work space (PCRE2_DFA_RESTART), while the interpreter and the
+ * JIT engine rescan the held tail of the subject from the start of the
+ * partial match together with the next chunk.
+ */
+typedef struct {
+    unsigned             done:1;
+    unsigned             started:1;
+    unsigned             restart:1;
+    size_t               nhold;
+    size_t               hold_size;
+    unsigned char       *hold;
+    int                 *work_space;
+} stream_t;
 
 
 static void usage(int rc);
 static void run_engines(pcre2_code *re, unsigned engine_types,
     pcre2_match_data *match_data, const char *input, size_t len,
     int global, int repeat);
+static void run_latency(pcre2_code *re, unsigned engine_types,
+    const char *input, size_t len);
+static void latency_setup(pcre2_code *re, unsigned engine,
+    pcre2_match_context *match_ctx, pcre2_match_data **match_data,
+    pcre2_jit_stack **stack);
+static void latency_teardown(pcre2_match_data **match_data,
+    pcre2_jit_stack **stack);
+static void run_threads(pcre2_code *re, unsigned engine_types,
+    const char *input, size_t len, int global, int repeat);
+static int thread_scan(void *data, const unsigned char *p, size_t len);
+static void run_streams(pcre2_code *re, unsigned engine_types,
+    const char *input, size_t len, int global, int repeat);
+static int stream_feed(pcre2_code *re, unsigned engine, stream_t *sm,
+    const unsigned char *p, size_t size, int eof, int global,
+    pcre2_match_data *match_data, pcre2_match_context *match_ctx,
+    unsigned char *buf);
+static void run_pipeline(pcre2_code *re, unsigned engine_types,
+    const char *path, int global, int repeat);
+static void run_tree(pcre2_code *re, unsigned engine_types,
+    const char *path, int global, int repeat);
+static int tree_scan(void *data, const unsigned char *p, size_t len);
+static void run_replace(pcre2_code *re, unsigned engine_types,
+    pcre2_match_data *match_data, const char *input, size_t len,
+    int repeat);
+static void run_fields(const char *pattern, int flags,
+    unsigned engine_types, const char *input, size_t len, int repeat);
+static void run_batch(pcre2_code *re, unsigned engine_types,
+    const char *input, size_t len, int repeat);
+static void run_heatmap(pcre2_code *re, unsigned engine_types,
+    const char *input, size_t len, int global, int repeat);
+static void run_grep(pcre2_code *re, unsigned engine_types,
+    const char *input, size_t len, int repeat);
+static void print_limits(void);
+static void set_limits(pcre2_match_context *match_ctx);
+static void print_error(int rc);
 
 
 enum {
     ENGINE_DEFAULT = (1 << 0),
     ENGINE_JIT     = (1 << 1),
     ENGINE_DFA     = (1 << 2),
-    MATCH_LIMIT    = 0,
 };
 
 
+/* the per-thread state of the threads mode */
+typedef struct {
+    pcre2_code          *re;
+    pcre2_match_data    *match_data;
+    pcre2_match_context *match_ctx;
+    pcre2_jit_stack     *stack;
+    unsigned             engine;
+    int                  global;
+    int                  work_space[4096];
+} thread_ctx_t;
+
+
+static int grep_scan(thread_ctx_t *ctx, const char *input, size_t len,
+    bench_grep_t *g);
+
+
+/* 0 keeps the library defaults */
+static uint32_t          match_limit = 0;
+static uint32_t          depth_limit = 0;
+static uint32_t          heap_limit = 0;
+
+
 #define TIMER_START                                                          \
         begin = get_cpu_time();                                              \
         if (begin == -1) {                                                   \
@@ -58,6 +139,7 @@ main(int argc, char **argv)
     unsigned             i;
     int                  err_code;
     char                *input;
+    const char          *pattern;
     FILE                *f;
     size_t               len;
     long                 rc;
@@ -99,12 +181,33 @@ main(int argc, char **argv)
                 repeat = 5;
             }
 
+        } else if (strncmp(argv[i], "--match-limit=",
+                           sizeof("--match-limit=") - 1) == 0)
+        {
+            match_limit = strtoul(argv[i] + sizeof("--match-limit=") - 1,
+                                  NULL, 10);
+
+        } else if (strncmp(argv[i], "--depth-limit=",
+                           sizeof("--depth-limit=") - 1) == 0)
+        {
+            depth_limit = strtoul(argv[i] + sizeof("--depth-limit=") - 1,
+                                  NULL, 10);
+
+        } else if (strncmp(argv[i], "--heap-limit=",
+                           sizeof("--heap-limit=") - 1) == 0)
+        {
+            heap_limit = strtoul(argv[i] + sizeof("--heap-limit=") - 1,
+                                 NULL, 10);
+
         } else if (strncmp(argv[i], "-i", 2) == 0) {
             flags |= PCRE2_CASELESS;
 
         } else if (strncmp(argv[i], "-g", 2) == 0) {
             global = 1;
 
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
         } else {
             fprintf(stderr, "unknown option: %s\n", argv[i]);
             exit(1);
@@ -120,13 +223,20 @@ main(int argc, char **argv)
         usage(1);
     }
 
+    bench_setup(BENCH_MODE_LATENCY | BENCH_MODE_THREADS | BENCH_MODE_STREAMS
+                | BENCH_MODE_PIPELINE | BENCH_MODE_TREE | BENCH_MODE_REPLACE
+                | BENCH_MODE_FIELDS | BENCH_MODE_BATCH | BENCH_MODE_HEATMAP
+                | BENCH_MODE_GREP);
+
     comp_ctx = pcre2_compile_context_create(NULL);
     if (comp_ctx == NULL) {
         fprintf(stderr, "PCRE2 cannot allocate compile context\n");
-        exit(1);
+        exit(BENCH_EXIT_NOMEM);
     }
 
-    re = pcre2_compile((PCRE2_SPTR8) argv[i++], /* the pattern */
+    pattern = argv[i++];
+
+    re = pcre2_compile((PCRE2_SPTR8) pattern,   /* the pattern */
                        PCRE2_ZERO_TERMINATED,   /* length */
                        flags,                   /* options */
                        &err_code,               /* for error code */
@@ -139,6 +249,18 @@ main(int argc, char **argv)
 
     pcre2_compile_context_free(comp_ctx);
 
+    if (bench_conf.pipeline) {
+        run_pipeline(re, engine_types, argv[i], global, repeat);
+        pcre2_code_free(re);
+        return 0;
+    }
+
+    if (bench_conf.tree) {
+        run_tree(re, engine_types, argv[i], global, repeat);
+        pcre2_code_free(re);
+        return 0;
+    }
+
     errno = 0;
 
     f = fopen(argv[i], "rb");
@@ -158,7 +280,7 @@ main(int argc, char **argv)
         return 1;
     }
 
-    len = (size_t) rc;
+    len = bench_input_size((size_t) rc);
 
     if (fseek(f, 0L, SEEK_SET) != 0) {
         perror("seek to file beginning");
@@ -168,7 +290,7 @@ main(int argc, char **argv)
     input = malloc(len);
     if (input == NULL) {
         fprintf(stderr, "failed to allocate %ld bytes.\n", len);
-        return 1;
+        return BENCH_EXIT_NOMEM;
     }
 
     if (fread(input, 1, len, f) < len) {
@@ -186,6 +308,8 @@ main(int argc, char **argv)
         return 1;
     }
 
+    bench_cache_add(input, len);
+
     if (engine_types & ENGINE_DFA) {
         match_data = pcre2_match_data_create(32, NULL);
 
@@ -195,10 +319,37 @@ main(int argc, char **argv)
 
     if (match_data == NULL) {
         fprintf(stderr, "PCRE2 cannot allocate match data\n");
-        exit(1);
+        exit(BENCH_EXIT_NOMEM);
     }
 
-    run_engines(re, engine_types, match_data, input, len, global, repeat);
+    if (bench_conf.batch) {
+        run_batch(re, engine_types, input, len, repeat);
+
+    } else if (bench_conf.fields) {
+        run_fields(pattern, flags, engine_types, input, len, repeat);
+
+    } else if (bench_conf.slice) {
+        run_heatmap(re, engine_types, input, len, global, repeat);
+
+    } else if (bench_conf.grep) {
+        run_grep(re, engine_types, input, len, repeat);
+
+    } else if (bench_conf.replace) {
+        run_replace(re, engine_types, match_data, input, len, repeat);
+
+    } else if (bench_conf.plant) {
+        run_latency(re, engine_types, input, len);
+
+    } else if (bench_conf.threads) {
+        run_threads(re, engine_types, input, len, global, repeat);
+
+    } else if (bench_conf.streams) {
+        run_streams(re, engine_types, input, len, global, repeat);
+
+    } else {
+        run_engines(re, engine_types, match_data, input, len, global,
+                    repeat);
+    }
 
     free(input);
     pcre2_match_data_free(match_data);
@@ -215,7 +366,8 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
     int                  i, n, matches = 0;
     int                  rc = -1;
     size_t               rest;
-    double               begin, end, best = -1;
+    double               begin, end;
+    bench_stats_t        st;
     const char          *p;
     PCRE2_SIZE          *ovector;
     pcre2_match_context *match_ctx;
@@ -225,14 +377,20 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
     if (engine_types & ENGINE_DEFAULT) {
 
         printf("PCRE2 interp ");
+        print_limits();
+        fflush(stdout);
 
         match_ctx = pcre2_match_context_create(NULL);
         if (match_ctx == NULL) {
             fprintf(stderr, "PCRE2 interp cannot allocate match context\n");
-            exit(2);
+            exit(BENCH_EXIT_NOMEM);
         }
 
-        for (i = 0; i < repeat; i++) {
+        set_limits(match_ctx);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
             double elapsed;
 
             matches = 0;
@@ -265,9 +423,7 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
 
             TIMER_STOP
 
-            if (i == 0 || elapsed < best) {
-                best = elapsed;
-            }
+            bench_stats_add(&st, elapsed);
         }
 
         if (rc == 0) {
@@ -279,7 +435,7 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
             printf("no match");
 
         } else if (rc < 0) {
-            printf("error: %d", rc);
+            print_error(rc);
 
         } else if (rc > 0) {
             printf("match");
@@ -289,7 +445,8 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
         }
 
         printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-               best * 1e3, matches, repeat);
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
 
         pcre2_match_context_free(match_ctx);
     }
@@ -300,12 +457,18 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
         match_ctx = pcre2_match_context_create(NULL);
         if (match_ctx == NULL) {
             fprintf(stderr, "PCRE2 interp cannot allocate match context\n");
-            exit(2);
+            exit(BENCH_EXIT_NOMEM);
         }
 
+        set_limits(match_ctx);
+
         printf("PCRE2 DFA ");
+        print_limits();
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
 
-        for (i = 0; i < repeat; i++) {
+        while (bench_stats_next(&st)) {
             double elapsed;
 
             matches = 0;
@@ -336,9 +499,7 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
 
             TIMER_STOP
 
-            if (i == 0 || elapsed < best) {
-                best = elapsed;
-            }
+            bench_stats_add(&st, elapsed);
         }
 
         if (rc == 0) {
@@ -349,7 +510,7 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
             printf("no match");
 
         } else if (rc < 0) {
-            printf("error: %d", rc);
+            print_error(rc);
 
         } else if (rc > 0) {
             printf("match");
@@ -359,7 +520,8 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
         }
 
         printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-               best * 1e3, matches, repeat);
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
 
         pcre2_match_context_free(match_ctx);
     }
@@ -370,9 +532,11 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
         match_ctx = pcre2_match_context_create(NULL);
         if (match_ctx == NULL) {
             fprintf(stderr, "PCRE2 interp cannot allocate match context\n");
-            exit(2);
+            exit(BENCH_EXIT_NOMEM);
         }
 
+        set_limits(match_ctx);
+
         if (pcre2_jit_compile(re, PCRE2_JIT_COMPLETE)) {
             fprintf(stderr, "PCRE2 JIT compilation failed\n");
             exit(1);
@@ -381,14 +545,18 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
         stack = pcre2_jit_stack_create(65536, 65536, NULL);
         if (stack == NULL) {
             fprintf(stderr, "PCRE2 JIT cannot allocate JIT stack\n");
-            exit(1);
+            exit(BENCH_EXIT_NOMEM);
         }
 
         pcre2_jit_stack_assign(match_ctx, NULL, stack);
 
         printf("PCRE2 JIT ");
+        print_limits();
+        fflush(stdout);
 
-        for (i = 0; i < repeat; i++) {
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
             double elapsed;
 
             matches = 0;
@@ -417,9 +585,7 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
 
             TIMER_STOP
 
-            if (i == 0 || elapsed < best) {
-                best = elapsed;
-            }
+            bench_stats_add(&st, elapsed);
         }
 
         if (rc == 0) {
@@ -431,7 +597,7 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
             printf("no match");
 
         } else if (rc < 0) {
-            printf("error: %d", rc);
+            print_error(rc);
 
         } else if (rc > 0) {
             printf("match");
@@ -441,7 +607,8 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
         }
 
         printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-               best * 1e3, matches, repeat);
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
 
         pcre2_jit_stack_free(stack);
         pcre2_match_context_free(match_ctx);
@@ -449,6 +616,1534 @@ run_engines(pcre2_code *re, unsigned engine_types, pcre2_match_data *match_data,
 }
 
 
+/*
+ * The time to the first match of short subjects (see --latency). The
+ * match data, and the JIT stack for the JIT engine, are either made once
+ * per engine and offset or with every call (--setup=include).
+ */
+static void
+run_latency(pcre2_code *re, unsigned engine_types, const char *input,
+    size_t len)
+{
+    int                  k, noffsets, call, missed, early, rc;
+    int                  work_space[4096];
+    size_t               offsets[BENCH_MAX_OFFSETS], max_offset = 0;
+    size_t               start;
+    double               begin, elapsed;
+    unsigned             engine;
+    bench_stats_t        st;
+    bench_subjects_t     subj;
+    pcre2_match_data    *match_data = NULL;
+    pcre2_jit_stack     *stack = NULL;
+    pcre2_match_context *match_ctx;
+    const unsigned char *s;
+
+    noffsets = bench_latency_offsets(offsets);
+
+    for (k = 0; k < noffsets; k++) {
+        if (offsets[k] != BENCH_NO_OFFSET && offsets[k] > max_offset) {
+            max_offset = offsets[k];
+        }
+    }
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        match_ctx = pcre2_match_context_create(NULL);
+        if (match_ctx == NULL) {
+            fprintf(stderr, "PCRE2 cannot allocate match context\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        set_limits(match_ctx);
+
+        for (k = 0; k < noffsets; k++) {
+            bench_subjects_init(&subj, (const unsigned char *) input, len,
+                                offsets[k], max_offset);
+
+            printf("PCRE2 %s ", engine == ENGINE_DEFAULT ? "interp"
+                                : engine == ENGINE_JIT ? "JIT" : "DFA");
+            print_limits();
+            fflush(stdout);
+
+            if (!bench_conf.setup) {
+                latency_setup(re, engine, match_ctx, &match_data, &stack);
+            }
+
+            bench_stats_init(&st, bench_conf.calls);
+            missed = 0;
+            early = 0;
+
+            for (call = 0; bench_latency_next(&st); call++) {
+                s = bench_subject(&subj, call);
+                start = 0;
+
+                begin = get_wall_time();
+
+                if (bench_conf.setup) {
+                    latency_setup(re, engine, match_ctx, &match_data,
+                                  &stack);
+                }
+
+                if (engine == ENGINE_DEFAULT) {
+                    rc = pcre2_match(re, s, subj.len, 0, PCRE2_NO_JIT,
+                                     match_data, match_ctx);
+
+                } else if (engine == ENGINE_JIT) {
+                    rc = pcre2_jit_match(re, s, subj.len, 0, 0, match_data,
+                                         match_ctx);
+
+                } else {
+                    rc = pcre2_dfa_match(re, s, subj.len, 0, 0, match_data,
+                                         match_ctx, work_space, 4096);
+                }
+
+                if (rc >= 0) {
+                    start = pcre2_get_ovector_pointer(match_data)[0];
+                }
+
+                if (bench_conf.setup) {
+                    latency_teardown(&match_data, &stack);
+                }
+
+                elapsed = get_wall_time() - begin;
+
+                if (st.warmup == 0) {
+                    if (rc < 0) {
+                        missed++;
+
+                    } else if (start < subj.offset) {
+                        early++;
+                    }
+                }
+
+                bench_stats_add(&st, elapsed);
+            }
+
+            bench_latency_print(&st, &subj, missed, early);
+
+            if (!bench_conf.setup) {
+                latency_teardown(&match_data, &stack);
+            }
+
+            bench_subjects_free(&subj);
+        }
+
+        pcre2_match_context_free(match_ctx);
+    }
+}
+
+
+/*
+ * Scans a copy of the input in each of 1, 2, 4 ... --threads threads
+ * (see bench_pool_run()), with either the one compiled pattern (and its
+ * JIT code) shared by all the threads or a pcre2_code_copy() per thread.
+ * The match data, match context and JIT stack are per thread either way.
+ */
+static void
+run_threads(pcre2_code *re, unsigned engine_types, const char *input,
+    size_t len, int global, int repeat)
+{
+    int                  t, n, objects;
+    size_t               rss, compiled, size, jit_size;
+    unsigned             engine;
+    thread_ctx_t        *ctxs, *ctx;
+    static bench_pool_t  pool;
+
+    static const char   *names[] = { NULL, "shared", "copy" };
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    ctxs = malloc(bench_conf.threads * sizeof(thread_ctx_t));
+    if (ctxs == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    bench_pool_init(&pool, thread_scan, (const unsigned char *) input, len,
+                    bench_conf.threads);
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        for (objects = BENCH_OBJECTS_SHARED; objects <= BENCH_OBJECTS_COPY;
+             objects++)
+        {
+            if (bench_conf.objects != BENCH_OBJECTS_BOTH
+                && bench_conf.objects != objects)
+            {
+                continue;
+            }
+
+            rss = bench_rss();
+            compiled = 0;
+
+            for (t = 0; t < pool.max; t++) {
+                ctx = &ctxs[t];
+                ctx->engine = engine;
+                ctx->global = global;
+                ctx->stack = NULL;
+                ctx->re = re;
+
+                if (objects == BENCH_OBJECTS_COPY) {
+                    ctx->re = pcre2_code_copy(re);
+                    if (ctx->re == NULL) {
+                        fprintf(stderr, "PCRE2 cannot copy the pattern\n");
+                        exit(2);
+                    }
+
+                    if (engine == ENGINE_JIT
+                        && pcre2_jit_compile(ctx->re, PCRE2_JIT_COMPLETE))
+                    {
+                        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+                        exit(1);
+                    }
+                }
+
+                if (objects == BENCH_OBJECTS_COPY || t == 0) {
+                    size = 0;
+                    jit_size = 0;
+                    pcre2_pattern_info(ctx->re, PCRE2_INFO_SIZE, &size);
+
+                    if (engine == ENGINE_JIT) {
+                        pcre2_pattern_info(ctx->re, PCRE2_INFO_JITSIZE,
+                                           &jit_size);
+                    }
+
+                    compiled += size + jit_size;
+                }
+
+                ctx->match_ctx = pcre2_match_context_create(NULL);
+                if (ctx->match_ctx == NULL) {
+                    fprintf(stderr, "PCRE2 cannot allocate match context\n");
+                    exit(BENCH_EXIT_NOMEM);
+                }
+
+                set_limits(ctx->match_ctx);
+
+                latency_setup(ctx->re, engine, ctx->match_ctx,
+                              &ctx->match_data, &ctx->stack);
+
+                pool.workers[t].ctx = ctx;
+            }
+
+            for (n = 1; n; n = bench_pool_next_threads(n)) {
+                printf("PCRE2 %s (%s, %d thread%s) ",
+                       engine == ENGINE_DEFAULT ? "interp"
+                       : engine == ENGINE_JIT ? "JIT" : "DFA",
+                       names[objects], n, n == 1 ? "" : "s");
+                print_limits();
+                fflush(stdout);
+
+                bench_pool_run(&pool, n, repeat);
+            }
+
+            bench_pool_print_memory(names[objects], pool.max, compiled, rss);
+
+            for (t = 0; t < pool.max; t++) {
+                ctx = &ctxs[t];
+
+                latency_teardown(&ctx->match_data, &ctx->stack);
+                pcre2_match_context_free(ctx->match_ctx);
+
+                if (ctx->re != re) {
+                    pcre2_code_free(ctx->re);
+                }
+            }
+        }
+    }
+
+    bench_pool_free(&pool);
+    free(ctxs);
+}
+
+
+static int
+thread_scan(void *data, const unsigned char *p, size_t len)
+{
+    int            rc, matches = 0;
+    thread_ctx_t  *ctx = data;
+    PCRE2_SIZE    *ovector;
+
+    ovector = pcre2_get_ovector_pointer(ctx->match_data);
+
+    do {
+        if (ctx->engine == ENGINE_DEFAULT) {
+            rc = pcre2_match(ctx->re, p, len, 0, PCRE2_NO_JIT,
+                             ctx->match_data, ctx->match_ctx);
+
+        } else if (ctx->engine == ENGINE_JIT) {
+            rc = pcre2_jit_match(ctx->re, p, len, 0, 0, ctx->match_data,
+                                 ctx->match_ctx);
+
+        } else {
+            rc = pcre2_dfa_match(ctx->re, p, len, 0, 0, ctx->match_data,
+                                 ctx->match_ctx, ctx->work_space, 4096);
+        }
+
+        if (rc >= 0) {
+            matches++;
+            p += ovector[1];
+            len -= ovector[1];
+        }
+
+    } while (ctx->global && rc >= 0);
+
+    return matches;
+}
+
+
+/*
+ * Splits the input among 1, 10, 100 ... --streams streams fed in
+ * interleaved chunks (see bench_streams_init()) and matches each stream
+ * with partial matching, up to its first match unless global is set.
+ */
+static void
+run_streams(pcre2_code *re, unsigned engine_types, const char *input,
+    size_t len, int global, int repeat)
+{
+    int                  n, s, eof, matches = 0, passes;
+    size_t               r, off, size, fed = 0, state;
+    unsigned             engine;
+    double               begin, end;
+    bench_stats_t        st;
+    bench_streams_t      ss;
+    bench_perf_t         perf;
+    stream_t            *streams, *sm;
+    unsigned char       *buf;
+    pcre2_match_data    *match_data = NULL;
+    pcre2_jit_stack     *stack = NULL;
+    pcre2_match_context *match_ctx;
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_HARD))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    buf = malloc(STREAM_MAX_HOLD + bench_conf.chunk);
+    if (buf == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    bench_perf_open(&perf);
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        match_ctx = pcre2_match_context_create(NULL);
+        if (match_ctx == NULL) {
+            fprintf(stderr, "PCRE2 cannot allocate match context\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        set_limits(match_ctx);
+        latency_setup(re, engine, match_ctx, &match_data, &stack);
+
+        for (n = 1; n; n = bench_streams_next_count(n)) {
+            bench_streams_init(&ss, len, n);
+
+            streams = calloc(n, sizeof(stream_t));
+            if (streams == NULL) {
+                fprintf(stderr, "failed to allocate memory\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+
+            for (s = 0; engine == ENGINE_DFA && s < n; s++) {
+                streams[s].work_space = malloc(STREAM_WORK_SPACE
+                                               * sizeof(int));
+                if (streams[s].work_space == NULL) {
+                    fprintf(stderr, "failed to allocate memory\n");
+                    exit(BENCH_EXIT_NOMEM);
+                }
+            }
+
+            printf("PCRE2 %s (%d stream%s) ", engine == ENGINE_DEFAULT
+                   ? "interp" : engine == ENGINE_JIT ? "JIT" : "DFA",
+                   n, n == 1 ? "" : "s");
+            print_limits();
+            fflush(stdout);
+
+            perf.count[0] = 0;
+            perf.count[1] = 0;
+            passes = 0;
+
+            bench_stats_init(&st, repeat);
+
+            while (bench_stats_next(&st)) {
+                double elapsed;
+
+                for (s = 0; s < n; s++) {
+                    streams[s].done = 0;
+                    streams[s].started = 0;
+                    streams[s].restart = 0;
+                    streams[s].nhold = 0;
+                }
+
+                matches = 0;
+                fed = 0;
+
+                bench_perf_start(&perf);
+
+                TIMER_START
+
+                for (r = 0; r < ss.rounds; r++) {
+                    for (s = 0; s < n; s++) {
+                        sm = &streams[s];
+
+                        if (sm->done) {
+                            continue;
+                        }
+
+                        size = bench_stream_chunk(&ss, s, r, &off, &eof);
+                        if (size == 0 && !eof) {
+                            continue;
+                        }
+
+                        fed += size;
+                        matches += stream_feed(re, engine, sm,
+                                               (const unsigned char *) input
+                                               + off, size, eof, global,
+                                               match_data, match_ctx, buf);
+                    }
+                }
+
+                TIMER_STOP
+
+                bench_perf_stop(&perf);
+                passes++;
+
+                bench_stats_add(&st, elapsed);
+            }
+
+            state = n * sizeof(stream_t);
+
+            for (s = 0; s < n; s++) {
+                state += streams[s].hold_size;
+
+                if (streams[s].work_space) {
+                    state += STREAM_WORK_SPACE * sizeof(int);
+                }
+            }
+
+            printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+                   "times).\n", matches ? "match" : "no match",
+                   bench_stats_median(&st) * 1e3, matches, st.n);
+            bench_streams_print(&ss, bench_stats_median(&st), fed,
+                                (double) state / n, &perf, passes);
+            bench_stats_print(&st);
+
+            for (s = 0; s < n; s++) {
+                free(streams[s].hold);
+                free(streams[s].work_space);
+            }
+
+            free(streams);
+        }
+
+        latency_teardown(&match_data, &stack);
+        pcre2_match_context_free(match_ctx);
+    }
+
+    bench_perf_close(&perf);
+    free(buf);
+}
+
+
+/*
+ * Matches the next chunk of a stream and returns the number of matches
+ * found in it. A partial match held for the interpreter or the JIT
+ * engine is cut to its last STREAM_MAX_HOLD bytes, and lookbehinds do
+ * not see past the start of the chunk.
+ */
+static int
+stream_feed(pcre2_code *re, unsigned engine, stream_t *sm,
+    const unsigned char *p, size_t size, int eof, int global,
+    pcre2_match_data *match_data, pcre2_match_context *match_ctx,
+    unsigned char *buf)
+{
+    int           rc, matches = 0;
+    uint32_t      opts;
+    size_t        start = 0, keep;
+    PCRE2_SIZE   *ovector;
+
+    ovector = pcre2_get_ovector_pointer(match_data);
+
+    opts = eof ? 0 : PCRE2_PARTIAL_HARD;
+    if (sm->started) {
+        opts |= PCRE2_NOTBOL;
+    }
+
+    sm->started = 1;
+
+    if (engine != ENGINE_DFA && sm->nhold) {
+        memcpy(buf, sm->hold, sm->nhold);
+        memcpy(buf + sm->nhold, p, size);
+        p = buf;
+        size += sm->nhold;
+        sm->nhold = 0;
+    }
+
+    for ( ;; ) {
+        if (engine == ENGINE_DFA) {
+            rc = pcre2_dfa_match(re, p, size, start,
+                                 opts | (sm->restart ? PCRE2_DFA_RESTART : 0),
+                                 match_data, match_ctx, sm->work_space,
+                                 STREAM_WORK_SPACE);
+
+            if (sm->restart) {
+                sm->restart = 0;
+
+                /* the held partial match died: scan the chunk afresh */
+                if (rc == PCRE2_ERROR_NOMATCH) {
+                    continue;
+                }
+            }
+
+        } else if (engine == ENGINE_JIT) {
+            rc = pcre2_jit_match(re, p, size, start, opts, match_data,
+                                 match_ctx);
+
+        } else {
+            rc = pcre2_match(re, p, size, start, opts | PCRE2_NO_JIT,
+                             match_data, match_ctx);
+        }
+
+        if (rc < 0) {
+            break;
+        }
+
+        matches++;
+
+        if (!global) {
+            sm->done = 1;
+            return matches;
+        }
+
+        start = ovector[1] > ovector[0] ? ovector[1] : ovector[1] + 1;
+        if (start > size) {
+            break;
+        }
+    }
+
+    if (eof) {
+        sm->done = 1;
+        return matches;
+    }
+
+    if (rc == PCRE2_ERROR_PARTIAL) {
+        if (engine == ENGINE_DFA) {
+            sm->restart = 1;
+            return matches;
+        }
+
+        keep = size - ovector[0];
+        if (keep > STREAM_MAX_HOLD) {
+            keep = STREAM_MAX_HOLD;
+        }
+
+        if (sm->hold == NULL) {
+            sm->hold = malloc(STREAM_MAX_HOLD);
+            if (sm->hold == NULL) {
+                fprintf(stderr, "failed to allocate memory\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+
+            sm->hold_size = STREAM_MAX_HOLD;
+        }
+
+        memmove(sm->hold, p + size - keep, keep);
+        sm->nhold = keep;
+
+    } else if (rc != PCRE2_ERROR_NOMATCH) {
+        print_error(rc);
+        printf("\n");
+        exit(2);
+    }
+
+    return matches;
+}
+
+
+/*
+ * Matches the file as one stream while it is being read into the
+ * buffers of a bench_reader_t, so that a match spanning two buffers is
+ * carried over by stream_feed(). The times include the reads.
+ */
+static void
+run_pipeline(pcre2_code *re, unsigned engine_types, const char *path,
+    int global, int repeat)
+{
+    int                  matches = 0;
+    size_t               size;
+    unsigned             engine;
+    bench_stats_t        st;
+    bench_reader_t       rd;
+    stream_t             sm;
+    unsigned char       *buf;
+    const unsigned char *p;
+    pcre2_match_data    *match_data = NULL;
+    pcre2_jit_stack     *stack = NULL;
+    pcre2_match_context *match_ctx;
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_HARD))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    bench_reader_open(&rd, path);
+    bench_reader_drain(&rd, repeat);
+
+    buf = malloc(STREAM_MAX_HOLD + rd.size);
+    if (buf == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    memset(&sm, 0, sizeof(stream_t));
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        match_ctx = pcre2_match_context_create(NULL);
+        if (match_ctx == NULL) {
+            fprintf(stderr, "PCRE2 cannot allocate match context\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        set_limits(match_ctx);
+        latency_setup(re, engine, match_ctx, &match_data, &stack);
+
+        if (engine == ENGINE_DFA) {
+            sm.work_space = malloc(STREAM_WORK_SPACE * sizeof(int));
+            if (sm.work_space == NULL) {
+                fprintf(stderr, "failed to allocate memory\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+        }
+
+        printf("PCRE2 %s (pipeline) ", engine == ENGINE_DEFAULT
+               ? "interp" : engine == ENGINE_JIT ? "JIT" : "DFA");
+        print_limits();
+        fflush(stdout);
+
+        rd.wait = 0;
+        rd.elapsed = 0;
+        rd.passes = 0;
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            sm.done = 0;
+            sm.started = 0;
+            sm.restart = 0;
+            sm.nhold = 0;
+
+            matches = 0;
+
+            bench_reader_start(&rd);
+
+            do {
+                size = bench_reader_next(&rd, &p);
+
+                /* keeps draining the ring after the first match */
+                if (!sm.done) {
+                    matches += stream_feed(re, engine, &sm, p, size,
+                                           size == 0, global, match_data,
+                                           match_ctx, buf);
+                }
+
+                bench_reader_release(&rd);
+
+            } while (size);
+
+            bench_stats_add(&st, bench_reader_end(&rd));
+        }
+
+        printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+               "times).\n", matches ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_reader_print(&rd, bench_stats_median(&st));
+        bench_stats_print(&st);
+
+        free(sm.work_space);
+        sm.work_space = NULL;
+
+        latency_teardown(&match_data, &stack);
+        pcre2_match_context_free(match_ctx);
+    }
+
+    free(sm.hold);
+    free(buf);
+    bench_reader_close(&rd);
+}
+
+
+/*
+ * Scans the files under a directory in a pool of workers sharing the
+ * compiled pattern (see bench_tree_run()), each with its own match data
+ * and JIT stack, or new ones for every job with --setup=include.
+ */
+static void
+run_tree(pcre2_code *re, unsigned engine_types, const char *path,
+    int global, int repeat)
+{
+    int                  t, n;
+    unsigned             engine;
+    thread_ctx_t        *ctxs, *ctx;
+    static bench_tree_t  tree;
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    bench_tree_init(&tree, tree_scan, path);
+
+    n = bench_conf.threads > 1 ? bench_conf.threads : 1;
+
+    ctxs = malloc(n * sizeof(thread_ctx_t));
+    if (ctxs == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        for (t = 0; t < n; t++) {
+            ctx = &ctxs[t];
+            ctx->re = re;
+            ctx->engine = engine;
+            ctx->global = global;
+            ctx->match_data = NULL;
+            ctx->stack = NULL;
+
+            ctx->match_ctx = pcre2_match_context_create(NULL);
+            if (ctx->match_ctx == NULL) {
+                fprintf(stderr, "PCRE2 cannot allocate match context\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+
+            set_limits(ctx->match_ctx);
+
+            if (!bench_conf.setup) {
+                latency_setup(re, engine, ctx->match_ctx, &ctx->match_data,
+                              &ctx->stack);
+            }
+
+            tree.workers[t].ctx = ctx;
+        }
+
+        for (t = 1; t; t = bench_pool_next_threads(t)) {
+            printf("PCRE2 %s (tree, %d worker%s) ", engine == ENGINE_DEFAULT
+                   ? "interp" : engine == ENGINE_JIT ? "JIT" : "DFA",
+                   t, t == 1 ? "" : "s");
+            print_limits();
+            fflush(stdout);
+
+            bench_tree_run(&tree, t, repeat);
+        }
+
+        for (t = 0; t < n; t++) {
+            ctx = &ctxs[t];
+
+            if (ctx->match_data) {
+                latency_teardown(&ctx->match_data, &ctx->stack);
+            }
+
+            pcre2_match_context_free(ctx->match_ctx);
+        }
+    }
+
+    bench_tree_free(&tree);
+    free(ctxs);
+}
+
+
+static int
+tree_scan(void *data, const unsigned char *p, size_t len)
+{
+    int            matches;
+    thread_ctx_t  *ctx = data;
+
+    if (!bench_conf.setup) {
+        return thread_scan(data, p, len);
+    }
+
+    latency_setup(ctx->re, ctx->engine, ctx->match_ctx, &ctx->match_data,
+                  &ctx->stack);
+
+    matches = thread_scan(data, p, len);
+
+    latency_teardown(&ctx->match_data, &ctx->stack);
+
+    return matches;
+}
+
+
+/*
+ * Replaces every match with pcre2_substitute() and PCRE2_SUBSTITUTE_GLOBAL
+ * into an output buffer kept from run to run, grown to the length
+ * PCRE2_SUBSTITUTE_OVERFLOW_LENGTH asks for when too short. The DFA
+ * engine cannot substitute.
+ */
+static void
+run_replace(pcre2_code *re, unsigned engine_types,
+    pcre2_match_data *match_data, const char *input, size_t len,
+    int repeat)
+{
+    int                  rc = 0, runs;
+    uint32_t             opts;
+    unsigned             engine;
+    unsigned long        allocs;
+    double               begin, end;
+    bench_stats_t        st;
+    PCRE2_UCHAR         *out = NULL;
+    PCRE2_SIZE           out_len, out_size = 0;
+    pcre2_match_context *match_ctx;
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    match_ctx = pcre2_match_context_create(NULL);
+    if (match_ctx == NULL) {
+        fprintf(stderr, "PCRE2 cannot allocate match context\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    set_limits(match_ctx);
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_JIT; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        /* groups the pattern lacks are empty, as for the other engines */
+        opts = PCRE2_SUBSTITUTE_GLOBAL | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH
+               | PCRE2_SUBSTITUTE_UNKNOWN_UNSET | PCRE2_SUBSTITUTE_UNSET_EMPTY;
+        if (engine == ENGINE_DEFAULT) {
+            opts |= PCRE2_NO_JIT;
+        }
+
+        printf("PCRE2 %s (replace) ", engine == ENGINE_DEFAULT
+               ? "interp" : "JIT");
+        print_limits();
+        fflush(stdout);
+
+        runs = 0;
+        out_len = 0;
+        allocs = BENCH_ALLOCS();
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            TIMER_START
+
+            for ( ;; ) {
+                out_len = out_size;
+
+                rc = pcre2_substitute(re, (PCRE2_SPTR) input, len, 0, opts,
+                                      match_data, match_ctx,
+                                      (PCRE2_SPTR) bench_conf.replace,
+                                      PCRE2_ZERO_TERMINATED, out, &out_len);
+
+                if (rc != PCRE2_ERROR_NOMEMORY) {
+                    break;
+                }
+
+                /* out_len is the length needed, with the terminating NUL */
+                out = realloc(out, out_len);
+                if (out == NULL) {
+                    fprintf(stderr, "failed to allocate %lu bytes.\n",
+                            (unsigned long) out_len);
+                    exit(BENCH_EXIT_NOMEM);
+                }
+
+                out_size = out_len;
+            }
+
+            TIMER_STOP
+
+            if (rc < 0) {
+                print_error(rc);
+                printf("\n");
+                exit(2);
+            }
+
+            runs++;
+            bench_stats_add(&st, elapsed);
+        }
+
+        allocs = BENCH_ALLOCS() - allocs;
+
+        printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+               "times).\n", rc ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, rc, st.n);
+        bench_replace_print(len, out_len, bench_stats_median(&st), allocs,
+                            runs);
+        bench_stats_print(&st);
+    }
+
+    if (engine_types & ENGINE_DFA) {
+        printf("PCRE2 DFA (replace) cannot substitute.\n");
+    }
+
+    free(out);
+    pcre2_match_context_free(match_ctx);
+}
+
+
+static void
+latency_setup(pcre2_code *re, unsigned engine,
+    pcre2_match_context *match_ctx, pcre2_match_data **match_data,
+    pcre2_jit_stack **stack)
+{
+    if (engine == ENGINE_DFA) {
+        *match_data = pcre2_match_data_create(32, NULL);
+
+    } else {
+        *match_data = pcre2_match_data_create_from_pattern(re, NULL);
+    }
+
+    if (*match_data == NULL) {
+        fprintf(stderr, "PCRE2 cannot allocate match data\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    if (engine == ENGINE_JIT) {
+        *stack = pcre2_jit_stack_create(65536, 65536, NULL);
+        if (*stack == NULL) {
+            fprintf(stderr, "PCRE2 JIT cannot allocate JIT stack\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        pcre2_jit_stack_assign(match_ctx, NULL, *stack);
+    }
+}
+
+
+static void
+latency_teardown(pcre2_match_data **match_data, pcre2_jit_stack **stack)
+{
+    pcre2_match_data_free(*match_data);
+    *match_data = NULL;
+
+    if (*stack) {
+        pcre2_jit_stack_free(*stack);
+        *stack = NULL;
+    }
+}
+
+
+/*
+ * The field extraction mode (see --fields): every line matched on its
+ * own and the groups of its match stored as views into the input, with
+ * the regexp compiled again for 0, 1, 2 ... of its capture groups left
+ * capturing. The DFA engine cannot capture and only stores the whole
+ * match, once.
+ */
+static void
+run_fields(const char *pattern, int flags, unsigned engine_types,
+    const char *input, size_t len, int repeat)
+{
+    int                  rc = 0, k, g, ngroups, ncaps, err_code;
+    int                  work_space[4096];
+    char                *src;
+    size_t               line, matches = 0;
+    unsigned             engine;
+    double               begin, end;
+    PCRE2_SIZE           err_offset, *ovector;
+    bench_line_t        *ln;
+    bench_field_t       *fields;
+    bench_stats_t        st;
+    bench_fields_t       fl;
+    pcre2_code          *re;
+    pcre2_jit_stack     *stack;
+    pcre2_match_data    *match_data;
+    pcre2_match_context *match_ctx;
+
+    src = bench_groups_keep(pattern, 0, 0, &ngroups);
+    free(src);
+
+    bench_fields_init(&fl, (const unsigned char *) input, len, ngroups);
+
+    match_ctx = pcre2_match_context_create(NULL);
+    if (match_ctx == NULL) {
+        fprintf(stderr, "PCRE2 cannot allocate match context\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    set_limits(match_ctx);
+
+    stack = pcre2_jit_stack_create(65536, 65536, NULL);
+    if (stack == NULL) {
+        fprintf(stderr, "PCRE2 JIT cannot allocate JIT stack\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    pcre2_jit_stack_assign(match_ctx, NULL, stack);
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        for (k = engine == ENGINE_DFA ? ngroups : 0; k <= ngroups; k++) {
+            src = bench_groups_keep(pattern, k, 0, &g);
+
+            re = pcre2_compile((PCRE2_SPTR8) src, PCRE2_ZERO_TERMINATED,
+                               flags, &err_code, &err_offset, NULL);
+            if (re == NULL) {
+                fprintf(stderr, "[error] pos %d: %d\n", (int) err_offset,
+                        err_code);
+                exit(2);
+            }
+
+            free(src);
+
+            if (engine == ENGINE_JIT
+                && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+            {
+                fprintf(stderr, "PCRE2 JIT compilation failed\n");
+                exit(1);
+            }
+
+            match_data = pcre2_match_data_create_from_pattern(re, NULL);
+            if (match_data == NULL) {
+                fprintf(stderr, "PCRE2 cannot allocate match data\n");
+                exit(BENCH_EXIT_NOMEM);
+            }
+
+            ovector = pcre2_get_ovector_pointer(match_data);
+            ncaps = engine == ENGINE_DFA ? 1 : k + 1;
+
+            if (engine == ENGINE_DFA) {
+                printf("PCRE2 DFA (fields, no groups) ");
+
+            } else {
+                printf("PCRE2 %s (fields, %d of %d groups) ",
+                       engine == ENGINE_DEFAULT ? "interp" : "JIT", k,
+                       ngroups);
+            }
+
+            print_limits();
+            fflush(stdout);
+
+            bench_stats_init(&st, repeat);
+
+            while (bench_stats_next(&st)) {
+                double elapsed;
+
+                matches = 0;
+
+                TIMER_START
+
+                for (line = 0; line < fl.nlines; line++) {
+                    ln = &fl.lines[line];
+
+                    if (engine == ENGINE_JIT) {
+                        rc = pcre2_jit_match(re, (PCRE2_SPTR8) input
+                                             + ln->off, ln->len, 0, 0,
+                                             match_data, match_ctx);
+
+                    } else if (engine == ENGINE_DEFAULT) {
+                        rc = pcre2_match(re, (PCRE2_SPTR8) input + ln->off,
+                                         ln->len, 0, 0, match_data,
+                                         match_ctx);
+
+                    } else {
+                        rc = pcre2_dfa_match(re, (PCRE2_SPTR8) input
+                                             + ln->off, ln->len, 0, 0,
+                                             match_data, match_ctx,
+                                             work_space, 4096);
+                    }
+
+                    if (rc == PCRE2_ERROR_NOMATCH) {
+                        continue;
+                    }
+
+                    if (rc < 0) {
+                        print_error(rc);
+                        printf("\n");
+                        exit(2);
+                    }
+
+                    /* a DFA match has the longest match first */
+                    matches++;
+                    fields = bench_fields_line(&fl, line);
+
+                    for (g = 0; g < ncaps; g++) {
+                        if (ovector[2 * g] == PCRE2_UNSET) {
+                            fields[g].data = NULL;
+                            fields[g].len = 0;
+                            continue;
+                        }
+
+                        fields[g].data = (const unsigned char *) input
+                                         + ln->off + ovector[2 * g];
+                        fields[g].len = ovector[2 * g + 1]
+                                        - ovector[2 * g];
+                    }
+                }
+
+                TIMER_STOP
+
+                bench_stats_add(&st, elapsed);
+            }
+
+            printf("%s: %.05lf ms elapsed (%lu matches found, %d repeated "
+                   "times).\n", matches ? "match" : "no match",
+                   bench_stats_median(&st) * 1e3, (unsigned long) matches,
+                   st.n);
+            bench_fields_print(&fl, engine == ENGINE_DFA ? -1 : k, matches,
+                               bench_stats_median(&st));
+            bench_stats_print(&st);
+
+            pcre2_match_data_free(match_data);
+            pcre2_code_free(re);
+        }
+
+        if (engine != ENGINE_DFA) {
+            bench_fields_print_cost(&fl);
+        }
+    }
+
+    pcre2_jit_stack_free(stack);
+    pcre2_match_context_free(match_ctx);
+    bench_fields_free(&fl);
+}
+
+
+/*
+ * The batch filter mode (see --batch): the file cut into a column of
+ * rows of each of the --rows sizes, every row matched on its own in a
+ * tight loop with one match data, and a bitmap of the rows matching.
+ */
+static void
+run_batch(pcre2_code *re, unsigned engine_types, const char *input,
+    size_t len, int repeat)
+{
+    int                  rc = 0, s, nsizes;
+    int                  work_space[4096];
+    size_t               row, n, sizes[BENCH_MAX_ROW_SIZES];
+    unsigned             engine;
+    double               begin, end;
+    const size_t        *off;
+    bench_stats_t        st;
+    bench_column_t       col;
+    pcre2_jit_stack     *stack;
+    pcre2_match_data    *match_data;
+    pcre2_match_context *match_ctx;
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    /* only whether a row matches: group 0 is enough */
+    match_data = pcre2_match_data_create(1, NULL);
+    if (match_data == NULL) {
+        fprintf(stderr, "PCRE2 cannot allocate match data\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    match_ctx = pcre2_match_context_create(NULL);
+    if (match_ctx == NULL) {
+        fprintf(stderr, "PCRE2 cannot allocate match context\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    set_limits(match_ctx);
+
+    stack = pcre2_jit_stack_create(65536, 65536, NULL);
+    if (stack == NULL) {
+        fprintf(stderr, "PCRE2 JIT cannot allocate JIT stack\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    pcre2_jit_stack_assign(match_ctx, NULL, stack);
+
+    nsizes = bench_column_sizes(sizes);
+
+    for (s = 0; s < nsizes; s++) {
+        bench_column_init(&col, input, len, sizes[s]);
+        off = col.offsets;
+
+        for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+            if (!(engine_types & engine)) {
+                continue;
+            }
+
+            printf("PCRE2 %s (batch, %lu-byte rows) ",
+                   engine == ENGINE_DEFAULT ? "interp"
+                   : engine == ENGINE_JIT ? "JIT" : "DFA",
+                   (unsigned long) sizes[s]);
+            print_limits();
+            fflush(stdout);
+
+            bench_stats_init(&st, repeat);
+
+            while (bench_stats_next(&st)) {
+                double elapsed;
+
+                bench_column_clear(&col);
+
+                TIMER_START
+
+                for (row = 0; row < col.nrows; row++) {
+                    if (engine == ENGINE_JIT) {
+                        rc = pcre2_jit_match(re, (PCRE2_SPTR8) input
+                                             + off[row],
+                                             off[row + 1] - off[row], 0, 0,
+                                             match_data, match_ctx);
+
+                    } else if (engine == ENGINE_DEFAULT) {
+                        rc = pcre2_match(re, (PCRE2_SPTR8) input + off[row],
+                                         off[row + 1] - off[row], 0,
+                                         PCRE2_NO_JIT, match_data,
+                                         match_ctx);
+
+                    } else {
+                        rc = pcre2_dfa_match(re, (PCRE2_SPTR8) input
+                                             + off[row],
+                                             off[row + 1] - off[row], 0, 0,
+                                             match_data, match_ctx,
+                                             work_space, 4096);
+                    }
+
+                    /* 0: a DFA match with more than one length */
+                    if (rc >= 0) {
+                        bench_column_select(&col, row);
+
+                    } else if (rc != PCRE2_ERROR_NOMATCH) {
+                        print_error(rc);
+                        printf("\n");
+                        exit(2);
+                    }
+                }
+
+                TIMER_STOP
+
+                bench_stats_add(&st, elapsed);
+            }
+
+            n = bench_column_count(&col);
+
+            printf("%s: %.05lf ms elapsed (%lu matches found, %d repeated "
+                   "times).\n", n ? "match" : "no match",
+                   bench_stats_median(&st) * 1e3, (unsigned long) n, st.n);
+            bench_column_print(&col, bench_stats_median(&st));
+            bench_stats_print(&st);
+        }
+
+        bench_column_free(&col);
+    }
+
+    pcre2_jit_stack_free(stack);
+    pcre2_match_context_free(match_ctx);
+    pcre2_match_data_free(match_data);
+}
+
+
+/*
+ * The heatmap mode (see --heatmap): the slices of the input timed one
+ * by one for each engine, with the scan of the threads mode.
+ */
+static void
+run_heatmap(pcre2_code *re, unsigned engine_types, const char *input,
+    size_t len, int global, int repeat)
+{
+    unsigned             engine;
+    static thread_ctx_t  ctx;
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    ctx.re = re;
+    ctx.global = global;
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        ctx.engine = engine;
+        ctx.stack = NULL;
+
+        ctx.match_ctx = pcre2_match_context_create(NULL);
+        if (ctx.match_ctx == NULL) {
+            fprintf(stderr, "PCRE2 cannot allocate match context\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        set_limits(ctx.match_ctx);
+
+        latency_setup(re, engine, ctx.match_ctx, &ctx.match_data, &ctx.stack);
+
+        printf("PCRE2 %s (heatmap) ", engine == ENGINE_DEFAULT ? "interp"
+               : engine == ENGINE_JIT ? "JIT" : "DFA");
+        print_limits();
+        fflush(stdout);
+
+        bench_heatmap_run(thread_scan, &ctx, (const unsigned char *) input,
+                          len, repeat);
+
+        latency_teardown(&ctx.match_data, &ctx.stack);
+        pcre2_match_context_free(ctx.match_ctx);
+    }
+}
+
+
+/*
+ * The grep mode (see --grep): every engine times a scan for all the
+ * matches of the input, then a scan writing their lines out too.
+ */
+static void
+run_grep(pcre2_code *re, unsigned engine_types, const char *input,
+    size_t len, int repeat)
+{
+    int                  matches = 0;
+    double               begin, end, match_only;
+    unsigned             engine;
+    bench_stats_t        st;
+    static thread_ctx_t  ctx;
+    static bench_grep_t  g;
+
+    if ((engine_types & ENGINE_JIT)
+        && pcre2_jit_compile(re, PCRE2_JIT_COMPLETE))
+    {
+        fprintf(stderr, "PCRE2 JIT compilation failed\n");
+        exit(1);
+    }
+
+    bench_grep_init(&g, (const unsigned char *) input, len);
+
+    ctx.re = re;
+
+    for (engine = ENGINE_DEFAULT; engine <= ENGINE_DFA; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        ctx.engine = engine;
+        ctx.stack = NULL;
+
+        ctx.match_ctx = pcre2_match_context_create(NULL);
+        if (ctx.match_ctx == NULL) {
+            fprintf(stderr, "PCRE2 cannot allocate match context\n");
+            exit(BENCH_EXIT_NOMEM);
+        }
+
+        set_limits(ctx.match_ctx);
+
+        latency_setup(re, engine, ctx.match_ctx, &ctx.match_data, &ctx.stack);
+
+        printf("PCRE2 %s (grep) ", engine == ENGINE_DEFAULT ? "interp"
+               : engine == ENGINE_JIT ? "JIT" : "DFA");
+        print_limits();
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            TIMER_START
+
+            grep_scan(&ctx, input, len, NULL);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        match_only = bench_stats_median(&st);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            bench_grep_reset(&g);
+
+            TIMER_START
+
+            matches = grep_scan(&ctx, input, len, &g);
+            bench_grep_flush(&g);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+               "times).\n", matches ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_grep_print(&g, match_only, bench_stats_median(&st));
+        bench_stats_print(&st);
+
+        latency_teardown(&ctx.match_data, &ctx.stack);
+        pcre2_match_context_free(ctx.match_ctx);
+    }
+
+    bench_grep_free(&g);
+}
+
+
+/* finds every match of the input, and queues its line to g unless it is
+ * NULL; an empty match moves on by one byte */
+static int
+grep_scan(thread_ctx_t *ctx, const char *input, size_t len,
+    bench_grep_t *g)
+{
+    int          rc, matches = 0;
+    size_t       off = 0;
+    PCRE2_SIZE  *ovector;
+
+    ovector = pcre2_get_ovector_pointer(ctx->match_data);
+
+    while (off <= len) {
+        if (ctx->engine == ENGINE_DEFAULT) {
+            rc = pcre2_match(ctx->re, (PCRE2_SPTR8) input, len, off,
+                             PCRE2_NO_JIT, ctx->match_data, ctx->match_ctx);
+
+        } else if (ctx->engine == ENGINE_JIT) {
+            rc = pcre2_jit_match(ctx->re, (PCRE2_SPTR8) input, len, off, 0,
+                                 ctx->match_data, ctx->match_ctx);
+
+        } else {
+            rc = pcre2_dfa_match(ctx->re, (PCRE2_SPTR8) input, len, off, 0,
+                                 ctx->match_data, ctx->match_ctx,
+                                 ctx->work_space, 4096);
+        }
+
+        if (rc == PCRE2_ERROR_NOMATCH) {
+            break;
+        }
+
+        /* 0: a DFA match with more than one length */
+        if (rc < 0) {
+            print_error(rc);
+            printf("\n");
+            exit(2);
+        }
+
+        matches++;
+
+        if (g) {
+            bench_grep_match(g, ovector[0], ovector[1]);
+        }
+
+        off = ovector[1] > ovector[0] ? ovector[1] : ovector[1] + 1;
+    }
+
+    return matches;
+}
+
+
+/* tags the engine name so that runs under different limits can be told
+ * apart */
+static void
+print_limits(void)
+{
+    const char  *sep = "";
+
+    if (match_limit == 0 && depth_limit == 0 && heap_limit == 0) {
+        return;
+    }
+
+    printf("(");
+
+    if (match_limit) {
+        printf("steps %u", (unsigned) match_limit);
+        sep = ", ";
+    }
+
+    if (depth_limit) {
+        printf("%sdepth %u", sep, (unsigned) depth_limit);
+        sep = ", ";
+    }
+
+    if (heap_limit) {
+        printf("%sheap %uK", sep, (unsigned) heap_limit);
+    }
+
+    printf(") ");
+}
+
+
+static void
+set_limits(pcre2_match_context *match_ctx)
+{
+    if (match_limit) {
+        pcre2_set_match_limit(match_ctx, match_limit);
+    }
+
+    if (depth_limit) {
+        pcre2_set_depth_limit(match_ctx, depth_limit);
+    }
+
+    if (heap_limit) {
+        pcre2_set_heap_limit(match_ctx, heap_limit);
+    }
+}
+
+
+static void
+print_error(int rc)
+{
+    PCRE2_UCHAR  buf[128];
+
+    if (pcre2_get_error_message(rc, buf, sizeof(buf)) < 0) {
+        printf("error: %d", rc);
+        return;
+    }
+
+    printf("error: %d (%s)", rc, (char *) buf);
+}
+
+
 static void
 usage(int rc)
 {
@@ -459,7 +2154,14 @@ usage(int rc)
             "   --dfa               use the PCRE2 DFA engine\n"
             "   --jit               use the PCRE2 JIT engine\n"
             "   -g                  enable the global search mode\n"
-            "   --repeat=N          repeat the test for N times; pick the best\n"
-            "                       result. default to 5.\n");
+            "   --repeat=N          repeat the test at least N times; report\n"
+            "                       the median. default to 5.\n"
+            BENCH_USAGE
+            "   --match-limit=N     fail a match after N backtracking steps.\n"
+            "                       default to the library setting.\n"
+            "   --depth-limit=N     limit the backtracking depth to N.\n"
+            "                       default to the library setting.\n"
+            "   --heap-limit=N      limit the backtracking heap to N KiB.\n"
+            "                       default to the library setting.\n");
     exit(rc);
 }
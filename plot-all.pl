@@ -5,6 +5,7 @@ use strict;
 use warnings;
 
 sub shell ($);
+sub try_shell ($);
 
 my $infile = "Makefile";
 open my $in, $infile
@@ -47,6 +48,17 @@ close $in;
 
 mkdir "images" unless -d "images";
 
+# every engine runs in a child with CPU, wall-clock and memory limits
+# (see runcase.c); the bench scripts pick it up from $E
+my $cpu_limit = $ENV{SREGEX_BENCH_CPU_LIMIT} // 60;
+my $wall_limit = $ENV{SREGEX_BENCH_WALL_LIMIT} // 120;
+my $mem_limit = $ENV{SREGEX_BENCH_MEM_LIMIT} // 4096;
+if (-x "./runcase") {
+    $ENV{E} = "./runcase --cpu=$cpu_limit --wall=$wall_limit --mem=$mem_limit";
+} else {
+    warn "./runcase not found; running cases without limits.\n";
+}
+
 my $num_width = length scalar @cmds;
 my @images;
 my @results;
@@ -62,10 +74,13 @@ for my $cmd (@cmds) {
     my $txtfile = "a.txt";
     (my $tag = $cmd) =~ s/\s+(?:gcc|clang)\s*$//g;
     shell(qq{echo $tag > $txtfile});
-    shell("$cmd > /dev/null") for 1..1;  # just to warm up a bit
-    shell("$cmd >> $txtfile");
-    shell("./gen-plot.pl -o $pngfile $txtfile");
-    push @images, $pngfile;
+    try_shell("$cmd > /dev/null") for 1..1;  # just to warm up a bit
+    try_shell("$cmd >> $txtfile");
+    if (try_shell("./gen-plot.pl -o $pngfile $txtfile")) {
+        push @images, $pngfile;
+    } else {
+        push @images, undef;
+    }
     {
         open my $in, $txtfile or die "Cannot open $txtfile for reading: $!\n";
         my $txt = do { local $/; <$in> };
@@ -232,10 +247,14 @@ _EOC_
 $res
 </pre>
 </p>
+_EOC_
+        if (defined $img) {
+            print $out <<_EOC_;
 <p>
 <img src="$img">
 </p>
 _EOC_
+        }
     }
 }
 
@@ -252,3 +271,15 @@ sub shell ($) {
     say $cmd;
     system($cmd) == 0 or die $!;
 }
+
+# like shell() but only warns on failure so that one broken case does not
+# abort the whole run; returns true on success
+sub try_shell ($) {
+    my $cmd = shift;
+    say $cmd;
+    if (system($cmd) != 0) {
+        warn "command failed (status ", $? >> 8, "): $cmd\n";
+        return 0;
+    }
+    return 1;
+}
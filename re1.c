@@ -6,6 +6,7 @@
  */
 
 
+#define _GNU_SOURCE
 #include <regexp.h>
 #include <assert.h>
 #include <string.h>
@@ -13,16 +14,71 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <time.h>
+#include <stddef.h>
 #include "getcputime.h"
+#include "bench.h"
+
+
+/*
+ * A lazily built DFA over re1's Prog: states are the sets of Char, Any
+ * and Match instructions reachable after each byte, created on demand
+ * and kept in a cache of at most max_states states.
+ */
+
+typedef struct dfa_state_s  dfa_state_t;
+
+struct dfa_state_s {
+    dfa_state_t         *next[256];     /* NULL: not computed yet */
+    dfa_state_t         *hnext;
+    unsigned             hash;
+    int                  cached;
+    int                  match;
+    int                  ninsts;
+    int                  insts[1];      /* sorted instruction indexes */
+};
+
+
+typedef struct {
+    Prog                *prog;
+    int                  policy;
+    unsigned             max_states;
+    unsigned             nstates;
+    size_t               state_size;
+    char                *arena;
+    dfa_state_t        **buckets;
+    unsigned             nbuckets;
+    dfa_state_t         *start;
+    dfa_state_t         *scratch[2];    /* uncached states, see DFA_NOCACHE */
+    unsigned             last_scratch;
+    int                 *stack;
+    int                 *work;
+    unsigned            *mark;
+    unsigned             gen;
+    unsigned long        bytes;
+    unsigned long        misses;
+    unsigned long        flushes;
+} dfa_t;
 
 
 static void usage(int rc);
-static void run_engines(Prog *prog, unsigned engine_types, char *input);
+static void run_engines(Prog *prog, unsigned engine_types, char *input,
+    size_t len, int global, int repeat, dfa_t *dfa);
+static dfa_t *dfa_create(Prog *prog, unsigned max_states, int policy);
+static void dfa_destroy(dfa_t *dfa);
+static long dfa_exec(dfa_t *dfa, const unsigned char *p, size_t len);
 
 
 enum {
     ENGINE_THOMPSON     = (1 << 0),
-    ENGINE_PIKE         = (1 << 1)
+    ENGINE_PIKE         = (1 << 1),
+    ENGINE_DFA          = (1 << 2)
+};
+
+
+/* what to do when the DFA state cache is full */
+enum {
+    DFA_RESET           = 0,    /* drop every state and start over (RE2) */
+    DFA_NOCACHE         = 1     /* keep the cache, stop adding to it */
 };
 
 
@@ -46,10 +102,13 @@ enum {
 int
 main(int argc, char **argv)
 {
+    int                  global = 0, repeat = 5;
+    int                  dfa_policy = DFA_RESET;
     unsigned             engine_types = 0;
-    unsigned             i;
+    unsigned             i, dfa_states = 4096;
     Regexp              *re;
     Prog                *prog;
+    dfa_t               *dfa = NULL;
     char                *input;
     FILE                *f;
     size_t               len;
@@ -72,6 +131,47 @@ main(int argc, char **argv)
         {
             engine_types |= ENGINE_PIKE;
 
+        } else if (strncmp(argv[i], "--dfa-states=",
+                           sizeof("--dfa-states=") - 1) == 0)
+        {
+            dfa_states = atoi(argv[i] + sizeof("--dfa-states=") - 1);
+            if (dfa_states < 2) {
+                dfa_states = 4096;
+            }
+
+        } else if (strncmp(argv[i], "--dfa-flush=",
+                           sizeof("--dfa-flush=") - 1) == 0)
+        {
+            if (strcmp(argv[i] + sizeof("--dfa-flush=") - 1, "reset") == 0) {
+                dfa_policy = DFA_RESET;
+
+            } else if (strcmp(argv[i] + sizeof("--dfa-flush=") - 1,
+                              "nocache") == 0)
+            {
+                dfa_policy = DFA_NOCACHE;
+
+            } else {
+                fprintf(stderr, "unknown DFA flush policy: %s\n", argv[i]);
+                exit(1);
+            }
+
+        } else if (strncmp(argv[i], "--dfa", sizeof("--dfa") - 1) == 0) {
+            engine_types |= ENGINE_DFA;
+
+        } else if (strncmp(argv[i], "--repeat=", sizeof("--repeat=") - 1)
+                   == 0)
+        {
+            repeat = atoi(argv[i] + sizeof("--repeat=") - 1);
+            if (repeat <= 0) {
+                repeat = 5;
+            }
+
+        } else if (strncmp(argv[i], "-g", 2) == 0) {
+            global = 1;
+
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
         } else {
             fprintf(stderr, "unknown option: %s\n", argv[i]);
             exit(1);
@@ -87,6 +187,9 @@ main(int argc, char **argv)
         usage(1);
     }
 
+    /* none of the modes */
+    bench_setup(0);
+
     re = parse(argv[i++]);
     if (re == NULL) {
         fprintf(stderr, "failed to parse the regex.\n");
@@ -118,7 +221,7 @@ main(int argc, char **argv)
         return 1;
     }
 
-    len = (size_t) rc;
+    len = bench_input_size((size_t) rc);
 
     if (fseek(f, 0L, SEEK_SET) != 0) {
         perror("seek to file beginning");
@@ -128,7 +231,7 @@ main(int argc, char **argv)
     input = malloc(len + 1);
     if (input == NULL) {
         fprintf(stderr, "failed to allocate %ld bytes.\n", len);
-        return 1;
+        return BENCH_EXIT_NOMEM;
     }
 
     if (fread(input, 1, len, f) < len) {
@@ -148,8 +251,23 @@ main(int argc, char **argv)
         return 1;
     }
 
-    run_engines(prog, engine_types, input);
+    bench_cache_add(input, len);
+
+    if (engine_types & ENGINE_DFA) {
+        dfa = dfa_create(prog, dfa_states, dfa_policy);
+        if (dfa == NULL) {
+            fprintf(stderr, "failed to allocate memory\n");
+            return BENCH_EXIT_NOMEM;
+        }
+    }
+
+    run_engines(prog, engine_types, input, len, global, repeat, dfa);
 
+    if (dfa) {
+        dfa_destroy(dfa);
+    }
+
+    free(input);
     free(re);
     free(prog);
     return 0;
@@ -157,10 +275,11 @@ main(int argc, char **argv)
 
 
 static void
-run_engines(Prog *prog, unsigned engine_types, char *input)
+run_engines(Prog *prog, unsigned engine_types, char *input, size_t len,
+    int global, int repeat, dfa_t *dfa)
 {
-    unsigned             i;
-    int                  rc;
+    int                  i;
+    int                  rc, matches = 0;
     char                *ovector[MAXSUB];
     size_t               ovecsize;
     double               begin, end;
@@ -170,6 +289,7 @@ run_engines(Prog *prog, unsigned engine_types, char *input)
     if (engine_types & ENGINE_THOMPSON) {
 
         printf("re1 Thompson ");
+        fflush(stdout);
 
         memset(ovector, 0, sizeof(ovector));
 
@@ -191,6 +311,7 @@ run_engines(Prog *prog, unsigned engine_types, char *input)
 
     if (engine_types & ENGINE_PIKE) {
         printf("re1 Pike ");
+        fflush(stdout);
 
         memset(ovector, 0, sizeof(ovector));
 
@@ -233,6 +354,302 @@ run_engines(Prog *prog, unsigned engine_types, char *input)
 
         printf(": %.02lf ms elapsed.\n", elapsed);
     }
+
+    if (engine_types & ENGINE_DFA) {
+        long                 mrc = -1;
+        size_t               rest;
+        bench_stats_t        st;
+        const unsigned char *p = NULL;
+
+        printf("re1 lazy DFA ");
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            matches = 0;
+            p = (const unsigned char *) input;
+            rest = len;
+
+            TIMER_START
+
+            do {
+                mrc = dfa_exec(dfa, p, rest);
+
+                if (mrc >= 0) {
+                    matches++;
+                    p += mrc;
+                    rest -= mrc;
+                }
+
+            } while (global && mrc > 0);
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        if (mrc < 0) {
+            printf("no match");
+
+        } else {
+            /* the DFA only knows where the earliest match ends */
+            printf("match (end %ld)", (long) (p - (unsigned char *) input));
+        }
+
+        printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
+
+        printf("re1 lazy DFA cache: %lu hits, %lu misses, %lu flushes, "
+               "%u states (limit %u, %s policy, %d repeated times).\n",
+               dfa->bytes - dfa->misses, dfa->misses, dfa->flushes,
+               dfa->nstates, dfa->max_states,
+               dfa->policy == DFA_RESET ? "reset" : "nocache", st.n);
+    }
+}
+
+
+static dfa_t *
+dfa_create(Prog *prog, unsigned max_states, int policy)
+{
+    unsigned   i;
+    dfa_t     *dfa;
+
+    dfa = calloc(1, sizeof(dfa_t));
+    if (dfa == NULL) {
+        return NULL;
+    }
+
+    dfa->prog = prog;
+    dfa->policy = policy;
+    dfa->max_states = max_states;
+
+    dfa->state_size = offsetof(dfa_state_t, insts)
+                      + prog->len * sizeof(int);
+    dfa->state_size = (dfa->state_size + sizeof(void *) - 1)
+                      & ~(sizeof(void *) - 1);
+
+    for (dfa->nbuckets = 16; dfa->nbuckets < max_states * 2;
+         dfa->nbuckets <<= 1)
+    {
+        /* void */
+    }
+
+    dfa->arena = malloc((max_states + 2) * dfa->state_size);
+    dfa->buckets = calloc(dfa->nbuckets, sizeof(dfa_state_t *));
+    dfa->stack = malloc(prog->len * sizeof(int));
+    dfa->work = malloc(prog->len * sizeof(int));
+    dfa->mark = calloc(prog->len, sizeof(unsigned));
+
+    if (dfa->arena == NULL || dfa->buckets == NULL || dfa->stack == NULL
+        || dfa->work == NULL || dfa->mark == NULL)
+    {
+        dfa_destroy(dfa);
+        return NULL;
+    }
+
+    for (i = 0; i < 2; i++) {
+        dfa->scratch[i] = (dfa_state_t *)
+                          (dfa->arena + (max_states + i) * dfa->state_size);
+    }
+
+    return dfa;
+}
+
+
+static void
+dfa_destroy(dfa_t *dfa)
+{
+    free(dfa->arena);
+    free(dfa->buckets);
+    free(dfa->stack);
+    free(dfa->work);
+    free(dfa->mark);
+    free(dfa);
+}
+
+
+/* adds the closure of pc to dfa->work; returns the new work size */
+static int
+dfa_add(dfa_t *dfa, int pc, int n)
+{
+    int    sp = 0;
+    Inst  *inst, *start = dfa->prog->start;
+
+    dfa->stack[sp++] = pc;
+
+    while (sp) {
+        pc = dfa->stack[--sp];
+
+        if (dfa->mark[pc] == dfa->gen) {
+            continue;
+        }
+
+        dfa->mark[pc] = dfa->gen;
+        inst = &start[pc];
+
+        switch (inst->opcode) {
+        case Jmp:
+            dfa->stack[sp++] = inst->x - start;
+            break;
+
+        case Split:
+            dfa->stack[sp++] = inst->y - start;
+            dfa->stack[sp++] = inst->x - start;
+            break;
+
+        case Save:
+            dfa->stack[sp++] = pc + 1;
+            break;
+
+        default: /* Char, Any, Match */
+            dfa->work[n++] = pc;
+            break;
+        }
+    }
+
+    return n;
+}
+
+
+static int
+dfa_cmp_int(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+
+/* turns dfa->work into a state, reusing a cached one when possible */
+static dfa_state_t *
+dfa_intern(dfa_t *dfa, int n)
+{
+    int           i, match = 0;
+    unsigned      h = 2166136261u;
+    dfa_state_t  *s;
+
+    qsort(dfa->work, n, sizeof(int), dfa_cmp_int);
+
+    for (i = 0; i < n; i++) {
+        h = (h ^ (unsigned) dfa->work[i]) * 16777619u;
+
+        if (dfa->prog->start[dfa->work[i]].opcode == Match) {
+            match = 1;
+        }
+    }
+
+    for (s = dfa->buckets[h & (dfa->nbuckets - 1)]; s; s = s->hnext) {
+        if (s->hash == h && s->ninsts == n
+            && memcmp(s->insts, dfa->work, n * sizeof(int)) == 0)
+        {
+            return s;
+        }
+    }
+
+    if (dfa->nstates == dfa->max_states) {
+        if (dfa->policy == DFA_NOCACHE) {
+            dfa->last_scratch ^= 1;
+            s = dfa->scratch[dfa->last_scratch];
+            s->cached = 0;
+            goto fill;
+        }
+
+        /* DFA_RESET */
+        memset(dfa->buckets, 0, dfa->nbuckets * sizeof(dfa_state_t *));
+        dfa->nstates = 0;
+        dfa->start = NULL;
+        dfa->flushes++;
+    }
+
+    s = (dfa_state_t *) (dfa->arena + dfa->nstates++ * dfa->state_size);
+    s->cached = 1;
+    s->hnext = dfa->buckets[h & (dfa->nbuckets - 1)];
+    dfa->buckets[h & (dfa->nbuckets - 1)] = s;
+
+fill:
+
+    memset(s->next, 0, sizeof(s->next));
+    s->hash = h;
+    s->match = match;
+    s->ninsts = n;
+    memcpy(s->insts, dfa->work, n * sizeof(int));
+
+    return s;
+}
+
+
+static dfa_state_t *
+dfa_step(dfa_t *dfa, dfa_state_t *s, int c)
+{
+    int            i, n = 0;
+    unsigned long  flushes = dfa->flushes;
+    Inst          *inst;
+    dfa_state_t   *ns;
+
+    dfa->misses++;
+    dfa->gen++;
+
+    for (i = 0; i < s->ninsts; i++) {
+        inst = &dfa->prog->start[s->insts[i]];
+
+        if (inst->opcode == Any
+            || (inst->opcode == Char && inst->c == c))
+        {
+            n = dfa_add(dfa, s->insts[i] + 1, n);
+        }
+    }
+
+    ns = dfa_intern(dfa, n);
+
+    /* a flush recycles s, so the edge must not be recorded then */
+    if (s->cached && ns->cached && dfa->flushes == flushes) {
+        s->next[c] = ns;
+    }
+
+    return ns;
+}
+
+
+/* returns the offset just past the earliest-ending match, or -1 */
+static long
+dfa_exec(dfa_t *dfa, const unsigned char *p, size_t len)
+{
+    size_t        i;
+    dfa_state_t  *s, *ns;
+
+    s = dfa->start;
+
+    if (s == NULL) {
+        dfa->gen++;
+        s = dfa_intern(dfa, dfa_add(dfa, 0, 0));
+
+        if (s->cached) {
+            dfa->start = s;
+        }
+    }
+
+    if (s->match) {
+        return 0;
+    }
+
+    for (i = 0; i < len; i++) {
+        ns = s->next[p[i]];
+
+        if (ns == NULL) {
+            ns = dfa_step(dfa, s, p[i]);
+        }
+
+        s = ns;
+
+        if (s->match) {
+            dfa->bytes += i + 1;
+            return (long) i + 1;
+        }
+    }
+
+    dfa->bytes += len;
+
+    return -1;
 }
 
 
@@ -242,6 +659,17 @@ usage(int rc)
     fprintf(stderr, "usage: re1 [options] <regexp> <file>\n"
             "options:\n"
             "   --pike              use the Pike VM interpreter\n"
-            "   --thompson          use the Thompson VM interpreter\n");
+            "   --thompson          use the Thompson VM interpreter\n"
+            "   --dfa               use the lazy DFA\n"
+            "   --dfa-states=N      cache at most N DFA states. default to\n"
+            "                       4096.\n"
+            "   --dfa-flush=POLICY  what to do when the DFA cache is full:\n"
+            "                       reset (drop all states, the default) or\n"
+            "                       nocache (stop caching new states).\n"
+            "   -g                  enable the global search mode (lazy DFA\n"
+            "                       only)\n"
+            "   --repeat=N          repeat the lazy DFA test at least N times;\n"
+            "                       report the median. default to 5.\n"
+            BENCH_USAGE);
     exit(rc);
 }
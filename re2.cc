@@ -6,6 +6,7 @@
  */
 
 
+#define BENCH_COUNT_ALLOCS
 #include <re2/re2.h>
 #include <re2/stringpiece.h>
 #include <cassert>
@@ -14,12 +15,39 @@
 #include <cerrno>
 #include <ctime>
 #include <cstdlib>
+#include <string>
 #include "getcputime.h"
+#include "bench.h"
 
 
 static void usage(int rc);
 static void run_engine(RE2 *re, char *input, size_t len, int global,
     int repeat);
+static void run_latency(RE2 *re, char *input, size_t len);
+static void run_threads(RE2 *re, char *input, size_t len, int global,
+    int repeat);
+static int thread_scan(void *data, const unsigned char *p, size_t len);
+static void run_tree(RE2 *re, const char *path, int global, int repeat);
+static void run_replace(RE2 *re, char *input, size_t len, int repeat);
+static void run_fields(const char *re_str, char *input, size_t len,
+    int repeat);
+static void run_batch(RE2 *re, char *input, size_t len, int repeat);
+static void run_heatmap(RE2 *re, char *input, size_t len, int global,
+    int repeat);
+static void run_grep(RE2 *re, char *input, size_t len, int repeat);
+static int grep_scan(RE2 *re, char *input, size_t len, bench_grep_t *g);
+static int tree_scan(void *data, const unsigned char *p, size_t len);
+
+
+/* the per-thread state of the threads mode */
+typedef struct {
+    RE2                 *re;
+    int                  global;
+} thread_ctx_t;
+
+
+/* 0 keeps the RE2 default */
+static long long         max_mem = 0;
 
 
 int
@@ -32,6 +60,7 @@ main(int argc, char **argv)
     FILE                *f;
     size_t               len;
     long                 rc;
+    RE2::Options         opts;
 
     if (argc < 3) {
         usage(1);
@@ -56,6 +85,15 @@ main(int argc, char **argv)
             continue;
         }
 
+        if (strncmp(argv[i], "--max-mem=", sizeof("--max-mem=") - 1) == 0) {
+            max_mem = strtoll(argv[i] + sizeof("--max-mem=") - 1, NULL, 10);
+            continue;
+        }
+
+        if (bench_parse_option(argv[i])) {
+            continue;
+        }
+
         fprintf(stderr, "unknown option: %s\n", argv[i]);
         exit(1);
     }
@@ -64,6 +102,10 @@ main(int argc, char **argv)
         usage(1);
     }
 
+    bench_setup(BENCH_MODE_LATENCY | BENCH_MODE_THREADS | BENCH_MODE_TREE
+                | BENCH_MODE_REPLACE | BENCH_MODE_FIELDS | BENCH_MODE_BATCH
+                | BENCH_MODE_HEATMAP | BENCH_MODE_GREP);
+
     re_str = argv[i++];
     len = strlen(re_str);
 
@@ -84,7 +126,13 @@ main(int argc, char **argv)
 
     //fprintf(stderr, "regex: %s\n", p);
 
-    re = new RE2(p);
+    opts.set_log_errors(false);
+
+    if (max_mem) {
+        opts.set_max_mem(max_mem);
+    }
+
+    re = new RE2(p, opts);
     if (re == NULL) {
         return 2;
     }
@@ -92,10 +140,17 @@ main(int argc, char **argv)
     free(p);
 
     if (!re->ok()) {
+        fprintf(stderr, "[error] %s\n", re->error().c_str());
         delete re;
         return 2;
     }
 
+    if (bench_conf.tree) {
+        run_tree(re, argv[i], global, repeat);
+        delete re;
+        return 0;
+    }
+
     errno = 0;
 
     f = fopen(argv[i], "rb");
@@ -115,7 +170,7 @@ main(int argc, char **argv)
         return 1;
     }
 
-    len = (size_t) rc;
+    len = bench_input_size((size_t) rc);
 
     //fprintf(stderr, "len = %d\n", (int) len);
 
@@ -127,7 +182,7 @@ main(int argc, char **argv)
     input = (char *) malloc(len + 1);
     if (input == NULL) {
         fprintf(stderr, "failed to allocate %ld bytes.\n", len);
-        return 1;
+        return BENCH_EXIT_NOMEM;
     }
 
     if (fread(input, 1, len, f) < len) {
@@ -147,7 +202,32 @@ main(int argc, char **argv)
         return 1;
     }
 
-    run_engine(re, input, len, global, repeat);
+    bench_cache_add(input, len);
+
+    if (bench_conf.batch) {
+        run_batch(re, input, len, repeat);
+
+    } else if (bench_conf.fields) {
+        run_fields(re_str, input, len, repeat);
+
+    } else if (bench_conf.slice) {
+        run_heatmap(re, input, len, global, repeat);
+
+    } else if (bench_conf.grep) {
+        run_grep(re, input, len, repeat);
+
+    } else if (bench_conf.replace) {
+        run_replace(re, input, len, repeat);
+
+    } else if (bench_conf.plant) {
+        run_latency(re, input, len);
+
+    } else if (bench_conf.threads) {
+        run_threads(re, input, len, global, repeat);
+
+    } else {
+        run_engine(re, input, len, global, repeat);
+    }
 
     delete re;
     free(input);
@@ -158,17 +238,26 @@ main(int argc, char **argv)
 static void
 run_engine(RE2 *re, char *input, size_t len, int global, int repeat)
 {
-    int                  i, matches = 0;
+    int                  matches = 0;
     bool                 rc = 0;
     size_t               rest;
     re2::StringPiece     cap;
     re2::StringPiece     subj;
-    double               begin, end, best = -1;
+    double               begin, end;
+    bench_stats_t        st;
     const char          *p;
 
     printf("RE2 PartialMatch ");
 
-    for (i = 0; i < repeat; i++) {
+    if (max_mem) {
+        printf("(max mem %lld) ", max_mem);
+    }
+
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
         double elapsed;
 
         matches = 0;
@@ -205,9 +294,7 @@ run_engine(RE2 *re, char *input, size_t len, int global, int repeat)
 
         elapsed = end - begin;
 
-        if (i == 0 || elapsed < best) {
-            best = elapsed;
-        }
+        bench_stats_add(&st, elapsed);
     }
 
     if (rc) {
@@ -220,7 +307,563 @@ run_engine(RE2 *re, char *input, size_t len, int global, int repeat)
     }
 
     printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-           best * 1e3, matches, repeat);
+           bench_stats_median(&st) * 1e3, matches, st.n);
+    bench_stats_print(&st);
+}
+
+
+/*
+ * The time to the first match of short subjects (see --latency). RE2
+ * builds its DFA lazily inside the RE2 object, so --setup=include
+ * compiles a fresh one for every call and pays for a cold DFA cache.
+ */
+static void
+run_latency(RE2 *re, char *input, size_t len)
+{
+    int                  k, noffsets, call, missed, early;
+    bool                 rc;
+    size_t               offsets[BENCH_MAX_OFFSETS], max_offset = 0;
+    size_t               start = 0;
+    double               begin, elapsed;
+    bench_stats_t        st;
+    bench_subjects_t     subjects;
+    re2::StringPiece     cap;
+    re2::StringPiece     subj;
+    RE2                 *r;
+    const char          *s;
+
+    noffsets = bench_latency_offsets(offsets);
+
+    for (k = 0; k < noffsets; k++) {
+        if (offsets[k] != BENCH_NO_OFFSET && offsets[k] > max_offset) {
+            max_offset = offsets[k];
+        }
+    }
+
+    for (k = 0; k < noffsets; k++) {
+        bench_subjects_init(&subjects, (const unsigned char *) input, len,
+                            offsets[k], max_offset);
+
+        printf("RE2 PartialMatch ");
+
+        if (max_mem) {
+            printf("(max mem %lld) ", max_mem);
+        }
+
+        fflush(stdout);
+
+        bench_stats_init(&st, bench_conf.calls);
+        missed = 0;
+        early = 0;
+
+        for (call = 0; bench_latency_next(&st); call++) {
+            s = (const char *) bench_subject(&subjects, call);
+            subj.set(s, subjects.len);
+            r = re;
+
+            begin = get_wall_time();
+
+            if (bench_conf.setup) {
+                r = new RE2(re->pattern(), re->options());
+            }
+
+            rc = RE2::PartialMatch(subj, *r, &cap);
+
+            if (rc) {
+                start = cap.data() - s;
+            }
+
+            if (bench_conf.setup) {
+                delete r;
+            }
+
+            elapsed = get_wall_time() - begin;
+
+            if (st.warmup == 0) {
+                if (!rc) {
+                    missed++;
+
+                } else if (start < subjects.offset) {
+                    early++;
+                }
+            }
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        bench_latency_print(&st, &subjects, missed, early);
+        bench_subjects_free(&subjects);
+    }
+}
+
+
+/*
+ * Scans a copy of the input in each of 1, 2, 4 ... --threads threads
+ * (see bench_pool_run()), with either the one RE2 object shared by all
+ * the threads or an RE2 object per thread. A shared object serializes
+ * the threads on the lock around its lazily built DFA cache; RE2 has no
+ * API for the size of the cache, so only the rss growth is reported.
+ */
+static void
+run_threads(RE2 *re, char *input, size_t len, int global, int repeat)
+{
+    int                  t, n, objects;
+    size_t               rss;
+    thread_ctx_t        *ctxs, *ctx;
+    static bench_pool_t  pool;
+
+    static const char   *names[] = { NULL, "shared", "copy" };
+
+    ctxs = (thread_ctx_t *) malloc(bench_conf.threads
+                                   * sizeof(thread_ctx_t));
+    if (ctxs == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    bench_pool_init(&pool, thread_scan, (const unsigned char *) input, len,
+                    bench_conf.threads);
+
+    for (objects = BENCH_OBJECTS_SHARED; objects <= BENCH_OBJECTS_COPY;
+         objects++)
+    {
+        if (bench_conf.objects != BENCH_OBJECTS_BOTH
+            && bench_conf.objects != objects)
+        {
+            continue;
+        }
+
+        rss = bench_rss();
+
+        for (t = 0; t < pool.max; t++) {
+            ctx = &ctxs[t];
+            ctx->global = global;
+            ctx->re = re;
+
+            if (objects == BENCH_OBJECTS_COPY) {
+                ctx->re = new RE2(re->pattern(), re->options());
+            }
+
+            pool.workers[t].ctx = ctx;
+        }
+
+        for (n = 1; n; n = bench_pool_next_threads(n)) {
+            printf("RE2 PartialMatch ");
+
+            if (max_mem) {
+                printf("(max mem %lld) ", max_mem);
+            }
+
+            printf("(%s, %d thread%s) ", names[objects], n,
+                   n == 1 ? "" : "s");
+            fflush(stdout);
+
+            bench_pool_run(&pool, n, repeat);
+        }
+
+        bench_pool_print_memory(names[objects], pool.max, 0, rss);
+
+        for (t = 0; t < pool.max; t++) {
+            if (ctxs[t].re != re) {
+                delete ctxs[t].re;
+            }
+        }
+    }
+
+    bench_pool_free(&pool);
+    free(ctxs);
+}
+
+
+static int
+thread_scan(void *data, const unsigned char *p, size_t len)
+{
+    int                  matches = 0;
+    bool                 rc;
+    thread_ctx_t        *ctx = (thread_ctx_t *) data;
+    re2::StringPiece     cap;
+    re2::StringPiece     subj((const char *) p, len);
+
+    do {
+        rc = RE2::PartialMatch(subj, *ctx->re, &cap);
+
+        if (rc) {
+            matches++;
+            subj.set(cap.data() + cap.size(),
+                     subj.size() - (cap.data() + cap.size() - subj.data()));
+        }
+
+    } while (ctx->global && rc);
+
+    return matches;
+}
+
+
+/*
+ * Scans the files under a directory in a pool of workers (see
+ * bench_tree_run()). The DFA cache of an RE2 object is its only state
+ * built while matching, so each worker gets an RE2 object of its own,
+ * or a new one for every job with --setup=include.
+ */
+static void
+run_tree(RE2 *re, const char *path, int global, int repeat)
+{
+    int                  t, n;
+    thread_ctx_t        *ctxs;
+    static bench_tree_t  tree;
+
+    bench_tree_init(&tree, tree_scan, path);
+
+    n = bench_conf.threads > 1 ? bench_conf.threads : 1;
+
+    ctxs = (thread_ctx_t *) malloc(n * sizeof(thread_ctx_t));
+    if (ctxs == NULL) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(BENCH_EXIT_NOMEM);
+    }
+
+    for (t = 0; t < n; t++) {
+        ctxs[t].global = global;
+        ctxs[t].re = bench_conf.setup ? re
+                     : new RE2(re->pattern(), re->options());
+
+        tree.workers[t].ctx = &ctxs[t];
+    }
+
+    for (t = 1; t; t = bench_pool_next_threads(t)) {
+        printf("RE2 PartialMatch ");
+
+        if (max_mem) {
+            printf("(max mem %lld) ", max_mem);
+        }
+
+        printf("(tree, %d worker%s) ", t, t == 1 ? "" : "s");
+        fflush(stdout);
+
+        bench_tree_run(&tree, t, repeat);
+    }
+
+    for (t = 0; t < n; t++) {
+        if (ctxs[t].re != re) {
+            delete ctxs[t].re;
+        }
+    }
+
+    bench_tree_free(&tree);
+    free(ctxs);
+}
+
+
+static int
+tree_scan(void *data, const unsigned char *p, size_t len)
+{
+    int            matches;
+    thread_ctx_t   job;
+    thread_ctx_t  *ctx = (thread_ctx_t *) data;
+
+    if (!bench_conf.setup) {
+        return thread_scan(data, p, len);
+    }
+
+    job.global = ctx->global;
+    job.re = new RE2(ctx->re->pattern(), ctx->re->options());
+
+    matches = thread_scan(&job, p, len);
+
+    delete job.re;
+
+    return matches;
+}
+
+
+/*
+ * Replaces every match with RE2::GlobalReplace(), which builds the result
+ * in a new string. The copy of the input it works on is refilled before
+ * each run, untimed. The template is turned into RE2's rewrite syntax,
+ * which has \0 to \9 only, and the groups are shifted by one for the
+ * group main() wraps the pattern in, so $9 is always empty.
+ */
+static void
+run_replace(RE2 *re, char *input, size_t len, int repeat)
+{
+    int                  n = 0, runs = 0, group, brace;
+    unsigned long        allocs = 0, a;
+    double               begin, end;
+    const char          *p;
+    std::string          subj, rewrite;
+    bench_stats_t        st;
+
+    for (p = bench_conf.replace; *p; p++) {
+        if (*p == '\\') {
+            rewrite += "\\\\";
+
+        } else if (p[0] == '$' && p[1] == '$') {
+            rewrite += '$';
+            p++;
+
+        } else if (p[0] == '$' && (p[1] == '{' || (p[1] >= '0'
+                                                    && p[1] <= '9')))
+        {
+            brace = p[1] == '{';
+            group = (int) strtol(p + 1 + brace, (char **) &p, 10);
+
+            if (!brace || *p != '}') {
+                p--;
+            }
+
+            if (group < 9) {
+                rewrite += '\\';
+                rewrite += (char) ('0' + (group ? group + 1 : 0));
+            }
+
+        } else {
+            rewrite += *p;
+        }
+    }
+
+    printf("RE2 GlobalReplace ");
+
+    if (max_mem) {
+        printf("(max mem %lld) ", max_mem);
+    }
+
+    printf("(replace) ");
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        subj.assign(input, len);
+
+        a = BENCH_ALLOCS();
+
+        begin = get_cpu_time();
+        if (begin == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        n = RE2::GlobalReplace(&subj, *re, rewrite);
+
+        end = get_cpu_time();
+        if (end == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        elapsed = end - begin;
+
+        allocs += BENCH_ALLOCS() - a;
+        runs++;
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           n ? "match" : "no match", bench_stats_median(&st) * 1e3, n,
+           st.n);
+    bench_replace_print(len, subj.size(), bench_stats_median(&st), allocs,
+                        runs);
+    bench_stats_print(&st);
+}
+
+
+/*
+ * The field extraction mode (see --fields): RE2::Match() on every line
+ * with the groups stored as views into the input, for 0, 1, 2 ... of
+ * the capture groups of the regexp left capturing. The regexp is not
+ * wrapped in a group of its own here.
+ */
+static void
+run_fields(const char *re_str, char *input, size_t len, int repeat)
+{
+    int                  k, g, ngroups;
+    char                *src;
+    size_t               line, matches = 0;
+    double               begin, end;
+    RE2                 *r;
+    RE2::Options         opts;
+    std::string          pattern;
+    bench_line_t        *ln;
+    bench_field_t       *fields;
+    bench_stats_t        st;
+    bench_fields_t       fl;
+    re2::StringPiece    *caps;
+
+    src = bench_groups_keep(re_str, 0, 0, &ngroups);
+    free(src);
+
+    bench_fields_init(&fl, (const unsigned char *) input, len, ngroups);
+
+    caps = new re2::StringPiece[ngroups + 1];
+
+    opts.set_log_errors(false);
+
+    if (max_mem) {
+        opts.set_max_mem(max_mem);
+    }
+
+    for (k = 0; k <= ngroups; k++) {
+        src = bench_groups_keep(re_str, k, 0, &g);
+
+        pattern = "(?ms)";
+        pattern += src;
+        free(src);
+
+        r = new RE2(pattern, opts);
+
+        if (!r->ok()) {
+            fprintf(stderr, "[error] %s\n", r->error().c_str());
+            exit(2);
+        }
+
+        printf("RE2 ");
+
+        if (max_mem) {
+            printf("(max mem %lld) ", max_mem);
+        }
+
+        printf("(fields, %d of %d groups) ", k, ngroups);
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            matches = 0;
+
+            begin = get_cpu_time();
+            if (begin == -1) {
+                perror("get_cpu_time");
+                exit(2);
+            }
+
+            for (line = 0; line < fl.nlines; line++) {
+                ln = &fl.lines[line];
+
+                re2::StringPiece subj(input + ln->off, ln->len);
+
+                if (!r->Match(subj, 0, ln->len, RE2::UNANCHORED, caps,
+                              k + 1))
+                {
+                    continue;
+                }
+
+                matches++;
+                fields = bench_fields_line(&fl, line);
+
+                for (g = 0; g <= k; g++) {
+                    fields[g].data = (const unsigned char *) caps[g].data();
+                    fields[g].len = caps[g].size();
+                }
+            }
+
+            end = get_cpu_time();
+            if (end == -1) {
+                perror("get_cpu_time");
+                exit(2);
+            }
+
+            elapsed = end - begin;
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        printf("%s: %.05lf ms elapsed (%lu matches found, %d repeated "
+               "times).\n", matches ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, (unsigned long) matches,
+               st.n);
+        bench_fields_print(&fl, k, matches, bench_stats_median(&st));
+        bench_stats_print(&st);
+
+        delete r;
+    }
+
+    bench_fields_print_cost(&fl);
+
+    delete[] caps;
+    bench_fields_free(&fl);
+}
+
+
+/*
+ * The batch filter mode (see --batch): the file cut into a column of
+ * rows of each of the --rows sizes, and RE2::Match() without submatches
+ * on every row for a bitmap of the rows matching.
+ */
+static void
+run_batch(RE2 *re, char *input, size_t len, int repeat)
+{
+    int                  s, nsizes;
+    size_t               row, n, sizes[BENCH_MAX_ROW_SIZES];
+    double               begin, end;
+    const size_t        *off;
+    bench_stats_t        st;
+    bench_column_t       col;
+
+    nsizes = bench_column_sizes(sizes);
+
+    for (s = 0; s < nsizes; s++) {
+        bench_column_init(&col, input, len, sizes[s]);
+        off = col.offsets;
+
+        printf("RE2 ");
+
+        if (max_mem) {
+            printf("(max mem %lld) ", max_mem);
+        }
+
+        printf("(batch, %lu-byte rows) ", (unsigned long) sizes[s]);
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            bench_column_clear(&col);
+
+            begin = get_cpu_time();
+            if (begin == -1) {
+                perror("get_cpu_time");
+                exit(2);
+            }
+
+            for (row = 0; row < col.nrows; row++) {
+                re2::StringPiece subj(input + off[row],
+                                      off[row + 1] - off[row]);
+
+                if (re->Match(subj, 0, subj.size(), RE2::UNANCHORED, NULL,
+                              0))
+                {
+                    bench_column_select(&col, row);
+                }
+            }
+
+            end = get_cpu_time();
+            if (end == -1) {
+                perror("get_cpu_time");
+                exit(2);
+            }
+
+            elapsed = end - begin;
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        n = bench_column_count(&col);
+
+        printf("%s: %.05lf ms elapsed (%lu matches found, %d repeated "
+               "times).\n", n ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, (unsigned long) n, st.n);
+        bench_column_print(&col, bench_stats_median(&st));
+        bench_stats_print(&st);
+
+        bench_column_free(&col);
+    }
 }
 
 
@@ -229,7 +872,147 @@ usage(int rc)
 {
     fprintf(stderr, "usage: [options] re2 <regexp> <file>\n"
             "   -g                  enable the global search mode\n"
-            "   --repeat=N          repeat the test for N times; pick the best\n"
-            "                       result. default to 5.\n");
+            "   --repeat=N          repeat the test at least N times; report\n"
+            "                       the median. default to 5.\n"
+            BENCH_USAGE
+            "   --max-mem=N         limit the compiled program and the DFA\n"
+            "                       caches to N bytes. default to 8MB.\n");
     exit(rc);
 }
+
+
+/* the heatmap mode (see --heatmap), with the scan of the threads mode */
+static void
+run_heatmap(RE2 *re, char *input, size_t len, int global, int repeat)
+{
+    thread_ctx_t         ctx;
+
+    ctx.re = re;
+    ctx.global = global;
+
+    printf("RE2 PartialMatch (heatmap) ");
+
+    if (max_mem) {
+        printf("(max mem %lld) ", max_mem);
+    }
+
+    fflush(stdout);
+
+    bench_heatmap_run(thread_scan, &ctx, (const unsigned char *) input, len,
+                      repeat);
+}
+
+
+/*
+ * The grep mode (see --grep): a scan for all the matches of the input
+ * timed, then a scan writing their lines out too.
+ */
+static void
+run_grep(RE2 *re, char *input, size_t len, int repeat)
+{
+    int                  matches = 0;
+    double               begin, end, match_only;
+    bench_stats_t        st;
+    static bench_grep_t  g;
+
+    bench_grep_init(&g, (const unsigned char *) input, len);
+
+    printf("RE2 ");
+
+    if (max_mem) {
+        printf("(max mem %lld) ", max_mem);
+    }
+
+    printf("(grep) ");
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        begin = get_cpu_time();
+        if (begin == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        grep_scan(re, input, len, NULL);
+
+        end = get_cpu_time();
+        if (end == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        elapsed = end - begin;
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    match_only = bench_stats_median(&st);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        bench_grep_reset(&g);
+
+        begin = get_cpu_time();
+        if (begin == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        matches = grep_scan(re, input, len, &g);
+        bench_grep_flush(&g);
+
+        end = get_cpu_time();
+        if (end == -1) {
+            perror("get_cpu_time");
+            exit(2);
+        }
+
+        elapsed = end - begin;
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           matches ? "match" : "no match", bench_stats_median(&st) * 1e3,
+           matches, st.n);
+    bench_grep_print(&g, match_only, bench_stats_median(&st));
+    bench_stats_print(&st);
+
+    bench_grep_free(&g);
+}
+
+
+/* finds every match of the input, and queues its line to g unless it is
+ * NULL; an empty match moves on by one byte */
+static int
+grep_scan(RE2 *re, char *input, size_t len, bench_grep_t *g)
+{
+    int                  matches = 0;
+    size_t               off = 0, start, stop;
+    re2::StringPiece     cap;
+    re2::StringPiece     subj(input, len);
+
+    while (off <= len
+           && re->Match(subj, off, len, RE2::UNANCHORED, &cap, 1))
+    {
+        matches++;
+
+        start = cap.data() - input;
+        stop = start + cap.size();
+
+        if (g) {
+            bench_grep_match(g, start, stop);
+        }
+
+        off = stop > start ? stop : stop + 1;
+    }
+
+    return matches;
+}
@@ -0,0 +1,104 @@
+#!/usr/bin/env perl
+
+# Summarizes the output of "make bench-redos": for every regex and engine
+# it prints the time (or the time to fail) on each input size, the
+# throughput on the largest input matched without error, and the
+# growth exponent of the time between the two largest such inputs
+# (about 1 for engines that stay linear).
+
+use strict;
+use warnings;
+
+my $infile = shift
+    or die "No input file specified.\n";
+open my $in, $infile
+    or die "Cannot open $infile for reading: $!\n";
+
+my @cases;
+my ($case, $size);
+while (<$in>) {
+    if (m{^\./bench-redos\s+(.*?)\s+redos-\S+\.txt\b}) {
+        $case = { re => $1, sizes => [], engines => [], runs => {} };
+        push @cases, $case;
+        undef $size;
+
+    } elsif ($case && /^-+ (\S+)$/) {
+        my $file = $1;
+        my @info = stat $file;
+        if (!@info) {
+            die "failed to stat $file.\n";
+        }
+        $size = $info[7];
+        push @{ $case->{sizes} }, $size;
+
+    } elsif (defined $size
+             && /^(\w+ .*?)\s*(match|error|no match|timeout|oom|crash)\b/)
+    {
+        my ($name, $status) = ($1, $2);
+        if (!/((?:\d+)(?:\.\d+)?) ms elapsed/) {
+            next;
+        }
+        my $ms = $1;
+        if (!exists $case->{runs}{$name}) {
+            push @{ $case->{engines} }, $name;
+        }
+        $case->{runs}{$name}{$size} = { ms => $ms,
+                                        failed => $status !~ /match/,
+                                        status => $status };
+    }
+}
+close $in;
+
+if (!@cases) {
+    die "No ./bench-redos command found!\n";
+}
+
+for my $case (@cases) {
+    my @sizes = @{ $case->{sizes} };
+    my $width = 40;
+
+    print "regex $case->{re}\n";
+    printf "  %-${width}s", "engine \\ input bytes";
+    printf " %12s", $_ for @sizes;
+    printf " %10s %7s\n", "MB/s", "growth";
+
+    for my $name (@{ $case->{engines} }) {
+        my $runs = $case->{runs}{$name};
+        my @ok;
+
+        printf "  %-${width}s", $name;
+
+        for my $size (@sizes) {
+            my $run = $runs->{$size};
+            if (!$run) {
+                printf " %12s", "-";
+                next;
+            }
+            if ($run->{failed}) {
+                my $word = $run->{status} eq 'error' ? 'fail' : $run->{status};
+                printf " %12s", sprintf "%s %.2f", $word, $run->{ms};
+                next;
+            }
+            printf " %12.3f", $run->{ms};
+            push @ok, $size;
+        }
+
+        my ($speed, $growth) = ("-", "-");
+        if (@ok) {
+            my $ms = $runs->{$ok[-1]}{ms};
+            if ($ms > 0) {
+                $speed = sprintf "%.1f", $ok[-1] / $ms * 1000 / 1024 / 1024;
+            }
+        }
+        if (@ok >= 2) {
+            my ($s1, $s2) = @ok[-2, -1];
+            my ($t1, $t2) = ($runs->{$s1}{ms}, $runs->{$s2}{ms});
+            if ($t1 > 0 && $t2 > 0) {
+                $growth = sprintf "%.2f", log($t2 / $t1) / log($s2 / $s1);
+            }
+        }
+        printf " %10s %7s\n", $speed, $growth;
+    }
+
+    print "\n";
+}
@@ -0,0 +1,420 @@
+/*
+ * Copyright 2012 Yichun "agentzh" Zhang
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ */
+
+/*
+ * Runs one benchmark driver in a forked child under a CPU time limit
+ * (RLIMIT_CPU), a wall-clock watchdog and an address space cap
+ * (RLIMIT_AS). The child's output is passed through; when the child is
+ * stopped by one of the limits, the engine line it was printing is
+ * completed with a result the plotting scripts understand, e.g.
+ *
+ *   PCRE2 interp timeout: 60000.00000 ms elapsed (cpu limit 60 s).
+ *
+ * The drivers flush the engine name before each run for this purpose.
+ * A driver whose allocation fails exits with BENCH_EXIT_NOMEM; under the
+ * memory cap a SIGSEGV or SIGABRT (e.g. an uncaught std::bad_alloc) is
+ * taken for the same. The bench scripts pick the runner up through the E
+ * variable.
+ */
+
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "getcputime.h"
+
+
+enum {
+    RESULT_OK      = 0,
+    RESULT_TIMEOUT = 124,
+    RESULT_OOM     = 125        /* BENCH_EXIT_NOMEM in bench.h */
+};
+
+
+static pid_t             child_pid;
+
+
+static void usage(int rc);
+static void child_exec(char **argv, int out_fd, int err_fd, long cpu_limit,
+    long mem_limit);
+static void kill_child(int signo);
+static int watchdog(pid_t pid, double begin, long wall_limit, int *killed);
+static int relay(int fd, FILE *dst, char *line, size_t *line_len,
+    size_t line_size);
+
+
+int
+main(int argc, char **argv)
+{
+    int                  i, status, nfds, timeout, wall_killed = 0, oom;
+    int                  out_pipe[2], err_pipe[2];
+    long                 cpu_limit = 0, wall_limit = 0, mem_limit = 0;
+    double               begin, elapsed, cpu;
+    pid_t                pid, rc;
+    struct pollfd        fds[2];
+    struct sigaction     sa;
+    struct rusage        ru;
+    const char          *name;
+    char                 out_line[256], err_line[256];
+    size_t               out_len = 0, err_len = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            break;
+        }
+
+        if (strncmp(argv[i], "--cpu=", sizeof("--cpu=") - 1) == 0) {
+            cpu_limit = atol(argv[i] + sizeof("--cpu=") - 1);
+
+        } else if (strncmp(argv[i], "--wall=", sizeof("--wall=") - 1) == 0) {
+            wall_limit = atol(argv[i] + sizeof("--wall=") - 1);
+
+        } else if (strncmp(argv[i], "--mem=", sizeof("--mem=") - 1) == 0) {
+            mem_limit = atol(argv[i] + sizeof("--mem=") - 1);
+
+        } else {
+            fprintf(stderr, "unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    if (i == argc) {
+        usage(1);
+    }
+
+    argv += i;
+
+    name = strrchr(argv[0], '/');
+    name = name ? name + 1 : argv[0];
+
+    if (pipe(out_pipe) != 0 || pipe(err_pipe) != 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    fflush(stdout);
+
+    /* the child leads its own process group and so misses a ^C at the
+     * terminal: take it down with us */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = kill_child;
+    sigemptyset(&sa.sa_mask);
+
+    if (sigaction(SIGINT, &sa, NULL) != 0
+        || sigaction(SIGTERM, &sa, NULL) != 0
+        || sigaction(SIGHUP, &sa, NULL) != 0)
+    {
+        perror("sigaction");
+        return 1;
+    }
+
+    begin = get_wall_time();
+    if (begin == -1) {
+        perror("get_wall_time");
+        return 2;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return 1;
+    }
+
+    if (pid == 0) {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        child_exec(argv, out_pipe[1], err_pipe[1], cpu_limit, mem_limit);
+    }
+
+    /* also done by the child; whichever comes first wins the race with
+     * kill() below */
+    setpgid(pid, pid);
+    child_pid = pid;
+
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+
+    fds[0].fd = out_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = err_pipe[0];
+    fds[1].events = POLLIN;
+
+    for (nfds = 2; nfds > 0; /* void */) {
+        timeout = watchdog(pid, begin, wall_limit, &wall_killed);
+
+        if (poll(fds, 2, timeout) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("poll");
+            kill(-pid, SIGKILL);
+            break;
+        }
+
+        for (i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || fds[i].revents == 0) {
+                continue;
+            }
+
+            if (i == 0) {
+                status = relay(fds[i].fd, stdout, out_line, &out_len,
+                               sizeof(out_line));
+
+            } else {
+                status = relay(fds[i].fd, stderr, err_line, &err_len,
+                               sizeof(err_line));
+            }
+
+            if (status <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                nfds--;
+            }
+        }
+    }
+
+    /* the child may close its output and go on running: keep the
+     * watchdog going until it exits */
+    for ( ;; ) {
+        timeout = watchdog(pid, begin, wall_limit, &wall_killed);
+
+        rc = wait4(pid, &status, timeout == -1 ? 0 : WNOHANG, &ru);
+        if (rc == pid) {
+            break;
+        }
+
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("wait4");
+            kill(-pid, SIGKILL);
+            return 1;
+        }
+
+        poll(NULL, 0, timeout < 10 ? timeout : 10);
+    }
+
+    elapsed = get_wall_time() - begin;
+    cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+          + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && !wall_killed) {
+        return RESULT_OK;
+    }
+
+    /* name the result after the engine being run when the child died in
+     * the middle of its line */
+    if (out_len == 0) {
+        printf("%s ", name);
+    }
+
+    if (wall_killed) {
+        printf("timeout: %.05lf ms elapsed (wall limit %ld s).\n",
+               elapsed * 1e3, wall_limit);
+        return RESULT_TIMEOUT;
+    }
+
+    if (WIFSIGNALED(status)
+        && (WTERMSIG(status) == SIGXCPU
+            || (cpu_limit && WTERMSIG(status) == SIGKILL && cpu >= cpu_limit)))
+    {
+        printf("timeout: %.05lf ms elapsed (cpu limit %ld s).\n",
+               cpu * 1e3, cpu_limit);
+        return RESULT_TIMEOUT;
+    }
+
+    oom = WIFEXITED(status) && WEXITSTATUS(status) == RESULT_OOM;
+
+    if (mem_limit && WIFSIGNALED(status)
+        && (WTERMSIG(status) == SIGSEGV || WTERMSIG(status) == SIGABRT))
+    {
+        /* a failed mmap() under RLIMIT_AS that the child did not check,
+         * or an allocation failure the C++ runtime aborted on */
+        oom = 1;
+    }
+
+    if (oom) {
+        if (mem_limit) {
+            printf("oom: %.05lf ms elapsed (memory limit %ld MB).\n",
+                   cpu * 1e3, mem_limit);
+
+        } else {
+            printf("oom: %.05lf ms elapsed (no memory limit).\n",
+                   cpu * 1e3);
+        }
+
+        return RESULT_OOM;
+    }
+
+    if (WIFSIGNALED(status)) {
+        printf("crash: %.05lf ms elapsed (%s).\n", cpu * 1e3,
+               strsignal(WTERMSIG(status)));
+        return 128 + WTERMSIG(status);
+    }
+
+    if (out_len) {
+        /* end the partial line but leave the failure to the driver's
+         * own message */
+        printf("\n");
+    }
+
+    return WEXITSTATUS(status);
+}
+
+
+static void
+child_exec(char **argv, int out_fd, int err_fd, long cpu_limit,
+    long mem_limit)
+{
+    struct rlimit        rl;
+
+    setpgid(0, 0);
+
+    if (cpu_limit) {
+        /* SIGXCPU at the soft limit, SIGKILL a second later */
+        rl.rlim_cur = cpu_limit;
+        rl.rlim_max = cpu_limit + 1;
+
+        if (setrlimit(RLIMIT_CPU, &rl) != 0) {
+            perror("setrlimit RLIMIT_CPU");
+            _exit(1);
+        }
+    }
+
+    if (mem_limit) {
+        rl.rlim_cur = rl.rlim_max = (rlim_t) mem_limit * 1024 * 1024;
+
+        if (setrlimit(RLIMIT_AS, &rl) != 0) {
+            perror("setrlimit RLIMIT_AS");
+            _exit(1);
+        }
+    }
+
+    if (dup2(out_fd, STDOUT_FILENO) == -1
+        || dup2(err_fd, STDERR_FILENO) == -1)
+    {
+        perror("dup2");
+        _exit(1);
+    }
+
+    close(out_fd);
+    close(err_fd);
+
+    execvp(argv[0], argv);
+
+    fprintf(stderr, "failed to run %s: %s\n", argv[0], strerror(errno));
+    _exit(127);
+}
+
+
+static void
+kill_child(int signo)
+{
+    if (child_pid > 0) {
+        kill(-child_pid, SIGKILL);
+    }
+
+    signal(signo, SIG_DFL);
+    raise(signo);
+}
+
+
+/*
+ * Kills the child's process group, which also takes out any compiler it
+ * may have spawned, once the wall clock limit has passed. Returns the
+ * milliseconds left until then, or -1 when there is nothing (left) to
+ * watch.
+ */
+static int
+watchdog(pid_t pid, double begin, long wall_limit, int *killed)
+{
+    double               elapsed;
+
+    if (wall_limit == 0 || *killed) {
+        return -1;
+    }
+
+    elapsed = get_wall_time() - begin;
+    if (elapsed >= wall_limit) {
+        kill(-pid, SIGKILL);
+        *killed = 1;
+        return -1;
+    }
+
+    return (int) ((wall_limit - elapsed) * 1e3) + 1;
+}
+
+
+/*
+ * Copies what is available on fd to dst and keeps the current unfinished
+ * line in line (truncated to line_size - 1 bytes), with *line_len its
+ * length. Returns 0 at EOF.
+ */
+static int
+relay(int fd, FILE *dst, char *line, size_t *line_len, size_t line_size)
+{
+    char                 buf[4096];
+    ssize_t              n, i;
+
+    n = read(fd, buf, sizeof(buf));
+    if (n == -1) {
+        return errno == EINTR ? 1 : -1;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+
+    fwrite(buf, 1, n, dst);
+    fflush(dst);
+
+    for (i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+            *line_len = 0;
+
+        } else if (*line_len < line_size - 1) {
+            line[(*line_len)++] = buf[i];
+        }
+    }
+
+    line[*line_len] = '\0';
+
+    return 1;
+}
+
+
+static void
+usage(int rc)
+{
+    fprintf(stderr, "usage: runcase [options] <command> [args...]\n"
+            "options:\n"
+            "   --cpu=N             stop the command after N seconds of CPU\n"
+            "                       time\n"
+            "   --wall=N            stop the command after N seconds of wall\n"
+            "                       clock time\n"
+            "   --mem=N             limit the address space of the command\n"
+            "                       to N MB\n"
+            "the limits are off by default. the exit code is 124 for a\n"
+            "timeout, 125 when running out of memory (the command exited\n"
+            "with 125, or crashed with SIGSEGV or SIGABRT under --mem),\n"
+            "128 + the signal number for a crash and the command's own\n"
+            "otherwise. SIGINT, SIGTERM and SIGHUP kill the command too.\n");
+    exit(rc);
+}
@@ -6,6 +6,8 @@
  */
 
 
+#define _GNU_SOURCE
+#define BENCH_COUNT_ALLOCS
 #include <sregex/sregex.h>
 #include <assert.h>
 #include <string.h>
@@ -14,12 +16,57 @@
 #include <errno.h>
 #include <time.h>
 #include "getcputime.h"
+#include "bench.h"
+
+
+/* the match state of a stream in the streams mode */
+typedef struct {
+    sre_pool_t          *pool;
+    void                *ctx;        /* Pike or Thompson */
+    size_t               pos;        /* bytes of the stream fed so far */
+    size_t               base;       /* where ctx started in the stream */
+    unsigned             done:1;
+} stream_t;
+
+
+/* the per-worker state of the tree mode */
+typedef struct {
+    stream_t             sm;
+    sre_program_t       *prog;
+    unsigned             engine;
+    int                  global;
+    sre_int_t           *ovector;
+    size_t               ovecsize;
+
+    sre_vm_thompson_exec_pt      texec;
+} tree_ctx_t;
 
 
 static void usage(int rc);
 static void run_engines(sre_program_t *prog, unsigned engine_types,
     sre_uint_t ncaps, sre_char *input, size_t len, int global,
     int repeat);
+static void run_streams(sre_program_t *prog, unsigned engine_types,
+    sre_uint_t ncaps, sre_char *input, size_t len, int global,
+    int repeat);
+static int stream_feed(stream_t *sm, unsigned engine, sre_program_t *prog,
+    sre_vm_thompson_exec_pt texec, sre_char *p, size_t size, int eof,
+    int global, sre_int_t *ovector, size_t ovecsize);
+static void stream_reset(stream_t *sm, unsigned engine,
+    sre_program_t *prog, sre_int_t *ovector, size_t ovecsize);
+static void run_pipeline(sre_program_t *prog, unsigned engine_types,
+    sre_uint_t ncaps, const char *path, int global, int repeat);
+static void run_tree(sre_program_t *prog, unsigned engine_types,
+    sre_uint_t ncaps, const char *path, int global, int repeat);
+static int tree_scan(void *data, const unsigned char *p, size_t len);
+static void run_heatmap(sre_program_t *prog, unsigned engine_types,
+    sre_uint_t ncaps, sre_char *input, size_t len, int global, int repeat);
+static void run_replace(sre_program_t *prog, unsigned engine_types,
+    sre_uint_t ncaps, sre_char *input, size_t len, int repeat);
+static void run_fields(const char *pattern, int flags,
+    unsigned engine_types, sre_char *input, size_t len, int repeat);
+static sre_vm_thompson_exec_pt thompson_jit(sre_pool_t *pool,
+    sre_program_t *prog);
 static void alloc_error(void);
 sre_int_t run_jitted_thompson(sre_vm_thompson_exec_pt handler,
     sre_vm_thompson_ctx_t *ctx, sre_char *input, size_t size, unsigned eof);
@@ -35,6 +82,7 @@ enum {
 #define u_char  unsigned char
 
 
+
 #define TIMER_START                                                          \
         begin = get_cpu_time();                                              \
         if (begin == -1) {                                                   \
@@ -56,7 +104,7 @@ int
 main(int argc, char **argv)
 {
     int                  flags = 0;
-    int                  global = 0, repeat = 5;
+    int                  global = 0, repeat = 5, ngroups;
     unsigned             engine_types = 0;
     sre_uint_t           i;
     sre_int_t            err_offset = -1;
@@ -66,6 +114,7 @@ main(int argc, char **argv)
     sre_program_t       *prog;
     sre_uint_t           ncaps;
     sre_char            *input;
+    char                *pattern, *src = NULL;
     FILE                *f;
     size_t               len;
     long                 rc;
@@ -108,6 +157,9 @@ main(int argc, char **argv)
                 repeat = 5;
             }
 
+        } else if (bench_parse_option(argv[i])) {
+            /* void */
+
         } else {
             fprintf(stderr, "unknown option: %s\n", argv[i]);
             exit(1);
@@ -123,12 +175,23 @@ main(int argc, char **argv)
         usage(1);
     }
 
+    bench_setup(BENCH_MODE_STREAMS | BENCH_MODE_PIPELINE | BENCH_MODE_TREE
+                | BENCH_MODE_REPLACE | BENCH_MODE_FIELDS | BENCH_MODE_HEATMAP);
+
     ppool = sre_create_pool(1024);
     if (ppool == NULL) {
         return 2;
     }
 
-    re = sre_regex_parse(ppool, (sre_char *) argv[i++], &ncaps, flags, &err_offset);
+    pattern = argv[i++];
+
+    if (bench_conf.fields) {
+        /* sregex knows no named groups */
+        src = bench_groups_keep(pattern, -1, 1, &ngroups);
+    }
+
+    re = sre_regex_parse(ppool, (sre_char *) (src ? src : pattern), &ncaps,
+                         flags, &err_offset);
     if (re == NULL) {
         if (err_offset >= 0) {
             fprintf(stderr, "[error] syntax error at pos %lld\n",
@@ -154,6 +217,18 @@ main(int argc, char **argv)
     ppool = NULL;
     re = NULL;
 
+    if (bench_conf.pipeline) {
+        run_pipeline(prog, engine_types, ncaps, argv[i], global, repeat);
+        sre_destroy_pool(cpool);
+        return 0;
+    }
+
+    if (bench_conf.tree) {
+        run_tree(prog, engine_types, ncaps, argv[i], global, repeat);
+        sre_destroy_pool(cpool);
+        return 0;
+    }
+
     errno = 0;
 
     f = fopen(argv[i], "rb");
@@ -173,7 +248,7 @@ main(int argc, char **argv)
         return 1;
     }
 
-    len = (size_t) rc;
+    len = bench_input_size((size_t) rc);
 
     if (fseek(f, 0L, SEEK_SET) != 0) {
         perror("seek to file beginning");
@@ -183,7 +258,7 @@ main(int argc, char **argv)
     input = malloc(len);
     if (input == NULL) {
         fprintf(stderr, "failed to allocate %ld bytes.\n", len);
-        return 1;
+        return BENCH_EXIT_NOMEM;
     }
 
     if (fread(input, 1, len, f) < len) {
@@ -201,9 +276,26 @@ main(int argc, char **argv)
         return 1;
     }
 
-    run_engines(prog, engine_types, ncaps, input, len, global, repeat);
+    bench_cache_add(input, len);
+
+    if (bench_conf.fields) {
+        run_fields(pattern, flags, engine_types, input, len, repeat);
+
+    } else if (bench_conf.slice) {
+        run_heatmap(prog, engine_types, ncaps, input, len, global, repeat);
+
+    } else if (bench_conf.replace) {
+        run_replace(prog, engine_types, ncaps, input, len, repeat);
+
+    } else if (bench_conf.streams) {
+        run_streams(prog, engine_types, ncaps, input, len, global, repeat);
+
+    } else {
+        run_engines(prog, engine_types, ncaps, input, len, global, repeat);
+    }
 
     free(input);
+    free(src);
     sre_destroy_pool(cpool);
     return 0;
 }
@@ -219,7 +311,7 @@ run_engines(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
     size_t               ovecsize, rest;
     sre_pool_t          *pool;
     double               begin, end;
-    double               best = -1;
+    bench_stats_t        st;
 
     sre_vm_thompson_ctx_t       *tctx;
     sre_vm_pike_ctx_t           *pctx;
@@ -235,6 +327,7 @@ run_engines(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
         double elapsed;
 
         printf("sregex Thompson ");
+        fflush(stdout);
 
         tctx = sre_vm_thompson_create_ctx(pool, prog);
         if (tctx == NULL) {
@@ -296,6 +389,7 @@ run_engines(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
         }
 
         printf("sregex Thompson JIT ");
+        fflush(stdout);
 
         tctx = sre_vm_thompson_jit_create_ctx(pool, prog);
         if (tctx == NULL) {
@@ -343,13 +437,16 @@ run_engines(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
         }
 
         printf("sregex Pike ");
+        fflush(stdout);
 
         pctx = sre_vm_pike_create_ctx(pool, prog, ovector, ovecsize);
         if (pctx == NULL) {
             alloc_error();
         }
 
-        for (i = 0; i < repeat; i++) {
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
             double        elapsed;
             const u_char *p;
 
@@ -371,9 +468,7 @@ run_engines(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
 
             TIMER_STOP
 
-            if (i == 0 || elapsed < best) {
-                best = elapsed;
-            }
+            bench_stats_add(&st, elapsed);
         }
 
         switch (rc) {
@@ -404,7 +499,8 @@ run_engines(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
         }
 
         printf(": %.05lf ms elapsed (%d matches found, %d repeated times).\n",
-               best * 1e3, matches, repeat);
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_stats_print(&st);
 
         free(ovector);
         sre_reset_pool(pool);
@@ -414,11 +510,841 @@ run_engines(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
 }
 
 
+/*
+ * Splits the input among 1, 10, 100 ... --streams streams fed in
+ * interleaved chunks (see bench_streams_init()), each with a VM context
+ * in a pool of its own, and feeds the chunks with eof set on the last
+ * one only, so that a context returns SRE_AGAIN until it knows the
+ * result. A stream stops at its first match, except for the Pike VM with
+ * -g, which starts a new context right after each match.
+ */
+static void
+run_streams(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
+    sre_char *input, size_t len, int global, int repeat)
+{
+    int                  n, s, eof, matches = 0, passes;
+    unsigned             engine;
+    sre_int_t           *ovector;
+    size_t               ovecsize, r, off, size, fed = 0, rss;
+    double               begin, end, state;
+    bench_stats_t        st;
+    bench_streams_t      ss;
+    bench_perf_t         perf;
+    stream_t            *streams, *sm;
+    sre_pool_t          *pool;
+
+    sre_vm_thompson_exec_pt      texec = NULL;
+
+    ovecsize = 2 * (ncaps + 1) * sizeof(sre_int_t);
+    ovector = malloc(ovecsize);
+    if (ovector == NULL) {
+        alloc_error();
+    }
+
+    pool = sre_create_pool(1024);
+    if (pool == NULL) {
+        alloc_error();
+    }
+
+    if (engine_types & ENGINE_THOMPSON_JIT) {
+        texec = thompson_jit(pool, prog);
+    }
+
+    bench_perf_open(&perf);
+
+    for (engine = ENGINE_THOMPSON; engine <= ENGINE_PIKE; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        for (n = 1; n; n = bench_streams_next_count(n)) {
+            bench_streams_init(&ss, len, n);
+
+            streams = calloc(n, sizeof(stream_t));
+            if (streams == NULL) {
+                alloc_error();
+            }
+
+            rss = bench_rss();
+
+            for (s = 0; s < n; s++) {
+                streams[s].pool = sre_create_pool(1024);
+                if (streams[s].pool == NULL) {
+                    alloc_error();
+                }
+
+                stream_reset(&streams[s], engine, prog, ovector, ovecsize);
+            }
+
+            state = rss ? ((double) bench_rss() - rss) / n : 0;
+
+            printf("sregex %s (%d stream%s) ", engine == ENGINE_THOMPSON
+                   ? "Thompson" : engine == ENGINE_THOMPSON_JIT
+                   ? "Thompson JIT" : "Pike", n, n == 1 ? "" : "s");
+            fflush(stdout);
+
+            perf.count[0] = 0;
+            perf.count[1] = 0;
+            passes = 0;
+
+            bench_stats_init(&st, repeat);
+
+            while (bench_stats_next(&st)) {
+                double elapsed;
+
+                matches = 0;
+                fed = 0;
+
+                bench_perf_start(&perf);
+
+                TIMER_START
+
+                for (r = 0; r < ss.rounds; r++) {
+                    for (s = 0; s < n; s++) {
+                        sm = &streams[s];
+
+                        if (sm->done) {
+                            continue;
+                        }
+
+                        size = bench_stream_chunk(&ss, s, r, &off, &eof);
+                        if (size == 0 && !eof) {
+                            continue;
+                        }
+
+                        fed += size;
+                        matches += stream_feed(sm, engine, prog, texec,
+                                               input + off, size, eof,
+                                               global, ovector, ovecsize);
+                    }
+                }
+
+                TIMER_STOP
+
+                bench_perf_stop(&perf);
+                passes++;
+
+                for (s = 0; s < n; s++) {
+                    streams[s].pos = 0;
+                    stream_reset(&streams[s], engine, prog, ovector,
+                                 ovecsize);
+                }
+
+                bench_stats_add(&st, elapsed);
+            }
+
+            printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+                   "times).\n", matches ? "match" : "no match",
+                   bench_stats_median(&st) * 1e3, matches, st.n);
+            bench_streams_print(&ss, bench_stats_median(&st), fed, state,
+                                &perf, passes);
+            bench_stats_print(&st);
+
+            for (s = 0; s < n; s++) {
+                sre_destroy_pool(streams[s].pool);
+            }
+
+            free(streams);
+        }
+    }
+
+    bench_perf_close(&perf);
+    sre_destroy_pool(pool);
+    free(ovector);
+}
+
+
+/*
+ * Feeds the next chunk of a stream and returns the number of matches
+ * found in it.
+ */
+static int
+stream_feed(stream_t *sm, unsigned engine, sre_program_t *prog,
+    sre_vm_thompson_exec_pt texec, sre_char *p, size_t size, int eof,
+    int global, sre_int_t *ovector, size_t ovecsize)
+{
+    int                  matches = 0;
+    size_t               k;
+    sre_int_t            rc;
+
+    for ( ;; ) {
+        if (engine == ENGINE_THOMPSON) {
+            rc = sre_vm_thompson_exec(sm->ctx, p, size, eof);
+
+        } else if (engine == ENGINE_THOMPSON_JIT) {
+            rc = run_jitted_thompson(texec, sm->ctx, p, size, eof);
+
+        } else {
+            rc = sre_vm_pike_exec(sm->ctx, p, size, eof, NULL);
+        }
+
+        if (rc != SRE_OK) {
+            break;
+        }
+
+        matches++;
+
+        if (!global || engine != ENGINE_PIKE) {
+            sm->done = 1;
+            break;
+        }
+
+        /* the match ends k bytes into what was fed */
+        k = sm->base + ovector[1] - sm->pos;
+        if (ovector[1] == ovector[0]) {
+            k++;
+        }
+
+        if (k > size || (k == size && !eof)) {
+            sm->pos += k;
+            stream_reset(sm, engine, prog, ovector, ovecsize);
+            size = 0;
+            break;
+        }
+
+        sm->pos += k;
+        p += k;
+        size -= k;
+        stream_reset(sm, engine, prog, ovector, ovecsize);
+    }
+
+    sm->pos += size;
+
+    if (rc == SRE_ERROR) {
+        fprintf(stderr, "sregex error at stream offset %lu\n",
+                (unsigned long) sm->pos);
+        exit(2);
+    }
+
+    if (eof) {
+        sm->done = 1;
+    }
+
+    return matches;
+}
+
+
+/*
+ * Matches the file as one stream while it is being read into the
+ * buffers of a bench_reader_t. The times include the reads.
+ */
+static void
+run_pipeline(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
+    const char *path, int global, int repeat)
+{
+    int                  matches = 0;
+    unsigned             engine;
+    sre_int_t           *ovector;
+    size_t               ovecsize, size;
+    bench_stats_t        st;
+    bench_reader_t       rd;
+    stream_t             sm;
+    sre_pool_t          *pool;
+    const unsigned char *p;
+
+    sre_vm_thompson_exec_pt      texec = NULL;
+
+    ovecsize = 2 * (ncaps + 1) * sizeof(sre_int_t);
+    ovector = malloc(ovecsize);
+    if (ovector == NULL) {
+        alloc_error();
+    }
+
+    pool = sre_create_pool(1024);
+    if (pool == NULL) {
+        alloc_error();
+    }
+
+    if (engine_types & ENGINE_THOMPSON_JIT) {
+        texec = thompson_jit(pool, prog);
+    }
+
+    memset(&sm, 0, sizeof(stream_t));
+
+    sm.pool = sre_create_pool(1024);
+    if (sm.pool == NULL) {
+        alloc_error();
+    }
+
+    bench_reader_open(&rd, path);
+    bench_reader_drain(&rd, repeat);
+
+    for (engine = ENGINE_THOMPSON; engine <= ENGINE_PIKE; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        printf("sregex %s (pipeline) ", engine == ENGINE_THOMPSON
+               ? "Thompson" : engine == ENGINE_THOMPSON_JIT
+               ? "Thompson JIT" : "Pike");
+        fflush(stdout);
+
+        rd.wait = 0;
+        rd.elapsed = 0;
+        rd.passes = 0;
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            matches = 0;
+
+            sm.pos = 0;
+            stream_reset(&sm, engine, prog, ovector, ovecsize);
+
+            bench_reader_start(&rd);
+
+            do {
+                size = bench_reader_next(&rd, &p);
+
+                /* keeps draining the ring after the first match */
+                if (!sm.done) {
+                    matches += stream_feed(&sm, engine, prog, texec,
+                                           (sre_char *) p, size, size == 0,
+                                           global, ovector, ovecsize);
+                }
+
+                bench_reader_release(&rd);
+
+            } while (size);
+
+            bench_stats_add(&st, bench_reader_end(&rd));
+        }
+
+        printf("%s: %.05lf ms elapsed (%d matches found, %d repeated "
+               "times).\n", matches ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, matches, st.n);
+        bench_reader_print(&rd, bench_stats_median(&st));
+        bench_stats_print(&st);
+    }
+
+    bench_reader_close(&rd);
+    sre_destroy_pool(sm.pool);
+    sre_destroy_pool(pool);
+    free(ovector);
+}
+
+
+/*
+ * Scans the files under a directory in a pool of workers (see
+ * bench_tree_run()), each job a stream fed at once with eof set. A
+ * worker keeps a memory pool for its VM contexts, reset for every job,
+ * or creates a new one for every job with --setup=include.
+ */
+static void
+run_tree(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
+    const char *path, int global, int repeat)
+{
+    int                  t, n;
+    unsigned             engine;
+    tree_ctx_t          *ctxs, *ctx;
+    sre_pool_t          *pool;
+    static bench_tree_t  tree;
+
+    sre_vm_thompson_exec_pt      texec = NULL;
+
+    pool = sre_create_pool(1024);
+    if (pool == NULL) {
+        alloc_error();
+    }
+
+    if (engine_types & ENGINE_THOMPSON_JIT) {
+        texec = thompson_jit(pool, prog);
+    }
+
+    bench_tree_init(&tree, tree_scan, path);
+
+    n = bench_conf.threads > 1 ? bench_conf.threads : 1;
+
+    ctxs = calloc(n, sizeof(tree_ctx_t));
+    if (ctxs == NULL) {
+        alloc_error();
+    }
+
+    for (t = 0; t < n; t++) {
+        ctx = &ctxs[t];
+        ctx->prog = prog;
+        ctx->global = global;
+        ctx->texec = texec;
+        ctx->ovecsize = 2 * (ncaps + 1) * sizeof(sre_int_t);
+
+        ctx->ovector = malloc(ctx->ovecsize);
+        if (ctx->ovector == NULL) {
+            alloc_error();
+        }
+
+        if (!bench_conf.setup) {
+            ctx->sm.pool = sre_create_pool(1024);
+            if (ctx->sm.pool == NULL) {
+                alloc_error();
+            }
+        }
+
+        tree.workers[t].ctx = ctx;
+    }
+
+    for (engine = ENGINE_THOMPSON; engine <= ENGINE_PIKE; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        for (t = 0; t < n; t++) {
+            ctxs[t].engine = engine;
+        }
+
+        for (t = 1; t; t = bench_pool_next_threads(t)) {
+            printf("sregex %s (tree, %d worker%s) ", engine == ENGINE_THOMPSON
+                   ? "Thompson" : engine == ENGINE_THOMPSON_JIT
+                   ? "Thompson JIT" : "Pike", t, t == 1 ? "" : "s");
+            fflush(stdout);
+
+            bench_tree_run(&tree, t, repeat);
+        }
+    }
+
+    for (t = 0; t < n; t++) {
+        if (ctxs[t].sm.pool) {
+            sre_destroy_pool(ctxs[t].sm.pool);
+        }
+
+        free(ctxs[t].ovector);
+    }
+
+    bench_tree_free(&tree);
+    free(ctxs);
+    sre_destroy_pool(pool);
+}
+
+
+static int
+tree_scan(void *data, const unsigned char *p, size_t len)
+{
+    int          matches;
+    tree_ctx_t  *ctx = data;
+
+    if (bench_conf.setup) {
+        ctx->sm.pool = sre_create_pool(1024);
+        if (ctx->sm.pool == NULL) {
+            alloc_error();
+        }
+    }
+
+    ctx->sm.pos = 0;
+    stream_reset(&ctx->sm, ctx->engine, ctx->prog, ctx->ovector,
+                 ctx->ovecsize);
+
+    matches = stream_feed(&ctx->sm, ctx->engine, ctx->prog, ctx->texec,
+                          (sre_char *) p, len, 1, ctx->global, ctx->ovector,
+                          ctx->ovecsize);
+
+    if (bench_conf.setup) {
+        sre_destroy_pool(ctx->sm.pool);
+        ctx->sm.pool = NULL;
+    }
+
+    return matches;
+}
+
+
+/* the heatmap mode (see --heatmap), with the scan of the tree mode */
+static void
+run_heatmap(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
+    sre_char *input, size_t len, int global, int repeat)
+{
+    unsigned             engine;
+    tree_ctx_t           ctx;
+    sre_pool_t          *pool;
+
+    pool = sre_create_pool(1024);
+    if (pool == NULL) {
+        alloc_error();
+    }
+
+    memset(&ctx, 0, sizeof(tree_ctx_t));
+
+    ctx.prog = prog;
+    ctx.global = global;
+    ctx.ovecsize = 2 * (ncaps + 1) * sizeof(sre_int_t);
+
+    ctx.ovector = malloc(ctx.ovecsize);
+    if (ctx.ovector == NULL) {
+        alloc_error();
+    }
+
+    if (engine_types & ENGINE_THOMPSON_JIT) {
+        ctx.texec = thompson_jit(pool, prog);
+    }
+
+    if (!bench_conf.setup) {
+        ctx.sm.pool = sre_create_pool(1024);
+        if (ctx.sm.pool == NULL) {
+            alloc_error();
+        }
+    }
+
+    for (engine = ENGINE_THOMPSON; engine <= ENGINE_PIKE; engine <<= 1) {
+        if (!(engine_types & engine)) {
+            continue;
+        }
+
+        ctx.engine = engine;
+
+        printf("sregex %s (heatmap) ", engine == ENGINE_THOMPSON
+               ? "Thompson" : engine == ENGINE_THOMPSON_JIT
+               ? "Thompson JIT" : "Pike");
+        fflush(stdout);
+
+        bench_heatmap_run(tree_scan, &ctx, input, len, repeat);
+    }
+
+    if (ctx.sm.pool) {
+        sre_destroy_pool(ctx.sm.pool);
+    }
+
+    free(ctx.ovector);
+    sre_destroy_pool(pool);
+}
+
+
+/*
+ * Replaces every match with the captures of the Pike VM, copying the
+ * input between the matches to an output buffer kept from run to run.
+ * Each match takes a new context from a pool reset in between. The
+ * Thompson VMs report no offsets and cannot replace.
+ */
+static void
+run_replace(sre_program_t *prog, unsigned engine_types, sre_uint_t ncaps,
+    sre_char *input, size_t len, int repeat)
+{
+    int                  matches = 0, runs = 0;
+    sre_int_t            rc = SRE_DECLINED;
+    sre_int_t           *ovector;
+    size_t               ovecsize, rest, k, *caps;
+    unsigned long        allocs = 0, a;
+    double               begin, end;
+    bench_stats_t        st;
+    bench_out_t          out;
+    sre_pool_t          *pool;
+    sre_char            *p;
+    sre_vm_pike_ctx_t   *pctx;
+
+    if (engine_types & (ENGINE_THOMPSON | ENGINE_THOMPSON_JIT)) {
+        printf("sregex Thompson (replace) cannot replace.\n");
+    }
+
+    if (!(engine_types & ENGINE_PIKE)) {
+        return;
+    }
+
+    ovecsize = 2 * (ncaps + 1) * sizeof(sre_int_t);
+    ovector = malloc(ovecsize);
+    caps = malloc(2 * (ncaps + 1) * sizeof(size_t));
+    if (ovector == NULL || caps == NULL) {
+        alloc_error();
+    }
+
+    pool = sre_create_pool(1024);
+    if (pool == NULL) {
+        alloc_error();
+    }
+
+    memset(&out, 0, sizeof(bench_out_t));
+
+    printf("sregex Pike (replace) ");
+    fflush(stdout);
+
+    bench_stats_init(&st, repeat);
+
+    while (bench_stats_next(&st)) {
+        double elapsed;
+
+        matches = 0;
+        out.len = 0;
+        p = input;
+        rest = len;
+
+        a = BENCH_ALLOCS();
+
+        TIMER_START
+
+        for ( ;; ) {
+            sre_reset_pool(pool);
+
+            pctx = sre_vm_pike_create_ctx(pool, prog, ovector, ovecsize);
+            if (pctx == NULL) {
+                alloc_error();
+            }
+
+            rc = sre_vm_pike_exec(pctx, p, rest, 1 /* eof */, NULL);
+            if (rc != SRE_OK) {
+                break;
+            }
+
+            matches++;
+
+            for (k = 0; k < 2 * (ncaps + 1); k++) {
+                caps[k] = ovector[k] < 0 ? BENCH_NO_OFFSET
+                                         : (size_t) ovector[k];
+            }
+
+            bench_out_append(&out, p, ovector[0]);
+            bench_out_expand(&out, p, caps, ncaps + 1);
+
+            k = ovector[1];
+
+            /* step over an empty match */
+            if (ovector[1] == ovector[0]) {
+                if (k >= rest) {
+                    p += rest;
+                    rest = 0;
+                    break;
+                }
+
+                bench_out_append(&out, p + k, 1);
+                k++;
+            }
+
+            p += k;
+            rest -= k;
+        }
+
+        bench_out_append(&out, p, rest);
+
+        TIMER_STOP
+
+        if (rc == SRE_ERROR) {
+            fprintf(stderr, "sregex error\n");
+            exit(2);
+        }
+
+        allocs += BENCH_ALLOCS() - a;
+        runs++;
+
+        bench_stats_add(&st, elapsed);
+    }
+
+    printf("%s: %.05lf ms elapsed (%d matches found, %d repeated times).\n",
+           matches ? "match" : "no match", bench_stats_median(&st) * 1e3,
+           matches, st.n);
+    bench_replace_print(len, out.len, bench_stats_median(&st), allocs, runs);
+    bench_stats_print(&st);
+
+    free(out.data);
+    free(caps);
+    free(ovector);
+    sre_destroy_pool(pool);
+}
+
+
+/*
+ * The field extraction mode (see --fields): the Pike VM on every line
+ * with the groups stored as views into the input, with the regexp parsed
+ * and compiled again for 0, 1, 2 ... of its capture groups left
+ * capturing. sregex knows no named groups, so their names are taken out.
+ */
+static void
+run_fields(const char *pattern, int flags, unsigned engine_types,
+    sre_char *input, size_t len, int repeat)
+{
+    int                  k, g, ngroups;
+    char                *src;
+    size_t               line, matches = 0, ovecsize;
+    double               begin, end;
+    sre_int_t            rc = SRE_DECLINED, err_offset = -1;
+    sre_int_t           *ovector;
+    sre_uint_t           ncaps;
+    sre_pool_t          *ppool, *cpool, *pool;
+    sre_regex_t         *re;
+    sre_program_t       *prog;
+    sre_vm_pike_ctx_t   *pctx;
+    bench_line_t        *ln;
+    bench_field_t       *fields;
+    bench_stats_t        st;
+    bench_fields_t       fl;
+
+    if (engine_types & (ENGINE_THOMPSON | ENGINE_THOMPSON_JIT)) {
+        printf("sregex Thompson (fields) cannot capture.\n");
+    }
+
+    if (!(engine_types & ENGINE_PIKE)) {
+        return;
+    }
+
+    src = bench_groups_keep(pattern, 0, 1, &ngroups);
+    free(src);
+
+    bench_fields_init(&fl, input, len, ngroups);
+
+    ovecsize = 2 * (ngroups + 1) * sizeof(sre_int_t);
+    ovector = malloc(ovecsize);
+    if (ovector == NULL) {
+        alloc_error();
+    }
+
+    pool = sre_create_pool(1024);
+    if (pool == NULL) {
+        alloc_error();
+    }
+
+    for (k = 0; k <= ngroups; k++) {
+        src = bench_groups_keep(pattern, k, 1, &g);
+
+        ppool = sre_create_pool(1024);
+        cpool = sre_create_pool(1024);
+        if (ppool == NULL || cpool == NULL) {
+            alloc_error();
+        }
+
+        re = sre_regex_parse(ppool, (sre_char *) src, &ncaps, flags,
+                             &err_offset);
+        if (re == NULL) {
+            fprintf(stderr, "[error] syntax error at pos %lld\n",
+                    (long long) err_offset);
+            exit(2);
+        }
+
+        prog = sre_regex_compile(cpool, re);
+        if (prog == NULL) {
+            fprintf(stderr, "failed to compile the regex.\n");
+            exit(2);
+        }
+
+        sre_destroy_pool(ppool);
+        free(src);
+
+        ovecsize = 2 * (ncaps + 1) * sizeof(sre_int_t);
+
+        printf("sregex Pike (fields, %d of %d groups) ", k, ngroups);
+        fflush(stdout);
+
+        bench_stats_init(&st, repeat);
+
+        while (bench_stats_next(&st)) {
+            double elapsed;
+
+            matches = 0;
+
+            TIMER_START
+
+            for (line = 0; line < fl.nlines; line++) {
+                ln = &fl.lines[line];
+
+                sre_reset_pool(pool);
+
+                pctx = sre_vm_pike_create_ctx(pool, prog, ovector, ovecsize);
+                if (pctx == NULL) {
+                    alloc_error();
+                }
+
+                rc = sre_vm_pike_exec(pctx, input + ln->off, ln->len,
+                                      1 /* eof */, NULL);
+                if (rc == SRE_ERROR) {
+                    fprintf(stderr, "sregex error\n");
+                    exit(2);
+                }
+
+                if (rc != SRE_OK) {
+                    continue;
+                }
+
+                matches++;
+                fields = bench_fields_line(&fl, line);
+
+                for (g = 0; g <= k; g++) {
+                    if (ovector[2 * g] < 0) {
+                        fields[g].data = NULL;
+                        fields[g].len = 0;
+                        continue;
+                    }
+
+                    fields[g].data = input + ln->off + ovector[2 * g];
+                    fields[g].len = ovector[2 * g + 1] - ovector[2 * g];
+                }
+            }
+
+            TIMER_STOP
+
+            bench_stats_add(&st, elapsed);
+        }
+
+        printf("%s: %.05lf ms elapsed (%lu matches found, %d repeated "
+               "times).\n", matches ? "match" : "no match",
+               bench_stats_median(&st) * 1e3, (unsigned long) matches,
+               st.n);
+        bench_fields_print(&fl, k, matches, bench_stats_median(&st));
+        bench_stats_print(&st);
+
+        sre_destroy_pool(cpool);
+    }
+
+    bench_fields_print_cost(&fl);
+
+    free(ovector);
+    sre_destroy_pool(pool);
+    bench_fields_free(&fl);
+}
+
+
+static sre_vm_thompson_exec_pt
+thompson_jit(sre_pool_t *pool, sre_program_t *prog)
+{
+    sre_int_t                    rc;
+    sre_vm_thompson_code_t      *tcode;
+    sre_vm_thompson_exec_pt      texec;
+
+    rc = sre_vm_thompson_jit_compile(pool, prog, &tcode);
+
+    if (rc == SRE_DECLINED) {
+        printf("sregex thompson JIT disabled\n");
+        exit(2);
+    }
+
+    if (rc != SRE_OK) {
+        fprintf(stderr, "failed to run thompson jit compile: %ld\n",
+                (long) rc);
+        exit(2);
+    }
+
+    texec = sre_vm_thompson_jit_get_handler(tcode);
+    if (texec == NULL) {
+        fprintf(stderr, "failed to get Thompson JIT handler.\n");
+        exit(2);
+    }
+
+    return texec;
+}
+
+
+/* starts the stream over with a fresh context from its pool */
+static void
+stream_reset(stream_t *sm, unsigned engine, sre_program_t *prog,
+    sre_int_t *ovector, size_t ovecsize)
+{
+    sre_reset_pool(sm->pool);
+
+    if (engine == ENGINE_THOMPSON) {
+        sm->ctx = sre_vm_thompson_create_ctx(sm->pool, prog);
+
+    } else if (engine == ENGINE_THOMPSON_JIT) {
+        sm->ctx = sre_vm_thompson_jit_create_ctx(sm->pool, prog);
+
+    } else {
+        sm->ctx = sre_vm_pike_create_ctx(sm->pool, prog, ovector, ovecsize);
+    }
+
+    if (sm->ctx == NULL) {
+        alloc_error();
+    }
+
+    sm->base = sm->pos;
+    sm->done = 0;
+}
+
+
 static void
 alloc_error(void)
 {
     fprintf(stderr, "failed to allocate memory");
-    exit(2);
+    exit(BENCH_EXIT_NOMEM);
 }
 
 
@@ -430,7 +1356,8 @@ usage(int rc)
             "   -i                  use case insensitive matching\n"
             "   --pike              use the Pike VM interpreter\n"
             "   --thompson          use the Thompson VM interpreter\n"
-            "   --thompson-jit      use the Thompson VM JIT compiler\n");
+            "   --thompson-jit      use the Thompson VM JIT compiler\n"
+            BENCH_USAGE);
     exit(rc);
 }
 